@@ -0,0 +1,41 @@
+attribute vec4 in_Position;   // blob position, relative sprite size
+attribute vec4 in_TexCoord0;  // sprite corner, color index, brightness
+attribute float blobIndex;
+
+// per galaxy
+attribute vec4 instOffset;    // position relative to the observer, sprite size
+attribute vec3 instAxis0;     // orientation and scale of the form
+attribute vec3 instAxis1;
+attribute vec3 instAxis2;
+attribute vec3 instParams;    // alpha scale, blob count, minimum feature size
+
+uniform vec3 viewRight;
+uniform vec3 viewUp;
+uniform sampler2D colorTex;
+
+varying vec4 color;
+varying vec2 texCoord;
+
+void main(void)
+{
+    vec3 p = instOffset.xyz + mat3(instAxis0, instAxis1, instAxis2) * in_Position.xyz;
+    float size = instOffset.w * in_Position.w;
+    float screenFrac = size / length(vec4(p, 1.0));
+
+    // Blobs beyond the detail of the galaxy, below the size of a pixel or
+    // too close are collapsed to a point and produce no fragments
+    float a = 0.0;
+    if (blobIndex < instParams.y && size >= instParams.z && screenFrac < 0.1)
+        a = clamp(instParams.x * (0.1 - screenFrac) * in_TexCoord0.w / 255.0, 0.0, 1.0);
+    else
+        size = 0.0;
+
+    vec2 corner = in_TexCoord0.st * 2.0 - 1.0;
+    p += (viewRight * corner.x + viewUp * corner.y) * size;
+
+    // we use 255 only because we have 256 color indices
+    float t = in_TexCoord0.z / 255.0; // [0, 255] -> [0, 1]
+    color = vec4(texture2D(colorTex, vec2(t, 0.0)).rgb, a);
+    texCoord = in_TexCoord0.st;
+    gl_Position = MVPMatrix * vec4(p, 1.0);
+}
@@ -1,10 +1,12 @@
 #include "fs.h"
+#include <cstdlib>
 #include <vector>
 #include <memory>
 #ifdef _WIN32
 #include <celutil/winutil.h>
 #else
 #include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 
@@ -419,5 +421,105 @@ bool is_directory(const path& p)
     return r;
 }
 
+
+path temp_directory_path(std::error_code& ec)
+{
+#ifdef _WIN32
+    wchar_t buf[MAX_PATH + 1];
+    DWORD len = GetTempPathW(MAX_PATH + 1, buf);
+    if (len == 0 || len > MAX_PATH)
+    {
+        ec = std::error_code(GetLastError(), std::system_category());
+        return path();
+    }
+    path p(std::wstring(buf, len));
+#else
+    const char* dir = nullptr;
+    for (const char* var : { "TMPDIR", "TMP", "TEMP", "TEMPDIR" })
+    {
+        dir = std::getenv(var);
+        if (dir != nullptr)
+            break;
+    }
+    path p(dir != nullptr ? dir : "/tmp");
+#endif
+    if (!is_directory(p, ec))
+    {
+        if (!ec)
+            ec = std::make_error_code(std::errc::not_a_directory);
+        return path();
+    }
+    return p;
+}
+
+path temp_directory_path()
+{
+    std::error_code ec;
+    path p = temp_directory_path(ec);
+    if (ec)
+        throw filesystem_error(ec, "celfs::temp_directory_path error");
+    return p;
+}
+
+
+// Directories are removed after their contents; symbolic links are removed
+// rather than followed.
+uintmax_t remove_all(const path& p, std::error_code& ec)
+{
+#ifdef _WIN32
+    DWORD attr = GetFileAttributesW(p.c_str());
+    if (attr == INVALID_FILE_ATTRIBUTES)
+        return 0;
+    bool isDir = (attr & FILE_ATTRIBUTE_DIRECTORY) != 0 &&
+                 (attr & FILE_ATTRIBUTE_REPARSE_POINT) == 0;
+#else
+    struct stat buf;
+    if (lstat(p.c_str(), &buf) != 0)
+        return 0;
+    bool isDir = S_ISDIR(buf.st_mode);
+#endif
+
+    uintmax_t count = 0;
+    if (isDir)
+    {
+        // Collect the entries first, as removing them changes the directory
+        std::vector<path> entries;
+        for (const auto& entry : directory_iterator(p, ec))
+            entries.push_back(entry.path());
+        for (const auto& entry : entries)
+        {
+            count += remove_all(entry, ec);
+            if (ec)
+                return static_cast<uintmax_t>(-1);
+        }
+    }
+
+#ifdef _WIN32
+    bool removed = (attr & FILE_ATTRIBUTE_DIRECTORY) != 0 ? RemoveDirectoryW(p.c_str()) != 0
+                                                           : DeleteFileW(p.c_str()) != 0;
+    if (!removed)
+    {
+        ec = std::error_code(GetLastError(), std::system_category());
+        return static_cast<uintmax_t>(-1);
+    }
+#else
+    if ((isDir ? rmdir(p.c_str()) : unlink(p.c_str())) != 0)
+    {
+        ec = std::error_code(errno, std::system_category());
+        return static_cast<uintmax_t>(-1);
+    }
+#endif
+    return count + 1;
+}
+
+uintmax_t remove_all(const path& p)
+{
+    std::error_code ec;
+    uintmax_t n = remove_all(p, ec);
+    if (ec)
+        throw filesystem_error(ec, "celfs::remove_all error");
+    return n;
+}
+
 }
 }
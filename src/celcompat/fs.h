@@ -409,5 +409,11 @@ bool exists(const path& p, std::error_code& ec) noexcept;
 
 bool is_directory(const path& p);
 bool is_directory(const path& p, std::error_code& ec) noexcept;
+
+path temp_directory_path();
+path temp_directory_path(std::error_code& ec);
+
+uintmax_t remove_all(const path& p);
+uintmax_t remove_all(const path& p, std::error_code& ec);
 }
 }
@@ -16,6 +16,8 @@
 #include "geometry.h"
 #include "meshmanager.h"
 #include "body.h"
+#include "bodystate.h"
+#include "orbitpathcache.h"
 #include "atmosphere.h"
 #include "frame.h"
 #include "timeline.h"
@@ -29,6 +31,25 @@ using namespace std;
 using namespace celmath;
 
 
+// State of the body in the current snapshot, if it was taken at time tdb
+static inline const BodyStateSnapshot::State*
+FindState(const Body* body, double tdb, BodyStateSnapshot::Query query)
+{
+    const BodyStateSnapshot* snapshot = BodyStateSnapshot::getCurrent();
+    return snapshot != nullptr ? snapshot->lookup(body, tdb, query) : nullptr;
+}
+
+
+// Drop the cached paths of the orbits of a timeline that is to be deleted
+static void ForgetOrbitPaths(const Timeline* timeline)
+{
+    if (timeline == nullptr)
+        return;
+    for (unsigned int i = 0; i < timeline->phaseCount(); i++)
+        OrbitPathCache::forget(timeline->getPhase(i)->orbit());
+}
+
+
 Body::Body(PlanetarySystem* _system, const string& _name) :
     system(_system),
     orbitVisibility(UseClassVisibility)
@@ -41,6 +62,8 @@ Body::Body(PlanetarySystem* _system, const string& _name) :
 
 Body::~Body()
 {
+    BodyStateSnapshot::setCurrent(nullptr);
+
     if (system)
         system->removeBody(this);
     // Remove from frame hierarchy
@@ -53,6 +76,7 @@ Body::~Body()
         delete referenceMarks;
     }
 
+    ForgetOrbitPaths(timeline);
     delete timeline;
     delete satellites;
     delete frameTree;
@@ -200,6 +224,7 @@ void Body::setTimeline(Timeline* newTimeline)
 {
     if (timeline != newTimeline)
     {
+        ForgetOrbitPaths(timeline);
         delete timeline;
         timeline = newTimeline;
         markChanged();
@@ -209,6 +234,7 @@ void Body::setTimeline(Timeline* newTimeline)
 
 void Body::markChanged()
 {
+    BodyStateSnapshot::setCurrent(nullptr);
     if (timeline)
         timeline->markChanged();
 }
@@ -565,6 +591,10 @@ void Body::setAtmosphere(const Atmosphere& _atmosphere)
  */
 UniversalCoord Body::getPosition(double tdb) const
 {
+    auto state = FindState(this, tdb, BodyStateSnapshot::PositionQuery);
+    if (state != nullptr)
+        return state->position;
+
     Vector3d position = Vector3d::Zero();
 
     auto phase = timeline->findPhase(tdb);
@@ -592,6 +622,10 @@ UniversalCoord Body::getPosition(double tdb) const
  */
 Quaterniond Body::getOrientation(double tdb) const
 {
+    auto state = FindState(this, tdb, BodyStateSnapshot::OrientationQuery);
+    if (state != nullptr)
+        return state->eclipticToBodyFixed;
+
     auto phase = timeline->findPhase(tdb);
     return phase->rotationModel()->orientationAtTime(tdb) * phase->bodyFrame()->getOrientation(tdb);
 }
@@ -645,6 +679,10 @@ Vector3d Body::getAngularVelocity(double tdb) const
  */
 Matrix4d Body::getLocalToAstrocentric(double tdb) const
 {
+    auto state = FindState(this, tdb, BodyStateSnapshot::PositionQuery);
+    if (state != nullptr)
+        return Eigen::Transform<double, 3, Affine>(Translation3d(state->astrocentricPosition)).matrix();
+
     auto phase = timeline->findPhase(tdb);
     Vector3d p = phase->orbitFrame()->convertToAstrocentric(phase->orbit()->positionAtTime(tdb), tdb);
     return Eigen::Transform<double, 3, Affine>(Translation3d(p)).matrix();
@@ -655,6 +693,10 @@ Matrix4d Body::getLocalToAstrocentric(double tdb) const
  */
 Vector3d Body::getAstrocentricPosition(double tdb) const
 {
+    auto state = FindState(this, tdb, BodyStateSnapshot::PositionQuery);
+    if (state != nullptr)
+        return state->astrocentricPosition;
+
     // TODO: Switch the iterative method used in getPosition
     auto phase = timeline->findPhase(tdb);
     return phase->orbitFrame()->convertToAstrocentric(phase->orbit()->positionAtTime(tdb), tdb);
@@ -665,6 +707,10 @@ Vector3d Body::getAstrocentricPosition(double tdb) const
  */
 Quaterniond Body::getEclipticToFrame(double tdb) const
 {
+    auto state = FindState(this, tdb, BodyStateSnapshot::FrameQuery);
+    if (state != nullptr)
+        return state->eclipticToFrame;
+
     auto phase = timeline->findPhase(tdb);
     return phase->bodyFrame()->getOrientation(tdb);
 }
@@ -675,6 +721,10 @@ Quaterniond Body::getEclipticToFrame(double tdb) const
  */
 Quaterniond Body::getEclipticToEquatorial(double tdb) const
 {
+    auto state = FindState(this, tdb, BodyStateSnapshot::OrientationQuery);
+    if (state != nullptr)
+        return state->eclipticToEquatorial;
+
     auto phase = timeline->findPhase(tdb);
     return phase->rotationModel()->equatorOrientationAtTime(tdb) * phase->bodyFrame()->getOrientation(tdb);
 }
@@ -685,6 +735,10 @@ Quaterniond Body::getEclipticToEquatorial(double tdb) const
  */
 Quaterniond Body::getEclipticToBodyFixed(double tdb) const
 {
+    auto state = FindState(this, tdb, BodyStateSnapshot::OrientationQuery);
+    if (state != nullptr)
+        return state->eclipticToBodyFixed;
+
     auto phase = timeline->findPhase(tdb);
     return phase->rotationModel()->orientationAtTime(tdb) * phase->bodyFrame()->getOrientation(tdb);
 }
@@ -695,6 +749,10 @@ Quaterniond Body::getEclipticToBodyFixed(double tdb) const
 // meridian, and z-axis at a right angle the xy plane.
 Quaterniond Body::getEquatorialToBodyFixed(double tdb) const
 {
+    auto state = FindState(this, tdb, BodyStateSnapshot::SpinQuery);
+    if (state != nullptr)
+        return state->equatorialToBodyFixed;
+
     auto phase = timeline->findPhase(tdb);
     return phase->rotationModel()->spin(tdb);
 }
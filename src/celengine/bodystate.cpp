@@ -0,0 +1,158 @@
+// bodystate.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Positions and orientations of solar system bodies at one instant.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include "body.h"
+#include "bodystate.h"
+#include "frame.h"
+#include "frametree.h"
+#include "timelinephase.h"
+
+using namespace Eigen;
+using namespace std;
+
+
+// Set by the render thread, read by any thread computing body positions
+static atomic<const BodyStateSnapshot*> currentSnapshot{ nullptr };
+
+
+BodyStateSnapshot::~BodyStateSnapshot()
+{
+    const BodyStateSnapshot* self = this;
+    currentSnapshot.compare_exchange_strong(self, nullptr);
+}
+
+
+void BodyStateSnapshot::begin(double t)
+{
+    previousStats = getStats();
+
+    tdb = t;
+    states.clear();
+    index.clear();
+
+    stats = Stats();
+    lookups = 0;
+    orbitsAvoided = 0;
+    framesAvoided = 0;
+    rotationsAvoided = 0;
+}
+
+
+void BodyStateSnapshot::evaluate(const FrameTree* tree, const UniversalCoord& starPosition)
+{
+    evaluateTree(tree, starPosition, Vector3d::Zero(), 1);
+}
+
+
+// The orbit frame of every phase in a tree is centered on the tree's body,
+// so the center's astrocentric position is already known. This computes
+// the same sums as ReferenceFrame::convertToAstrocentric() and the same
+// products as the Body methods.
+void BodyStateSnapshot::evaluateTree(const FrameTree* tree,
+                                     const UniversalCoord& starPosition,
+                                     const Vector3d& center,
+                                     unsigned int depth)
+{
+    if (tree == nullptr)
+        return;
+
+    for (unsigned int i = 0; i < tree->childCount(); i++)
+    {
+        auto phase = tree->getChild(i);
+        if (!phase->includes(tdb))
+            continue;
+
+        const Body* body = phase->body();
+        const RotationModel* rotationModel = phase->rotationModel();
+
+        State state;
+        Vector3d p = phase->orbit()->positionAtTime(tdb);
+        state.astrocentricPosition = center + phase->orbitFrame()->getOrientation(tdb).conjugate() * p;
+        UniversalCoord starCenter = starPosition;
+        state.position = starCenter.offsetKm(state.astrocentricPosition);
+
+        Quaterniond equator = rotationModel->equatorOrientationAtTime(tdb);
+        Quaterniond spin = rotationModel->spin(tdb);
+        state.eclipticToFrame = phase->bodyFrame()->getOrientation(tdb);
+        state.eclipticToEquatorial = equator * state.eclipticToFrame;
+        state.eclipticToBodyFixed = (spin * equator) * state.eclipticToFrame;
+        state.equatorialToBodyFixed = spin;
+        state.depth = depth;
+
+        stats.bodies++;
+        stats.orbitEvaluations++;
+        stats.frameEvaluations += 2;
+        stats.rotationEvaluations++;
+
+        index[body] = states.size();
+        states.push_back(state);
+
+        evaluateTree(body->getFrameTree(), starPosition, state.astrocentricPosition, depth + 1);
+    }
+}
+
+
+const BodyStateSnapshot::State*
+BodyStateSnapshot::lookup(const Body* body, double t, Query query) const
+{
+    if (t != tdb)
+        return nullptr;
+
+    auto iter = index.find(body);
+    if (iter == index.end())
+        return nullptr;
+
+    const State& state = states[iter->second];
+
+    lookups.fetch_add(1, memory_order_relaxed);
+    switch (query)
+    {
+    case PositionQuery:
+        orbitsAvoided.fetch_add(state.depth, memory_order_relaxed);
+        framesAvoided.fetch_add(state.depth, memory_order_relaxed);
+        break;
+    case OrientationQuery:
+        framesAvoided.fetch_add(1, memory_order_relaxed);
+        rotationsAvoided.fetch_add(1, memory_order_relaxed);
+        break;
+    case FrameQuery:
+        framesAvoided.fetch_add(1, memory_order_relaxed);
+        break;
+    case SpinQuery:
+        rotationsAvoided.fetch_add(1, memory_order_relaxed);
+        break;
+    }
+
+    return &state;
+}
+
+
+BodyStateSnapshot::Stats BodyStateSnapshot::getStats() const
+{
+    Stats s = stats;
+    s.lookups = lookups.load(memory_order_relaxed);
+    s.orbitEvaluationsAvoided = orbitsAvoided.load(memory_order_relaxed);
+    s.frameEvaluationsAvoided = framesAvoided.load(memory_order_relaxed);
+    s.rotationEvaluationsAvoided = rotationsAvoided.load(memory_order_relaxed);
+    return s;
+}
+
+
+void BodyStateSnapshot::setCurrent(const BodyStateSnapshot* snapshot)
+{
+    currentSnapshot.store(snapshot, memory_order_release);
+}
+
+
+const BodyStateSnapshot* BodyStateSnapshot::getCurrent()
+{
+    return currentSnapshot.load(memory_order_acquire);
+}
@@ -0,0 +1,117 @@
+// bodystate.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Positions and orientations of solar system bodies at one instant.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <celengine/univcoord.h>
+
+class Body;
+class FrameTree;
+
+/*! The position of a body is found by walking the chain of reference
+ *  frames and orbits up to its star, and it's asked for many times per
+ *  frame: render lists, lighting, eclipses, labels, picking, the HUD. A
+ *  snapshot evaluates the frame trees once, parents before children, so
+ *  that each orbit, frame and rotation model is evaluated once per body.
+ *
+ *  While a snapshot is current, the Body methods that return positions and
+ *  orientations look their results up in it when called for its time.
+ *  Lookups don't modify the snapshot, so they may be made from several
+ *  threads.
+ */
+class BodyStateSnapshot
+{
+ public:
+    struct State
+    {
+        UniversalCoord position;
+        Eigen::Vector3d astrocentricPosition;
+        Eigen::Quaterniond eclipticToFrame;
+        Eigen::Quaterniond eclipticToEquatorial;
+        Eigen::Quaterniond eclipticToBodyFixed;
+        Eigen::Quaterniond equatorialToBodyFixed;
+        unsigned int depth;  // orbits between the body and its star
+    };
+
+    // What a lookup replaces, to count the evaluations avoided
+    enum Query
+    {
+        PositionQuery,      // orbits and frames up to the star
+        OrientationQuery,   // rotation model and body frame
+        FrameQuery,         // body frame
+        SpinQuery,          // rotation model
+    };
+
+    struct Stats
+    {
+        uint64_t bodies{ 0 };
+        uint64_t orbitEvaluations{ 0 };
+        uint64_t frameEvaluations{ 0 };
+        uint64_t rotationEvaluations{ 0 };
+        uint64_t lookups{ 0 };
+        uint64_t orbitEvaluationsAvoided{ 0 };
+        uint64_t frameEvaluationsAvoided{ 0 };
+        uint64_t rotationEvaluationsAvoided{ 0 };
+    };
+
+    BodyStateSnapshot() = default;
+    ~BodyStateSnapshot();
+
+    BodyStateSnapshot(const BodyStateSnapshot&) = delete;
+    BodyStateSnapshot& operator=(const BodyStateSnapshot&) = delete;
+
+    // Discard the states and start a snapshot of time tdb
+    void begin(double tdb);
+
+    // Evaluate the bodies of a solar system, given the root of its frame
+    // tree and the position of its star.
+    void evaluate(const FrameTree* tree, const UniversalCoord& starPosition);
+
+    double getTime() const { return tdb; }
+
+    // State of a body at time t, or nullptr if t isn't the time of the
+    // snapshot or the body wasn't evaluated.
+    const State* lookup(const Body* body, double t, Query query) const;
+
+    // Counts for the snapshot so far, and for the whole previous one
+    Stats getStats() const;
+    const Stats& getPreviousStats() const { return previousStats; }
+
+    // Snapshot used by the Body methods; nullptr disables lookups. Any
+    // change to a body's timeline clears it. The renderer sets it while
+    // drawing a frame and clears it at the end of the frame; it must not
+    // be changed while other threads look states up in it.
+    static void setCurrent(const BodyStateSnapshot* snapshot);
+    static const BodyStateSnapshot* getCurrent();
+
+ private:
+    void evaluateTree(const FrameTree* tree,
+                      const UniversalCoord& starPosition,
+                      const Eigen::Vector3d& center,
+                      unsigned int depth);
+
+    double tdb{ 0.0 };
+    std::vector<State, Eigen::aligned_allocator<State>> states;
+    std::unordered_map<const Body*, size_t> index;
+
+    Stats stats;
+    Stats previousStats;
+    mutable std::atomic<uint64_t> lookups{ 0 };
+    mutable std::atomic<uint64_t> orbitsAvoided{ 0 };
+    mutable std::atomic<uint64_t> framesAvoided{ 0 };
+    mutable std::atomic<uint64_t> rotationsAvoided{ 0 };
+};
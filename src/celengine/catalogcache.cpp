@@ -0,0 +1,406 @@
+// catalogcache.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// On-disk cache of tokenized catalog files.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fmt/printf.h>
+#include <celutil/debug.h>
+#include <celutil/timer.h>
+#include <celutil/util.h>
+#include "catalogcache.h"
+
+using namespace std;
+
+namespace
+{
+const char     CACHE_MAGIC[8]   = { 'C', 'E', 'L', 'C', 'A', 'C', 'H', 'E' };
+const uint32_t CACHE_VERSION    = 2;
+// Entries are only read back on the machine that wrote them, so they are
+// in native byte order; this tells a foreign entry apart.
+const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+// A file modified this many seconds or less before its entry was written
+// may be modified again without a change of its time stamp, so the
+// contents of such a file are always compared.
+const int64_t  RACY_INTERVAL    = 2;
+
+// 64-bit FNV-1a
+uint64_t hashBytes(const char* data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char) data[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool statFile(const fs::path& path, int64_t& mtime, uint64_t& size)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_wstat64(path.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+#endif
+    mtime = (int64_t) st.st_mtime;
+    size  = (uint64_t) st.st_size;
+    return true;
+}
+
+bool replaceFile(const fs::path& from, const fs::path& to)
+{
+#ifdef _WIN32
+    _wremove(to.c_str());
+    return _wrename(from.c_str(), to.c_str()) == 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool hasText(Tokenizer::TokenType type)
+{
+    return type == Tokenizer::TokenName ||
+           type == Tokenizer::TokenString ||
+           type == Tokenizer::TokenError;
+}
+
+// Output and input of the entry fields
+
+void writeRaw(string& out, const void* data, size_t size)
+{
+    out.append(static_cast<const char*>(data), size);
+}
+
+template<typename T> void writeValue(string& out, T value)
+{
+    writeRaw(out, &value, sizeof(value));
+}
+
+void writeVarUint(string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((char) ((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+void writeString(string& out, const string& s)
+{
+    writeVarUint(out, s.size());
+    out.append(s);
+}
+
+class EntryReader
+{
+ public:
+    EntryReader(const string& _data) : data(_data) {}
+
+    template<typename T> bool read(T& value)
+    {
+        if (data.size() - pos < sizeof(value))
+            return false;
+        memcpy(&value, data.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return true;
+    }
+
+    bool readVarUint(uint64_t& value)
+    {
+        value = 0;
+        for (unsigned int shift = 0; shift < 64 && pos < data.size(); shift += 7)
+        {
+            auto c = (unsigned char) data[pos++];
+            value |= (uint64_t) (c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool readString(string& s)
+    {
+        uint64_t length;
+        if (!readVarUint(length) || data.size() - pos < length)
+            return false;
+        s.assign(data, pos, (size_t) length);
+        pos += (size_t) length;
+        return true;
+    }
+
+    bool atEnd() const { return pos == data.size(); }
+
+ private:
+    const string& data;
+    size_t pos{ 0 };
+};
+
+bool readFile(const fs::path& path, string& contents)
+{
+    ifstream in(path.string(), ios::in | ios::binary);
+    if (!in.good())
+        return false;
+
+    ostringstream buffer;
+    buffer << in.rdbuf();
+    contents = buffer.str();
+    return !in.bad();
+}
+} // end unnamed namespace
+
+
+CatalogCache::CatalogCache(const fs::path& _directory) :
+    directory(_directory)
+{
+}
+
+
+bool CatalogCache::load(const fs::path& filename, istream& in, const LoadFunc& loadFunc)
+{
+    Tokenizer::TokenList tokens;
+    getTokens(filename, in, tokens);
+
+    Tokenizer tokenizer(&tokens);
+    return loadFunc(tokenizer);
+}
+
+
+void CatalogCache::getTokens(const fs::path& filename, istream& in, Tokenizer::TokenList& tokens)
+{
+    Timer timer;
+
+    FileInfo info;
+    bool haveInfo = !directory.empty() && statFile(filename, info.mtime, info.size);
+
+    string key = filename.string();
+    fs::path entry = entryPath(key);
+
+    // The file is only read when its time stamp and size don't settle
+    // whether the entry is valid, or when it has to be tokenized.
+    string contents;
+    bool haveContents = false;
+    auto hashContents = [&]()
+    {
+        if (!haveContents)
+        {
+            ostringstream buffer;
+            buffer << in.rdbuf();
+            contents = buffer.str();
+            info.hash = hashBytes(contents.data(), contents.size());
+            haveContents = true;
+        }
+        return info.hash;
+    };
+
+    bool refresh = false;
+    if (haveInfo && !rebuild && readEntry(entry, key, info, hashContents, tokens, refresh))
+    {
+        // Store the new time stamp of a file with unchanged contents, so
+        // that it needn't be read again next time.
+        if (refresh)
+            writeEntry(entry, key, info, tokens);
+
+        lock_guard<mutex> lock(statsMutex);
+        stats.hits++;
+        stats.hitTime += timer.getTime();
+        return;
+    }
+
+    hashContents();
+
+    // Tokenize up to the end of the file or the first error, past which
+    // no loader reads.
+    tokens.clear();
+    istringstream text(contents);
+    Tokenizer tokenizer(&text);
+    tokenizer.setRecorder(&tokens);
+
+    Tokenizer::TokenType tok;
+    do
+    {
+        tok = tokenizer.nextToken();
+    }
+    while (tok != Tokenizer::TokenEnd && tok != Tokenizer::TokenError);
+
+    bool stored = haveInfo && tok == Tokenizer::TokenEnd &&
+                  writeEntry(entry, key, info, tokens);
+
+    lock_guard<mutex> lock(statsMutex);
+    stats.misses++;
+    if (stored)
+        stats.stored++;
+    stats.missTime += timer.getTime();
+}
+
+
+CatalogCache::Stats CatalogCache::getStats() const
+{
+    lock_guard<mutex> lock(statsMutex);
+    return stats;
+}
+
+
+fs::path CatalogCache::entryPath(const string& key) const
+{
+    return directory / fmt::sprintf("%016x.cache", hashBytes(key.data(), key.size()));
+}
+
+
+bool CatalogCache::readEntry(const fs::path& entry,
+                             const string& key,
+                             const FileInfo& info,
+                             const HashFunc& hashContents,
+                             Tokenizer::TokenList& tokens,
+                             bool& refresh) const
+{
+    string data;
+    if (!readFile(entry, data))
+        return false;
+
+    EntryReader reader(data);
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t version, byteOrder;
+    string entryKey;
+    FileInfo entryInfo;
+    uint8_t racy;
+    uint64_t nTokens;
+    if (!reader.read(magic) || memcmp(magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        !reader.read(version) || version != CACHE_VERSION ||
+        !reader.read(byteOrder) || byteOrder != CACHE_BYTE_ORDER ||
+        !reader.readString(entryKey) || entryKey != key ||
+        !reader.read(entryInfo.mtime) ||
+        !reader.read(entryInfo.size) || entryInfo.size != info.size ||
+        !reader.read(entryInfo.hash) ||
+        !reader.read(racy) ||
+        !reader.readVarUint(nTokens) || nTokens > data.size())
+    {
+        return false;
+    }
+
+    // Trust an unchanged time stamp, unless the file was modified too
+    // shortly before the entry was written; otherwise compare the
+    // contents, which may be the same after a touch or a fresh checkout.
+    if (entryInfo.mtime != info.mtime || racy != 0)
+    {
+        if (entryInfo.hash != hashContents())
+            return false;
+        refresh = entryInfo.mtime != info.mtime ||
+                  info.mtime < (int64_t) time(nullptr) - RACY_INTERVAL;
+    }
+
+    tokens.resize((size_t) nTokens);
+    uint64_t line = 0;
+    for (auto& token : tokens)
+    {
+        uint8_t type;
+        uint64_t lineDelta;
+        if (!reader.read(type) || type > Tokenizer::TokenEndUnits ||
+            !reader.readVarUint(lineDelta))
+        {
+            return false;
+        }
+
+        token.type = (Tokenizer::TokenType) type;
+        line += lineDelta;
+        token.line = (int) line;
+        token.number = 0.0;
+
+        if (token.type == Tokenizer::TokenNumber && !reader.read(token.number))
+            return false;
+        if (hasText(token.type) && !reader.readString(token.text))
+            return false;
+    }
+
+    return reader.atEnd();
+}
+
+
+bool CatalogCache::writeEntry(const fs::path& entry,
+                              const string& key,
+                              const FileInfo& info,
+                              const Tokenizer::TokenList& tokens) const
+{
+    if (!MakeDirectories(directory))
+    {
+        DPRINTF(LOG_LEVEL_WARNING, "Cannot create catalog cache directory %s\n", directory);
+        return false;
+    }
+
+    string out;
+    writeRaw(out, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    writeValue(out, CACHE_VERSION);
+    writeValue(out, CACHE_BYTE_ORDER);
+    writeString(out, key);
+    writeValue(out, info.mtime);
+    writeValue(out, info.size);
+    writeValue(out, info.hash);
+    writeValue(out, (uint8_t) (info.mtime >= (int64_t) time(nullptr) - RACY_INTERVAL));
+    writeVarUint(out, tokens.size());
+
+    // Line numbers never decrease, so store the differences
+    int line = 0;
+    for (const auto& token : tokens)
+    {
+        writeValue(out, (uint8_t) token.type);
+        writeVarUint(out, (uint64_t) max(token.line - line, 0));
+        line = max(token.line, line);
+
+        if (token.type == Tokenizer::TokenNumber)
+            writeValue(out, token.number);
+        if (hasText(token.type))
+            writeString(out, token.text);
+    }
+
+    // Write to a temporary file first, so that an interrupted write never
+    // leaves a truncated entry behind.
+    fs::path tempPath = entry;
+    tempPath += ".tmp";
+    {
+        ofstream file(tempPath.string(), ios::out | ios::binary | ios::trunc);
+        if (!file.good())
+            return false;
+        file.write(out.data(), out.size());
+        if (!file.good())
+            return false;
+    }
+
+    return replaceFile(tempPath, entry);
+}
+
+
+fs::path CatalogCache::defaultDirectory()
+{
+#ifdef _WIN32
+    const wchar_t* localAppData = _wgetenv(L"LOCALAPPDATA");
+    if (localAppData != nullptr)
+        return fs::path(localAppData) / "Celestia" / "cache";
+    return homeDir() / "AppData" / "Local" / "Celestia" / "cache";
+#elif defined(__APPLE__)
+    return homeDir() / "Library" / "Caches" / "Celestia";
+#else
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    if (cacheHome != nullptr && cacheHome[0] != '\0')
+        return fs::path(cacheHome) / "celestia";
+    return homeDir() / ".cache" / "celestia";
+#endif
+}
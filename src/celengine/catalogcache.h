@@ -0,0 +1,86 @@
+// catalogcache.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// On-disk cache of tokenized catalog files.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <celcompat/filesystem.h>
+#include <celengine/tokenizer.h>
+
+// Keeps the token streams of .ssc, .stc and .dsc files in a cache
+// directory in a compact binary form. On later runs, the tokens are
+// replayed straight into the catalog loaders instead of lexing the text
+// again. An entry is used if the path, modification time and size match
+// the catalog file, without reading the file. If only the time stamp
+// differs, or the file was modified just before the entry was written, the
+// hash of the contents decides. Files with syntax errors aren't cached.
+class CatalogCache
+{
+ public:
+    typedef std::function<bool(Tokenizer&)> LoadFunc;
+
+    struct Stats
+    {
+        unsigned int hits{ 0 };
+        unsigned int misses{ 0 };
+        unsigned int stored{ 0 };
+        // Seconds spent getting the tokens of cached and other files,
+        // summed over all threads
+        double       hitTime{ 0.0 };
+        double       missTime{ 0.0 };
+    };
+
+    // An empty directory disables the cache.
+    explicit CatalogCache(const fs::path& directory);
+
+    // Ignore the existing entries and write them again.
+    void setRebuild(bool rebuild) { this->rebuild = rebuild; }
+
+    // Call loadFunc with a tokenizer for the catalog file read from in,
+    // replaying the cache entry if there is a valid one.
+    bool load(const fs::path& filename, std::istream& in, const LoadFunc& loadFunc);
+
+    // Get the tokens of the catalog file read from in, from the cache if
+    // there is a valid entry; otherwise tokenize the file and add it to
+    // the cache. This may be called from several threads at once.
+    void getTokens(const fs::path& filename, std::istream& in, Tokenizer::TokenList& tokens);
+
+    Stats getStats() const;
+
+    static fs::path defaultDirectory();
+
+ private:
+    struct FileInfo
+    {
+        int64_t  mtime{ 0 };
+        uint64_t size{ 0 };
+        uint64_t hash{ 0 };
+    };
+
+    typedef std::function<uint64_t()> HashFunc;
+
+    fs::path entryPath(const std::string& key) const;
+    bool readEntry(const fs::path& entry, const std::string& key,
+                   const FileInfo& info, const HashFunc& hashContents,
+                   Tokenizer::TokenList& tokens, bool& refresh) const;
+    bool writeEntry(const fs::path& entry, const std::string& key,
+                    const FileInfo& info, const Tokenizer::TokenList& tokens) const;
+
+    fs::path directory;
+    bool     rebuild{ false };
+
+    mutable std::mutex statsMutex;
+    Stats    stats;
+};
@@ -12,12 +12,18 @@
 
 #include <cmath>
 #include <cstdlib>
+#include <cstddef>
+#include <cstring>
 #include <cassert>
 #include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
 #include <celutil/debug.h>
 #include <celmath/mathlib.h>
 #include <celutil/gettext.h>
 #include <celutil/bytes.h>
+#include <celutil/mappedfile.h>
 #include <celutil/utf8.h>
 #include <celengine/dsodb.h>
 #include <config.h>
@@ -33,6 +39,7 @@
 #include <celengine/globular.h>
 #include <celengine/opencluster.h>
 #include <celengine/nebula.h>
+#include <celengine/category.h>
 
 #include <Eigen/Core>
 #include <Eigen/Geometry>
@@ -45,7 +52,271 @@ constexpr const float DSO_OCTREE_MAGNITUDE   = 8.0f;
 //constexpr const float DSO_EXTRA_ROOM         = 0.01f; // Reserve 1% capacity for extra DSOs
                                                       // (useful as a complement of binary loaded DSOs)
 
-//constexpr char FILE_HEADER[]                 = "CEL_DSOs";
+constexpr const char FILE_HEADER[]           = "CEL_DSOs";
+
+
+// Pre-sorted binary deep sky catalog, version 0x0100 of the CEL_DSOs
+// format. Everything is little endian. The file starts with a fixed size
+// header, followed by these sections, each starting at a multiple of
+// DSO_FILE_ALIGNMENT bytes:
+//
+//   node table        nNodes x DSOFileNode
+//   object records    nDSOs x DSOFileRecord
+//   string table      stringBytes of NUL terminated strings
+//
+// Objects are stored in octree order, with the node table laid out as in
+// the pre-sorted star database: every node owns a contiguous range of
+// objects, ranges are assigned depth first, node 0 is the root and the
+// eight children of a node start at firstChild, which is zero for a leaf.
+// Strings are referenced by their offset in the string table, which starts
+// with the empty string; lists of names and categories are separated by
+// ':' as in the text catalogs.
+constexpr const uint16_t DSO_FILE_VERSION     = 0x0100;
+constexpr const size_t DSO_FILE_ALIGNMENT     = 64;
+constexpr const unsigned int MAX_OCTREE_DEPTH = 64;
+
+struct DSOFileHeader
+{
+    char     magic[8];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t nDSOs;
+    uint32_t nNodes;
+    float    rootSize;
+    uint32_t stringBytes;
+    // The writer's next automatic catalog number plus one: the lowest
+    // number it assigned to an unnumbered object
+    uint32_t nextAutoCatalogNumber;
+};
+static_assert(sizeof(DSOFileHeader) == 32, "Unexpected DSO file header size");
+
+struct DSOFileNode
+{
+    double   center[3];
+    float    exclusionFactor;
+    uint32_t firstObject;
+    uint32_t nObjects;
+    uint32_t firstChild;
+};
+static_assert(sizeof(DSOFileNode) == 40, "Unexpected DSO file node size");
+
+enum DSOFileObjectType : uint8_t
+{
+    DSOFileGalaxy      = 0,
+    DSOFileGlobular    = 1,
+    DSOFileNebula      = 2,
+    DSOFileOpenCluster = 3,
+};
+
+enum DSOFileFlags : uint8_t
+{
+    DSOFileVisible          = 0x01,
+    DSOFileClickable        = 0x02,
+    // Globular with a KingConcentration
+    DSOFileHasConcentration = 0x04,
+};
+
+struct DSOFileRecord
+{
+    uint32_t catalogNumber;
+    uint8_t  type;
+    uint8_t  flags;
+    uint16_t reserved;
+    double   position[3];
+    float    orientation[4];    // w, x, y, z
+    float    radius;
+    float    absMag;
+    float    detail;            // galaxies and globulars
+    float    coreRadius;        // globulars
+    float    concentration;     // globulars
+    // String table offsets
+    uint32_t names;
+    uint32_t galaxyType;
+    uint32_t model;             // galaxy template or nebula mesh
+    uint32_t resourcePath;      // path of the mesh, domain of the categories
+    uint32_t infoURL;
+    uint32_t categories;
+    uint32_t reserved2;
+};
+static_assert(sizeof(DSOFileRecord) == 96, "Unexpected DSO file record size");
+
+struct DSOFileLayout
+{
+    size_t nodes;
+    size_t records;
+    size_t strings;
+    size_t total;
+
+    DSOFileLayout(uint32_t nDSOs, uint32_t nNodes, uint32_t stringBytes)
+    {
+        size_t offset = 0;
+        auto section = [&offset](size_t bytes)
+        {
+            offset = (offset + DSO_FILE_ALIGNMENT - 1) & ~(DSO_FILE_ALIGNMENT - 1);
+            size_t start = offset;
+            offset += bytes;
+            return start;
+        };
+
+        section(sizeof(DSOFileHeader));
+        nodes   = section((size_t) nNodes * sizeof(DSOFileNode));
+        records = section((size_t) nDSOs * sizeof(DSOFileRecord));
+        strings = section(stringBytes);
+        total   = offset;
+    }
+};
+
+
+// Unaligned, endian-safe accessors for the binary catalog
+static inline uint32_t fileUint32(const char* base, size_t offset)
+{
+    uint32_t n;
+    memcpy(&n, base + offset, sizeof n);
+    LE_TO_CPU_INT32(n, n);
+    return n;
+}
+
+static inline uint16_t fileUint16(const char* base, size_t offset)
+{
+    uint16_t n;
+    memcpy(&n, base + offset, sizeof n);
+    LE_TO_CPU_INT16(n, n);
+    return n;
+}
+
+static inline float fileFloat(const char* base, size_t offset)
+{
+    float f;
+    memcpy(&f, base + offset, sizeof f);
+    LE_TO_CPU_FLOAT(f, f);
+    return f;
+}
+
+// Doubles are assembled from their two 32 bit halves, low half first, as
+// there's no working 64 bit byte swap on every platform.
+static inline double fileDouble(const char* base, size_t offset)
+{
+    uint64_t bits = (uint64_t) fileUint32(base, offset + 4) << 32 | fileUint32(base, offset);
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    return d;
+}
+
+static DSOFileNode fileNode(const char* nodes, uint32_t i)
+{
+    size_t offset = (size_t) i * sizeof(DSOFileNode);
+    DSOFileNode node;
+    node.center[0]       = fileDouble(nodes, offset + offsetof(DSOFileNode, center));
+    node.center[1]       = fileDouble(nodes, offset + offsetof(DSOFileNode, center) + 8);
+    node.center[2]       = fileDouble(nodes, offset + offsetof(DSOFileNode, center) + 16);
+    node.exclusionFactor = fileFloat(nodes, offset + offsetof(DSOFileNode, exclusionFactor));
+    node.firstObject     = fileUint32(nodes, offset + offsetof(DSOFileNode, firstObject));
+    node.nObjects        = fileUint32(nodes, offset + offsetof(DSOFileNode, nObjects));
+    node.firstChild      = fileUint32(nodes, offset + offsetof(DSOFileNode, firstChild));
+    return node;
+}
+
+
+// Check that the node table describes a tree whose object ranges appear in
+// depth-first order and exactly cover the records.
+static bool validateOctreeNode(const char* nodes,
+                               uint32_t nNodes,
+                               uint32_t index,
+                               unsigned int depth,
+                               uint32_t& nextObject,
+                               uint32_t nObjects,
+                               vector<bool>& visited)
+{
+    if (index >= nNodes || visited[index] || depth > MAX_OCTREE_DEPTH)
+        return false;
+    visited[index] = true;
+
+    DSOFileNode node = fileNode(nodes, index);
+    if (node.firstObject != nextObject || node.nObjects > nObjects - nextObject)
+        return false;
+    nextObject += node.nObjects;
+
+    if (node.firstChild == 0)
+        return true;
+    if (node.firstChild <= index || nNodes < 8 || node.firstChild > nNodes - 8)
+        return false;
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        if (!validateOctreeNode(nodes, nNodes, node.firstChild + i, depth + 1,
+                                nextObject, nObjects, visited))
+            return false;
+    }
+
+    return true;
+}
+
+
+static void writeUint(ostream& out, uint32_t n)
+{
+    LE_TO_CPU_INT32(n, n);
+    out.write(reinterpret_cast<char*>(&n), sizeof n);
+}
+
+static void writeUshort(ostream& out, uint16_t n)
+{
+    LE_TO_CPU_INT16(n, n);
+    out.write(reinterpret_cast<char*>(&n), sizeof n);
+}
+
+static void writeFloat(ostream& out, float f)
+{
+    LE_TO_CPU_FLOAT(f, f);
+    out.write(reinterpret_cast<char*>(&f), sizeof f);
+}
+
+static void writeDouble(ostream& out, double d)
+{
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof bits);
+    writeUint(out, (uint32_t) bits);
+    writeUint(out, (uint32_t) (bits >> 32));
+}
+
+static void writePadding(ostream& out, size_t& pos, size_t offset)
+{
+    static const char zeros[DSO_FILE_ALIGNMENT] = {};
+    while (pos < offset)
+    {
+        size_t n = min(offset - pos, DSO_FILE_ALIGNMENT);
+        out.write(zeros, n);
+        pos += n;
+    }
+}
+
+
+// Strings of the binary catalog, each stored once
+class DSOFileStrings
+{
+ public:
+    DSOFileStrings() : table(1, '\0') {}
+
+    uint32_t add(const string& s)
+    {
+        if (s.empty())
+            return 0;
+
+        auto iter = offsets.find(s);
+        if (iter != offsets.end())
+            return iter->second;
+
+        auto offset = (uint32_t) table.size();
+        table.append(s.c_str(), s.size() + 1);
+        offsets[s] = offset;
+        return offset;
+    }
+
+    const string& data() const { return table; }
+
+ private:
+    string table;
+    unordered_map<string, uint32_t> offsets;
+};
 
 // Used to sort DSO pointers by catalog number
 struct PtrCatalogNumberOrderingPredicate
@@ -65,6 +336,8 @@ DSODatabase::~DSODatabase()
 {
     delete [] DSOs;
     delete [] catalogNumberIndex;
+    delete octreeRoot;
+    delete extraOctreeRoot;
 }
 
 
@@ -101,13 +374,17 @@ DeepSkyObject* DSODatabase::find(const string& name) const
 }
 
 
-vector<string> DSODatabase::getCompletion(const string& name) const
+vector<string> DSODatabase::getCompletion(const string& name, unsigned int maxResults) const
 {
     vector<string> completion;
 
     // only named DSOs are supported by completion.
     if (!name.empty() && namesDB != nullptr)
+    {
+        if (maxResults > 0)
+            return namesDB->getRankedCompletion(name, maxResults);
         return namesDB->getCompletion(name);
+    }
     else
         return completion;
 }
@@ -119,7 +396,7 @@ string DSODatabase::getDSOName(const DeepSkyObject* const & dso, bool i18n) cons
 
     if (namesDB != nullptr)
     {
-        DSONameDatabase::NumberIndex::const_iterator iter   = namesDB->getFirstNameIter(catalogNumber);
+        auto iter = namesDB->getFirstNameIter(catalogNumber);
         if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
         {
             if (i18n && iter->second != _(iter->second.c_str()))
@@ -139,7 +416,7 @@ string DSODatabase::getDSONameList(const DeepSkyObject* const & dso, const unsig
 
     auto catalogNumber   = dso->getIndex();
 
-    DSONameDatabase::NumberIndex::const_iterator iter  = namesDB->getFirstNameIter(catalogNumber);
+    auto iter = namesDB->getFirstNameIter(catalogNumber);
 
     unsigned int count = 0;
     while (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber && count < maxNames)
@@ -191,6 +468,15 @@ void DSODatabase::findVisibleDSOs(DSOHandler&    dsoHandler,
                                       limitingMag,
                                       DSO_OCTREE_ROOT_SIZE,
                                       stats);
+    if (extraOctreeRoot != nullptr)
+    {
+        extraOctreeRoot->processVisibleObjects(dsoHandler,
+                                               obsPos,
+                                               frustumPlanes,
+                                               limitingMag,
+                                               DSO_OCTREE_ROOT_SIZE,
+                                               stats);
+    }
 }
 
 
@@ -202,6 +488,13 @@ void DSODatabase::findCloseDSOs(DSOHandler&     dsoHandler,
                                     obsPos,
                                     radius,
                                     DSO_OCTREE_ROOT_SIZE);
+    if (extraOctreeRoot != nullptr)
+    {
+        extraOctreeRoot->processCloseObjects(dsoHandler,
+                                             obsPos,
+                                             radius,
+                                             DSO_OCTREE_ROOT_SIZE);
+    }
 }
 
 
@@ -220,57 +513,81 @@ void DSODatabase::setNameDatabase(DSONameDatabase* _namesDB)
 bool DSODatabase::load(istream& in, const fs::path& resourcePath)
 {
     Tokenizer tokenizer(&in);
-    Parser    parser(&tokenizer);
+    return load(tokenizer, resourcePath);
+}
 
-#ifdef ENABLE_NLS
-    string s = resourcePath.string();
-    const char *d = s.c_str();
-    bindtextdomain(d, d); // domain name is the same as resource path
-#endif
+
+bool DSODatabase::load(Tokenizer& tokenizer, const fs::path& resourcePath)
+{
+    ParsedCatalog catalog;
+    parse(tokenizer, catalog);
+    return load(catalog, resourcePath);
+}
+
+
+/*! Read the object definitions of a deep sky catalog file without adding
+ *  them to a database. Returns false if a syntax error ended parsing.
+ */
+bool DSODatabase::parse(Tokenizer& tokenizer, ParsedCatalog& catalog)
+{
+    Parser    parser(&tokenizer);
 
     while (tokenizer.nextToken() != Tokenizer::TokenEnd)
     {
-        string objType;
-        string objName;
+        CatalogDefinition def;
 
         if (tokenizer.getTokenType() != Tokenizer::TokenName)
         {
-            DPRINTF(LOG_LEVEL_ERROR, "Error parsing deep sky catalog file.\n");
+            catalog.error = "Error parsing deep sky catalog file.\n";
             return false;
         }
-        objType = tokenizer.getNameValue();
+        def.type = tokenizer.getNameValue();
 
-        bool autoGenCatalogNumber = true;
-        AstroCatalog::IndexNumber objCatalogNumber = AstroCatalog::InvalidIndex;
-        if (tokenizer.getTokenType() == Tokenizer::TokenNumber)
-        {
-            autoGenCatalogNumber   = false;
-            objCatalogNumber       = (AstroCatalog::IndexNumber) tokenizer.getNumberValue();
-            tokenizer.nextToken();
-        }
-
-        if (autoGenCatalogNumber)
+        if (tokenizer.nextToken() != Tokenizer::TokenString)
         {
-            objCatalogNumber   = nextAutoCatalogNumber--;
+            catalog.error = "Error parsing deep sky catalog file: bad name.\n";
+            return false;
         }
+        def.name = tokenizer.getStringValue();
 
-        if (tokenizer.nextToken() != Tokenizer::TokenString)
+        def.value.reset(parser.readValue());
+        if (def.value == nullptr ||
+            def.value->getType() != Value::HashType)
         {
-            DPRINTF(LOG_LEVEL_ERROR, "Error parsing deep sky catalog file: bad name.\n");
+            catalog.error = fmt::sprintf("Error parsing deep sky catalog entry %s\n", def.name);
             return false;
         }
-        objName = tokenizer.getStringValue();
 
-        Value* objParamsValue    = parser.readValue();
-        if (objParamsValue == nullptr ||
-            objParamsValue->getType() != Value::HashType)
+        def.line = tokenizer.getLineNumber();
+        catalog.definitions.push_back(move(def));
+    }
+    return true;
+}
+
+
+/*! Add the object definitions read by parse() to the database, in file
+ *  order. Loading stops at the first bad definition.
+ */
+bool DSODatabase::load(const ParsedCatalog& catalog, const fs::path& resourcePath)
+{
+#ifdef ENABLE_NLS
+    string s = resourcePath.string();
+    const char *d = s.c_str();
+    bindtextdomain(d, d); // domain name is the same as resource path
+#endif
+
+    for (const auto& def : catalog.definitions)
+    {
+        const string& objType = def.type;
+        const string& objName = def.name;
+
+        AstroCatalog::IndexNumber objCatalogNumber = def.catalogNumber;
+        if (objCatalogNumber == AstroCatalog::InvalidIndex)
         {
-            DPRINTF(LOG_LEVEL_ERROR, "Error parsing deep sky catalog entry %s\n", objName.c_str());
-            return false;
+            objCatalogNumber   = nextAutoCatalogNumber--;
         }
 
-        Hash* objParams    = objParamsValue->getHash();
-        assert(objParams != nullptr);
+        Hash* objParams    = def.getData();
 
         DeepSkyObject* obj = nullptr;
         if (compareIgnoringCase(objType, "Galaxy") == 0)
@@ -285,85 +602,517 @@ bool DSODatabase::load(istream& in, const fs::path& resourcePath)
         if (obj != nullptr && obj->load(objParams, resourcePath))
         {
             obj->loadCategories(objParams, DataDisposition::Add, resourcePath.string());
-            delete objParamsValue;
 
-            // Ensure that the DSO array is large enough
-            if (nDSOs == capacity)
-            {
-                // Grow the array by 5%--this may be too little, but the
-                // assumption here is that there will be small numbers of
-                // DSOs in text files added to a big collection loaded from
-                // a binary file.
-                capacity = (int) (capacity * 1.05);
+            addDSO(obj);
+            obj->setIndex(objCatalogNumber);
+
+            // List of names will replace any that already exist for
+            // this DSO.
+            if (namesDB != nullptr && !objName.empty())
+                namesDB->erase(objCatalogNumber);
+            addNames(objCatalogNumber, objName);
+        }
+        else
+        {
+            DPRINTF(LOG_LEVEL_WARNING, "Bad Deep Sky Object definition--will continue parsing file.\n");
+            delete obj;
+            return false;
+        }
+    }
+
+    if (!catalog.error.empty())
+    {
+        DPRINTF(LOG_LEVEL_ERROR, "%s", catalog.error);
+        return false;
+    }
+
+    return true;
+}
+
+
+void DSODatabase::addDSO(DeepSkyObject* obj)
+{
+    // Ensure that the DSO array is large enough
+    if (nDSOs == capacity)
+    {
+        // Grow the array by 5%--this may be too little, but the
+        // assumption here is that there will be small numbers of
+        // DSOs in text files added to a big collection loaded from
+        // a binary file.
+        capacity = (int) (capacity * 1.05);
 
-                // 100 DSOs seems like a reasonable minimum
-                if (capacity < 100)
-                    capacity = 100;
+        // 100 DSOs seems like a reasonable minimum
+        if (capacity < 100)
+            capacity = 100;
 
-                DeepSkyObject** newDSOs = new DeepSkyObject*[capacity];
+        DeepSkyObject** newDSOs = new DeepSkyObject*[capacity];
 
-                if (DSOs != nullptr)
+        if (DSOs != nullptr)
+        {
+            copy(DSOs, DSOs + nDSOs, newDSOs);
+            delete[] DSOs;
+        }
+        DSOs = newDSOs;
+    }
+
+    DSOs[nDSOs++] = obj;
+}
+
+
+void DSODatabase::addNames(AstroCatalog::IndexNumber catalogNumber, const string& names)
+{
+    if (namesDB == nullptr || names.empty())
+        return;
+
+    // Iterate through the string for names delimited
+    // by ':', and insert them into the DSO database.
+    // Note that db->add() will skip empty names.
+    string::size_type startPos   = 0;
+    while (startPos != string::npos)
+    {
+        string::size_type next    = names.find(':', startPos);
+        string::size_type length  = string::npos;
+        if (next != string::npos)
+        {
+            length = next - startPos;
+            ++next;
+        }
+        string DSOName = names.substr(startPos, length);
+        namesDB->add(catalogNumber, DSOName);
+        if (DSOName != _(DSOName.c_str()))
+            namesDB->add(catalogNumber, _(DSOName.c_str()));
+        startPos   = next;
+    }
+}
+
+
+/*! Check whether a file is a binary deep sky catalog, which has to be
+ *  loaded with loadBinary() instead of load().
+ */
+bool DSODatabase::isBinaryFile(const fs::path& filename)
+{
+    ifstream in(filename.string(), ios::in | ios::binary);
+    char magic[sizeof(FILE_HEADER) - 1];
+    return in.read(magic, sizeof magic).good() &&
+           memcmp(magic, FILE_HEADER, sizeof magic) == 0;
+}
+
+
+/*! Load a binary deep sky catalog with a single mapping of the file. The
+ *  objects keep the octree order of the file; if the catalog is the first
+ *  one loaded, finish() restores its octree instead of rebuilding it.
+ */
+bool DSODatabase::loadBinary(const fs::path& filename)
+{
+    MappedFile file;
+    if (!file.open(filename))
+    {
+        fmt::fprintf(cerr, _("Error opening %s\n"), filename);
+        return false;
+    }
+
+    return loadBinary(file.data(), file.size());
+}
+
+
+bool DSODatabase::loadBinary(istream& in)
+{
+    string contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    return loadBinary(contents.data(), contents.size());
+}
+
+
+bool DSODatabase::loadBinary(const char* data, size_t size)
+{
+    if (size < sizeof(DSOFileHeader) ||
+        memcmp(data, FILE_HEADER, strlen(FILE_HEADER)) != 0 ||
+        fileUint16(data, offsetof(DSOFileHeader, version)) != DSO_FILE_VERSION)
+    {
+        cerr << _("Bad header for binary deep sky catalog\n");
+        return false;
+    }
+
+    uint32_t nDSOsInFile = fileUint32(data, offsetof(DSOFileHeader, nDSOs));
+    uint32_t nNodes      = fileUint32(data, offsetof(DSOFileHeader, nNodes));
+    float rootSize       = fileFloat(data, offsetof(DSOFileHeader, rootSize));
+    uint32_t stringBytes = fileUint32(data, offsetof(DSOFileHeader, stringBytes));
+    uint32_t nextAuto    = fileUint32(data, offsetof(DSOFileHeader, nextAutoCatalogNumber));
+
+    DSOFileLayout layout(nDSOsInFile, nNodes, stringBytes);
+    if (nNodes == 0 || stringBytes == 0 || layout.total > size ||
+        rootSize != DSO_OCTREE_ROOT_SIZE ||
+        data[layout.strings + stringBytes - 1] != '\0')
+    {
+        cerr << _("Bad header for binary deep sky catalog\n");
+        return false;
+    }
+
+    uint32_t nextObject = 0;
+    vector<bool> visited(nNodes, false);
+    if (!validateOctreeNode(data + layout.nodes, nNodes, 0, 0, nextObject, nDSOsInFile, visited) ||
+        nextObject != nDSOsInFile)
+    {
+        cerr << _("Bad octree in binary deep sky catalog\n");
+        return false;
+    }
+
+    const char* strings = data + layout.strings;
+    auto fileString = [strings, stringBytes](const char* record, size_t field, string& s)
+    {
+        uint32_t offset = fileUint32(record, field);
+        if (offset >= stringBytes)
+            return false;
+        s = strings + offset;
+        return true;
+    };
+
+    // Unnumbered objects were numbered down from the top of the range when
+    // the file was written; after other catalogs they take new numbers so
+    // that none is used twice.
+    bool renumber = nDSOs > 0;
+
+    vector<DeepSkyObject*> objects;
+    objects.reserve(nDSOsInFile);
+    vector<string> objNames(nDSOsInFile);
+    bool ok = true;
+    for (uint32_t i = 0; i < nDSOsInFile && ok; i++)
+    {
+        const char* record = data + layout.records + (size_t) i * sizeof(DSOFileRecord);
+        uint8_t type  = (uint8_t) record[offsetof(DSOFileRecord, type)];
+        uint8_t flags = (uint8_t) record[offsetof(DSOFileRecord, flags)];
+
+        string galaxyType, model, resourcePath, infoURL, categories;
+        if (!fileString(record, offsetof(DSOFileRecord, names), objNames[i]) ||
+            !fileString(record, offsetof(DSOFileRecord, galaxyType), galaxyType) ||
+            !fileString(record, offsetof(DSOFileRecord, model), model) ||
+            !fileString(record, offsetof(DSOFileRecord, resourcePath), resourcePath) ||
+            !fileString(record, offsetof(DSOFileRecord, infoURL), infoURL) ||
+            !fileString(record, offsetof(DSOFileRecord, categories), categories))
+        {
+            ok = false;
+            break;
+        }
+
+        float detail = fileFloat(record, offsetof(DSOFileRecord, detail));
+        DeepSkyObject* obj = nullptr;
+        switch (type)
+        {
+        case DSOFileGalaxy:
+            {
+                auto* galaxy = new Galaxy();
+                galaxy->setDetail(detail);
+                if (!model.empty())
+                    galaxy->setCustomTmpName(model);
+                galaxy->setType(galaxyType);
+                obj = galaxy;
+            }
+            break;
+        case DSOFileGlobular:
+            {
+                auto* globular = new Globular();
+                globular->setDetail(detail);
+                globular->setCoreRadius(fileFloat(record, offsetof(DSOFileRecord, coreRadius)));
+                if ((flags & DSOFileHasConcentration) != 0)
+                    globular->setConcentration(fileFloat(record, offsetof(DSOFileRecord, concentration)));
+                obj = globular;
+            }
+            break;
+        case DSOFileNebula:
+            {
+                auto* nebula = new Nebula();
+                if (!model.empty())
                 {
-                    copy(DSOs, DSOs + nDSOs, newDSOs);
-                    delete[] DSOs;
+                    nebula->setGeometry(GetGeometryManager()->getHandle(GeometryInfo(model,
+                                                                                     resourcePath)));
                 }
-                DSOs = newDSOs;
+                obj = nebula;
             }
+            break;
+        case DSOFileOpenCluster:
+            obj = new OpenCluster();
+            break;
+        default:
+            ok = false;
+            continue;
+        }
+        objects.push_back(obj);
+
+        size_t position = offsetof(DSOFileRecord, position);
+        size_t orientation = offsetof(DSOFileRecord, orientation);
+        AstroCatalog::IndexNumber catalogNumber = fileUint32(record, offsetof(DSOFileRecord, catalogNumber));
+        if (renumber && catalogNumber >= nextAuto)
+            catalogNumber = nextAutoCatalogNumber--;
+        obj->setIndex(catalogNumber);
+        obj->setPosition(Vector3d(fileDouble(record, position),
+                                  fileDouble(record, position + 8),
+                                  fileDouble(record, position + 16)));
+        obj->setOrientation(Quaternionf(fileFloat(record, orientation),
+                                        fileFloat(record, orientation + 4),
+                                        fileFloat(record, orientation + 8),
+                                        fileFloat(record, orientation + 12)));
+        obj->setRadius(fileFloat(record, offsetof(DSOFileRecord, radius)));
+        obj->setAbsoluteMagnitude(fileFloat(record, offsetof(DSOFileRecord, absMag)));
+        obj->setInfoURL(infoURL);
+        obj->setVisible((flags & DSOFileVisible) != 0);
+        obj->setClickable((flags & DSOFileClickable) != 0);
+
+        string::size_type startPos = 0;
+        while (startPos < categories.size())
+        {
+            string::size_type next = categories.find(':', startPos);
+            if (next == string::npos)
+                next = categories.size();
+            obj->addToCategory(categories.substr(startPos, next - startPos), true, resourcePath);
+            startPos = next + 1;
+        }
+    }
 
-            DSOs[nDSOs++] = obj;
+    if (!ok)
+    {
+        fmt::fprintf(cerr, _("Bad record in binary deep sky catalog, object #%u\n"),
+                     (unsigned int) objects.size());
+        for (auto obj : objects)
+        {
+            obj->clearCategories();
+            delete obj;
+        }
+        return false;
+    }
 
-            obj->setIndex(objCatalogNumber);
+    // The octree can only be restored as-is if this is the first catalog
+    // loaded; otherwise the objects are sorted along with the text ones.
+    if (nDSOs == 0 && prebuiltNodes.empty())
+    {
+        prebuiltNodes.assign(data + layout.nodes,
+                             data + layout.nodes + (size_t) nNodes * sizeof(DSOFileNode));
+        prebuiltNodeCount = nNodes;
+        prebuiltDSOCount  = (int) nDSOsInFile;
+    }
 
-            if (namesDB != nullptr && !objName.empty())
+    if (capacity < nDSOs + (int) nDSOsInFile)
+    {
+        capacity = nDSOs + (int) nDSOsInFile;
+        DeepSkyObject** newDSOs = new DeepSkyObject*[capacity];
+        if (DSOs != nullptr)
+        {
+            copy(DSOs, DSOs + nDSOs, newDSOs);
+            delete[] DSOs;
+        }
+        DSOs = newDSOs;
+    }
+
+    for (uint32_t i = 0; i < nDSOsInFile; i++)
+    {
+        DSOs[nDSOs++] = objects[i];
+        addNames(objects[i]->getIndex(), objNames[i]);
+    }
+
+    // Keep the catalog numbers of unnumbered objects added later unique
+    if (!renumber && nextAuto != 0 && nextAuto - 1 < nextAutoCatalogNumber)
+        nextAutoCatalogNumber = nextAuto - 1;
+
+    fmt::fprintf(clog, _("%u deep space objects in binary catalog\n"), nDSOsInFile);
+
+    return true;
+}
+
+
+/*! Write the database in the binary catalog format read by loadBinary().
+ *  The database must be finished, and all of its objects must reside in a
+ *  single octree.
+ */
+bool DSODatabase::writeBinary(ostream& out) const
+{
+    if (octreeRoot == nullptr || extraOctreeRoot != nullptr)
+        return false;
+
+    // Number the nodes breadth first, so that the eight children of a node
+    // are adjacent and always follow their parent.
+    vector<const DSOOctree*> nodes;
+    vector<uint32_t> firstChild;
+    nodes.push_back(octreeRoot);
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i]->getChild(0) == nullptr)
+        {
+            firstChild.push_back(0);
+            continue;
+        }
+
+        firstChild.push_back((uint32_t) nodes.size());
+        for (int j = 0; j < 8; j++)
+            nodes.push_back(nodes[i]->getChild(j));
+    }
+
+    // Gather the strings first, as the header gives the size of their table
+    DSOFileStrings strings;
+    vector<DSOFileRecord> records(nDSOs);
+    for (int i = 0; i < nDSOs; i++)
+    {
+        const DeepSkyObject* obj = DSOs[i];
+        DSOFileRecord& record = records[i];
+        memset(&record, 0, sizeof record);
+
+        string names;
+        if (namesDB != nullptr)
+        {
+            AstroCatalog::IndexNumber catalogNumber = obj->getIndex();
+            for (auto iter = namesDB->getFirstNameIter(catalogNumber);
+                 iter != namesDB->getFinalNameIter() && iter->first == catalogNumber;
+                 ++iter)
             {
-                // List of names will replace any that already exist for
-                // this DSO.
-                namesDB->erase(objCatalogNumber);
+                if (!names.empty())
+                    names += ':';
+                names += iter->second;
+            }
+        }
 
-                // Iterate through the string for names delimited
-                // by ':', and insert them into the DSO database.
-                // Note that db->add() will skip empty names.
-                string::size_type startPos   = 0;
-                while (startPos != string::npos)
-                {
-                    string::size_type next    = objName.find(':', startPos);
-                    string::size_type length  = string::npos;
-                    if (next != string::npos)
-                    {
-                        length = next - startPos;
-                        ++next;
-                    }
-                    string DSOName = objName.substr(startPos, length);
-                    namesDB->add(objCatalogNumber, DSOName);
-                    if (DSOName != _(DSOName.c_str()))
-                        namesDB->add(objCatalogNumber, _(DSOName.c_str()));
-                    startPos   = next;
-                }
+        string typeName = obj->getObjTypeName();
+        if (typeName == "galaxy")
+        {
+            auto galaxy = static_cast<const Galaxy*>(obj);
+            record.type       = DSOFileGalaxy;
+            record.detail     = galaxy->getDetail();
+            record.galaxyType = strings.add(galaxy->getType());
+            record.model      = strings.add(galaxy->getCustomTmpName());
+        }
+        else if (typeName == "globular")
+        {
+            auto globular = static_cast<const Globular*>(obj);
+            record.type          = DSOFileGlobular;
+            record.detail        = globular->getDetail();
+            record.coreRadius    = globular->getCoreRadius();
+            record.concentration = globular->getConcentration();
+            if (globular->getForm() != nullptr)
+                record.flags |= DSOFileHasConcentration;
+        }
+        else if (typeName == "nebula")
+        {
+            auto nebula = static_cast<const Nebula*>(obj);
+            record.type = DSOFileNebula;
+            const GeometryInfo* info = nullptr;
+            if (nebula->getGeometry() != InvalidResource)
+                info = GetGeometryManager()->getResourceInfo(nebula->getGeometry());
+            if (info != nullptr)
+            {
+                record.model        = strings.add(info->source.string());
+                record.resourcePath = strings.add(info->path.string());
             }
         }
+        else if (typeName == "opencluster")
+        {
+            record.type = DSOFileOpenCluster;
+        }
         else
         {
-            DPRINTF(LOG_LEVEL_WARNING, "Bad Deep Sky Object definition--will continue parsing file.\n");
-            delete objParamsValue;
             return false;
         }
+
+        // Sorted for the sake of reproducible output
+        string categories;
+        if (obj->getCategories() != nullptr)
+        {
+            vector<string> categoryNames;
+            for (const auto category : *obj->getCategories())
+                categoryNames.push_back(category->name());
+            sort(categoryNames.begin(), categoryNames.end());
+            for (const auto& name : categoryNames)
+            {
+                if (!categories.empty())
+                    categories += ':';
+                categories += name;
+            }
+        }
+
+        if (obj->isVisible())
+            record.flags |= DSOFileVisible;
+        if (obj->isClickable())
+            record.flags |= DSOFileClickable;
+        record.names      = strings.add(names);
+        record.infoURL    = strings.add(obj->getInfoURL());
+        record.categories = strings.add(categories);
     }
-    return true;
-}
 
+    auto nNodes = (uint32_t) nodes.size();
+    auto stringBytes = (uint32_t) strings.data().size();
+    DSOFileLayout layout(nDSOs, nNodes, stringBytes);
+    size_t pos = 0;
+
+    out.write(FILE_HEADER, strlen(FILE_HEADER));
+    writeUshort(out, DSO_FILE_VERSION);
+    writeUshort(out, 0);
+    writeUint(out, nDSOs);
+    writeUint(out, nNodes);
+    writeFloat(out, DSO_OCTREE_ROOT_SIZE);
+    writeUint(out, stringBytes);
+    writeUint(out, nextAutoCatalogNumber + 1);
+    pos += sizeof(DSOFileHeader);
+
+    writePadding(out, pos, layout.nodes);
+    for (uint32_t i = 0; i < nNodes; i++)
+    {
+        const DSOOctree* node = nodes[i];
+        writeDouble(out, node->getCellCenterPos().x());
+        writeDouble(out, node->getCellCenterPos().y());
+        writeDouble(out, node->getCellCenterPos().z());
+        writeFloat(out, node->getExclusionFactor());
+        writeUint(out, (uint32_t) (node->getFirstObject() - DSOs));
+        writeUint(out, node->getObjectCount());
+        writeUint(out, firstChild[i]);
+    }
+    pos += nNodes * sizeof(DSOFileNode);
 
-bool DSODatabase::loadBinary(istream&)
-{
-    // TODO: define a binary dso file format
-    return true;
+    writePadding(out, pos, layout.records);
+    for (int i = 0; i < nDSOs; i++)
+    {
+        const DeepSkyObject* obj = DSOs[i];
+        const DSOFileRecord& record = records[i];
+        Vector3d position = obj->getPosition();
+        Quaternionf orientation = obj->getOrientation();
+
+        writeUint(out, obj->getIndex());
+        out.put((char) record.type);
+        out.put((char) record.flags);
+        writeUshort(out, 0);
+        writeDouble(out, position.x());
+        writeDouble(out, position.y());
+        writeDouble(out, position.z());
+        writeFloat(out, orientation.w());
+        writeFloat(out, orientation.x());
+        writeFloat(out, orientation.y());
+        writeFloat(out, orientation.z());
+        writeFloat(out, obj->getRadius());
+        writeFloat(out, obj->getAbsoluteMagnitude());
+        writeFloat(out, record.detail);
+        writeFloat(out, record.coreRadius);
+        writeFloat(out, record.concentration);
+        writeUint(out, record.names);
+        writeUint(out, record.galaxyType);
+        writeUint(out, record.model);
+        writeUint(out, record.resourcePath);
+        writeUint(out, record.infoURL);
+        writeUint(out, record.categories);
+        writeUint(out, 0);
+    }
+    pos += nDSOs * sizeof(DSOFileRecord);
+
+    writePadding(out, pos, layout.strings);
+    out.write(strings.data().data(), stringBytes);
+
+    return out.good();
 }
 
 
 void DSODatabase::finish()
 {
-    buildOctree();
+    if (!prebuiltNodes.empty())
+        buildPrebuiltOctree();
+    else
+        buildOctree();
     buildIndexes();
     calcAvgAbsMag();
+    if (namesDB != nullptr)
+        namesDB->buildCompletionIndex();
     /*
     // Put AbsMag = avgAbsMag for Add-ons without AbsMag entry
     for (int i = 0; i < nDSOs; ++i)
@@ -410,6 +1159,63 @@ void DSODatabase::buildOctree()
     DSOs = sortedDSOs;
 }
 
+/*! Restore the octree of a pre-sorted binary catalog; objects from text
+ *  catalogs loaded after it are sorted into a small secondary octree.
+ */
+void DSODatabase::buildPrebuiltOctree()
+{
+    DPRINTF(LOG_LEVEL_INFO, "Restoring pre-sorted DSO octree . . .\n");
+    DeepSkyObject** sortedDSOs    = new DeepSkyObject*[nDSOs];
+    DeepSkyObject** firstDSO      = sortedDSOs;
+    octreeRoot = restoreOctreeNode(0, firstDSO);
+
+    if (nDSOs > prebuiltDSOCount)
+    {
+        DPRINTF(LOG_LEVEL_INFO, "Sorting %d additional DSOs into octree . . .\n",
+                nDSOs - prebuiltDSOCount);
+        float absMag = astro::appToAbsMag(DSO_OCTREE_MAGNITUDE, DSO_OCTREE_ROOT_SIZE * (float) sqrt(3.0));
+        DynamicDSOOctree* root = new DynamicDSOOctree(Vector3d::Zero(), absMag);
+        for (int i = prebuiltDSOCount; i < nDSOs; ++i)
+            root->insertObject(DSOs[i], DSO_OCTREE_ROOT_SIZE);
+        root->rebuildAndSort(extraOctreeRoot, firstDSO);
+        delete root;
+    }
+
+    DPRINTF(LOG_LEVEL_INFO, "%d DSOs total\n", (int) (firstDSO - sortedDSOs));
+
+    delete[] DSOs;
+    DSOs     = sortedDSOs;
+    capacity = nDSOs;
+
+    prebuiltNodes.clear();
+    prebuiltNodes.shrink_to_fit();
+}
+
+
+DSOOctree* DSODatabase::restoreOctreeNode(uint32_t index, DeepSkyObject**& sortedDSOs) const
+{
+    DSOFileNode node = fileNode(prebuiltNodes.data(), index);
+
+    DeepSkyObject** firstObject = sortedDSOs;
+    sortedDSOs = copy(DSOs + node.firstObject, DSOs + node.firstObject + node.nObjects, sortedDSOs);
+
+    auto* octree = new DSOOctree(Vector3d(node.center[0], node.center[1], node.center[2]),
+                                 node.exclusionFactor,
+                                 firstObject,
+                                 node.nObjects);
+
+    if (node.firstChild != 0)
+    {
+        auto** children = new DSOOctree*[8];
+        for (uint32_t i = 0; i < 8; i++)
+            children[i] = restoreOctreeNode(node.firstChild + i, sortedDSOs);
+        octree->setChildren(children);
+    }
+
+    return octree;
+}
+
+
 void DSODatabase::calcAvgAbsMag()
 {
     uint32_t nDSOeff = size();
@@ -19,6 +19,7 @@
 #include <celengine/deepskyobj.h>
 #include <celengine/dsooctree.h>
 #include <celengine/parser.h>
+#include <celengine/parsedcatalog.h>
 
 
 constexpr const unsigned int MAX_DSO_NAMES = 10;
@@ -27,6 +28,8 @@ constexpr const unsigned int MAX_DSO_NAMES = 10;
 constexpr const float DSO_OCTREE_ROOT_SIZE = 1.0e11f;
 
 //NOTE: this one and starDatabase should be derived from a common base class since they share lots of code and functionality.
+class Tokenizer;
+
 class DSODatabase
 {
  public:
@@ -40,7 +43,8 @@ class DSODatabase
     DeepSkyObject* find(const AstroCatalog::IndexNumber catalogNumber) const;
     DeepSkyObject* find(const std::string&) const;
 
-    std::vector<std::string> getCompletion(const std::string&) const;
+    // All completions, or the best maxResults of them if it isn't zero
+    std::vector<std::string> getCompletion(const std::string&, unsigned int maxResults = 0) const;
 
     void findVisibleDSOs(DSOHandler& dsoHandler,
                          const Eigen::Vector3d& obsPosition,
@@ -61,16 +65,28 @@ class DSODatabase
     void setNameDatabase(DSONameDatabase*);
 
     bool load(std::istream&, const fs::path& resourcePath = fs::path());
+    bool load(Tokenizer&, const fs::path& resourcePath = fs::path());
+    bool load(const ParsedCatalog&, const fs::path& resourcePath = fs::path());
+    static bool parse(Tokenizer&, ParsedCatalog&);
     bool loadBinary(std::istream&);
+    bool loadBinary(const fs::path&);
     void finish();
 
+    bool writeBinary(std::ostream&) const;
+    static bool isBinaryFile(const fs::path&);
+
     static DSODatabase* read(std::istream&);
 
     double getAverageAbsoluteMagnitude() const;
 
 private:
+    bool loadBinary(const char* data, size_t size);
+    void addNames(AstroCatalog::IndexNumber catalogNumber, const std::string& names);
+    void addDSO(DeepSkyObject*);
     void buildIndexes();
     void buildOctree();
+    void buildPrebuiltOctree();
+    DSOOctree* restoreOctreeNode(uint32_t node, DeepSkyObject**& sortedDSOs) const;
     void calcAvgAbsMag();
 
     int              nDSOs{ 0 };
@@ -79,9 +95,18 @@ private:
     DSONameDatabase* namesDB{ nullptr };
     DeepSkyObject**  catalogNumberIndex{ nullptr };
     DSOOctree*       octreeRoot{ nullptr };
+    // DSOs loaded from text catalogs after a pre-sorted binary one
+    DSOOctree*       extraOctreeRoot{ nullptr };
     AstroCatalog::IndexNumber nextAutoCatalogNumber{ 0xfffffffe };
 
     double           avgAbsMag{ 0.0 };
+
+    // Node table of a pre-sorted binary catalog, as stored in the file,
+    // whose objects are the first prebuiltDSOCount entries of DSOs; only
+    // kept until finish()
+    std::vector<char> prebuiltNodes;
+    uint32_t         prebuiltNodeCount{ 0 };
+    int              prebuiltDSOCount{ 0 };
 };
 
 
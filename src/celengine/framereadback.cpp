@@ -0,0 +1,111 @@
+// framereadback.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Pipelined readback of rendered frames for video capture.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <cstring>
+#include "framereadback.h"
+#include "render.h"
+
+FrameReadback::FrameReadback(int width, int height, unsigned int _nBuffers) :
+    frameWidth(width),
+    frameHeight(height),
+    nBuffers(_nBuffers > 0 ? _nBuffers : 1)
+{
+    if (isSupported())
+    {
+        pbos.resize(nBuffers);
+        glGenBuffers(nBuffers, pbos.data());
+        for (GLuint pbo : pbos)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameSize(), nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    else
+    {
+        frames.resize(nBuffers);
+        for (auto& frame : frames)
+            frame.resize(frameSize());
+    }
+}
+
+FrameReadback::~FrameReadback()
+{
+    if (!pbos.empty())
+        glDeleteBuffers(pbos.size(), pbos.data());
+}
+
+bool FrameReadback::isSupported()
+{
+#ifdef GL_ES
+    // OpenGL ES 2.0 has no pixel buffer objects, and 3.0 no glMapBuffer()
+    return false;
+#else
+    return true;
+#endif
+}
+
+bool FrameReadback::read(const Renderer& renderer, int x, int y)
+{
+    if (full())
+        return false;
+
+    bool ok;
+    if (!pbos.empty())
+    {
+        // With a pack buffer bound the pointer is an offset into it
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[next]);
+        ok = renderer.captureFrame(x, y, frameWidth, frameHeight,
+                                   Renderer::PixelFormat::RGBA,
+                                   nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    else
+    {
+        ok = renderer.captureFrame(x, y, frameWidth, frameHeight,
+                                   Renderer::PixelFormat::RGBA,
+                                   frames[next].data());
+    }
+
+    if (!ok)
+        return false;
+
+    next = (next + 1) % nBuffers;
+    nPending++;
+    return true;
+}
+
+bool FrameReadback::retrieve(unsigned char* dest)
+{
+    if (nPending == 0)
+        return false;
+
+    unsigned int oldest = (next + nBuffers - nPending) % nBuffers;
+    nPending--;
+
+#ifndef GL_ES
+    if (!pbos.empty())
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[oldest]);
+        auto* pixels = static_cast<const unsigned char*>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+        if (pixels != nullptr)
+        {
+            std::memcpy(dest, pixels, frameSize());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return pixels != nullptr;
+    }
+#endif
+
+    std::memcpy(dest, frames[oldest].data(), frameSize());
+    return true;
+}
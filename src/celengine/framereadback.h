@@ -0,0 +1,61 @@
+// framereadback.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Pipelined readback of rendered frames for video capture.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "glsupport.h"
+
+class Renderer;
+
+// A ring of pixel buffer objects that frames are read into without
+// waiting for the transfer; a frame is copied out a few frames later,
+// when its transfer has completed. Where pixel buffer objects aren't
+// available frames are read into memory with glReadPixels() at once.
+// All methods must be called with the GL context current.
+class FrameReadback
+{
+ public:
+    FrameReadback(int width, int height, unsigned int nBuffers = 3);
+    ~FrameReadback();
+
+    FrameReadback(const FrameReadback&) = delete;
+    FrameReadback& operator=(const FrameReadback&) = delete;
+
+    static bool isSupported();
+
+    int width() const { return frameWidth; }
+    int height() const { return frameHeight; }
+    // Size of a frame of RGBA pixels, bottom row first
+    size_t frameSize() const { return (size_t) frameWidth * frameHeight * 4; }
+
+    // Start reading the frame with its lower left corner at x, y. The
+    // ring must not be full.
+    bool read(const Renderer& renderer, int x, int y);
+
+    // Copy the oldest frame read and not yet retrieved to dest, which
+    // must hold frameSize() bytes. Returns false if there is none.
+    bool retrieve(unsigned char* dest);
+
+    unsigned int pending() const { return nPending; }
+    bool full() const { return nPending == nBuffers; }
+
+ private:
+    int frameWidth;
+    int frameHeight;
+    unsigned int nBuffers;
+    unsigned int next{ 0 };
+    unsigned int nPending{ 0 };
+
+    std::vector<GLuint> pbos;
+    std::vector<std::vector<unsigned char>> frames;
+};
@@ -19,6 +19,7 @@
 #include <celutil/gettext.h>
 #include <celutil/debug.h>
 #include <celcompat/filesystem.h>
+#include <cstddef>
 #include <fstream>
 #include <algorithm>
 #include <random>
@@ -57,6 +58,13 @@ class GalacticForm
 public:
     BlobVector* blobs;
     Vector3f scale;
+#ifndef GL_ES
+    // Quads of the blobs for instanced drawing, uploaded on first use
+    GLuint vertexBuffer{ 0 };
+    GLuint indexBuffer{ 0 };
+    // Galaxies of this form waiting to be drawn
+    vector<GalaxyInstance> instances;
+#endif
 };
 
 struct GalaxyTypeName
@@ -284,6 +292,293 @@ void Galaxy::render(const Vector3f& offset,
     }
 }
 
+bool Galaxy::getInstance(const Vector3f& offset,
+                         float brightness,
+                         float pixelSize,
+                         GalaxyInstance& instance) const
+{
+    if (form == nullptr)
+        return false;
+
+    /* We'll first see if the galaxy's apparent size is big enough to
+       be noticeable on screen; if it's not we'll break right here,
+       avoiding all the overhead of the matrix transformations and
+       GL state changes: */
+    float distanceToDSO = offset.norm() - getRadius();
+    if (distanceToDSO < 0)
+        distanceToDSO = 0;
+
+    float minimumFeatureSize = pixelSize * distanceToDSO;
+    float size  = 2 * getRadius();
+
+    if (size < minimumFeatureSize)
+        return false;
+
+    Quaternionf orientation = getOrientation().conjugate();
+    Matrix3f mScale = form->scale.asDiagonal() * size;
+    Matrix3f mLinear = orientation.toRotationMatrix() * mScale;
+
+    // corrections to avoid excessive brightening if viewed e.g. edge-on
+
+    float brightness_corr = 1.0f;
+    float cosi;
+
+    if (type < E0 || type > E3) //all galaxies, except ~round elliptics
+    {
+        cosi = (orientation * Vector3f::UnitY()).dot(offset) / offset.norm();
+        brightness_corr = std::sqrt(std::abs(cosi));
+        if (brightness_corr < 0.2f)
+            brightness_corr = 0.2f;
+    }
+    if (type > E3) // only elliptics with higher ellipticities
+    {
+        cosi = (orientation * Vector3f::UnitX()).dot(offset) / offset.norm();
+        brightness_corr = brightness_corr * std::abs(cosi);
+        if (brightness_corr < 0.45f)
+            brightness_corr = 0.45f;
+    }
+
+    const float btot = ((type > SBc) && (type < Irr)) ? 2.5f : 5.0f;
+
+    Map<Vector3f>(instance.offset) = offset;
+    instance.size = size;
+    Map<Matrix3f>(instance.axes) = mLinear;
+    instance.alphaScale = (4.0f * lightGain + 1.0f) * btot * brightness_corr * brightness;
+    instance.blobCount = (float) (unsigned int) (form->blobs->size() * clamp(getDetail()));
+    instance.minimumFeatureSize = minimumFeatureSize;
+
+    return true;
+}
+
+
+static void BindTextures()
+{
+    if (galaxyTex == nullptr)
+    {
+        galaxyTex = CreateProceduralTexture(width, height, GL_RGBA,
+                                            GalaxyTextureEval);
+    }
+    assert(galaxyTex != nullptr);
+    glActiveTexture(GL_TEXTURE0);
+    galaxyTex->bind();
+
+    if (colorTex == nullptr)
+    {
+        colorTex = CreateProceduralTexture(256, 1, GL_RGBA,
+                                           ColorTextureEval,
+                                           Texture::EdgeClamp,
+                                           Texture::NoMipMaps);
+    }
+    assert(colorTex != nullptr);
+    glActiveTexture(GL_TEXTURE1);
+    colorTex->bind();
+}
+
+
+static const float spriteScaleFactor = 1.0f / 1.55f;
+
+#ifndef GL_ES
+// Instanced drawing: the blobs of every form are uploaded once, and a
+// visible galaxy only adds a GalaxyInstance to the batch of its form. The
+// batches are drawn when the projection changes and after the last deep
+// sky object.
+
+struct FormVertex
+{
+    float position[4];  // blob position, relative sprite size
+    float texCoord[4];  // sprite corner, color index, brightness
+    float blobIndex;
+};
+
+static vector<GalacticForm*> batchForms;
+static Matrix4f batchMVP;
+static Matrix3f batchViewMat;
+static GLuint instanceBuffer = 0;
+
+static void UploadForm(GalacticForm* form)
+{
+    static const float corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+    const BlobVector& blobs = *form->blobs;
+    vector<FormVertex> vertices;
+    vertices.reserve(blobs.size() * 4);
+    vector<GLuint> indices;
+    indices.reserve(blobs.size() * 6);
+
+    // Sprites shrink at every power of two, as in renderGalaxyPointSprites()
+    float scale = 1.0f;
+    size_t pow2 = 1;
+    for (size_t i = 0; i < blobs.size(); ++i)
+    {
+        if ((i & pow2) != 0)
+        {
+            pow2 <<= 1;
+            scale *= spriteScaleFactor;
+        }
+
+        const Blob& b = blobs[i];
+        auto first = (GLuint) vertices.size();
+        for (const auto& c : corners)
+        {
+            vertices.push_back({ { b.position.x(), b.position.y(), b.position.z(), scale },
+                                 { c[0], c[1], (float) b.colorIndex, b.brightness },
+                                 (float) i });
+        }
+        for (GLuint j : { 0u, 1u, 2u, 0u, 2u, 3u })
+            indices.push_back(first + j);
+    }
+
+    glGenBuffers(1, &form->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, form->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(FormVertex),
+                 vertices.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &form->indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, form->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                 indices.data(), GL_STATIC_DRAW);
+}
+
+static void AddInstance(GalacticForm* form,
+                        const GalaxyInstance& instance,
+                        const Matrix4f& mvp,
+                        const Matrix3f& viewMat,
+                        Renderer* renderer)
+{
+    if (!batchForms.empty() && (mvp != batchMVP || viewMat != batchViewMat))
+        Galaxy::renderInstances(renderer);
+
+    batchMVP = mvp;
+    batchViewMat = viewMat;
+    if (form->instances.empty())
+        batchForms.push_back(form);
+    form->instances.push_back(instance);
+}
+#endif
+
+
+void Galaxy::renderInstances(Renderer* renderer)
+{
+#ifndef GL_ES
+    if (batchForms.empty())
+        return;
+
+    auto *prog = renderer->getShaderManager().getShader("galaxyinst");
+    GLint blobIndex = prog != nullptr ? prog->attribIndex("blobIndex") : -1;
+    GLint instanceAttribs[] =
+    {
+        prog != nullptr ? prog->attribIndex("instOffset") : -1,
+        prog != nullptr ? prog->attribIndex("instAxis0") : -1,
+        prog != nullptr ? prog->attribIndex("instAxis1") : -1,
+        prog != nullptr ? prog->attribIndex("instAxis2") : -1,
+        prog != nullptr ? prog->attribIndex("instParams") : -1
+    };
+    const GLint instanceSizes[] = { 4, 3, 3, 3, 3 };
+    const size_t instanceOffsets[] =
+    {
+        offsetof(GalaxyInstance, offset),
+        offsetof(GalaxyInstance, axes),
+        offsetof(GalaxyInstance, axes) + 3 * sizeof(float),
+        offsetof(GalaxyInstance, axes) + 6 * sizeof(float),
+        offsetof(GalaxyInstance, alphaScale)
+    };
+    if (blobIndex < 0 || *min_element(begin(instanceAttribs), end(instanceAttribs)) < 0)
+    {
+        for (auto* form : batchForms)
+            form->instances.clear();
+        batchForms.clear();
+        return;
+    }
+
+    // The instances of all forms go into one buffer, orphaning the one
+    // of the previous batch
+    size_t nInstances = 0;
+    for (const auto* form : batchForms)
+        nInstances += form->instances.size();
+    if (instanceBuffer == 0)
+        glGenBuffers(1, &instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, nInstances * sizeof(GalaxyInstance), nullptr, GL_STREAM_DRAW);
+    GLintptr bufferOffset = 0;
+    for (const auto* form : batchForms)
+    {
+        GLsizeiptr bytes = form->instances.size() * sizeof(GalaxyInstance);
+        glBufferSubData(GL_ARRAY_BUFFER, bufferOffset, bytes, form->instances.data());
+        bufferOffset += bytes;
+    }
+
+    BindTextures();
+    renderer->setBlendingFactors(GL_SRC_ALPHA, GL_ONE);
+
+    prog->use();
+    prog->mat4Param("MVPMatrix") = batchMVP;
+    prog->vec3Param("viewRight") = batchViewMat.col(0);
+    prog->vec3Param("viewUp") = batchViewMat.col(1);
+    prog->samplerParam("galaxyTex") = 0;
+    prog->samplerParam("colorTex") = 1;
+
+    glEnableVertexAttribArray(CelestiaGLProgram::VertexCoordAttributeIndex);
+    glEnableVertexAttribArray(CelestiaGLProgram::TextureCoord0AttributeIndex);
+    glEnableVertexAttribArray(blobIndex);
+    for (GLint attrib : instanceAttribs)
+    {
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribDivisorARB(attrib, 1);
+    }
+
+    bufferOffset = 0;
+    for (auto* form : batchForms)
+    {
+        if (form->vertexBuffer == 0)
+            UploadForm(form);
+
+        // Blobs beyond the largest detail of the batch are never drawn
+        float maxBlobs = 0.0f;
+        for (const auto& instance : form->instances)
+            maxBlobs = max(maxBlobs, instance.blobCount);
+
+        glBindBuffer(GL_ARRAY_BUFFER, form->vertexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, form->indexBuffer);
+        glVertexAttribPointer(CelestiaGLProgram::VertexCoordAttributeIndex,
+                              4, GL_FLOAT, GL_FALSE, sizeof(FormVertex),
+                              reinterpret_cast<const void*>(offsetof(FormVertex, position)));
+        glVertexAttribPointer(CelestiaGLProgram::TextureCoord0AttributeIndex,
+                              4, GL_FLOAT, GL_FALSE, sizeof(FormVertex),
+                              reinterpret_cast<const void*>(offsetof(FormVertex, texCoord)));
+        glVertexAttribPointer(blobIndex,
+                              1, GL_FLOAT, GL_FALSE, sizeof(FormVertex),
+                              reinterpret_cast<const void*>(offsetof(FormVertex, blobIndex)));
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int i = 0; i < 5; i++)
+        {
+            glVertexAttribPointer(instanceAttribs[i],
+                                  instanceSizes[i], GL_FLOAT, GL_FALSE, sizeof(GalaxyInstance),
+                                  reinterpret_cast<const void*>(bufferOffset + instanceOffsets[i]));
+        }
+
+        glDrawElementsInstancedARB(GL_TRIANGLES, (GLsizei) maxBlobs * 6, GL_UNSIGNED_INT,
+                                   nullptr, (GLsizei) form->instances.size());
+
+        bufferOffset += form->instances.size() * sizeof(GalaxyInstance);
+        form->instances.clear();
+    }
+    batchForms.clear();
+
+    for (GLint attrib : instanceAttribs)
+    {
+        glVertexAttribDivisorARB(attrib, 0);
+        glDisableVertexAttribArray(attrib);
+    }
+    glDisableVertexAttribArray(blobIndex);
+    glDisableVertexAttribArray(CelestiaGLProgram::VertexCoordAttributeIndex);
+    glDisableVertexAttribArray(CelestiaGLProgram::TextureCoord0AttributeIndex);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+#endif
+}
+
+
 struct GalaxyVertex
 {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -314,48 +609,33 @@ void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
                                       const Matrices& ms,
                                       Renderer* renderer)
 {
-    if (form == nullptr)
+    GalaxyInstance instance;
+    if (!getInstance(offset, brightness, pixelSize, instance))
         return;
 
-    /* We'll first see if the galaxy's apparent size is big enough to
-       be noticeable on screen; if it's not we'll break right here,
-       avoiding all the overhead of the matrix transformations and
-       GL state changes: */
-    float distanceToDSO = offset.norm() - getRadius();
-    if (distanceToDSO < 0)
-        distanceToDSO = 0;
-
-    float minimumFeatureSize = pixelSize * distanceToDSO;
-    float size  = 2 * getRadius();
+    Matrix3f viewMat = viewerOrientation.conjugate().toRotationMatrix();
 
-    if (size < minimumFeatureSize)
+#ifndef GL_ES
+    if (gl::ARB_draw_instanced && gl::ARB_instanced_arrays)
+    {
+        // The instance is relative to the observer, so the batch is
+        // transformed by the renderer's model view matrix
+        AddInstance(form, instance,
+                    (*ms.projection) * renderer->getModelViewMatrix(),
+                    viewMat, renderer);
         return;
+    }
+#endif
 
     auto *prog = renderer->getShaderManager().getShader("galaxy");
     if (prog == nullptr)
         return;
 
-    if (galaxyTex == nullptr)
-    {
-        galaxyTex = CreateProceduralTexture(width, height, GL_RGBA,
-                                            GalaxyTextureEval);
-    }
-    assert(galaxyTex != nullptr);
-    glActiveTexture(GL_TEXTURE0);
-    galaxyTex->bind();
+    BindTextures();
 
-    if (colorTex == nullptr)
-    {
-        colorTex = CreateProceduralTexture(256, 1, GL_RGBA,
-                                           ColorTextureEval,
-                                           Texture::EdgeClamp,
-                                           Texture::NoMipMaps);
-    }
-    assert(colorTex != nullptr);
-    glActiveTexture(GL_TEXTURE1);
-    colorTex->bind();
+    float size = instance.size;
+    float minimumFeatureSize = instance.minimumFeatureSize;
 
-    Matrix3f viewMat = viewerOrientation.conjugate().toRotationMatrix();
     Vector4f v0(Vector4f::Zero());
     Vector4f v1(Vector4f::Zero());
     Vector4f v2(Vector4f::Zero());
@@ -365,44 +645,17 @@ void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
     v2.head(3) = viewMat * Vector3f( 1,  1, 0) * size;
     v3.head(3) = viewMat * Vector3f(-1,  1, 0) * size;
 
-    Quaternionf orientation = getOrientation().conjugate();
-    Matrix3f mScale = form->scale.asDiagonal() * size;
-    Matrix3f mLinear = orientation.toRotationMatrix() * mScale;
-
     Matrix4f m = Matrix4f::Identity();
-    m.topLeftCorner(3,3) = mLinear;
+    m.topLeftCorner(3,3) = Map<Matrix3f>(instance.axes);
     m.block<3,1>(0, 3) = offset;
 
     int pow2 = 1;
 
     BlobVector* points = form->blobs;
-    unsigned int nPoints = (unsigned int) (points->size() * clamp(getDetail()));
-    // corrections to avoid excessive brightening if viewed e.g. edge-on
-
-    float brightness_corr = 1.0f;
-    float cosi;
-
-    if (type < E0 || type > E3) //all galaxies, except ~round elliptics
-    {
-        cosi = (orientation * Vector3f::UnitY()).dot(offset) / offset.norm();
-        brightness_corr = std::sqrt(std::abs(cosi));
-        if (brightness_corr < 0.2f)
-            brightness_corr = 0.2f;
-    }
-    if (type > E3) // only elliptics with higher ellipticities
-    {
-        cosi = (orientation * Vector3f::UnitX()).dot(offset) / offset.norm();
-        brightness_corr = brightness_corr * std::abs(cosi);
-        if (brightness_corr < 0.45f)
-            brightness_corr = 0.45f;
-    }
-
+    auto nPoints = (unsigned int) instance.blobCount;
 
     Matrix4f mv = vecgl::translate(*ms.modelview, Vector3f(-offset));
 
-    const float btot = ((type > SBc) && (type < Irr)) ? 2.5f : 5.0f;
-    const float spriteScaleFactor = 1.0f / 1.55f;
-
     glEnableVertexAttribArray(CelestiaGLProgram::VertexCoordAttributeIndex);
     glEnableVertexAttribArray(CelestiaGLProgram::TextureCoord0AttributeIndex);
 
@@ -440,7 +693,7 @@ void Galaxy::renderGalaxyPointSprites(const Vector3f& offset,
         float screenFrac = size / p.norm();
         if (screenFrac < 0.1f)
         {
-            float a = (4.0f * lightGain + 1.0f) * btot * (0.1f - screenFrac) * brightness_corr * brightness * br;
+            float a = instance.alphaScale * (0.1f - screenFrac) * br;
             short alpha = (short) (a * 65535.99f);
             short color = (short) b.colorIndex;
             g_vertices[vertex++] = { p + v0, { 0, 0, color, alpha } };
@@ -25,6 +25,19 @@ struct Blob
 
 class GalacticForm;
 
+// What a galaxy adds to an instanced draw of its form: the transform of
+// the form relative to the observer, and the parameters of its blobs.
+// The layout is that of the instance attributes of the galaxyinst shader.
+struct GalaxyInstance
+{
+    float offset[3];
+    float size;                 // sprite size of the first blob
+    float axes[9];              // rotated and scaled axes of the form
+    float alphaScale;
+    float blobCount;
+    float minimumFeatureSize;
+};
+
 class Galaxy : public DeepSkyObject
 {
  public:
@@ -52,6 +65,12 @@ class Galaxy : public DeepSkyObject
 
     GalacticForm* getForm() const;
 
+    bool getInstance(const Eigen::Vector3f& offset,
+                     float brightness,
+                     float pixelSize,
+                     GalaxyInstance& instance) const;
+    static void renderInstances(Renderer* r);
+
     static void  increaseLightGain();
     static void  decreaseLightGain();
     static float getLightGain();
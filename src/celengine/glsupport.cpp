@@ -10,6 +10,8 @@ bool OES_vertex_array_object        = false;
 #else
 bool ARB_vertex_array_object        = false;
 bool EXT_framebuffer_object         = false;
+bool ARB_draw_instanced             = false;
+bool ARB_instanced_arrays           = false;
 #endif
 bool ARB_shader_texture_lod         = false;
 bool EXT_texture_compression_s3tc   = false;
@@ -30,6 +32,8 @@ bool init() noexcept
 #else
     ARB_vertex_array_object        = has_extension("GL_ARB_vertex_array_object");
     EXT_framebuffer_object         = has_extension("GL_EXT_framebuffer_object");
+    ARB_draw_instanced             = has_extension("GL_ARB_draw_instanced");
+    ARB_instanced_arrays           = has_extension("GL_ARB_instanced_arrays");
 #endif
     ARB_shader_texture_lod         = has_extension("GL_ARB_shader_texture_lod");
     EXT_texture_compression_s3tc   = has_extension("GL_EXT_texture_compression_s3tc");
@@ -41,6 +41,8 @@ extern bool OES_vertex_array_object;
 #else
 extern bool ARB_vertex_array_object;
 extern bool EXT_framebuffer_object;
+extern bool ARB_draw_instanced;
+extern bool ARB_instanced_arrays;
 #endif
 
 bool init() noexcept;
@@ -1,9 +1,89 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <celutil/debug.h>
 #include "name.h"
 
+// Lookups by name and erase() search up to this many names added since the
+// indexes were updated linearly; more are merged into the indexes first.
+static const size_t MaxUnindexedNames = 4096;
+
+static inline int foldName(char c)
+{
+    return c >= 'a' && c <= 'z' ? c - 'a' + 'A' : static_cast<unsigned char>(c);
+}
+
+// Order names ignoring the case of ASCII letters, as compareIgnoringCase()
+// matches them; names which compare equal are the same name.
+static int compareNames(const char* s0, size_t len0, const char* s1, size_t len1)
+{
+    size_t n = std::min(len0, len1);
+    for (size_t i = 0; i < n; i++)
+    {
+        int c0 = foldName(s0[i]);
+        int c1 = foldName(s1[i]);
+        if (c0 != c1)
+            return c0 < c1 ? -1 : 1;
+    }
+    return len0 == len1 ? 0 : (len0 < len1 ? -1 : 1);
+}
+
+// The first eight characters of a name as compareNames() orders them
+static uint64_t namePrefix(const char* s, size_t len)
+{
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; i++)
+        prefix = (prefix << 8) | (i < len ? foldName(s[i]) : 0);
+    return prefix;
+}
+
+NameDatabase::NameIterator::NameIterator(const NameDatabase* _db,
+                                         const uint32_t* _pos,
+                                         const uint32_t* _end) :
+    db(_db),
+    pos(_pos),
+    end(_end)
+{
+    skipErased();
+}
+
+NameDatabase::NameIterator& NameDatabase::NameIterator::operator++()
+{
+    ++pos;
+    skipErased();
+    return *this;
+}
+
+void NameDatabase::NameIterator::skipErased()
+{
+    while (pos != end && db->entries[*pos].erased)
+        ++pos;
+    if (pos != end)
+    {
+        const NameEntry& entry = db->entries[*pos];
+        value.first = entry.catalogNumber;
+        value.second.assign(db->nameOf(*pos), entry.length);
+    }
+}
+
 uint32_t NameDatabase::getNameCount() const
 {
-    return nameIndex.size();
+    updateIndexes();
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < nameIndex.size(); i++)
+    {
+        if (i == 0 || compareNames(nameOf(nameIndex[i - 1]), entries[nameIndex[i - 1]].length,
+                                   nameOf(nameIndex[i]), entries[nameIndex[i]].length) != 0)
+            count++;
+    }
+    return count;
+}
+
+void NameDatabase::reserve(size_t nNames, size_t nameBytes)
+{
+    entries.reserve(nNames);
+    names.reserve(nameBytes + nNames);
 }
 
 void NameDatabase::add(const AstroCatalog::IndexNumber catalogNumber, const std::string& name, bool /*replaceGreek*/)
@@ -16,47 +96,172 @@ void NameDatabase::add(const AstroCatalog::IndexNumber catalogNumber, const std:
             DPRINTF(LOG_LEVEL_INFO,"Duplicated name '%s' on object with catalog numbers: %d and %d\n", name.c_str(), tmp, catalogNumber);
 #endif
         // Add the new name
-        //nameIndex.insert(NameIndex::value_type(name, catalogNumber));
         std::string fname = ReplaceGreekLetterAbbr(name);
 
-        nameIndex[fname] = catalogNumber;
-        numberIndex.insert(NumberIndex::value_type(catalogNumber, fname));
+        NameEntry entry;
+        entry.catalogNumber = catalogNumber;
+        entry.offset = names.length();
+        entry.length = fname.length();
+        entry.erased = 0;
+        entries.push_back(entry);
+
+        names += fname;
+        names += '\0';
+        completionIndexValid = false;
     }
 }
+
 void NameDatabase::erase(const AstroCatalog::IndexNumber catalogNumber)
 {
-    numberIndex.erase(catalogNumber);
+    if (entries.size() - numberIndex.size() > MaxUnindexedNames)
+        mergeNewEntries();
+
+    auto first = std::lower_bound(numberIndex.begin(), numberIndex.end(), catalogNumber,
+                                  [this](uint32_t e, AstroCatalog::IndexNumber n)
+                                  { return entries[e].catalogNumber < n; });
+    for (auto iter = first; iter != numberIndex.end() && entries[*iter].catalogNumber == catalogNumber; ++iter)
+        entries[*iter].erased = 1;
+
+    for (size_t i = numberIndex.size(); i < entries.size(); i++)
+    {
+        if (entries[i].catalogNumber == catalogNumber)
+            entries[i].erased = 1;
+    }
+    completionIndexValid = false;
+}
+
+// Merge all names into the indexes. Afterwards they may be read without
+// holding indexMutex.
+void NameDatabase::updateIndexes() const
+{
+    std::lock_guard<std::mutex> lock(indexMutex);
+    mergeNewEntries();
+}
+
+// Merge the entries added since the last update into the indexes. Callers
+// hold indexMutex or have exclusive access to the database.
+void NameDatabase::mergeNewEntries() const
+{
+    size_t nIndexed = numberIndex.size();
+    if (nIndexed == entries.size())
+        return;
+
+    // Sort the new entries by keys held with their indices rather than
+    // through the indices, which would touch the entries and names in
+    // random order.
+    std::vector<uint64_t> numberKeys;
+    numberKeys.reserve(entries.size() - nIndexed);
+    for (size_t i = nIndexed; i < entries.size(); i++)
+        numberKeys.push_back((uint64_t) entries[i].catalogNumber << 32 | i);
+    std::sort(numberKeys.begin(), numberKeys.end());
+    for (uint64_t key : numberKeys)
+        numberIndex.push_back((uint32_t) key);
+    numberKeys = std::vector<uint64_t>();
+
+    auto numberLess = [this](uint32_t a, uint32_t b)
+    {
+        AstroCatalog::IndexNumber na = entries[a].catalogNumber;
+        AstroCatalog::IndexNumber nb = entries[b].catalogNumber;
+        return na != nb ? na < nb : a < b;
+    };
+    std::inplace_merge(numberIndex.begin(), numberIndex.begin() + nIndexed, numberIndex.end(), numberLess);
+
+    auto nameLess = [this](uint32_t a, uint32_t b)
+    {
+        int c = compareNames(nameOf(a), entries[a].length, nameOf(b), entries[b].length);
+        return c != 0 ? c < 0 : a < b;
+    };
+    std::vector<std::pair<uint64_t, uint32_t>> nameKeys;
+    nameKeys.reserve(entries.size() - nIndexed);
+    for (size_t i = nIndexed; i < entries.size(); i++)
+        nameKeys.emplace_back(0, i);
+    sortByName(nameKeys, 0, nameKeys.size(), 0);
+    for (const auto& key : nameKeys)
+        nameIndex.push_back(key.second);
+    nameKeys = std::vector<std::pair<uint64_t, uint32_t>>();
+    std::inplace_merge(nameIndex.begin(), nameIndex.begin() + nIndexed, nameIndex.end(), nameLess);
+}
+
+// Sort entries by the characters of their names from depth on, eight at a
+// time: runs of entries whose names share those characters are sorted by
+// the next ones. Ties are left in the order added.
+void NameDatabase::sortByName(std::vector<std::pair<uint64_t, uint32_t>>& keys,
+                              size_t first, size_t last, size_t depth) const
+{
+    for (size_t i = first; i < last; i++)
+    {
+        uint32_t e = keys[i].second;
+        size_t length = entries[e].length;
+        keys[i].first = length > depth ? namePrefix(nameOf(e) + depth, length - depth) : 0;
+    }
+    std::sort(keys.begin() + first, keys.begin() + last);
+
+    size_t i = first;
+    while (i < last)
+    {
+        size_t j = i + 1;
+        while (j < last && keys[j].first == keys[i].first)
+            j++;
+        // Names that end within these characters are equal
+        if (j - i > 1 && (keys[i].first & 0xff) != 0)
+            sortByName(keys, i, j, depth + 8);
+        i = j;
+    }
+}
+
+// Return the entry of the name added last that is the same ignoring case,
+// or -1 if there is none.
+int NameDatabase::findName(const std::string& name) const
+{
+    // Held throughout, as the indexes may still be missing names
+    std::lock_guard<std::mutex> lock(indexMutex);
+
+    if (entries.size() - nameIndex.size() > MaxUnindexedNames)
+        mergeNewEntries();
+
+    for (size_t i = entries.size(); i > nameIndex.size(); i--)
+    {
+        if (compareNames(nameOf(i - 1), entries[i - 1].length, name.data(), name.length()) == 0)
+            return i - 1;
+    }
+
+    auto last = std::upper_bound(nameIndex.begin(), nameIndex.end(), name,
+                                 [this](const std::string& n, uint32_t e)
+                                 { return compareNames(n.data(), n.length(), nameOf(e), entries[e].length) < 0; });
+    if (last == nameIndex.begin())
+        return -1;
+    --last;
+    if (compareNames(nameOf(*last), entries[*last].length, name.data(), name.length()) != 0)
+        return -1;
+    return *last;
 }
 
 AstroCatalog::IndexNumber NameDatabase::getCatalogNumberByName(const std::string& name) const
 {
-    NameIndex::const_iterator iter = nameIndex.find(name);
+    int entry = findName(name);
 
-    if (iter == nameIndex.end())
+    if (entry < 0)
     {
-        iter = nameIndex.find(ReplaceGreekLetterAbbr(name));
-        if (iter == nameIndex.end())
+        entry = findName(ReplaceGreekLetterAbbr(name));
+        if (entry < 0)
             return AstroCatalog::InvalidIndex;
     }
-    return iter->second;
+    return entries[entry].catalogNumber;
 }
 
 // Return the first name matching the catalog number or end()
 // if there are no matching names.  The first name *should* be the
 // proper name of the OBJ, if one exists. This requires the
 // OBJ name database file to have the proper names listed before
-// other designations.  Also, the STL implementation must
-// preserve this order when inserting the names into the multimap
-// (not certain whether or not this behavior is in the STL spec.
-// but it works on the implementations I've tried so far.)
+// other designations.
 std::string NameDatabase::getNameByCatalogNumber(const AstroCatalog::IndexNumber catalogNumber) const
 {
     if (catalogNumber == AstroCatalog::InvalidIndex)
         return "";
 
-    NumberIndex::const_iterator iter = numberIndex.lower_bound(catalogNumber);
+    NameIterator iter = getFirstNameIter(catalogNumber);
 
-    if (iter != numberIndex.end() && iter->first == catalogNumber)
+    if (iter != getFinalNameIter())
         return iter->second;
 
     return "";
@@ -67,23 +272,133 @@ std::string NameDatabase::getNameByCatalogNumber(const AstroCatalog::IndexNumber
 // if there are no matching names.  The first name *should* be the
 // proper name of the OBJ, if one exists. This requires the
 // OBJ name database file to have the proper names listed before
-// other designations.  Also, the STL implementation must
-// preserve this order when inserting the names into the multimap
-// (not certain whether or not this behavior is in the STL spec.
-// but it works on the implementations I've tried so far.)
-NameDatabase::NumberIndex::const_iterator NameDatabase::getFirstNameIter(const AstroCatalog::IndexNumber catalogNumber) const
+// other designations.
+NameDatabase::NameIterator NameDatabase::getFirstNameIter(const AstroCatalog::IndexNumber catalogNumber) const
 {
-    NumberIndex::const_iterator iter = numberIndex.lower_bound(catalogNumber);
+    updateIndexes();
+
+    const uint32_t* begin = numberIndex.data();
+    const uint32_t* end = begin + numberIndex.size();
+    const uint32_t* first = std::lower_bound(begin, end, catalogNumber,
+                                             [this](uint32_t e, AstroCatalog::IndexNumber n)
+                                             { return entries[e].catalogNumber < n; });
+    NameIterator iter(this, first, end);
 
-    if (iter == numberIndex.end() || iter->first != catalogNumber)
+    if (iter == getFinalNameIter() || iter->first != catalogNumber)
         return getFinalNameIter();
     else
         return iter;
 }
 
-NameDatabase::NumberIndex::const_iterator NameDatabase::getFinalNameIter() const
+NameDatabase::NameIterator NameDatabase::getFinalNameIter() const
+{
+    updateIndexes();
+
+    const uint32_t* end = numberIndex.data() + numberIndex.size();
+    return NameIterator(this, end, end);
+}
+
+void NameDatabase::buildCompletionIndex() const
 {
-    return numberIndex.end();
+    std::lock_guard<std::mutex> lock(completionMutex);
+    buildCompletionEntries();
+}
+
+// Callers hold completionMutex or have exclusive access to the database
+void NameDatabase::buildCompletionEntries() const
+{
+    updateIndexes();
+
+    completionEntries.clear();
+    completionKeys.clear();
+    completionEntries.reserve(nameIndex.size());
+
+    // The first name of each object that still has names
+    std::vector<bool> primary(entries.size(), false);
+    for (size_t i = 0; i < numberIndex.size(); i++)
+    {
+        const NameEntry& e = entries[numberIndex[i]];
+        if (!e.erased && (i == 0 || entries[numberIndex[i - 1]].catalogNumber != e.catalogNumber ||
+                          entries[numberIndex[i - 1]].erased))
+        {
+            primary[numberIndex[i]] = true;
+        }
+    }
+
+    // One entry for each distinct name: the spelling it was first added
+    // with, and whether it is the first name of the object it was last
+    // added for.
+    size_t i = 0;
+    while (i < nameIndex.size())
+    {
+        uint32_t first = nameIndex[i];
+        size_t j = i + 1;
+        while (j < nameIndex.size() &&
+               compareNames(nameOf(first), entries[first].length,
+                            nameOf(nameIndex[j]), entries[nameIndex[j]].length) == 0)
+        {
+            j++;
+        }
+        uint32_t last = nameIndex[j - 1];
+
+        std::string key = UTF8FoldCase(std::string(nameOf(first), entries[first].length));
+
+        CompletionEntry entry;
+        entry.keyOffset = completionKeys.size();
+        entry.keyLength = key.length();
+        entry.name = first;
+        entry.primary = false;
+        for (size_t k = i; k < j; k++)
+        {
+            if (primary[nameIndex[k]] && entries[nameIndex[k]].catalogNumber == entries[last].catalogNumber)
+                entry.primary = true;
+        }
+
+        completionKeys += key;
+        completionEntries.push_back(entry);
+        i = j;
+    }
+
+    const char* keys = completionKeys.data();
+    std::sort(completionEntries.begin(), completionEntries.end(),
+              [keys](const CompletionEntry& a, const CompletionEntry& b)
+              {
+                  int c = std::memcmp(keys + a.keyOffset, keys + b.keyOffset,
+                                      std::min(a.keyLength, b.keyLength));
+                  return c != 0 ? c < 0 : a.keyLength < b.keyLength;
+              });
+
+    completionIndexValid = true;
+}
+
+NameDatabase::CompletionRange NameDatabase::findCompletions(const std::string& name) const
+{
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+        if (!completionIndexValid)
+            buildCompletionEntries();
+    }
+
+    std::string prefix = UTF8FoldCase(name);
+    const char* keys = completionKeys.data();
+    uint32_t prefixLength = prefix.length();
+
+    // Entries whose key starts with the prefix follow all the entries whose
+    // key is less than it.
+    auto first = std::lower_bound(completionEntries.begin(), completionEntries.end(), prefix,
+                                  [keys](const CompletionEntry& e, const std::string& p)
+                                  {
+                                      uint32_t n = std::min(e.keyLength, (uint32_t) p.length());
+                                      int c = std::memcmp(keys + e.keyOffset, p.data(), n);
+                                      return c != 0 ? c < 0 : e.keyLength < p.length();
+                                  });
+    auto last = std::upper_bound(first, completionEntries.end(), prefix,
+                                 [keys, prefixLength](const std::string& p, const CompletionEntry& e)
+                                 {
+                                     return e.keyLength < prefixLength ||
+                                            std::memcmp(keys + e.keyOffset, p.data(), prefixLength) != 0;
+                                 });
+    return std::make_pair(first, last);
 }
 
 std::vector<std::string> NameDatabase::getCompletion(const std::string& name, bool greek) const
@@ -96,15 +411,10 @@ std::vector<std::string> NameDatabase::getCompletion(const std::string& name, bo
     }
 
     std::vector<std::string> completion;
-    int name_length = UTF8Length(name);
-
-    for (NameIndex::const_iterator iter = nameIndex.begin(); iter != nameIndex.end(); ++iter)
-    {
-        if (!UTF8StringCompare(iter->first, name, name_length, true))
-        {
-            completion.push_back(iter->first);
-        }
-    }
+    auto range = findCompletions(name);
+    completion.reserve(range.second - range.first);
+    for (auto iter = range.first; iter != range.second; ++iter)
+        completion.emplace_back(nameOf(iter->name), entries[iter->name].length);
     return completion;
 }
 
@@ -118,3 +428,68 @@ std::vector<std::string> NameDatabase::getCompletion(const std::vector<std::stri
     }
     return completion;
 }
+
+std::vector<std::string> NameDatabase::getRankedCompletion(const std::string& name,
+                                                           unsigned int maxResults,
+                                                           bool greek) const
+{
+    std::vector<std::string> prefixes;
+    if (greek)
+        prefixes = getGreekCompletion(name);
+    prefixes.push_back(name);
+
+    // Keep the best entries in a heap whose top is the worst of them. Only
+    // entries better than the top are compared further, so a prefix with
+    // many completions costs little more than one pass over them.
+    auto better = [](const CompletionEntry* a, const CompletionEntry* b)
+    {
+        if (a->primary != b->primary)
+            return a->primary;
+        if (a->keyLength != b->keyLength)
+            return a->keyLength < b->keyLength;
+        return a->keyOffset < b->keyOffset;
+    };
+
+    std::vector<const CompletionEntry*> best;
+    best.reserve(maxResults);
+    const CompletionEntry* exact = nullptr;
+    for (const auto& prefix : prefixes)
+    {
+        auto range = findCompletions(prefix);
+        uint32_t prefixLength = UTF8FoldCase(prefix).length();
+        for (auto iter = range.first; iter != range.second; ++iter)
+        {
+            const CompletionEntry* entry = &*iter;
+            if (exact == nullptr && entry->keyLength == prefixLength && prefix == name)
+            {
+                exact = entry;
+                continue;
+            }
+
+            if (best.size() < maxResults)
+            {
+                best.push_back(entry);
+                std::push_heap(best.begin(), best.end(), better);
+            }
+            else if (maxResults > 0 && better(entry, best.front()))
+            {
+                std::pop_heap(best.begin(), best.end(), better);
+                best.back() = entry;
+                std::push_heap(best.begin(), best.end(), better);
+            }
+        }
+    }
+
+    std::sort_heap(best.begin(), best.end(), better);
+
+    std::vector<std::string> completion;
+    if (exact != nullptr && maxResults > 0)
+    {
+        completion.emplace_back(nameOf(exact->name), entries[exact->name].length);
+        if (best.size() == maxResults)
+            best.pop_back();
+    }
+    for (const auto* entry : best)
+        completion.emplace_back(nameOf(entry->name), entries[entry->name].length);
+    return completion;
+}
@@ -14,7 +14,7 @@
 
 #include <string>
 #include <iostream>
-#include <map>
+#include <mutex>
 #include <vector>
 #include <celutil/debug.h>
 #include <celutil/util.h>
@@ -25,9 +25,35 @@
 // lies the one and only need for type genericity.
 class NameDatabase
 {
+    struct NameEntry;
+
  public:
-    typedef std::map<std::string, AstroCatalog::IndexNumber, CompareIgnoringCasePredicate> NameIndex;
-    typedef std::multimap<AstroCatalog::IndexNumber, std::string> NumberIndex;
+    // Iterates over the names in catalog number order, and over the names
+    // of an object in the order they were added. Dereferences to a pair of
+    // catalog number and name.
+    class NameIterator
+    {
+     public:
+        typedef std::pair<AstroCatalog::IndexNumber, std::string> value_type;
+
+        const value_type& operator*() const { return value; }
+        const value_type* operator->() const { return &value; }
+        NameIterator& operator++();
+
+        bool operator==(const NameIterator& other) const { return pos == other.pos; }
+        bool operator!=(const NameIterator& other) const { return pos != other.pos; }
+
+     private:
+        NameIterator(const NameDatabase* _db, const uint32_t* _pos, const uint32_t* _end);
+        void skipErased();
+
+        const NameDatabase* db;
+        const uint32_t* pos;
+        const uint32_t* end;
+        value_type value;
+
+        friend class NameDatabase;
+    };
 
  public:
     NameDatabase() {};
@@ -43,14 +69,79 @@ class NameDatabase
     AstroCatalog::IndexNumber getCatalogNumberByName(const std::string&) const;
     std::string getNameByCatalogNumber(const AstroCatalog::IndexNumber) const;
 
-    NumberIndex::const_iterator getFirstNameIter(const AstroCatalog::IndexNumber catalogNumber) const;
-    NumberIndex::const_iterator getFinalNameIter() const;
+    NameIterator getFirstNameIter(const AstroCatalog::IndexNumber catalogNumber) const;
+    NameIterator getFinalNameIter() const;
 
     std::vector<std::string> getCompletion(const std::string& name, bool greek = true) const;
     std::vector<std::string> getCompletion(const std::vector<std::string> &list) const;
 
+    // At most maxResults completions, best first: an exact match, then the
+    // first names of objects before their other designations, then shorter
+    // names before longer ones.
+    std::vector<std::string> getRankedCompletion(const std::string& name,
+                                                 unsigned int maxResults,
+                                                 bool greek = true) const;
+
+    // Merge all names into the indexes and build the index used for
+    // completion, as done when a catalog has been loaded. Names added
+    // afterwards make them be updated again by the next lookup.
+    void buildCompletionIndex() const;
+
  protected:
-    NameIndex   nameIndex;
-    NumberIndex numberIndex;
-};
+    // Reserve space for the given number of names and total name length.
+    void reserve(size_t nNames, size_t nameBytes);
+
+ private:
+    // All names are stored in one string, each followed by a zero byte.
+    // Entries are kept in the order the names were added; the number and
+    // name indexes are entry indices sorted by catalog number and by name
+    // ignoring case, with ties in the order added. Entries added since the
+    // indexes were last updated are merged into them lazily, so loading a
+    // catalog doesn't keep two sorted containers up to date.
+    //
+    // Const members may be called from several threads at once, so the
+    // lazy updates are made under indexMutex and completionMutex. Only
+    // names added by a non-const member leave something to update; once a
+    // lookup has merged them, the indexes don't change until the next one.
+    struct NameEntry
+    {
+        AstroCatalog::IndexNumber catalogNumber;
+        uint32_t offset;
+        uint32_t length : 31;
+        uint32_t erased : 1;  // no longer found by catalog number
+    };
+
+    const char* nameOf(uint32_t entry) const { return names.data() + entries[entry].offset; }
+    void updateIndexes() const;
+    void mergeNewEntries() const;
+    void sortByName(std::vector<std::pair<uint64_t, uint32_t>>& keys,
+                    size_t first, size_t last, size_t depth) const;
+    int findName(const std::string& name) const;
+
+    std::string names;
+    std::vector<NameEntry> entries;
+    mutable std::vector<uint32_t> numberIndex;
+    mutable std::vector<uint32_t> nameIndex;
+    mutable std::mutex indexMutex;
 
+    // Names sorted by their folded form, which is stored in one string.
+    // Names with a common prefix are contiguous, so completions are found
+    // with a binary search rather than a scan of every name.
+    struct CompletionEntry
+    {
+        uint32_t keyOffset;
+        uint32_t keyLength;
+        uint32_t name;  // index of the entry
+        bool primary;   // first name of its object
+    };
+
+    typedef std::pair<std::vector<CompletionEntry>::const_iterator,
+                      std::vector<CompletionEntry>::const_iterator> CompletionRange;
+    CompletionRange findCompletions(const std::string& name) const;
+    void buildCompletionEntries() const;
+
+    mutable std::vector<CompletionEntry> completionEntries;
+    mutable std::string completionKeys;
+    mutable bool completionIndexValid{ false };
+    mutable std::mutex completionMutex;
+};
@@ -39,6 +39,14 @@ template <class OBJ, class PREC> class OctreeProcessor
     virtual ~OctreeProcessor() {};
 
     virtual void process(const OBJ& obj, PREC distance, float appMag) = 0;
+
+    // Process a batch of objects; traversals that cull many objects at
+    // once hand their survivors over through this method.
+    virtual void processBatch(const OBJ* const* objs, const PREC* distances, const float* appMags, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            process(*objs[i], distances[i], appMags[i]);
+    }
 };
 
 
@@ -147,6 +155,17 @@ template <class OBJ, class PREC> class StaticOctree
 
     void computeStatistics(std::vector<OctreeLevelStatistics>& stats, unsigned int level = 0);
 
+    // Accessors used when an octree is serialized into, or restored from,
+    // a pre-built catalog file.
+    const PointType& getCellCenterPos() const  { return cellCenterPos; }
+    float            getExclusionFactor() const { return exclusionFactor; }
+    const OBJ*       getFirstObject() const     { return _firstObject; }
+    unsigned int     getObjectCount() const     { return nObjects; }
+    const StaticOctree* getChild(int i) const   { return _children != nullptr ? _children[i] : nullptr; }
+
+    // Take ownership of an array of eight child nodes.
+    void setChildren(StaticOctree** children)  { _children = children; }
+
  private:
     static const PREC SQRT3;
 
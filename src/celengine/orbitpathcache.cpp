@@ -0,0 +1,263 @@
+// orbitpathcache.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Orbit paths sampled in the background, within a memory budget.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <celephem/orbit.h>
+#include <celutil/threadpool.h>
+#include "curveplot.h"
+#include "orbitpathcache.h"
+#include "orbitsampler.h"
+
+using namespace std;
+
+
+namespace
+{
+
+// Approximate memory used by a path
+size_t PathBytes(const CurvePlot* plot)
+{
+    return plot == nullptr ? 0 : plot->sampleCount() * sizeof(CurvePlotSample);
+}
+
+
+bool Covers(const CurvePlot* plot, double startTime, double endTime)
+{
+    return plot != nullptr && !plot->empty() &&
+           plot->startTime() <= endTime && plot->endTime() >= startTime;
+}
+
+
+CurvePlot* SampleCoarsely(const Orbit* orbit, double startTime, double endTime)
+{
+    auto plot = new CurvePlot();
+    unsigned int n = OrbitPathCache::CoarseSampleCount;
+    for (unsigned int i = 0; i <= n; i++)
+    {
+        CurvePlotSample sample;
+        sample.t = startTime + (endTime - startTime) * i / n;
+        sample.position = orbit->positionAtTime(sample.t);
+        sample.velocity = orbit->velocityAtTime(sample.t);
+        plot->addSample(sample);
+    }
+    return plot;
+}
+
+} // end unnamed namespace
+
+
+mutex OrbitPathCache::cachesMutex;
+vector<OrbitPathCache*> OrbitPathCache::caches;
+
+
+OrbitPathCache::OrbitPathCache()
+{
+    lock_guard<mutex> lock(cachesMutex);
+    caches.push_back(this);
+}
+
+
+OrbitPathCache::~OrbitPathCache()
+{
+    {
+        lock_guard<mutex> lock(cachesMutex);
+        caches.erase(find(caches.begin(), caches.end(), this));
+    }
+
+    // The jobs use the orbits, which may be deleted after the renderer.
+    for (auto& p : paths)
+    {
+        if (p.second.done.valid())
+            p.second.done.wait();
+    }
+}
+
+
+void OrbitPathCache::forget(const Orbit* orbit)
+{
+    lock_guard<mutex> lock(cachesMutex);
+    for (auto cache : caches)
+        cache->erase(orbit);
+}
+
+
+CurvePlot* OrbitPathCache::getPath(const Orbit* orbit,
+                                   double startTime,
+                                   double endTime,
+                                   uint32_t frame,
+                                   bool& preliminary)
+{
+    trim(frame);
+
+    Path& path = paths[orbit];
+    path.lastUsed = frame;
+
+    if (path.done.valid() &&
+        path.done.wait_for(chrono::seconds(0)) == future_status::ready)
+    {
+        finishJob(path);
+    }
+
+    // After a jump in time a periodic orbit is sampled again rather than
+    // extended by more than a revolution.
+    if (path.current && orbit->isPeriodic() && !Covers(path.plot.get(), startTime, endTime))
+        path.current = false;
+
+    if (!path.current && !path.done.valid())
+    {
+        if (orbit->isSampleThreadSafe())
+        {
+            startJob(orbit, path, startTime, endTime);
+
+            // Without worker threads the job has already run
+            if (path.done.valid() &&
+                path.done.wait_for(chrono::seconds(0)) == future_status::ready)
+            {
+                finishJob(path);
+            }
+            else if (orbit->isPeriodic() && !Covers(path.plot.get(), startTime, endTime))
+            {
+                path.plot.reset(SampleCoarsely(orbit, startTime, endTime));
+                path.preliminary = true;
+            }
+        }
+        else
+        {
+            OrbitSampler sampler;
+            orbit->sample(startTime, endTime, sampler);
+            path.plot.reset(new CurvePlot());
+            sampler.insertForward(path.plot.get());
+            path.current = true;
+            path.preliminary = false;
+        }
+    }
+
+    preliminary = path.preliminary;
+    return path.plot.get();
+}
+
+
+void OrbitPathCache::startJob(const Orbit* orbit, Path& path, double startTime, double endTime)
+{
+    // Leave the other paths to the next frames rather than fill the pool,
+    // which also runs the rendering tasks.
+    ThreadPool& pool = ThreadPool::global();
+    if (pendingJobs >= 2 * max(pool.size(), 1u))
+        return;
+
+    auto job = make_shared<Job>();
+    path.job = job;
+    path.done = pool.async([orbit, job, startTime, endTime]()
+    {
+        auto start = chrono::steady_clock::now();
+
+        OrbitSampler sampler;
+        orbit->sample(startTime, endTime, sampler);
+        job->plot.reset(new CurvePlot());
+        sampler.insertForward(job->plot.get());
+
+        job->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    });
+    pendingJobs++;
+}
+
+
+void OrbitPathCache::finishJob(Path& path)
+{
+    path.done.get();
+    pendingJobs--;
+
+    samplesGenerated += path.job->plot->sampleCount();
+    samplingTime += path.job->seconds;
+
+    path.plot = move(path.job->plot);
+    path.job.reset();
+    path.current = true;
+    path.preliminary = false;
+}
+
+
+void OrbitPathCache::invalidate()
+{
+    for (auto& p : paths)
+        p.second.current = false;
+}
+
+
+// Delete the least recently used paths while over the budget. Paths used in
+// the current frame and those being sampled are kept. Run at most once per
+// frame.
+void OrbitPathCache::trim(uint32_t frame)
+{
+    if (frame == lastTrimFrame)
+        return;
+    lastTrimFrame = frame;
+
+    bytes = 0;
+    for (const auto& p : paths)
+        bytes += PathBytes(p.second.plot.get());
+
+    if (memoryBudget == 0 || bytes <= memoryBudget)
+        return;
+
+    vector<map<const Orbit*, Path>::iterator> candidates;
+    for (auto iter = paths.begin(); iter != paths.end(); ++iter)
+    {
+        if (iter->second.lastUsed != frame && !iter->second.done.valid())
+            candidates.push_back(iter);
+    }
+    sort(candidates.begin(), candidates.end(),
+         [](const map<const Orbit*, Path>::iterator& a, const map<const Orbit*, Path>::iterator& b)
+         {
+             return a->second.lastUsed < b->second.lastUsed;
+         });
+
+    for (auto iter : candidates)
+    {
+        if (bytes <= memoryBudget)
+            break;
+        bytes -= PathBytes(iter->second.plot.get());
+        paths.erase(iter);
+        evictions++;
+    }
+}
+
+
+void OrbitPathCache::erase(const Orbit* orbit)
+{
+    auto iter = paths.find(orbit);
+    if (iter == paths.end())
+        return;
+
+    if (iter->second.done.valid())
+    {
+        iter->second.done.wait();
+        pendingJobs--;
+    }
+    bytes -= min(bytes, PathBytes(iter->second.plot.get()));
+    paths.erase(iter);
+}
+
+
+OrbitPathCache::Stats OrbitPathCache::getStats() const
+{
+    Stats stats;
+    stats.paths = paths.size();
+    stats.bytes = bytes;
+    stats.pendingJobs = pendingJobs;
+    stats.samplesGenerated = samplesGenerated;
+    if (samplingTime > 0.0)
+        stats.samplesPerSecond = samplesGenerated / samplingTime;
+    stats.evictions = evictions;
+    return stats;
+}
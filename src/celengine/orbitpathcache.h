@@ -0,0 +1,117 @@
+// orbitpathcache.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Orbit paths sampled in the background, within a memory budget.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class CurvePlot;
+class Orbit;
+
+/*! Cache of the sampled paths drawn for orbits. Orbits whose sample()
+ *  is thread safe are sampled on the global thread pool; until their path
+ *  is ready, periodic orbits are drawn from a coarse path of a few points,
+ *  and paths that are being resampled keep being drawn. Other orbits are
+ *  sampled synchronously, as before.
+ *
+ *  Once the paths use more memory than the budget, the least recently
+ *  used ones are deleted, but never those used in the current frame.
+ */
+class OrbitPathCache
+{
+ public:
+    OrbitPathCache();
+    ~OrbitPathCache();
+
+    OrbitPathCache(const OrbitPathCache&) = delete;
+    OrbitPathCache& operator=(const OrbitPathCache&) = delete;
+
+    /*! Return the path of an orbit, or nullptr if there is nothing to draw
+     *  yet. New paths cover the time range [ startTime, endTime ]. A path
+     *  is preliminary when it's a coarse placeholder; it must not be
+     *  extended by the caller, as it will be replaced.
+     */
+    CurvePlot* getPath(const Orbit* orbit,
+                       double startTime,
+                       double endTime,
+                       uint32_t frame,
+                       bool& preliminary);
+
+    // Resample all paths, drawing the old ones until the new ones are ready
+    void invalidate();
+
+    /*! Delete the paths of an orbit from all caches, waiting for the jobs
+     *  sampling it. Must be called before the orbit is deleted, both
+     *  because the jobs use it and so that a new orbit at the same address
+     *  doesn't get its path.
+     */
+    static void forget(const Orbit* orbit);
+
+    // Zero means no limit
+    void setMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+    size_t getMemoryBudget() const { return memoryBudget; }
+
+    struct Stats
+    {
+        size_t   paths{ 0 };
+        size_t   bytes{ 0 };              // used by the samples of the paths
+        size_t   pendingJobs{ 0 };
+        uint64_t samplesGenerated{ 0 };   // by background jobs
+        double   samplesPerSecond{ 0.0 }; // per thread while sampling
+        uint64_t evictions{ 0 };
+    };
+    Stats getStats() const;
+
+    // Samples used for the placeholders of periodic orbits
+    static constexpr unsigned int CoarseSampleCount = 32;
+
+ private:
+    struct Job
+    {
+        std::unique_ptr<CurvePlot> plot;
+        double seconds{ 0.0 };
+    };
+
+    struct Path
+    {
+        std::unique_ptr<CurvePlot> plot;
+        std::shared_ptr<Job> job;
+        std::future<void> done;
+        uint32_t lastUsed{ 0 };
+        bool current{ false };      // plot is a full sampling of the orbit
+        bool preliminary{ false };  // plot is a coarse placeholder
+    };
+
+    void startJob(const Orbit* orbit, Path& path, double startTime, double endTime);
+    void finishJob(Path& path);
+    void trim(uint32_t frame);
+    void erase(const Orbit* orbit);
+
+    std::map<const Orbit*, Path> paths;
+    size_t memoryBudget{ 0 };
+    size_t pendingJobs{ 0 };
+    uint32_t lastTrimFrame{ ~0u };
+
+    size_t bytes{ 0 };
+    uint64_t samplesGenerated{ 0 };
+    double samplingTime{ 0.0 };
+    uint64_t evictions{ 0 };
+
+    // All caches, for forget()
+    static std::mutex cachesMutex;
+    static std::vector<OrbitPathCache*> caches;
+};
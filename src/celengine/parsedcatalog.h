@@ -0,0 +1,50 @@
+// parsedcatalog.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Object definitions read from a catalog file, before they are added to
+// a database.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <celengine/astroobj.h>
+#include <celengine/parseobject.h>
+
+/*! An object definition from a .stc, .dsc or .ssc file: the disposition,
+ *  type, catalog number and names preceding the property list, and the
+ *  property list itself. Fields a catalog format doesn't have keep their
+ *  default values.
+ */
+struct CatalogDefinition
+{
+    DataDisposition disposition{ DataDisposition::Add };
+    std::string type;
+    AstroCatalog::IndexNumber catalogNumber{ AstroCatalog::InvalidIndex };
+    std::string name;
+    std::string parentName;
+    std::unique_ptr<Value> value;
+    // Line at the end of the definition, for error messages
+    int line{ 0 };
+
+    Hash* getData() const { return value->getHash(); }
+};
+
+/*! The definitions of a catalog file in file order. Parsing a file needs
+ *  no database, so it may be done on any thread; the definitions are then
+ *  added to the database on the loading thread.
+ */
+struct ParsedCatalog
+{
+    std::vector<CatalogDefinition> definitions;
+    // Message of the syntax error that ended parsing, if any. The
+    // definitions before the error are still loaded.
+    std::string error;
+};
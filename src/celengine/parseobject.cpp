@@ -16,6 +16,7 @@
 #include "trajmanager.h"
 #include "rotationmanager.h"
 #include "universe.h"
+#include <celephem/chebyshevorbit.h>
 #include <celephem/customorbit.h>
 #include <celephem/customrotation.h>
 #ifdef USE_SPICE
@@ -667,6 +668,23 @@ CreateScriptedOrbit(Hash* orbitData,
 }
 
 
+/*! Replace an expensive orbit with Chebyshev fits when an error tolerance
+ *  (in km) is given, either for the object with OrbitCacheTolerance or for
+ *  all objects in the configuration file. Fits of orbits with a cache key
+ *  are kept on disk.
+ */
+static Orbit*
+CacheOrbit(Orbit* orbit, Hash* planetData, const string& cacheKey)
+{
+    double tolerance = ChebyshevOrbitCache::getDefaultTolerance();
+    planetData->getLength("OrbitCacheTolerance", tolerance);
+    if (tolerance <= 0.0 || orbit->isChebyshevApproximation())
+        return orbit;
+
+    return new ChebyshevOrbitCache(unique_ptr<Orbit>(orbit), tolerance, cacheKey);
+}
+
+
 Orbit*
 CreateOrbit(const Selection& centralObject,
             Hash* planetData,
@@ -680,9 +698,7 @@ CreateOrbit(const Selection& centralObject,
     {
         orbit = GetCustomOrbit(customOrbitName);
         if (orbit != nullptr)
-        {
-            return orbit;
-        }
+            return CacheOrbit(orbit, planetData, "CustomOrbit " + customOrbitName);
         clog << "Could not find custom orbit named '" << customOrbitName <<
             "'\n";
     }
@@ -719,9 +735,10 @@ CreateOrbit(const Selection& centralObject,
             return nullptr;
         }
 
+        // Scripts may change between runs, so their fits aren't saved
         orbit = CreateScriptedOrbit(scriptedOrbitValue->getHash(), path);
         if (orbit != nullptr)
-            return orbit;
+            return CacheOrbit(orbit, planetData, string());
     }
 
     // New 1.5.0 style for sampled trajectories. Permits specification of
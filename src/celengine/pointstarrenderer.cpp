@@ -55,6 +55,18 @@ void PointStarRenderer::process(const Star& star, float distance, float appMag)
     // cost of a normalize per star.
     if (relPos.dot(viewNormal) > 0.0f || relPos.x() * relPos.x() < 0.1f || hasOrbit)
     {
+        // Stars near the observer need the orbit of the star evaluated, go
+        // to the render list or get labelled; none of that is safe outside
+        // the main thread, so leave them to submit(). They are few.
+        if (deferOutput &&
+            (distance < 1.0f || distance <= SolarSystemMaxDistance ||
+             (hasOrbit && orbitalRadius / (distance * pixelSize) > 1.0f)))
+        {
+            deferred.push_back({ DeferredOutput::NearbyStar, relPos, Color(), appMag, distance, &star });
+            nProcessed--;
+            return;
+        }
+
 #ifdef HDR_COMPRESS
         Color starColorFull = colorTemp->lookupColor(star.getTemperature());
         Color starColor(starColorFull.red()   * 0.5f,
@@ -108,9 +120,11 @@ void PointStarRenderer::process(const Star& star, float distance, float appMag)
                 float distr = 3.5f * (labelThresholdMag - appMag)/labelThresholdMag;
                 if (distr > 1.0f)
                     distr = 1.0f;
-                renderer->addBackgroundAnnotation(nullptr, starDB->getStarName(star, true),
-                                                  Color(Renderer::StarLabelColor, distr * Renderer::StarLabelColor.alpha()),
-                                                  relPos);
+                Color labelColor(Renderer::StarLabelColor, distr * Renderer::StarLabelColor.alpha());
+                if (deferOutput)
+                    deferred.push_back({ DeferredOutput::Label, relPos, labelColor, 0.0f, distance, &star });
+                else
+                    renderer->addBackgroundAnnotation(nullptr, starDB->getStarName(star, true), labelColor, relPos);
                 nLabelled++;
             }
         }
@@ -151,11 +165,11 @@ void PointStarRenderer::process(const Star& star, float distance, float appMag)
                     discSize *= discScale;
 
                     float glareAlpha = min(0.5f, discScale / 4.0f);
-                    glareVertexBuffer->addStar(relPos, Color(starColor, glareAlpha), discSize * 3.0f);
+                    addGlareVertex(relPos, Color(starColor, glareAlpha), discSize * 3.0f);
 
                     alpha = 1.0f;
                 }
-                starVertexBuffer->addStar(relPos, Color(starColor, alpha), discSize);
+                addStarVertex(relPos, Color(starColor, alpha), discSize);
             }
             else
             {
@@ -167,12 +181,12 @@ void PointStarRenderer::process(const Star& star, float distance, float appMag)
                 {
                     float discScale = min(100.0f, satPoint - appMag + 2.0f);
                     float glareAlpha = min(GlareOpacity, (discScale - 2.0f) / 4.0f);
-                    glareVertexBuffer->addStar(relPos, Color(starColor, glareAlpha), 2.0f * discScale * size);
+                    addGlareVertex(relPos, Color(starColor, glareAlpha), 2.0f * discScale * size);
 #ifdef DEBUG_HDR_ADAPT
                     maxSize = max(maxSize, 2.0f * discScale * size);
 #endif
                 }
-                starVertexBuffer->addStar(relPos, Color(starColor, alpha), size);
+                addStarVertex(relPos, Color(starColor, alpha), size);
             }
 
             ++nRendered;
@@ -201,3 +215,57 @@ void PointStarRenderer::process(const Star& star, float distance, float appMag)
         }
     }
 }
+
+void PointStarRenderer::submit(const PointStarRenderer& part)
+{
+    for (const auto& item : part.deferred)
+    {
+        switch (item.kind)
+        {
+        case DeferredOutput::StarVertex:
+            starVertexBuffer->addStar(item.position, item.color, item.size);
+            break;
+        case DeferredOutput::GlareVertex:
+            glareVertexBuffer->addStar(item.position, item.color, item.size);
+            break;
+        case DeferredOutput::Label:
+            renderer->addBackgroundAnnotation(nullptr, starDB->getStarName(*item.star, true),
+                                              item.color, item.position);
+            break;
+        case DeferredOutput::NearbyStar:
+            process(*item.star, item.distance, item.size);
+            break;
+        }
+    }
+
+    nRendered  += part.nRendered;
+    nClose     += part.nClose;
+    nBright    += part.nBright;
+    nProcessed += part.nProcessed;
+    nLabelled  += part.nLabelled;
+#ifdef DEBUG_HDR_ADAPT
+    minMag      = max(minMag, part.minMag);
+    maxMag      = min(maxMag, part.maxMag);
+    minAlpha    = min(minAlpha, part.minAlpha);
+    maxAlpha    = max(maxAlpha, part.maxAlpha);
+    maxSize     = max(maxSize, part.maxSize);
+    countAboveN += part.countAboveN;
+    total       += part.total;
+#endif
+}
+
+void PointStarRenderer::addStarVertex(const Vector3f& pos, const Color& color, float size)
+{
+    if (deferOutput)
+        deferred.push_back({ DeferredOutput::StarVertex, pos, color, size, 0.0f, nullptr });
+    else
+        starVertexBuffer->addStar(pos, color, size);
+}
+
+void PointStarRenderer::addGlareVertex(const Vector3f& pos, const Color& color, float size)
+{
+    if (deferOutput)
+        deferred.push_back({ DeferredOutput::GlareVertex, pos, color, size, 0.0f, nullptr });
+    else
+        glareVertexBuffer->addStar(pos, color, size);
+}
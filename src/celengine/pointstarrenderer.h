@@ -12,6 +12,7 @@
 
 #include <Eigen/Core>
 #include <vector>
+#include <celutil/color.h>
 #include "objectrenderer.h"
 #include "renderlistentry.h"
 
@@ -42,6 +43,10 @@ class PointStarRenderer : public ObjectRenderer<Star, float>
     PointStarRenderer();
     void process(const Star &star, float distance, float appMag);
 
+    // Pass the output recorded by a deferred renderer on to the vertex
+    // buffers, annotations and render list, and add up its counters.
+    void submit(const PointStarRenderer& part);
+
     Eigen::Vector3d obsPos;
     std::vector<RenderListEntry>* renderList    { nullptr };
     PointStarVertexBuffer* starVertexBuffer     { nullptr };
@@ -62,4 +67,31 @@ class PointStarRenderer : public ObjectRenderer<Star, float>
     unsigned long total                         { 0 };
 #endif
     bool  useScaledDiscs                        { false };
+    // Record the output instead of drawing it, so that the renderer can
+    // run outside the main thread; see submit().
+    bool  deferOutput                           { false };
+
+ private:
+    struct DeferredOutput
+    {
+        enum Kind
+        {
+            StarVertex,
+            GlareVertex,
+            Label,
+            NearbyStar, // processed again by submit()
+        };
+
+        Kind            kind;
+        Eigen::Vector3f position;
+        Color           color;
+        float           size;      // vertex size or apparent magnitude
+        float           distance;
+        const Star*     star;
+    };
+
+    void addStarVertex(const Eigen::Vector3f& pos, const Color& color, float size);
+    void addGlareVertex(const Eigen::Vector3f& pos, const Color& color, float size);
+
+    std::vector<DeferredOutput> deferred;
 };
@@ -37,6 +37,7 @@ std::ofstream hdrlog;
 #include "render.h"
 #include "boundaries.h"
 #include "dsorenderer.h"
+#include "galaxy.h"
 #include "asterism.h"
 #include "astro.h"
 #include "vecgl.h"
@@ -65,6 +66,7 @@ std::ofstream hdrlog;
 #include "boundariesrenderer.h"
 #include "rendcontext.h"
 #include "vertexobject.h"
+#include "virtualtex.h"
 #include <celengine/observer.h>
 #include <celmath/frustum.h>
 #include <celmath/distance.h>
@@ -74,6 +76,7 @@ std::ofstream hdrlog;
 #include <celutil/utf8.h>
 #include <celutil/util.h>
 #include <celutil/timer.h>
+#include <celutil/threadpool.h>
 #include <celttf/truetypefont.h>
 #include "glsupport.h"
 #include <algorithm>
@@ -156,10 +159,11 @@ static const int MaxSkyRings = 32;
 static const int MaxSkySlices = 180;
 static const int MinSkySlices = 30;
 
-// Size at which the orbit cache will be flushed of old orbit paths
-static const unsigned int OrbitCacheCullThreshold = 200;
-// Age in frames at which unused orbit paths may be eliminated from the cache
-static const uint32_t OrbitCacheRetireAge = 16;
+// Frame trees with fewer children are traversed on one thread when
+// building render lists; larger ones are split in tasks of this many
+// children.
+static const unsigned int ParallelRenderListThreshold = 512;
+static const size_t RenderListChildrenPerTask = 256;
 
 Color Renderer::StarLabelColor          (0.471f, 0.356f, 0.682f);
 Color Renderer::PlanetLabelColor        (0.407f, 0.333f, 0.964f);
@@ -259,7 +263,6 @@ Renderer::Renderer() :
     glareVertexBuffer(nullptr),
     textureResolution(medres),
     frameCount(0),
-    lastOrbitCacheFlush(0),
     minOrbitSize(MinOrbitSizeForLabel),
     distanceLimit(1.0e6f),
     minFeatureSize(MinFeatureSizeForLabel),
@@ -343,7 +346,8 @@ Renderer::DetailOptions::DetailOptions() :
     eclipseTextureSize(128),
     orbitWindowEnd(0.5),
     orbitPeriodsShown(1.0),
-    linearFadeFraction(0.0)
+    linearFadeFraction(0.0),
+    orbitPathCacheMemory(64 << 20)
 {
 }
 
@@ -583,6 +587,7 @@ bool Renderer::init(
     context = _context;
 #endif
     detailOptions = _detailOptions;
+    orbitCache.setMemoryBudget(detailOptions.orbitPathCacheMemory);
 
     // Initialize static meshes and textures common to all instances of Renderer
     if (!commonDataInitialized)
@@ -1106,84 +1111,6 @@ void Renderer::renderOrbit(const OrbitPathListEntry& orbitPath,
     else
         orbit = orbitPath.star->getOrbit();
 
-    CurvePlot* cachedOrbit = nullptr;
-    OrbitCache::iterator cached = orbitCache.find(orbit);
-    if (cached != orbitCache.end())
-    {
-        cachedOrbit = cached->second;
-        cachedOrbit->setLastUsed(frameCount);
-    }
-
-    // If it's not in the cache already
-    if (cachedOrbit == nullptr)
-    {
-        double startTime = t;
-        int nSamples = detailOptions.orbitPathSamplePoints;
-
-        // Adjust the number of samples used for aperiodic orbits--these aren't
-        // true orbits, but are sampled trajectories, generally of spacecraft.
-        // Better control is really needed--some sort of adaptive sampling would
-        // be ideal.
-        if (!orbit->isPeriodic())
-        {
-            double begin = 0.0, end = 0.0;
-            orbit->getValidRange(begin, end);
-
-            if (begin != end)
-            {
-                startTime = begin;
-                nSamples = (int) (orbit->getPeriod() * 100.0);
-                nSamples = max(min(nSamples, 1000), 100);
-            }
-            else
-            {
-                // If the orbit is aperiodic and doesn't have a
-                // finite duration, we don't render it. A compromise
-                // would be to pick some time window centered at the
-                // current time, but we'd have to pick some arbitrary
-                // duration.
-                nSamples = 0;
-            }
-        }
-        else
-        {
-            startTime = t - orbit->getPeriod();
-        }
-
-        cachedOrbit = new CurvePlot();
-        cachedOrbit->setLastUsed(frameCount);
-
-        OrbitSampler sampler;
-        orbit->sample(startTime,
-                      startTime + orbit->getPeriod(),
-                      sampler);
-        sampler.insertForward(cachedOrbit);
-
-        // If the orbit cache is full, first try and eliminate some old orbits
-        if (orbitCache.size() > OrbitCacheCullThreshold)
-        {
-            // Check for old orbits at most once per frame
-            if (lastOrbitCacheFlush != frameCount)
-            {
-                for (auto iter = orbitCache.begin(); iter != orbitCache.end();)
-                {
-                    // Tricky code to eliminate a node in the orbit cache without screwing
-                    // up the iterator. Should work in all STL implementations.
-                    if (frameCount - iter->second->lastUsed() > OrbitCacheRetireAge)
-                        orbitCache.erase(iter++);
-                    else
-                        ++iter;
-                }
-                lastOrbitCacheFlush = frameCount;
-            }
-        }
-
-        orbitCache[orbit] = cachedOrbit;
-    }
-
-    if (cachedOrbit->empty())
-        return;
-
     //*** Orbit rendering parameters
 
     // The 'window' is the interval of time for which the orbit will be drawn.
@@ -1208,10 +1135,40 @@ void Renderer::renderOrbit(const OrbitPathListEntry& orbitPath,
 
     //***
 
+    // Time range sampled when the orbit isn't in the cache yet. Periodic
+    // orbits get the window with its slack; aperiodic orbits, which aren't
+    // true orbits but are sampled trajectories, generally of spacecraft,
+    // are sampled over their whole valid range.
+    double sampleStart = t;
+    double sampleEnd;
+    if (orbit->isPeriodic())
+    {
+        double period = orbit->getPeriod();
+        sampleEnd = t + period * (OrbitWindowEnd + WindowSlack);
+        sampleStart = sampleEnd - period * (OrbitPeriodsShown + 2.0 * WindowSlack);
+    }
+    else
+    {
+        double begin = 0.0, end = 0.0;
+        orbit->getValidRange(begin, end);
+        if (begin != end)
+            sampleStart = begin;
+        sampleEnd = sampleStart + orbit->getPeriod();
+    }
+
+    // Orbits are sampled in the background when possible; meanwhile the
+    // cache returns a coarse or the previous path, or nothing.
+    bool preliminary = false;
+    CurvePlot* cachedOrbit = orbitCache.getPath(orbit, sampleStart, sampleEnd,
+                                                frameCount, preliminary);
+    if (cachedOrbit == nullptr || cachedOrbit->empty())
+        return;
+
     // 'Periodic' orbits are generally not strictly periodic because of perturbations
     // from other bodies. Here we update the trajectory samples to make sure that the
     // orbit covers a time range centered at the current time and covering a full revolution.
-    if (orbit->isPeriodic())
+    // The coarse paths are replaced rather than extended.
+    if (orbit->isPeriodic() && !preliminary)
     {
         double period = orbit->getPeriod();
         double endTime = t + period * OrbitWindowEnd;
@@ -1562,6 +1519,7 @@ void Renderer::draw(const Observer& observer,
 
     frameCount++;
     settingsChanged = false;
+    VirtualTexture::beginFrame();
 
     // Compute the size of a pixel
     setFieldOfView(radToDeg(observer.getFOV()));
@@ -1785,6 +1743,10 @@ void Renderer::draw(const Observer& observer,
     setBlendingFactors(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     disableBlending();
     enableDepthMask();
+
+    // The snapshot is only valid for the frame; body queries made between
+    // frames evaluate the orbits again.
+    BodyStateSnapshot::setCurrent(nullptr);
 }
 
 void renderPoint(const Renderer &renderer,
@@ -3853,7 +3815,8 @@ static bool isBodyVisible(const Body* body, int bodyVisibilityMask)
 
 void Renderer::addRenderListEntries(RenderListEntry& rle,
                                     Body& body,
-                                    bool isLabeled)
+                                    bool isLabeled,
+                                    vector<RenderListEntry>& entries)
 {
     bool visibleAsPoint = rle.appMag < faintestPlanetMag && body.isVisibleAsPoint();
 
@@ -3861,21 +3824,10 @@ void Renderer::addRenderListEntries(RenderListEntry& rle,
     {
         rle.renderableType = RenderListEntry::RenderableBody;
         rle.body = &body;
-
-        if (body.getGeometry() != InvalidResource && rle.discSizeInPixels > 1)
-        {
-            Geometry* geometry = GetGeometryManager()->find(body.getGeometry());
-            if (geometry == nullptr)
-                rle.isOpaque = true;
-            else
-                rle.isOpaque = geometry->isOpaque();
-        }
-        else
-        {
-            rle.isOpaque = true;
-        }
+        // Updated from the geometry by resolveRenderListOpacity()
+        rle.isOpaque = true;
         rle.radius = body.getRadius();
-        renderList.push_back(rle);
+        entries.push_back(rle);
     }
 
     if (body.getClassification() == Body::Comet && (renderFlags & ShowCometTails) != 0)
@@ -3889,7 +3841,7 @@ void Renderer::addRenderListEntries(RenderListEntry& rle,
             rle.isOpaque = false;
             rle.radius = radius;
             rle.discSizeInPixels = discSize;
-            renderList.push_back(rle);
+            entries.push_back(rle);
         }
     }
 
@@ -3902,7 +3854,26 @@ void Renderer::addRenderListEntries(RenderListEntry& rle,
             rle.refMark = rm;
             rle.isOpaque = rm->isOpaque();
             rle.radius = rm->boundingSphereRadius();
-            renderList.push_back(rle);
+            entries.push_back(rle);
+        }
+    }
+}
+
+
+// Bodies with models are opaque unless the model isn't. Models are found
+// here rather than while building the lists on the worker threads, since
+// finding one may load it.
+void Renderer::resolveRenderListOpacity(size_t first)
+{
+    for (size_t i = first; i < renderList.size(); i++)
+    {
+        RenderListEntry& rle = renderList[i];
+        if (rle.renderableType == RenderListEntry::RenderableBody &&
+            rle.body->getGeometry() != InvalidResource &&
+            rle.discSizeInPixels > 1)
+        {
+            Geometry* geometry = GetGeometryManager()->find(rle.body->getGeometry());
+            rle.isOpaque = geometry == nullptr || geometry->isOpaque();
         }
     }
 }
@@ -3914,7 +3885,8 @@ void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
                                 const Vector3d& frameCenter,
                                 const FrameTree* tree,
                                 const Observer& observer,
-                                double now)
+                                double now,
+                                RenderListPart& part)
 {
     int labelClassMask = translateLabelModeToClassMask(labelMode);
 
@@ -3923,14 +3895,13 @@ void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
     double invCosViewAngle = 1.0 / cosViewConeAngle;
     double sinViewAngle = sqrt(1.0 - square(cosViewConeAngle));
 
-    unsigned int nChildren = tree != nullptr ? tree->childCount() : 0;
-    for (unsigned int i = 0; i < nChildren; i++)
+    auto processChild = [&](unsigned int i, RenderListPart& out)
     {
         auto phase = tree->getChild(i);
 
         // No need to do anything if the phase isn't active now
         if (!phase->includes(now))
-            continue;
+            return;
 
         Body* body = phase->body();
 
@@ -3938,9 +3909,18 @@ void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
         // pos_v: viewer-relative position of object
 
         // Get the position of the body relative to the sun.
-        Vector3d p = phase->orbit()->positionAtTime(now);
-        auto frame = phase->orbitFrame();
-        Vector3d pos_s = frameCenter + frame->getOrientation(now).conjugate() * p;
+        Vector3d pos_s;
+        auto state = bodyStates.lookup(body, now, BodyStateSnapshot::PositionQuery);
+        if (state != nullptr)
+        {
+            pos_s = state->astrocentricPosition;
+        }
+        else
+        {
+            Vector3d p = phase->orbit()->positionAtTime(now);
+            auto frame = phase->orbitFrame();
+            pos_s = frameCenter + frame->getOrientation(now).conjugate() * p;
+        }
 
         // We now have the positions of the observer and the planet relative
         // to the sun.  From these, compute the position of the body
@@ -3980,7 +3960,7 @@ void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
                         illum.body = body;
                         illum.position_v = pos_v;
                         illum.radius = body->getRadius();
-                        secondaryIlluminators.push_back(illum);
+                        out.illuminators.push_back(illum);
                     }
                 }
                 else
@@ -4043,7 +4023,7 @@ void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
                 // defined relative to the SSB.)
                 rle.sun = -pos_s.cast<float>();
 
-                addRenderListEntries(rle, *body, isLabeled);
+                addRenderListEntries(rle, *body, isLabeled, out.entries);
             }
         }
 
@@ -4127,12 +4107,44 @@ void Renderer::buildRenderLists(const Vector3d& astrocentricObserverPos,
                                  pos_s,
                                  subtree,
                                  observer,
-                                 now);
+                                 now,
+                                 out);
             }
         } // end subtree traverse
+    };
+
+    unsigned int nChildren = tree != nullptr ? tree->childCount() : 0;
+
+    // Children are only handled on several threads when there are many,
+    // and when their positions come from the snapshot; evaluating orbits
+    // and frames isn't thread safe.
+    ThreadPool& pool = ThreadPool::global();
+    if (nChildren < ParallelRenderListThreshold || pool.size() == 0 ||
+        BodyStateSnapshot::getCurrent() != &bodyStates || bodyStates.getTime() != now)
+    {
+        for (unsigned int i = 0; i < nChildren; i++)
+            processChild(i, part);
+        return;
     }
-}
 
+    // Each task handles a contiguous range of children, subtrees included,
+    // and fills its own part. Appending the parts in order gives the same
+    // lists as the serial traversal.
+    size_t nTasks = (nChildren + RenderListChildrenPerTask - 1) / RenderListChildrenPerTask;
+    vector<RenderListPart> parts(nTasks);
+    pool.parallelFor(nTasks, [&](size_t task)
+    {
+        auto end = (unsigned int) min((size_t) nChildren, (task + 1) * RenderListChildrenPerTask);
+        for (auto i = (unsigned int) (task * RenderListChildrenPerTask); i < end; i++)
+            processChild(i, parts[task]);
+    });
+
+    for (const auto& p : parts)
+    {
+        part.entries.insert(part.entries.end(), p.entries.begin(), p.entries.end());
+        part.illuminators.insert(part.illuminators.end(), p.illuminators.begin(), p.illuminators.end());
+    }
+}
 
 void Renderer::buildOrbitLists(const Vector3d& astrocentricObserverPos,
                                const Quaterniond& observerOrientation,
@@ -4511,17 +4523,41 @@ void Renderer::renderPointStars(const StarDatabase& starDB,
     m_starProcStats.nodes = 0;
     m_starProcStats.height = 0;
     m_starProcStats.objects = 0;
-#endif
     starDB.findVisibleStars(starRenderer,
                             obsPos.cast<float>(),
                             observer.getOrientationf(),
                             degToRad(fov),
                             getAspectRatio(),
                             faintestMagNight,
-#ifdef OCTREE_DEBUG
                             &m_starProcStats);
 #else
-                            nullptr);
+    ThreadPool& pool = ThreadPool::global();
+    if (pool.size() > 0)
+    {
+        // Traverse the octree on all threads, then hand the vertices and
+        // labels over to the GL buffers here, in traversal order.
+        PointStarRenderer prototype = starRenderer;
+        prototype.deferOutput = true;
+
+        vector<PointStarRenderer> parts;
+        starDB.findVisibleStars(pool, parts, prototype,
+                                obsPos.cast<float>(),
+                                observer.getOrientationf(),
+                                degToRad(fov),
+                                getAspectRatio(),
+                                faintestMagNight);
+        for (const auto& part : parts)
+            starRenderer.submit(part);
+    }
+    else
+    {
+        starDB.findVisibleStars(starRenderer,
+                                obsPos.cast<float>(),
+                                observer.getOrientationf(),
+                                degToRad(fov),
+                                getAspectRatio(),
+                                faintestMagNight);
+    }
 #endif
 
     starRenderer.starVertexBuffer->render();
@@ -4609,6 +4645,9 @@ void Renderer::renderDeepSkyObjects(const Universe& universe,
                             nullptr);
 #endif
 
+    // Galaxies drawn with instancing are batched by form
+    Galaxy::renderInstances(this);
+
     // clog << "DSOs processed: " << dsoRenderer.dsosProcessed << endl;
 
     disableSmoothLines();
@@ -5108,7 +5147,19 @@ void Renderer::loadTextures(Body* body)
 
 void Renderer::invalidateOrbitCache()
 {
-    orbitCache.clear();
+    orbitCache.invalidate();
+}
+
+
+OrbitPathCache::Stats Renderer::getOrbitCacheStats() const
+{
+    return orbitCache.getStats();
+}
+
+
+const BodyStateSnapshot::Stats& Renderer::getBodyStateStats() const
+{
+    return bodyStates.getPreviousStats();
 }
 
 
@@ -5779,6 +5830,21 @@ Renderer::buildNearSystemsLists(const Universe &universe,
     if ((renderFlags & ShowSolarSystemObjects) != 0)
         setupLightSources(nearStars, observerPos, now, lightSourceList, renderFlags);
 
+    // Evaluate the bodies of the nearby solar systems once for the whole
+    // frame; Body queries at this time become lookups.
+    BodyStateSnapshot::setCurrent(nullptr);
+    bodyStates.begin(now);
+    if ((renderFlags & ShowSolarSystemObjects) != 0)
+    {
+        for (const auto sun : nearStars)
+        {
+            SolarSystem* solarSystem = universe.getSolarSystem(sun);
+            if (solarSystem != nullptr)
+                bodyStates.evaluate(solarSystem->getFrameTree(), sun->getPosition(now));
+        }
+    }
+    BodyStateSnapshot::setCurrent(&bodyStates);
+
     // Traverse the frame trees of each nearby solar system and
     // build the list of objects to be rendered.
     for (const auto sun : nearStars)
@@ -5807,9 +5873,15 @@ Renderer::buildNearSystemsLists(const Universe &universe,
         Vector3d astrocentricObserverPos = astrocentricPosition(observerPos, *sun, now);
 
         // Build render lists for bodies and orbits paths
+        RenderListPart part;
         buildRenderLists(astrocentricObserverPos, xfrustum,
                          observerOrient.conjugate() * -Vector3d::UnitZ(),
-                         Vector3d::Zero(), solarSysTree, observer, now);
+                         Vector3d::Zero(), solarSysTree, observer, now, part);
+        size_t first = renderList.size();
+        renderList.insert(renderList.end(), part.entries.begin(), part.entries.end());
+        secondaryIlluminators.insert(secondaryIlluminators.end(),
+                                     part.illuminators.begin(), part.illuminators.end());
+        resolveRenderListOpacity(first);
         if ((renderFlags & ShowOrbits) != 0)
         {
             buildOrbitLists(astrocentricObserverPos, observerOrient,
@@ -21,6 +21,8 @@
 #include <celengine/starcolors.h>
 #include <celengine/rendcontext.h>
 #include <celengine/renderlistentry.h>
+#include <celengine/orbitpathcache.h>
+#include <celengine/bodystate.h>
 #include "vertexobject.h"
 
 #ifdef USE_GLCONTEXT
@@ -98,6 +100,7 @@ class Renderer
         double orbitWindowEnd;
         double orbitPeriodsShown;
         double linearFadeFraction;
+        size_t orbitPathCacheMemory; // bytes, zero for no limit
     };
 
 #ifdef USE_GLCONTEXT
@@ -223,6 +226,7 @@ class Renderer
     enum class PixelFormat
     {
         RGB = GL_RGB,
+        RGBA = GL_RGBA,
 #ifndef GL_ES
         BGR_EXT = GL_BGR_EXT
 #endif
@@ -401,6 +405,10 @@ class Renderer
     void clearAnnotations(std::vector<Annotation>&);
 
     void invalidateOrbitCache();
+    OrbitPathCache::Stats getOrbitCacheStats() const;
+
+    // Evaluations made and avoided by the snapshot of the last frame
+    const BodyStateSnapshot::Stats& getBodyStateStats() const;
 
     struct OrbitPathListEntry
     {
@@ -537,13 +545,23 @@ class Renderer
                                const celmath::Frustum &xfrustum,
                                double jd);
 
+    // Render list entries and planetshine sources found in part of a frame
+    // tree. Parts built on different threads are appended in traversal
+    // order.
+    struct RenderListPart
+    {
+        std::vector<RenderListEntry> entries;
+        std::vector<SecondaryIlluminator> illuminators;
+    };
+
     void buildRenderLists(const Eigen::Vector3d& astrocentricObserverPos,
                           const celmath::Frustum& viewFrustum,
                           const Eigen::Vector3d& viewPlaneNormal,
                           const Eigen::Vector3d& frameCenter,
                           const FrameTree* tree,
                           const Observer& observer,
-                          double now);
+                          double now,
+                          RenderListPart& part);
     void buildOrbitLists(const Eigen::Vector3d& astrocentricObserverPos,
                          const Eigen::Quaterniond& observerOrientation,
                          const celmath::Frustum& viewFrustum,
@@ -556,7 +574,9 @@ class Renderer
 
     void addRenderListEntries(RenderListEntry& rle,
                               Body& body,
-                              bool isLabeled);
+                              bool isLabeled,
+                              std::vector<RenderListEntry>& entries);
+    void resolveRenderListOpacity(size_t first);
 
     void addStarOrbitToRenderList(const Star& star,
                                   const Observer& observer,
@@ -820,9 +840,8 @@ class Renderer
     State m_GLState { false, false, false, false, false };
 
  private:
-    typedef std::map<const Orbit*, CurvePlot*> OrbitCache;
-    OrbitCache orbitCache;
-    uint32_t lastOrbitCacheFlush;
+    OrbitPathCache orbitCache;
+    BodyStateSnapshot bodyStates;
 
     float minOrbitSize;
     float distanceLimit;
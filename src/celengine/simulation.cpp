@@ -18,6 +18,9 @@
 using namespace Eigen;
 using namespace std;
 
+// Completions offered from each star and DSO catalog; a short prefix can
+// match millions of catalog names.
+static const unsigned int MaxCatalogCompletions = 1000;
 
 Simulation::Simulation(Universe* _universe) :
     universe(_universe)
@@ -464,7 +467,8 @@ vector<std::string> Simulation::getObjectCompletion(string s, bool withLocations
         path[nPathEntries++] = Selection(closestSolarSystem->getStar());
     }
 
-    auto completion = universe->getCompletionPath(s, path, nPathEntries, withLocations);
+    auto completion = universe->getCompletionPath(s, path, nPathEntries, withLocations,
+                                                  MaxCatalogCompletions);
 
     sort(begin(completion), end(completion),
          [](const string &s1, const string &s2) { return strnatcmp(s1, s2) < 0; });
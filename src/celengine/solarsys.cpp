@@ -75,18 +75,24 @@ enum BodyType
   The name and parent name are both mandatory.
 */
 
-static void errorMessagePrelude(const Tokenizer& tok)
+static void errorMessagePrelude(int line)
 {
-    fmt::fprintf(cerr,_("Error in .ssc file (line %d): "), tok.getLineNumber());
+    fmt::fprintf(cerr,_("Error in .ssc file (line %d): "), line);
 }
 
-static void sscError(const Tokenizer& tok,
+static void sscError(int line,
                      const string& msg)
 {
-    errorMessagePrelude(tok);
+    errorMessagePrelude(line);
     cerr << msg << '\n';
 }
 
+static string sscErrorMessage(const Tokenizer& tok,
+                              const string& msg)
+{
+    return fmt::sprintf(_("Error in .ssc file (line %d): "), tok.getLineNumber()) + msg + '\n';
+}
+
 
 // Object class properties
 static const int CLASSES_UNCLICKABLE           = Body::Invisible |
@@ -1088,76 +1094,111 @@ bool LoadSolarSystemObjects(istream& in,
                             const fs::path& directory)
 {
     Tokenizer tokenizer(&in);
-    Parser parser(&tokenizer);
+    return LoadSolarSystemObjects(tokenizer, universe, directory);
+}
 
-#ifdef ENABLE_NLS
-    string s = directory.string();
-    const char* d = s.c_str();
-    bindtextdomain(d, d); // domain name is the same as resource path
-#endif
+
+bool LoadSolarSystemObjects(Tokenizer& tokenizer,
+                            Universe& universe,
+                            const fs::path& directory)
+{
+    ParsedCatalog catalog;
+    ParseSolarSystemObjects(tokenizer, catalog);
+    return LoadSolarSystemObjects(catalog, universe, directory);
+}
+
+
+bool ParseSolarSystemObjects(Tokenizer& tokenizer, ParsedCatalog& catalog)
+{
+    Parser parser(&tokenizer);
 
     while (tokenizer.nextToken() != Tokenizer::TokenEnd)
     {
+        CatalogDefinition def;
+
         // Read the disposition; if none is specified, the default is Add.
-        DataDisposition disposition = DataDisposition::Add;
         if (tokenizer.getTokenType() == Tokenizer::TokenName)
         {
             if (tokenizer.getNameValue() == "Add")
             {
-                disposition = DataDisposition::Add;
+                def.disposition = DataDisposition::Add;
                 tokenizer.nextToken();
             }
             else if (tokenizer.getNameValue() == "Replace")
             {
-                disposition = DataDisposition::Replace;
+                def.disposition = DataDisposition::Replace;
                 tokenizer.nextToken();
             }
             else if (tokenizer.getNameValue() == "Modify")
             {
-                disposition = DataDisposition::Modify;
+                def.disposition = DataDisposition::Modify;
                 tokenizer.nextToken();
             }
         }
 
         // Read the item type; if none is specified the default is Body
-        string itemType("Body");
+        def.type = "Body";
         if (tokenizer.getTokenType() == Tokenizer::TokenName)
         {
-            itemType = tokenizer.getNameValue();
+            def.type = tokenizer.getNameValue();
             tokenizer.nextToken();
         }
 
         if (tokenizer.getTokenType() != Tokenizer::TokenString)
         {
-            sscError(tokenizer, "object name expected");
+            catalog.error = sscErrorMessage(tokenizer, "object name expected");
             return false;
         }
 
         // The name list is a string with zero more names. Multiple names are
         // delimited by colons.
-        string nameList = tokenizer.getStringValue().c_str();
+        def.name = tokenizer.getStringValue();
 
         if (tokenizer.nextToken() != Tokenizer::TokenString)
         {
-            sscError(tokenizer, "bad parent object name");
+            catalog.error = sscErrorMessage(tokenizer, "bad parent object name");
             return false;
         }
-        string parentName = tokenizer.getStringValue().c_str();
+        def.parentName = tokenizer.getStringValue();
 
-        Value* objectDataValue = parser.readValue();
-        if (objectDataValue == nullptr)
+        def.value.reset(parser.readValue());
+        if (def.value == nullptr)
         {
-            sscError(tokenizer, "bad object definition");
+            catalog.error = sscErrorMessage(tokenizer, "bad object definition");
             return false;
         }
 
-        if (objectDataValue->getType() != Value::HashType)
+        if (def.value->getType() != Value::HashType)
         {
-            sscError(tokenizer, "{ expected");
-            delete objectDataValue;
+            catalog.error = sscErrorMessage(tokenizer, "{ expected");
             return false;
         }
-        Hash* objectData = objectDataValue->getHash();
+
+        def.line = tokenizer.getLineNumber();
+        catalog.definitions.push_back(move(def));
+    }
+
+    return true;
+}
+
+
+bool LoadSolarSystemObjects(const ParsedCatalog& catalog,
+                            Universe& universe,
+                            const fs::path& directory)
+{
+#ifdef ENABLE_NLS
+    string s = directory.string();
+    const char* d = s.c_str();
+    bindtextdomain(d, d); // domain name is the same as resource path
+#endif
+
+    for (const auto& def : catalog.definitions)
+    {
+        DataDisposition disposition = def.disposition;
+        const string& itemType = def.type;
+        const string& nameList = def.name;
+        const string& parentName = def.parentName;
+        Hash* objectData = def.getData();
 
         Selection parent = universe.findPath(parentName, nullptr, 0);
         PlanetarySystem* parentSystem = nullptr;
@@ -1224,7 +1265,7 @@ bool LoadSolarSystemObjects(istream& in,
             }
             else
             {
-                errorMessagePrelude(tokenizer);
+                errorMessagePrelude(def.line);
                 fmt::fprintf(cerr, _("parent body '%s' of '%s' not found.\n"), parentName, primaryName);
             }
 
@@ -1235,7 +1276,7 @@ bool LoadSolarSystemObjects(istream& in,
                 {
                     if (disposition == DataDisposition::Add)
                     {
-                        errorMessagePrelude(tokenizer);
+                        errorMessagePrelude(def.line);
                         fmt::fprintf(cerr, _("warning duplicate definition of %s %s\n"), parentName, primaryName);
                     }
                     else if (disposition == DataDisposition::Replace)
@@ -1267,7 +1308,7 @@ bool LoadSolarSystemObjects(istream& in,
             if (parent.body() != nullptr)
                 parent.body()->addAlternateSurface(primaryName, surface);
             else
-                sscError(tokenizer, _("bad alternate surface"));
+                sscError(def.line, _("bad alternate surface"));
         }
         else if (itemType == "Location")
         {
@@ -1282,19 +1323,23 @@ bool LoadSolarSystemObjects(istream& in,
                 }
                 else
                 {
-                    sscError(tokenizer, _("bad location"));
+                    sscError(def.line, _("bad location"));
                 }
             }
             else
             {
-                errorMessagePrelude(tokenizer);
+                errorMessagePrelude(def.line);
                 fmt::fprintf(cerr, _("parent body '%s' of '%s' not found.\n"), parentName, primaryName);
             }
         }
-        delete objectDataValue;
     }
 
-    // TODO: Return some notification if there's an error parsing the file
+    if (!catalog.error.empty())
+    {
+        cerr << catalog.error;
+        return false;
+    }
+
     return true;
 }
 
@@ -15,6 +15,7 @@
 #include <iostream>
 #include <celengine/body.h>
 #include <celengine/stardb.h>
+#include <celengine/parsedcatalog.h>
 
 class FrameTree;
 
@@ -37,11 +38,22 @@ class SolarSystem
 
 typedef std::map<uint32_t, SolarSystem*> SolarSystemCatalog;
 
+class Tokenizer;
 class Universe;
 
 bool LoadSolarSystemObjects(std::istream& in,
                             Universe& universe,
                             const fs::path& dir = fs::path());
+bool LoadSolarSystemObjects(Tokenizer& tokenizer,
+                            Universe& universe,
+                            const fs::path& dir = fs::path());
+
+// Read the object definitions of a solar system catalog without adding
+// them to the universe; LoadSolarSystemObjects() adds them in file order.
+bool ParseSolarSystemObjects(Tokenizer& tokenizer, ParsedCatalog& catalog);
+bool LoadSolarSystemObjects(const ParsedCatalog& catalog,
+                            Universe& universe,
+                            const fs::path& dir = fs::path());
 
 #endif // _SOLARSYS_H_
 
@@ -0,0 +1,264 @@
+// starcull.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Vectorized per-star culling for the star octree traversal.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <cstring>
+#include "starcull.h"
+
+// The instruction set is chosen at compile time: AVX2 when the compiler
+// targets it (e.g. -mavx2 or -march=native), otherwise SSE2, which every
+// x86-64 compiler enables, or NEON on ARM.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CULL_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULL_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CULL_NEON
+#endif
+
+
+size_t CullStarsScalar(const float* x,
+                       const float* y,
+                       const float* z,
+                       const float* absMag,
+                       size_t count,
+                       const StarCullParams& params,
+                       uint32_t* survivors,
+                       float* distancesSquared)
+{
+    size_t nSurvivors = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        float dx = params.obsPosition.x() - x[i];
+        float dy = params.obsPosition.y() - y[i];
+        float dz = params.obsPosition.z() - z[i];
+        float d2 = dx * dx + dy * dy + dz * dz;
+        if (absMag[i] < params.dimmest && d2 < params.maxDistanceSquared)
+        {
+            survivors[nSurvivors] = (uint32_t) i;
+            distancesSquared[nSurvivors] = d2;
+            nSurvivors++;
+        }
+    }
+
+    return nSurvivors;
+}
+
+
+#if defined(CULL_AVX2)
+
+size_t CullStars(const float* x,
+                 const float* y,
+                 const float* z,
+                 const float* absMag,
+                 size_t count,
+                 const StarCullParams& params,
+                 uint32_t* survivors,
+                 float* distancesSquared)
+{
+    const __m256 ox      = _mm256_set1_ps(params.obsPosition.x());
+    const __m256 oy      = _mm256_set1_ps(params.obsPosition.y());
+    const __m256 oz      = _mm256_set1_ps(params.obsPosition.z());
+    const __m256 dimmest = _mm256_set1_ps(params.dimmest);
+    const __m256 maxD2   = _mm256_set1_ps(params.maxDistanceSquared);
+
+    size_t nSurvivors = 0;
+    size_t i = 0;
+    alignas(32) float d2s[8];
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 dx = _mm256_sub_ps(ox, _mm256_loadu_ps(x + i));
+        __m256 dy = _mm256_sub_ps(oy, _mm256_loadu_ps(y + i));
+        __m256 dz = _mm256_sub_ps(oz, _mm256_loadu_ps(z + i));
+        __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                  _mm256_mul_ps(dz, dz));
+        __m256 mask = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(absMag + i), dimmest, _CMP_LT_OQ),
+                                    _mm256_cmp_ps(d2, maxD2, _CMP_LT_OQ));
+        int bits = _mm256_movemask_ps(mask);
+        if (bits == 0)
+            continue;
+
+        _mm256_store_ps(d2s, d2);
+        // Branchless compaction: always write, advance only on survivors
+        for (int lane = 0; lane < 8; lane++)
+        {
+            survivors[nSurvivors] = (uint32_t) (i + lane);
+            distancesSquared[nSurvivors] = d2s[lane];
+            nSurvivors += (bits >> lane) & 1;
+        }
+    }
+
+    size_t n = CullStarsScalar(x + i, y + i, z + i, absMag + i, count - i, params,
+                               survivors + nSurvivors, distancesSquared + nSurvivors);
+    for (size_t j = nSurvivors; j < nSurvivors + n; j++)
+        survivors[j] += (uint32_t) i;
+
+    return nSurvivors + n;
+}
+
+#elif defined(CULL_SSE2)
+
+size_t CullStars(const float* x,
+                 const float* y,
+                 const float* z,
+                 const float* absMag,
+                 size_t count,
+                 const StarCullParams& params,
+                 uint32_t* survivors,
+                 float* distancesSquared)
+{
+    const __m128 ox      = _mm_set1_ps(params.obsPosition.x());
+    const __m128 oy      = _mm_set1_ps(params.obsPosition.y());
+    const __m128 oz      = _mm_set1_ps(params.obsPosition.z());
+    const __m128 dimmest = _mm_set1_ps(params.dimmest);
+    const __m128 maxD2   = _mm_set1_ps(params.maxDistanceSquared);
+
+    size_t nSurvivors = 0;
+    size_t i = 0;
+    alignas(16) float d2s[4];
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 dx = _mm_sub_ps(ox, _mm_loadu_ps(x + i));
+        __m128 dy = _mm_sub_ps(oy, _mm_loadu_ps(y + i));
+        __m128 dz = _mm_sub_ps(oz, _mm_loadu_ps(z + i));
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                               _mm_mul_ps(dz, dz));
+        __m128 mask = _mm_and_ps(_mm_cmplt_ps(_mm_loadu_ps(absMag + i), dimmest),
+                                 _mm_cmplt_ps(d2, maxD2));
+        int bits = _mm_movemask_ps(mask);
+        if (bits == 0)
+            continue;
+
+        _mm_store_ps(d2s, d2);
+        // Branchless compaction: always write, advance only on survivors
+        for (int lane = 0; lane < 4; lane++)
+        {
+            survivors[nSurvivors] = (uint32_t) (i + lane);
+            distancesSquared[nSurvivors] = d2s[lane];
+            nSurvivors += (bits >> lane) & 1;
+        }
+    }
+
+    size_t n = CullStarsScalar(x + i, y + i, z + i, absMag + i, count - i, params,
+                               survivors + nSurvivors, distancesSquared + nSurvivors);
+    for (size_t j = nSurvivors; j < nSurvivors + n; j++)
+        survivors[j] += (uint32_t) i;
+
+    return nSurvivors + n;
+}
+
+#elif defined(CULL_NEON)
+
+size_t CullStars(const float* x,
+                 const float* y,
+                 const float* z,
+                 const float* absMag,
+                 size_t count,
+                 const StarCullParams& params,
+                 uint32_t* survivors,
+                 float* distancesSquared)
+{
+    const float32x4_t ox      = vdupq_n_f32(params.obsPosition.x());
+    const float32x4_t oy      = vdupq_n_f32(params.obsPosition.y());
+    const float32x4_t oz      = vdupq_n_f32(params.obsPosition.z());
+    const float32x4_t dimmest = vdupq_n_f32(params.dimmest);
+    const float32x4_t maxD2   = vdupq_n_f32(params.maxDistanceSquared);
+
+    size_t nSurvivors = 0;
+    size_t i = 0;
+    float d2s[4];
+    uint32_t lanes[4];
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t dx = vsubq_f32(ox, vld1q_f32(x + i));
+        float32x4_t dy = vsubq_f32(oy, vld1q_f32(y + i));
+        float32x4_t dz = vsubq_f32(oz, vld1q_f32(z + i));
+        float32x4_t d2 = vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)),
+                                   vmulq_f32(dz, dz));
+        uint32x4_t mask = vandq_u32(vcltq_f32(vld1q_f32(absMag + i), dimmest),
+                                    vcltq_f32(d2, maxD2));
+        // Skip the lane extraction when no star in the group survives
+        uint32x2_t any = vorr_u32(vget_low_u32(mask), vget_high_u32(mask));
+        if ((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) == 0)
+            continue;
+
+        vst1q_f32(d2s, d2);
+        vst1q_u32(lanes, mask);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            survivors[nSurvivors] = (uint32_t) (i + lane);
+            distancesSquared[nSurvivors] = d2s[lane];
+            nSurvivors += lanes[lane] & 1;
+        }
+    }
+
+    size_t n = CullStarsScalar(x + i, y + i, z + i, absMag + i, count - i, params,
+                               survivors + nSurvivors, distancesSquared + nSurvivors);
+    for (size_t j = nSurvivors; j < nSurvivors + n; j++)
+        survivors[j] += (uint32_t) i;
+
+    return nSurvivors + n;
+}
+
+#else
+
+size_t CullStars(const float* x,
+                 const float* y,
+                 const float* z,
+                 const float* absMag,
+                 size_t count,
+                 const StarCullParams& params,
+                 uint32_t* survivors,
+                 float* distancesSquared)
+{
+    return CullStarsScalar(x, y, z, absMag, count, params, survivors, distancesSquared);
+}
+
+#endif
+
+
+const char* CullStarsInstructionSet()
+{
+#if defined(CULL_AVX2)
+    return "AVX2";
+#elif defined(CULL_SSE2)
+    return "SSE2";
+#elif defined(CULL_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+
+float FastLog10(float x)
+{
+    // Split x into 2^e * m with m in [sqrt(1/2), sqrt(2)) without branching,
+    // then use ln(m) = 2 * (s + s^3/3 + s^5/5 + s^7/7 + ...) where
+    // s = (m-1)/(m+1); |s| < 0.172, so four terms suffice for single
+    // precision.
+    int32_t bits;
+    std::memcpy(&bits, &x, sizeof bits);
+    int32_t e = (bits - 0x3f3504f3) >> 23;
+    bits -= e << 23;
+    float m;
+    std::memcpy(&m, &bits, sizeof m);
+
+    float s  = (m - 1.0f) / (m + 1.0f);
+    float s2 = s * s;
+    float lnm = 2.0f * s * (1.0f + s2 * (1.0f / 3.0f + s2 * (1.0f / 5.0f + s2 * (1.0f / 7.0f))));
+
+    constexpr float log10_2 = 0.30102999566f;
+    constexpr float log10_e = 0.43429448190f;
+    return (float) e * log10_2 + lnm * log10_e;
+}
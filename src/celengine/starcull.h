@@ -0,0 +1,68 @@
+// starcull.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Vectorized per-star culling for the star octree traversal.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <Eigen/Core>
+
+// Parameters shared by all stars of one octree node.
+struct StarCullParams
+{
+    Eigen::Vector3f obsPosition;
+    // Stars at least this faint (absolute magnitude) can't be visible
+    // anywhere in the node.
+    float dimmest;
+    // Squared distance beyond which even the brightest star of the node
+    // is fainter than the limiting magnitude.
+    float maxDistanceSquared;
+};
+
+// Find the stars that pass the node's magnitude and distance thresholds.
+// The indices of the candidates and their squared distances from the
+// observer are written to survivors and distancesSquared, which must hold
+// count entries; the number of candidates is returned.
+size_t CullStars(const float* x,
+                 const float* y,
+                 const float* z,
+                 const float* absMag,
+                 size_t count,
+                 const StarCullParams& params,
+                 uint32_t* survivors,
+                 float* distancesSquared);
+
+// Plain C++ version of CullStars(), used for the tail of a batch and as
+// the reference for the vectorized versions.
+size_t CullStarsScalar(const float* x,
+                       const float* y,
+                       const float* z,
+                       const float* absMag,
+                       size_t count,
+                       const StarCullParams& params,
+                       uint32_t* survivors,
+                       float* distancesSquared);
+
+// Name of the instruction set CullStars() was compiled for
+const char* CullStarsInstructionSet();
+
+// Base 10 logarithm accurate to about 1e-7, cheaper than std::log10().
+// The argument must be positive and finite.
+float FastLog10(float x);
+
+// Apparent magnitude of a star from its squared distance in light years;
+// equivalent to astro::absToAppMag() without the square root.
+inline float AppMagFromDistanceSquared(float absMag, float distanceSquared)
+{
+    // 5 * log10(LY_PER_PARSEC)
+    constexpr float parsecTerm = 2.567284f;
+    return absMag - 5.0f + 2.5f * FastLog10(distanceSquared) - parsecTerm;
+}
@@ -14,6 +14,8 @@
 #include <cstdlib>
 #include <cassert>
 #include <algorithm>
+#include <cstddef>
+#include <fstream>
 #include <celmath/mathlib.h>
 #include <celutil/bytes.h>
 #include <celutil/debug.h>
@@ -56,6 +58,195 @@ constexpr const char FILE_HEADER[]            = "CELSTARS";
 constexpr const char CROSSINDEX_FILE_HEADER[] = "CELINDEX";
 
 
+// Pre-sorted octree star database, version 0x0300 of the CELSTARS format.
+// Everything is little endian. The file starts with a fixed size header,
+// followed by these sections, each starting at a multiple of
+// OCTREE_FILE_ALIGNMENT bytes so that the arrays can be used straight from
+// a memory mapping:
+//
+//   node table        nNodes x OctreeFileNode
+//   catalog numbers   nStars x uint32
+//   x, y, z           3 x nStars x float (light years)
+//   absolute mags     nStars x float
+//   spectral types    nStars x uint16, packed with StellarClass::packV2()
+//   catalog index     nStars x uint32, star indices sorted by catalog number
+//
+// Stars are stored in octree order: every node owns a contiguous range of
+// stars, and ranges are assigned in depth-first order (node, then children
+// 0..7), just as DynamicOctree::rebuildAndSort() lays them out. Node 0 is the
+// root; the children of a node are eight consecutive entries starting at
+// firstChild, which is zero for a leaf.
+constexpr const uint16_t OCTREE_FILE_VERSION  = 0x0300;
+constexpr const size_t OCTREE_FILE_ALIGNMENT  = 64;
+constexpr const unsigned int MAX_OCTREE_DEPTH = 64;
+
+struct OctreeFileHeader
+{
+    char     magic[8];
+    uint16_t version;
+    uint16_t flags;
+    uint32_t nStars;
+    uint32_t nNodes;
+    float    rootSize;
+    uint32_t reserved[2];
+};
+static_assert(sizeof(OctreeFileHeader) == 32, "Unexpected octree file header size");
+
+struct OctreeFileNode
+{
+    float    center[3];
+    float    exclusionFactor;
+    uint32_t firstStar;
+    uint32_t nStars;
+    uint32_t firstChild;
+    uint32_t reserved;
+};
+static_assert(sizeof(OctreeFileNode) == 32, "Unexpected octree file node size");
+
+struct OctreeFileLayout
+{
+    size_t nodes;
+    size_t catalogNumbers;
+    size_t x;
+    size_t y;
+    size_t z;
+    size_t absMag;
+    size_t spectralTypes;
+    size_t catalogIndex;
+    size_t total;
+
+    OctreeFileLayout(uint32_t nStars, uint32_t nNodes)
+    {
+        size_t offset = 0;
+        auto section = [&offset](size_t bytes)
+        {
+            offset = (offset + OCTREE_FILE_ALIGNMENT - 1) & ~(OCTREE_FILE_ALIGNMENT - 1);
+            size_t start = offset;
+            offset += bytes;
+            return start;
+        };
+
+        section(sizeof(OctreeFileHeader));
+        nodes          = section((size_t) nNodes * sizeof(OctreeFileNode));
+        catalogNumbers = section((size_t) nStars * sizeof(uint32_t));
+        x              = section((size_t) nStars * sizeof(float));
+        y              = section((size_t) nStars * sizeof(float));
+        z              = section((size_t) nStars * sizeof(float));
+        absMag         = section((size_t) nStars * sizeof(float));
+        spectralTypes  = section((size_t) nStars * sizeof(uint16_t));
+        catalogIndex   = section((size_t) nStars * sizeof(uint32_t));
+        total          = offset;
+    }
+};
+
+
+// Unaligned, endian-safe accessors for the mapped octree file
+static inline uint32_t mappedUint32(const char* base, size_t offset, size_t i = 0)
+{
+    uint32_t n;
+    memcpy(&n, base + offset + i * sizeof n, sizeof n);
+    LE_TO_CPU_INT32(n, n);
+    return n;
+}
+
+static inline uint16_t mappedUint16(const char* base, size_t offset, size_t i = 0)
+{
+    uint16_t n;
+    memcpy(&n, base + offset + i * sizeof n, sizeof n);
+    LE_TO_CPU_INT16(n, n);
+    return n;
+}
+
+static inline float mappedFloat(const char* base, size_t offset, size_t i = 0)
+{
+    float f;
+    memcpy(&f, base + offset + i * sizeof f, sizeof f);
+    LE_TO_CPU_FLOAT(f, f);
+    return f;
+}
+
+static OctreeFileNode mappedNode(const char* base, const OctreeFileLayout& layout, uint32_t i)
+{
+    size_t offset = layout.nodes + (size_t) i * sizeof(OctreeFileNode);
+    OctreeFileNode node;
+    node.center[0]       = mappedFloat(base, offset);
+    node.center[1]       = mappedFloat(base, offset + 4);
+    node.center[2]       = mappedFloat(base, offset + 8);
+    node.exclusionFactor = mappedFloat(base, offset + 12);
+    node.firstStar       = mappedUint32(base, offset + 16);
+    node.nStars          = mappedUint32(base, offset + 20);
+    node.firstChild      = mappedUint32(base, offset + 24);
+    node.reserved        = 0;
+    return node;
+}
+
+
+// Check that the node table describes a tree whose star ranges appear in
+// depth-first order and exactly cover the star arrays.
+static bool validateOctreeNode(const char* base,
+                               const OctreeFileLayout& layout,
+                               uint32_t nNodes,
+                               uint32_t index,
+                               unsigned int depth,
+                               uint32_t& nextStar,
+                               uint32_t nStars,
+                               vector<bool>& visited)
+{
+    if (index >= nNodes || visited[index] || depth > MAX_OCTREE_DEPTH)
+        return false;
+    visited[index] = true;
+
+    OctreeFileNode node = mappedNode(base, layout, index);
+    if (node.firstStar != nextStar || node.nStars > nStars - nextStar)
+        return false;
+    nextStar += node.nStars;
+
+    if (node.firstChild == 0)
+        return true;
+    if (node.firstChild <= index || node.firstChild > nNodes - 8)
+        return false;
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        if (!validateOctreeNode(base, layout, nNodes, node.firstChild + i, depth + 1,
+                                nextStar, nStars, visited))
+            return false;
+    }
+
+    return true;
+}
+
+
+static void writeUint(ostream& out, uint32_t n)
+{
+    LE_TO_CPU_INT32(n, n);
+    out.write(reinterpret_cast<char*>(&n), sizeof n);
+}
+
+static void writeUshort(ostream& out, uint16_t n)
+{
+    LE_TO_CPU_INT16(n, n);
+    out.write(reinterpret_cast<char*>(&n), sizeof n);
+}
+
+static void writeFloat(ostream& out, float f)
+{
+    LE_TO_CPU_FLOAT(f, f);
+    out.write(reinterpret_cast<char*>(&f), sizeof f);
+}
+
+static void writePadding(ostream& out, size_t& pos, size_t offset)
+{
+    static const char zeros[OCTREE_FILE_ALIGNMENT] = {};
+    while (pos < offset)
+    {
+        size_t n = min(offset - pos, OCTREE_FILE_ALIGNMENT);
+        out.write(zeros, n);
+        pos += n;
+    }
+}
+
+
 // Used to sort stars by catalog number
 struct CatalogNumberOrderingPredicate
 {
@@ -189,8 +380,12 @@ StarDatabase::StarDatabase()
 
 StarDatabase::~StarDatabase()
 {
+    delete octreeRoot;
+    delete extraOctreeRoot;
     delete [] stars;
+    delete [] extraStars;
     delete [] catalogNumberIndex;
+    delete [] prebuiltStars;
 
     for (const auto index : crossIndexes)
         delete index;
@@ -319,13 +514,17 @@ Star* StarDatabase::searchCrossIndex(const Catalog catalog, const AstroCatalog::
 }
 
 
-vector<string> StarDatabase::getCompletion(const string& name) const
+vector<string> StarDatabase::getCompletion(const string& name, unsigned int maxResults) const
 {
     vector<string> completion;
 
     // only named stars are supported by completion.
     if (!name.empty() && namesDB != nullptr)
+    {
+        if (maxResults > 0)
+            return namesDB->getRankedCompletion(name, maxResults);
         return namesDB->getCompletion(name);
+    }
     else
         return completion;
 }
@@ -376,7 +575,7 @@ string StarDatabase::getStarName(const Star& star, bool i18n) const
 
     if (namesDB != nullptr)
     {
-        StarNameDatabase::NumberIndex::const_iterator iter = namesDB->getFirstNameIter(catalogNumber);
+        auto iter = namesDB->getFirstNameIter(catalogNumber);
         if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
         {
             if (i18n && iter->second != _(iter->second.c_str()))
@@ -406,7 +605,7 @@ void StarDatabase::getStarName(const Star& star, char* nameBuffer, unsigned int
 
     if (namesDB != nullptr)
     {
-        StarNameDatabase::NumberIndex::const_iterator iter = namesDB->getFirstNameIter(catalogNumber);
+        auto iter = namesDB->getFirstNameIter(catalogNumber);
         if (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber)
         {
             if (i18n && iter->second != _(iter->second.c_str()))
@@ -433,7 +632,7 @@ string StarDatabase::getStarNameList(const Star& star, const unsigned int maxNam
 
     if (namesDB != nullptr)
     {
-        StarNameDatabase::NumberIndex::const_iterator iter = namesDB->getFirstNameIter(catalogNumber);
+        auto iter = namesDB->getFirstNameIter(catalogNumber);
 
         while (iter != namesDB->getFinalNameIter() && iter->first == catalogNumber && count < maxNames)
         {
@@ -501,8 +700,25 @@ void StarDatabase::findVisibleStars(StarHandler& starHandler,
                                     float limitingMag,
                                     OctreeProcStats *stats) const
 {
-    // Compute the bounding planes of an infinite view frustum
     Hyperplane<float, 3> frustumPlanes[5];
+    computeFrustumPlanes(frustumPlanes, position, orientation, fovY, aspectRatio);
+
+    octreeArrays.processVisibleObjects(starHandler,
+                                       position,
+                                       frustumPlanes,
+                                       limitingMag,
+                                       STAR_OCTREE_ROOT_SIZE,
+                                       stats);
+}
+
+
+// Compute the bounding planes of an infinite view frustum
+void StarDatabase::computeFrustumPlanes(Hyperplane<float, 3>* frustumPlanes,
+                                        const Vector3f& position,
+                                        const Quaternionf& orientation,
+                                        float fovY,
+                                        float aspectRatio)
+{
     Vector3f planeNormals[5];
     Eigen::Matrix3f rot = orientation.toRotationMatrix();
     float h = (float) tan(fovY / 2);
@@ -517,13 +733,24 @@ void StarDatabase::findVisibleStars(StarHandler& starHandler,
         planeNormals[i] = rot.transpose() * planeNormals[i].normalized();
         frustumPlanes[i] = Hyperplane<float, 3>(planeNormals[i], position);
     }
+}
+
+
+void StarDatabase::splitVisibleStars(std::vector<StarOctreeSoA::Part>& parts,
+                                     Hyperplane<float, 3>* frustumPlanes,
+                                     const Vector3f& position,
+                                     const Quaternionf& orientation,
+                                     float fovY,
+                                     float aspectRatio,
+                                     float limitingMag) const
+{
+    // Splitting three levels down gives up to a few hundred parts, enough
+    // to balance the load without much per-part overhead.
+    constexpr unsigned int SplitDepth = 3;
 
-    octreeRoot->processVisibleObjects(starHandler,
-                                      position,
-                                      frustumPlanes,
-                                      limitingMag,
-                                      STAR_OCTREE_ROOT_SIZE,
-                                      stats);
+    computeFrustumPlanes(frustumPlanes, position, orientation, fovY, aspectRatio);
+    octreeArrays.splitVisibleObjects(parts, position, frustumPlanes, limitingMag,
+                                     STAR_OCTREE_ROOT_SIZE, SplitDepth);
 }
 
 
@@ -535,6 +762,13 @@ void StarDatabase::findCloseStars(StarHandler& starHandler,
                                     position,
                                     radius,
                                     STAR_OCTREE_ROOT_SIZE);
+    if (extraOctreeRoot != nullptr)
+    {
+        extraOctreeRoot->processCloseObjects(starHandler,
+                                             position,
+                                             radius,
+                                             STAR_OCTREE_ROOT_SIZE);
+    }
 }
 
 
@@ -720,12 +954,131 @@ bool StarDatabase::loadBinary(istream& in)
 }
 
 
+/*! Load a star database, preferring the pre-sorted octree format. Files
+ *  in that format are memory mapped and the octree is restored from them
+ *  by finish() instead of being rebuilt; any other file is handed to the
+ *  stream loader.
+ */
+bool StarDatabase::loadBinary(const fs::path& filename)
+{
+    unique_ptr<MappedFile> file(new MappedFile());
+    if (file->open(filename) && file->size() >= sizeof(OctreeFileHeader))
+    {
+        const char* data = file->data();
+        if (strncmp(data, FILE_HEADER, strlen(FILE_HEADER)) == 0 &&
+            mappedUint16(data, offsetof(OctreeFileHeader, version)) == OCTREE_FILE_VERSION)
+        {
+            return loadOctreeBinary(std::move(file));
+        }
+    }
+    file->close();
+
+    ifstream in(filename.string(), ios::in | ios::binary);
+    if (!in.good())
+    {
+        fmt::fprintf(cerr, _("Error opening %s\n"), filename);
+        return false;
+    }
+
+    return loadBinary(in);
+}
+
+
+bool StarDatabase::loadOctreeBinary(unique_ptr<MappedFile>&& file)
+{
+    const char* data = file->data();
+
+    // The octree can only be restored as-is if it's the first catalog
+    // loaded; stars from stc files are handled separately in finish().
+    if (nStars != 0 || prebuiltFile != nullptr)
+    {
+        cerr << _("Pre-sorted star database must be loaded first\n");
+        return false;
+    }
+
+    uint32_t nStarsInFile = mappedUint32(data, offsetof(OctreeFileHeader, nStars));
+    uint32_t nNodes       = mappedUint32(data, offsetof(OctreeFileHeader, nNodes));
+    float rootSize        = mappedFloat(data, offsetof(OctreeFileHeader, rootSize));
+
+    OctreeFileLayout layout(nStarsInFile, nNodes);
+    if (nNodes == 0 || layout.total > file->size() || rootSize != STAR_OCTREE_ROOT_SIZE)
+    {
+        cerr << _("Bad header for pre-sorted star database\n");
+        return false;
+    }
+
+    uint32_t nextStar = 0;
+    vector<bool> visited(nNodes, false);
+    if (!validateOctreeNode(data, layout, nNodes, 0, 0, nextStar, nStarsInFile, visited) ||
+        nextStar != nStarsInFile)
+    {
+        cerr << _("Bad octree in pre-sorted star database\n");
+        return false;
+    }
+
+    prebuiltStars = new Star[nStarsInFile];
+    binFileCatalogNumberIndex = new Star*[nStarsInFile];
+
+    for (uint32_t i = 0; i < nStarsInFile; i++)
+    {
+        Star& star = prebuiltStars[i];
+        star.setPosition(mappedFloat(data, layout.x, i),
+                         mappedFloat(data, layout.y, i),
+                         mappedFloat(data, layout.z, i));
+        star.setAbsoluteMagnitude(mappedFloat(data, layout.absMag, i));
+        star.setIndex(mappedUint32(data, layout.catalogNumbers, i));
+
+        StarDetails* details = nullptr;
+        StellarClass sc;
+        if (sc.unpackV2(mappedUint16(data, layout.spectralTypes, i)))
+            details = StarDetails::GetStarDetails(sc);
+
+        uint32_t catalogIndex = mappedUint32(data, layout.catalogIndex, i);
+        if (details == nullptr || catalogIndex >= nStarsInFile)
+        {
+            fmt::fprintf(cerr, _("Bad record in star database, star #%u\n"), i);
+            delete[] prebuiltStars;
+            prebuiltStars = nullptr;
+            delete[] binFileCatalogNumberIndex;
+            binFileCatalogNumberIndex = nullptr;
+            return false;
+        }
+
+        star.setDetails(details);
+        binFileCatalogNumberIndex[i] = prebuiltStars + catalogIndex;
+    }
+
+    // The catalog index was stored sorted, so no sort is needed before
+    // the stc files are loaded.
+    binFileStarCount  = nStarsInFile;
+    prebuiltStarCount = nStarsInFile;
+    prebuiltNodeCount = nNodes;
+    prebuiltFile      = std::move(file);
+    nStars           += nStarsInFile;
+
+    fmt::fprintf(clog, _("%d stars in binary database\n"), nStars);
+
+    return true;
+}
+
+
 void StarDatabase::finish()
 {
     fmt::fprintf(clog, _("Total star count: %d\n"), nStars);
 
-    buildOctree();
-    buildIndexes();
+    if (prebuiltFile != nullptr)
+    {
+        buildPrebuiltOctree();
+    }
+    else
+    {
+        buildOctree();
+        buildIndexes();
+    }
+
+    octreeArrays.addOctree(*octreeRoot);
+    if (extraOctreeRoot != nullptr)
+        octreeArrays.addOctree(*extraOctreeRoot);
 
     // Delete the temporary indices used only during loading
     delete[] binFileCatalogNumberIndex;
@@ -750,13 +1103,16 @@ void StarDatabase::finish()
     }
 
     barycenters.clear();
+
+    if (namesDB != nullptr)
+        namesDB->buildCompletionIndex();
 }
 
 
-static void stcError(const Tokenizer& tok,
-                     const string& msg)
+static string stcError(const Tokenizer& tok,
+                       const string& msg)
 {
-    fmt::fprintf(cerr,  _("Error in .stc file (line %i): %s\n"), tok.getLineNumber(), msg);
+    return fmt::sprintf(_("Error in .stc file (line %i): %s\n"), tok.getLineNumber(), msg);
 }
 
 
@@ -1178,36 +1534,46 @@ bool StarDatabase::createStar(Star* star,
 bool StarDatabase::load(istream& in, const fs::path& resourcePath)
 {
     Tokenizer tokenizer(&in);
-    Parser parser(&tokenizer);
+    return load(tokenizer, resourcePath);
+}
 
-#ifdef ENABLE_NLS
-    string s = resourcePath.string();
-    const char *d = s.c_str();
-    bindtextdomain(d, d); // domain name is the same as resource path
-#endif
+
+bool StarDatabase::load(Tokenizer& tokenizer, const fs::path& resourcePath)
+{
+    ParsedCatalog catalog;
+    parse(tokenizer, catalog);
+    return load(catalog, resourcePath);
+}
+
+
+/*! Read the star definitions of an STC file without adding them to a
+ *  database. Returns false if a syntax error ended parsing.
+ */
+bool StarDatabase::parse(Tokenizer& tokenizer, ParsedCatalog& catalog)
+{
+    Parser parser(&tokenizer);
 
     while (tokenizer.nextToken() != Tokenizer::TokenEnd)
     {
-        bool isStar = true;
+        CatalogDefinition def;
 
         // Parse the disposition--either Add, Replace, or Modify. The disposition
         // may be omitted. The default value is Add.
-        DataDisposition disposition = DataDisposition::Add;
         if (tokenizer.getTokenType() == Tokenizer::TokenName)
         {
             if (tokenizer.getNameValue() == "Modify")
             {
-                disposition = DataDisposition::Modify;
+                def.disposition = DataDisposition::Modify;
                 tokenizer.nextToken();
             }
             else if (tokenizer.getNameValue() == "Replace")
             {
-                disposition = DataDisposition::Replace;
+                def.disposition = DataDisposition::Replace;
                 tokenizer.nextToken();
             }
             else if (tokenizer.getNameValue() == "Add")
             {
-                disposition = DataDisposition::Add;
+                def.disposition = DataDisposition::Add;
                 tokenizer.nextToken();
             }
         }
@@ -1216,42 +1582,76 @@ bool StarDatabase::load(istream& in, const fs::path& resourcePath)
         // may be omitted. The default is Star.
         if (tokenizer.getTokenType() == Tokenizer::TokenName)
         {
-            if (tokenizer.getNameValue() == "Star")
-            {
-                isStar = true;
-            }
-            else if (tokenizer.getNameValue() == "Barycenter")
-            {
-                isStar = false;
-            }
-            else
+            if (tokenizer.getNameValue() != "Star" &&
+                tokenizer.getNameValue() != "Barycenter")
             {
-                stcError(tokenizer, "unrecognized object type");
+                catalog.error = stcError(tokenizer, "unrecognized object type");
                 return false;
             }
+            def.type = tokenizer.getNameValue();
             tokenizer.nextToken();
         }
 
         // Parse the catalog number; it may be omitted if a name is supplied.
-        AstroCatalog::IndexNumber catalogNumber = AstroCatalog::InvalidIndex;
         if (tokenizer.getTokenType() == Tokenizer::TokenNumber)
         {
-            catalogNumber = (AstroCatalog::IndexNumber) tokenizer.getNumberValue();
+            def.catalogNumber = (AstroCatalog::IndexNumber) tokenizer.getNumberValue();
             tokenizer.nextToken();
         }
 
-        string objName;
-        string firstName;
         if (tokenizer.getTokenType() == Tokenizer::TokenString)
         {
             // A star name (or names) is present
-            objName    = tokenizer.getStringValue();
+            def.name = tokenizer.getStringValue();
             tokenizer.nextToken();
-            if (!objName.empty())
-            {
-                string::size_type next = objName.find(':', 0);
-                firstName = objName.substr(0, next);
-            }
+        }
+
+        tokenizer.pushBack();
+
+        def.value.reset(parser.readValue());
+        if (def.value == nullptr)
+        {
+            catalog.error = "Error reading star.\n";
+            return false;
+        }
+
+        if (def.value->getType() != Value::HashType)
+        {
+            catalog.error = "Bad star definition.\n";
+            return false;
+        }
+
+        def.line = tokenizer.getLineNumber();
+        catalog.definitions.push_back(move(def));
+    }
+
+    return true;
+}
+
+
+/*! Add the star definitions read by parse() to the database, in file
+ *  order. Returns false if parsing had stopped at a syntax error.
+ */
+bool StarDatabase::load(const ParsedCatalog& catalog, const fs::path& resourcePath)
+{
+#ifdef ENABLE_NLS
+    string s = resourcePath.string();
+    const char *d = s.c_str();
+    bindtextdomain(d, d); // domain name is the same as resource path
+#endif
+
+    for (const auto& def : catalog.definitions)
+    {
+        bool isStar = def.type != "Barycenter";
+        DataDisposition disposition = def.disposition;
+        AstroCatalog::IndexNumber catalogNumber = def.catalogNumber;
+
+        const string& objName = def.name;
+        string firstName;
+        if (!objName.empty())
+        {
+            string::size_type next = objName.find(':', 0);
+            firstName = objName.substr(0, next);
         }
 
         Star* star = nullptr;
@@ -1307,22 +1707,7 @@ bool StarDatabase::load(istream& in, const fs::path& resourcePath)
 
         bool isNewStar = star == nullptr;
 
-        tokenizer.pushBack();
-
-        Value* starDataValue = parser.readValue();
-        if (starDataValue == nullptr)
-        {
-            clog << "Error reading star.\n";
-            return false;
-        }
-
-        if (starDataValue->getType() != Value::HashType)
-        {
-            DPRINTF(LOG_LEVEL_ERROR, "Bad star definition.\n");
-            delete starDataValue;
-            return false;
-        }
-        Hash* starData = starDataValue->getHash();
+        Hash* starData = def.getData();
 
         if (isNewStar)
             star = new Star();
@@ -1337,7 +1722,6 @@ bool StarDatabase::load(istream& in, const fs::path& resourcePath)
             ok = createStar(star, disposition, catalogNumber, starData, resourcePath, !isStar);
             star->loadCategories(starData, disposition, resourcePath.string());
         }
-        delete starDataValue;
 
         if (ok)
         {
@@ -1386,6 +1770,12 @@ bool StarDatabase::load(istream& in, const fs::path& resourcePath)
         }
     }
 
+    if (!catalog.error.empty())
+    {
+        cerr << catalog.error;
+        return false;
+    }
+
     return true;
 }
 
@@ -1436,6 +1826,238 @@ void StarDatabase::buildOctree()
     delete root;
 
     stars = sortedStars;
+    nMainStars = nStars;
+}
+
+
+/*! Restore the octree stored in a pre-sorted star database. Catalog stars
+ *  still satisfying the placement they had when the file was written keep
+ *  their node; stc stars, and catalog stars that an stc file moved, changed
+ *  in brightness or put into an orbit are sorted into a small secondary
+ *  octree instead of rebuilding the whole tree.
+ *
+ *  The catalog stars were copied once from the mapped file, in octree
+ *  order; the kept ones are compacted in place to become the main star
+ *  array, and the stars of the secondary octree get an array of their own.
+ */
+void StarDatabase::buildPrebuiltOctree()
+{
+    const char* data = prebuiltFile->data();
+    OctreeFileLayout layout(prebuiltStarCount, prebuiltNodeCount);
+
+    // Catalog stars leaving the main octree are copied out before the
+    // compaction overwrites them.
+    vector<Star> movedStars;
+
+    // Final position of each catalog star in the main star array, or
+    // InvalidIndex if it has to move to the secondary octree.
+    vector<uint32_t> finalIndex(prebuiltStarCount);
+    uint32_t nKept = 0;
+    for (uint32_t i = 0; i < prebuiltStarCount; i++)
+    {
+        const Star& star = prebuiltStars[i];
+        Vector3f pos(mappedFloat(data, layout.x, i),
+                     mappedFloat(data, layout.y, i),
+                     mappedFloat(data, layout.z, i));
+        if (star.getPosition() == pos &&
+            star.getAbsoluteMagnitude() == mappedFloat(data, layout.absMag, i) &&
+            star.getOrbitalRadius() == 0.0f)
+        {
+            finalIndex[i] = nKept++;
+        }
+        else
+        {
+            finalIndex[i] = AstroCatalog::InvalidIndex;
+            movedStars.push_back(star);
+        }
+    }
+
+    DPRINTF(LOG_LEVEL_INFO, "Restoring pre-sorted star octree . . .\n");
+    Star* firstStar = prebuiltStars;
+    octreeRoot = restoreOctreeNode(0, firstStar, finalIndex);
+
+    auto nExtra = (uint32_t) (unsortedStars.size() + movedStars.size());
+    if (nExtra != 0)
+    {
+        DPRINTF(LOG_LEVEL_INFO, "Sorting %u additional stars into octree . . .\n", nExtra);
+        float absMag = astro::appToAbsMag(STAR_OCTREE_MAGNITUDE,
+                                          STAR_OCTREE_ROOT_SIZE * (float) sqrt(3.0));
+        DynamicStarOctree* root = new DynamicStarOctree(Vector3f(1000.0f, 1000.0f, 1000.0f),
+                                                        absMag);
+        for (unsigned int i = 0; i < unsortedStars.size(); ++i)
+            root->insertObject(unsortedStars[i], STAR_OCTREE_ROOT_SIZE);
+        for (const auto& star : movedStars)
+            root->insertObject(star, STAR_OCTREE_ROOT_SIZE);
+
+        extraStars = new Star[nExtra];
+        Star* firstExtraStar = extraStars;
+        root->rebuildAndSort(extraOctreeRoot, firstExtraStar);
+        delete root;
+    }
+
+    DPRINTF(LOG_LEVEL_INFO, "%d stars total\n", (int) (nKept + nExtra));
+
+    // Merge the stored catalog number order of the kept stars with the
+    // (few) additional stars, avoiding a sort of the entire catalog.
+    vector<Star*> keptIndex;
+    keptIndex.reserve(nKept);
+    for (uint32_t i = 0; i < prebuiltStarCount; i++)
+    {
+        uint32_t star = finalIndex[mappedUint32(data, layout.catalogIndex, i)];
+        if (star != AstroCatalog::InvalidIndex)
+            keptIndex.push_back(prebuiltStars + star);
+    }
+
+    vector<Star*> extraIndex;
+    extraIndex.reserve(nExtra);
+    for (uint32_t i = 0; i < nExtra; i++)
+        extraIndex.push_back(extraStars + i);
+    sort(extraIndex.begin(), extraIndex.end(), PtrCatalogNumberOrderingPredicate());
+
+    catalogNumberIndex = new Star*[nStars];
+    merge(keptIndex.begin(), keptIndex.end(),
+          extraIndex.begin(), extraIndex.end(),
+          catalogNumberIndex,
+          PtrCatalogNumberOrderingPredicate());
+
+    unsortedStars.clear();
+    prebuiltFile.reset();
+
+    // The slots of the moved stars at the end of the array stay unused
+    stars = prebuiltStars;
+    prebuiltStars = nullptr;
+    nMainStars = nKept;
+}
+
+
+StarOctree* StarDatabase::restoreOctreeNode(uint32_t index,
+                                            Star*& sortedStars,
+                                            const vector<uint32_t>& finalIndex) const
+{
+    OctreeFileLayout layout(prebuiltStarCount, prebuiltNodeCount);
+    OctreeFileNode node = mappedNode(prebuiltFile->data(), layout, index);
+
+    // Nodes are visited in star order, so a kept star is only ever copied
+    // to its own or an earlier slot.
+    Star* firstObject = sortedStars;
+    for (uint32_t i = node.firstStar; i < node.firstStar + node.nStars; i++)
+    {
+        if (finalIndex[i] == AstroCatalog::InvalidIndex)
+            continue;
+        if (sortedStars != prebuiltStars + i)
+            *sortedStars = prebuiltStars[i];
+        ++sortedStars;
+    }
+
+    auto* octree = new StarOctree(Vector3f(node.center[0], node.center[1], node.center[2]),
+                                  node.exclusionFactor,
+                                  firstObject,
+                                  (unsigned int) (sortedStars - firstObject));
+
+    if (node.firstChild != 0)
+    {
+        auto** children = new StarOctree*[8];
+        for (uint32_t i = 0; i < 8; i++)
+            children[i] = restoreOctreeNode(node.firstChild + i, sortedStars, finalIndex);
+        octree->setChildren(children);
+    }
+
+    return octree;
+}
+
+
+/*! Write the database in the pre-sorted octree format read by
+ *  loadBinary(const fs::path&). The database must be finished, and all of
+ *  its stars must reside in a single octree.
+ */
+bool StarDatabase::writeOctreeBinary(ostream& out, const SpectralTypeFunc& spectralType) const
+{
+    if (octreeRoot == nullptr || extraOctreeRoot != nullptr)
+        return false;
+
+    // Number the nodes breadth first, so that the eight children of a node
+    // are adjacent and always follow their parent.
+    vector<const StarOctree*> nodes;
+    vector<uint32_t> firstChild;
+    nodes.push_back(octreeRoot);
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i]->getChild(0) == nullptr)
+        {
+            firstChild.push_back(0);
+            continue;
+        }
+
+        firstChild.push_back((uint32_t) nodes.size());
+        for (int j = 0; j < 8; j++)
+            nodes.push_back(nodes[i]->getChild(j));
+    }
+
+    auto nNodes = (uint32_t) nodes.size();
+    OctreeFileLayout layout(nStars, nNodes);
+    size_t pos = 0;
+
+    out.write(FILE_HEADER, strlen(FILE_HEADER));
+    writeUshort(out, OCTREE_FILE_VERSION);
+    writeUshort(out, 0);
+    writeUint(out, nStars);
+    writeUint(out, nNodes);
+    writeFloat(out, STAR_OCTREE_ROOT_SIZE);
+    writeUint(out, 0);
+    writeUint(out, 0);
+    pos += sizeof(OctreeFileHeader);
+
+    writePadding(out, pos, layout.nodes);
+    for (uint32_t i = 0; i < nNodes; i++)
+    {
+        const StarOctree* node = nodes[i];
+        writeFloat(out, node->getCellCenterPos().x());
+        writeFloat(out, node->getCellCenterPos().y());
+        writeFloat(out, node->getCellCenterPos().z());
+        writeFloat(out, node->getExclusionFactor());
+        writeUint(out, (uint32_t) (node->getFirstObject() - stars));
+        writeUint(out, node->getObjectCount());
+        writeUint(out, firstChild[i]);
+        writeUint(out, 0);
+    }
+    pos += nNodes * sizeof(OctreeFileNode);
+
+    writePadding(out, pos, layout.catalogNumbers);
+    for (int i = 0; i < nStars; i++)
+        writeUint(out, stars[i].getIndex());
+    pos += nStars * sizeof(uint32_t);
+
+    writePadding(out, pos, layout.x);
+    for (int i = 0; i < nStars; i++)
+        writeFloat(out, stars[i].getPosition().x());
+    pos += nStars * sizeof(float);
+
+    writePadding(out, pos, layout.y);
+    for (int i = 0; i < nStars; i++)
+        writeFloat(out, stars[i].getPosition().y());
+    pos += nStars * sizeof(float);
+
+    writePadding(out, pos, layout.z);
+    for (int i = 0; i < nStars; i++)
+        writeFloat(out, stars[i].getPosition().z());
+    pos += nStars * sizeof(float);
+
+    writePadding(out, pos, layout.absMag);
+    for (int i = 0; i < nStars; i++)
+        writeFloat(out, stars[i].getAbsoluteMagnitude());
+    pos += nStars * sizeof(float);
+
+    writePadding(out, pos, layout.spectralTypes);
+    for (int i = 0; i < nStars; i++)
+        writeUshort(out, spectralType(stars[i]));
+    pos += nStars * sizeof(uint16_t);
+
+    writePadding(out, pos, layout.catalogIndex);
+    for (int i = 0; i < nStars; i++)
+        writeUint(out, (uint32_t) (catalogNumberIndex[i] - stars));
+    pos += nStars * sizeof(uint32_t);
+
+    return out.good();
 }
 
 
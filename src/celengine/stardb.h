@@ -12,16 +12,23 @@
 #define _CELENGINE_STARDB_H_
 
 #include <iostream>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <map>
 #include <celutil/blockarray.h>
+#include <celutil/mappedfile.h>
+#include <celutil/threadpool.h>
 #include <celengine/constellation.h>
 #include <celengine/starname.h>
 #include <celengine/star.h>
 #include <celengine/staroctree.h>
 #include <celengine/parseobject.h>
+#include <celengine/parsedcatalog.h>
 
 
+class Tokenizer;
+
 static const unsigned int MAX_STAR_NAMES = 10;
 
 
@@ -39,7 +46,8 @@ class StarDatabase
     Star* find(const std::string&) const;
     AstroCatalog::IndexNumber findCatalogNumberByName(const std::string&) const;
 
-    std::vector<std::string> getCompletion(const std::string&) const;
+    // All completions, or the best maxResults of them if it isn't zero
+    std::vector<std::string> getCompletion(const std::string&, unsigned int maxResults = 0) const;
 
     void findVisibleStars(StarHandler& starHandler,
                           const Eigen::Vector3f& obsPosition,
@@ -49,6 +57,21 @@ class StarDatabase
                           float limitingMag,
                           OctreeProcStats * = nullptr) const;
 
+    // Parallel version of findVisibleStars(): the traversal is split into
+    // parts which are run on the pool, each with its own copy of
+    // prototype. On return, handlers holds one handler per part; merging
+    // their results in order gives the same result as the serial version,
+    // whatever the number of threads.
+    template<class HANDLER>
+    void findVisibleStars(ThreadPool& pool,
+                          std::vector<HANDLER>& handlers,
+                          const HANDLER& prototype,
+                          const Eigen::Vector3f& obsPosition,
+                          const Eigen::Quaternionf& obsOrientation,
+                          float fovY,
+                          float aspectRatio,
+                          float limitingMag) const;
+
     void findCloseStars(StarHandler& starHandler,
                         const Eigen::Vector3f& obsPosition,
                         float radius) const;
@@ -61,7 +84,17 @@ class StarDatabase
     void setNameDatabase(StarNameDatabase*);
 
     bool load(std::istream&, const fs::path& resourcePath = fs::path());
+    bool load(Tokenizer&, const fs::path& resourcePath = fs::path());
+    bool load(const ParsedCatalog&, const fs::path& resourcePath = fs::path());
+    static bool parse(Tokenizer&, ParsedCatalog&);
     bool loadBinary(std::istream&);
+    bool loadBinary(const fs::path&);
+
+    // Write the finished database in the pre-sorted octree format. The
+    // caller supplies the packed (V2) spectral type of each star, since
+    // only the derived StarDetails are kept after loading.
+    typedef std::function<uint16_t(const Star&)> SpectralTypeFunc;
+    bool writeOctreeBinary(std::ostream&, const SpectralTypeFunc&) const;
 
     enum Catalog
     {
@@ -102,16 +135,41 @@ private:
                     const fs::path& path,
                     const bool isBarycenter);
 
+    bool loadOctreeBinary(std::unique_ptr<MappedFile>&&);
+
     void buildOctree();
+    void buildPrebuiltOctree();
+    StarOctree* restoreOctreeNode(uint32_t node, Star*& sortedStars,
+                                  const std::vector<uint32_t>& finalIndex) const;
     void buildIndexes();
+    static void computeFrustumPlanes(Eigen::Hyperplane<float, 3>* frustumPlanes,
+                                     const Eigen::Vector3f& position,
+                                     const Eigen::Quaternionf& orientation,
+                                     float fovY,
+                                     float aspectRatio);
+    void splitVisibleStars(std::vector<StarOctreeSoA::Part>& parts,
+                           Eigen::Hyperplane<float, 3>* frustumPlanes,
+                           const Eigen::Vector3f& position,
+                           const Eigen::Quaternionf& orientation,
+                           float fovY,
+                           float aspectRatio,
+                           float limitingMag) const;
     Star* findWhileLoading(AstroCatalog::IndexNumber catalogNumber) const;
 
     int nStars{ 0 };
 
     Star*             stars{ nullptr };
+    // Stars of the secondary octree, numbered after the nMainStars of stars
+    Star*             extraStars{ nullptr };
+    uint32_t          nMainStars{ 0 };
     StarNameDatabase* namesDB{ nullptr };
     Star**            catalogNumberIndex{ nullptr };
     StarOctree*       octreeRoot{ nullptr };
+    // Stars which couldn't be placed in a pre-built octree: those defined in
+    // stc files, and catalog stars moved or given orbits by them.
+    StarOctree*       extraOctreeRoot{ nullptr };
+    // Flattened copy of the octrees read by findVisibleStars()
+    StarOctreeSoA     octreeArrays;
     AstroCatalog::IndexNumber nextAutoCatalogNumber{ 0xfffffffe };
 
     std::vector<CrossIndex*> crossIndexes;
@@ -122,6 +180,13 @@ private:
     // List of stars loaded from binary file, sorted by catalog number
     Star** binFileCatalogNumberIndex{ nullptr };
     unsigned int binFileStarCount{ 0 };
+    // Pre-built octree file; it stays mapped until finish() has restored
+    // the octree nodes from it. prebuiltStars, copied from it once in
+    // octree order, becomes the main star array.
+    std::unique_ptr<MappedFile> prebuiltFile;
+    Star* prebuiltStars{ nullptr };
+    uint32_t prebuiltStarCount{ 0 };
+    uint32_t prebuiltNodeCount{ 0 };
     // Catalog number -> star mapping for stars loaded from stc files
     std::map<AstroCatalog::IndexNumber, Star*> stcFileCatalogNumberIndex;
 
@@ -136,7 +201,7 @@ private:
 
 Star* StarDatabase::getStar(const uint32_t n) const
 {
-    return stars + n;
+    return n < nMainStars ? stars + n : extraStars + (n - nMainStars);
 }
 
 uint32_t StarDatabase::size() const
@@ -144,4 +209,27 @@ uint32_t StarDatabase::size() const
     return nStars;
 }
 
+template<class HANDLER>
+void StarDatabase::findVisibleStars(ThreadPool& pool,
+                                    std::vector<HANDLER>& handlers,
+                                    const HANDLER& prototype,
+                                    const Eigen::Vector3f& position,
+                                    const Eigen::Quaternionf& orientation,
+                                    float fovY,
+                                    float aspectRatio,
+                                    float limitingMag) const
+{
+    Eigen::Hyperplane<float, 3> frustumPlanes[5];
+    std::vector<StarOctreeSoA::Part> parts;
+    splitVisibleStars(parts, frustumPlanes, position, orientation,
+                      fovY, aspectRatio, limitingMag);
+
+    handlers.assign(parts.size(), prototype);
+    pool.parallelFor(parts.size(), [&](size_t i)
+    {
+        octreeArrays.processPart(parts[i], handlers[i], position,
+                                 frustumPlanes, limitingMag);
+    });
+}
+
 #endif // _CELENGINE_STARDB_H_
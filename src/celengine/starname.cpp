@@ -10,6 +10,10 @@
 //
 //
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <celengine/constellation.h>
 #include <celengine/starname.h>
 
@@ -100,58 +104,58 @@ uint32_t StarNameDatabase::findCatalogNumberByName(const string& name) const
 
 StarNameDatabase* StarNameDatabase::readNames(istream& in)
 {
+    // Read the whole file first; its size bounds the space needed for the
+    // names, and parsing it in memory avoids a string for every line.
+    string buffer;
+    char chunk[65536];
+    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0)
+        buffer.append(chunk, in.gcount());
+    if (in.bad())
+        return nullptr;
+
+    // Each line holds a catalog number followed by names each preceded
+    // by a ':', so there are as many names as ':' characters.
     StarNameDatabase* db = new StarNameDatabase();
-    bool failed = false;
-    string s;
+    db->reserve(count(buffer.begin(), buffer.end(), ':'), buffer.length());
 
-    while (!failed)
+    const char* p = buffer.c_str();
+    const char* end = p + buffer.length();
+    string name;
+    while (p != end)
     {
-        auto catalogNumber = AstroCatalog::InvalidIndex;
-
-        in >> catalogNumber;
-        if (in.eof())
-            break;
-        if (in.bad())
-        {
-            failed = true;
+        while (p != end && isspace(static_cast<unsigned char>(*p)))
+            ++p;
+        if (p == end)
             break;
-        }
-
-        // in.get(); // skip a space (or colon);
 
-        string name;
-        getline(in, name);
-        if (in.bad())
+        char* numberEnd;
+        auto catalogNumber = (AstroCatalog::IndexNumber) strtoul(p, &numberEnd, 10);
+        if (numberEnd == p)
         {
-            failed = true;
-            break;
+            delete db;
+            return nullptr;
         }
+        p = numberEnd;
+
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (lineEnd == nullptr)
+            lineEnd = end;
 
-        // Iterate through the string for names delimited
-        // by ':', and insert them into the star database. Note that
-        // db->add() will skip empty names.
-        string::size_type startPos = 0;
-        while (startPos != string::npos)
+        // Iterate through the line for names delimited by ':', and insert
+        // them into the star database. The character following the number
+        // is skipped. Note that db->add() will skip empty names.
+        const char* startPos = p;
+        while (startPos != lineEnd)
         {
             ++startPos;
-            string::size_type next = name.find(':', startPos);
-            string::size_type length = string::npos;
-
-            if (next != string::npos)
-                length = next - startPos;
-
-            db->add(catalogNumber, name.substr(startPos, length));
+            const char* next = find(startPos, lineEnd, ':');
+            name.assign(startPos, next);
+            db->add(catalogNumber, name);
             startPos = next;
         }
-    }
 
-    if (failed)
-    {
-        delete db;
-        return nullptr;
-    }
-    else
-    {
-        return db;
+        p = lineEnd;
     }
+
+    return db;
 }
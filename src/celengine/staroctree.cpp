@@ -10,7 +10,10 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <algorithm>
+#include <cmath>
 #include <celengine/staroctree.h>
+#include <celengine/starcull.h>
 
 using namespace Eigen;
 
@@ -24,6 +27,9 @@ using namespace Eigen;
 // render stars with orbits that are closer than MAX_STAR_ORBIT_RADIUS.
 static const float MAX_STAR_ORBIT_RADIUS = 1.0f;
 
+// Ratio of a node's bounding sphere radius to its half-width (sqrt(3))
+static const float NODE_RADIUS_FACTOR = 1.732050807568877f;
+
 
 // The octree node into which a star is placed is dependent on two properties:
 // its obsPosition and its luminosity--the fainter the star, the deeper the node
@@ -213,3 +219,294 @@ void StarOctree::processCloseObjects(StarHandler&    processor,
         }
     }
 }
+
+
+
+void StarOctreeSoA::addOctree(const StarOctree& root)
+{
+    // Nodes are numbered breadth first, so that the eight children of a
+    // node are adjacent in the node table and always follow it; a
+    // firstChild of zero can thus mark a leaf.
+    std::vector<std::pair<const StarOctree*, uint32_t>> queue;
+    roots.push_back(addNode(root));
+    queue.emplace_back(&root, roots.back());
+
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        const StarOctree* octree = queue[i].first;
+        if (octree->getChild(0) == nullptr)
+            continue;
+
+        nodes[queue[i].second].firstChild = static_cast<uint32_t>(nodes.size());
+        for (int j = 0; j < 8; j++)
+        {
+            const StarOctree* child = octree->getChild(j);
+            queue.emplace_back(child, addNode(*child));
+        }
+    }
+}
+
+
+uint32_t StarOctreeSoA::addNode(const StarOctree& octree)
+{
+    constexpr size_t floatsPerBlock = ALIGNMENT / sizeof(float);
+
+    Node node;
+    node.cellCenterPos   = octree.getCellCenterPos();
+    node.exclusionFactor = octree.getExclusionFactor();
+    node.nObjects        = octree.getObjectCount();
+    node.firstChild      = 0;
+    node.brightest       = 1000.0f;
+    node.firstObject     = octree.getFirstObject();
+
+    size_t first = (components[X].size() + floatsPerBlock - 1) / floatsPerBlock * floatsPerBlock;
+    node.first = static_cast<uint32_t>(first);
+    for (auto& component : components)
+        component.resize(first + node.nObjects, 0.0f);
+
+    for (uint32_t i = 0; i < node.nObjects; i++)
+    {
+        const Star& star = node.firstObject[i];
+        Vector3f pos = star.getPosition();
+        components[X][first + i]          = pos.x();
+        components[Y][first + i]          = pos.y();
+        components[Z][first + i]          = pos.z();
+        components[AbsMag][first + i]     = star.getAbsoluteMagnitude();
+        components[Extinction][first + i] = star.getExtinction();
+        node.brightest = std::min(node.brightest, star.getAbsoluteMagnitude());
+    }
+
+    nodes.push_back(node);
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+
+void StarOctreeSoA::processVisibleObjects(StarHandler&                processor,
+                                          const Vector3f&             obsPosition,
+                                          const Hyperplane<float, 3>* frustumPlanes,
+                                          float                       limitingFactor,
+                                          float                       scale,
+                                          OctreeProcStats*            stats) const
+{
+    for (const auto root : roots)
+    {
+        processNode(root, processor, obsPosition, frustumPlanes,
+                    limitingFactor, scale, stats);
+    }
+}
+
+
+void StarOctreeSoA::splitVisibleObjects(std::vector<Part>&          parts,
+                                        const Vector3f&             obsPosition,
+                                        const Hyperplane<float, 3>* frustumPlanes,
+                                        float                       limitingFactor,
+                                        float                       scale,
+                                        unsigned int                splitDepth) const
+{
+    for (const auto root : roots)
+    {
+        splitNode(root, parts, obsPosition, frustumPlanes,
+                  limitingFactor, scale, splitDepth);
+    }
+}
+
+
+void StarOctreeSoA::splitNode(uint32_t                    index,
+                              std::vector<Part>&          parts,
+                              const Vector3f&             obsPosition,
+                              const Hyperplane<float, 3>* frustumPlanes,
+                              float                       limitingFactor,
+                              float                       scale,
+                              unsigned int                depth) const
+{
+    if (depth == 0)
+    {
+        parts.push_back({ index, scale, true });
+        return;
+    }
+
+    const Node& node = nodes[index];
+
+    float minDistance, dimmest;
+    if (cullNode(node, obsPosition, frustumPlanes, limitingFactor, scale, minDistance, dimmest))
+        return;
+
+    if (node.nObjects > 0 && node.brightest < dimmest)
+        parts.push_back({ index, scale, false });
+
+    if (node.firstChild != 0 &&
+        (minDistance <= 0 || astro::absToAppMag(node.exclusionFactor, minDistance) <= limitingFactor))
+    {
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            splitNode(node.firstChild + i, parts, obsPosition, frustumPlanes,
+                      limitingFactor, scale * 0.5f, depth - 1);
+        }
+    }
+}
+
+
+void StarOctreeSoA::processPart(const Part&                 part,
+                                StarHandler&                processor,
+                                const Vector3f&             obsPosition,
+                                const Hyperplane<float, 3>* frustumPlanes,
+                                float                       limitingFactor) const
+{
+    if (part.subtree)
+    {
+        processNode(part.node, processor, obsPosition, frustumPlanes,
+                    limitingFactor, part.scale, nullptr);
+        return;
+    }
+
+    // The node already passed the culling tests in splitNode()
+    const Node& node = nodes[part.node];
+    float minDistance = (obsPosition - node.cellCenterPos).norm() - part.scale * NODE_RADIUS_FACTOR;
+    float dimmest     = minDistance > 0 ? astro::appToAbsMag(limitingFactor, minDistance) : 1000;
+    processStars(node, processor, obsPosition, limitingFactor, dimmest);
+}
+
+
+// Return true if the node lies outside the view frustum; otherwise compute
+// the smallest possible distance to its stars and the faintest absolute
+// magnitude that is still visible at that distance.
+bool StarOctreeSoA::cullNode(const Node&                 node,
+                             const Vector3f&             obsPosition,
+                             const Hyperplane<float, 3>* frustumPlanes,
+                             float                       limitingFactor,
+                             float                       scale,
+                             float&                      minDistance,
+                             float&                      dimmest) const
+{
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        const Hyperplane<float, 3>& plane = frustumPlanes[i];
+        float r = scale * plane.normal().cwiseAbs().sum();
+        if (plane.signedDistance(node.cellCenterPos) < -r)
+            return true;
+    }
+
+    minDistance = (obsPosition - node.cellCenterPos).norm() - scale * NODE_RADIUS_FACTOR;
+    dimmest     = minDistance > 0 ? astro::appToAbsMag(limitingFactor, minDistance) : 1000;
+    return false;
+}
+
+
+// Same traversal as StarOctree::processVisibleObjects(), but the per-star
+// culling reads the component arrays; only stars passing the magnitude
+// and distance tests touch their Star object.
+void StarOctreeSoA::processNode(uint32_t                    index,
+                                StarHandler&                processor,
+                                const Vector3f&             obsPosition,
+                                const Hyperplane<float, 3>* frustumPlanes,
+                                float                       limitingFactor,
+                                float                       scale,
+                                OctreeProcStats*            stats) const
+{
+    const Node& node = nodes[index];
+
+#ifdef OCTREE_DEBUG
+    size_t h;
+    if (stats != nullptr)
+    {
+        h = stats->height + 1;
+        stats->nodes++;
+    }
+#endif
+
+    float minDistance, dimmest;
+    if (cullNode(node, obsPosition, frustumPlanes, limitingFactor, scale, minDistance, dimmest))
+        return;
+
+#ifdef OCTREE_DEBUG
+    if (stats != nullptr)
+        stats->objects += node.nObjects;
+#endif
+
+    if (node.nObjects > 0 && node.brightest < dimmest)
+        processStars(node, processor, obsPosition, limitingFactor, dimmest);
+
+    if (node.firstChild != 0 &&
+        (minDistance <= 0 || astro::absToAppMag(node.exclusionFactor, minDistance) <= limitingFactor))
+    {
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            processNode(node.firstChild + i, processor, obsPosition, frustumPlanes,
+                        limitingFactor, scale * 0.5f, stats);
+#ifdef OCTREE_DEBUG
+            if (stats != nullptr && stats->height > h)
+                h = stats->height;
+#endif
+        }
+#ifdef OCTREE_DEBUG
+        if (stats != nullptr)
+            stats->height = h;
+#endif
+    }
+}
+
+
+// Cull the stars of a node with the vectorized kernel, then compute the
+// apparent magnitudes of the survivors and hand the visible ones to the
+// processor in batches.
+void StarOctreeSoA::processStars(const Node&     node,
+                                 StarHandler&    processor,
+                                 const Vector3f& obsPosition,
+                                 float           limitingFactor,
+                                 float           dimmest) const
+{
+    constexpr uint32_t BATCH_SIZE = 256;
+
+    // No star in the node can be visible beyond the distance at which the
+    // brightest of them fades to the limiting magnitude; extinction only
+    // makes stars fainter. Stars closer than MAX_STAR_ORBIT_RADIUS are
+    // kept as well, as they may be orbiting.
+    StarCullParams params;
+    params.obsPosition        = obsPosition;
+    params.dimmest            = dimmest;
+    params.maxDistanceSquared = std::max(
+        (float) (LY_PER_PARSEC * LY_PER_PARSEC) * std::pow(10.0f, (limitingFactor - node.brightest + 5.0f) * 0.4f),
+        MAX_STAR_ORBIT_RADIUS * MAX_STAR_ORBIT_RADIUS);
+
+    uint32_t    survivors[BATCH_SIZE];
+    float       distancesSquared[BATCH_SIZE];
+    const Star* batchStars[BATCH_SIZE];
+    float       batchDistances[BATCH_SIZE];
+    float       batchAppMags[BATCH_SIZE];
+
+    for (uint32_t start = 0; start < node.nObjects; start += BATCH_SIZE)
+    {
+        uint32_t count  = std::min(BATCH_SIZE, node.nObjects - start);
+        uint32_t offset = node.first + start;
+        size_t nSurvivors = CullStars(components[X].data() + offset,
+                                      components[Y].data() + offset,
+                                      components[Z].data() + offset,
+                                      components[AbsMag].data() + offset,
+                                      count,
+                                      params,
+                                      survivors,
+                                      distancesSquared);
+
+        size_t nVisible = 0;
+        for (size_t i = 0; i < nSurvivors; i++)
+        {
+            uint32_t star    = start + survivors[i];
+            float distance   = std::sqrt(distancesSquared[i]);
+            float appMag     = AppMagFromDistanceSquared(components[AbsMag][node.first + star],
+                                                         distancesSquared[i]) +
+                               components[Extinction][node.first + star] * distance;
+
+            if (appMag < limitingFactor ||
+                (distance < MAX_STAR_ORBIT_RADIUS && node.firstObject[star].getOrbit()))
+            {
+                batchStars[nVisible]     = node.firstObject + star;
+                batchDistances[nVisible] = distance;
+                batchAppMags[nVisible]   = appMag;
+                nVisible++;
+            }
+        }
+
+        if (nVisible > 0)
+            processor.processBatch(batchStars, batchDistances, batchAppMags, nVisible);
+    }
+}
@@ -13,6 +13,8 @@
 #ifndef _CELENGINE_STAROCTREE_H_
 #define _CELENGINE_STAROCTREE_H_
 
+#include <vector>
+#include <celutil/align.h>
 #include <celengine/star.h>
 #include <celengine/octree.h>
 
@@ -21,4 +23,106 @@ typedef DynamicOctree  <Star, float> DynamicStarOctree;
 typedef StaticOctree   <Star, float> StarOctree;
 typedef OctreeProcessor<Star, float> StarHandler;
 
+
+// A flattened copy of one or more star octrees used for visibility
+// traversal. The node table is a single array, and the positions and
+// absolute magnitudes the culling loop needs are kept in
+// structure-of-arrays form beside the Star array, so rejecting a star
+// doesn't pull its whole Star object into the cache. Each node's slice of
+// the arrays starts on an ALIGNMENT byte boundary.
+class StarOctreeSoA
+{
+ public:
+    static constexpr size_t ALIGNMENT = 64;
+
+    StarOctreeSoA() = default;
+    StarOctreeSoA(const StarOctreeSoA&) = delete;
+    StarOctreeSoA& operator=(const StarOctreeSoA&) = delete;
+
+    // Append the nodes and stars of a finished StaticOctree; the stars
+    // must stay in place for the lifetime of this object.
+    void addOctree(const StarOctree& root);
+
+    void processVisibleObjects(StarHandler&                     processor,
+                               const Eigen::Vector3f&           obsPosition,
+                               const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                               float                            limitingFactor,
+                               float                            scale,
+                               OctreeProcStats*                 stats = nullptr) const;
+
+    // A piece of the visible-object traversal that can be processed
+    // independently of the others: either the stars of a single node or
+    // a whole subtree.
+    struct Part
+    {
+        uint32_t node;
+        float    scale;
+        bool     subtree;
+    };
+
+    // Split the traversal done by processVisibleObjects() into parts,
+    // descending splitDepth levels below the roots. Processing the parts
+    // in order hands the stars to the processor in the same order as the
+    // serial traversal.
+    void splitVisibleObjects(std::vector<Part>&               parts,
+                             const Eigen::Vector3f&           obsPosition,
+                             const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                             float                            limitingFactor,
+                             float                            scale,
+                             unsigned int                     splitDepth) const;
+
+    void processPart(const Part&                      part,
+                     StarHandler&                     processor,
+                     const Eigen::Vector3f&           obsPosition,
+                     const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                     float                            limitingFactor) const;
+
+ private:
+    struct Node
+    {
+        Eigen::Vector3f cellCenterPos;
+        float           exclusionFactor;
+        uint32_t        first;       // offset of the node's stars in the arrays
+        uint32_t        nObjects;
+        uint32_t        firstChild;  // index of eight consecutive children, or 0
+        float           brightest;   // smallest absolute magnitude in the node
+        const Star*     firstObject;
+    };
+
+    uint32_t addNode(const StarOctree& node);
+    void processStars(const Node&            node,
+                      StarHandler&           processor,
+                      const Eigen::Vector3f& obsPosition,
+                      float                  limitingFactor,
+                      float                  dimmest) const;
+    void splitNode(uint32_t                         index,
+                   std::vector<Part>&               parts,
+                   const Eigen::Vector3f&           obsPosition,
+                   const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                   float                            limitingFactor,
+                   float                            scale,
+                   unsigned int                     depth) const;
+    bool cullNode(const Node&                      node,
+                  const Eigen::Vector3f&           obsPosition,
+                  const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                  float                            limitingFactor,
+                  float                            scale,
+                  float&                           minDistance,
+                  float&                           dimmest) const;
+    void processNode(uint32_t                         index,
+                     StarHandler&                     processor,
+                     const Eigen::Vector3f&           obsPosition,
+                     const Eigen::Hyperplane<float, 3>* frustumPlanes,
+                     float                            limitingFactor,
+                     float                            scale,
+                     OctreeProcStats*                 stats) const;
+
+    std::vector<Node>     nodes;
+    std::vector<uint32_t> roots;
+
+    // Component arrays: x, y, z, absMag, extinction
+    enum { X, Y, Z, AbsMag, Extinction, ComponentCount };
+    std::vector<float, AlignedAllocator<float, ALIGNMENT>> components[ComponentCount];
+};
+
 #endif  // _CELENGINE_STAROCTREE_H_
@@ -27,16 +27,59 @@ Tokenizer::Tokenizer(istream* _in) :
 }
 
 
-Tokenizer::TokenType Tokenizer::nextToken()
+Tokenizer::Tokenizer(const TokenList* tokens) :
+    replayTokens(tokens)
 {
-    State state = StartState;
+}
+
+
+void Tokenizer::setRecorder(TokenList* tokens)
+{
+    recordedTokens = tokens;
+}
 
+
+Tokenizer::TokenType Tokenizer::nextToken()
+{
     if (pushedBack)
     {
         pushedBack = false;
         return tokenType;
     }
 
+    if (replayTokens != nullptr)
+        return replayToken();
+
+    TokenType tok = lexToken();
+    if (recordedTokens != nullptr && tok != TokenEnd)
+        recordedTokens->push_back({ tok, lineNum, haveValidNumber ? numberValue : 0.0, textToken });
+
+    return tok;
+}
+
+
+Tokenizer::TokenType Tokenizer::replayToken()
+{
+    if (replayPosition == replayTokens->size())
+    {
+        tokenType = TokenEnd;
+        return tokenType;
+    }
+
+    const Token& token = (*replayTokens)[replayPosition++];
+    tokenType   = token.type;
+    lineNum     = token.line;
+    numberValue = token.number;
+    textToken   = token.text;
+
+    return tokenType;
+}
+
+
+Tokenizer::TokenType Tokenizer::lexToken()
+{
+    State state = StartState;
+
     textToken = "";
     haveValidNumber = false;
     haveValidName = false;
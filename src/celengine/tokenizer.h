@@ -13,6 +13,7 @@
 
 #include <string>
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
@@ -39,7 +40,23 @@ public:
         TokenEndUnits       = 14,
     };
 
+    // A token as returned by nextToken(), with its value and line number
+    struct Token
+    {
+        TokenType type;
+        int line;
+        double number;
+        string text;
+    };
+    typedef std::vector<Token> TokenList;
+
     Tokenizer(istream*);
+    // Replay tokens recorded earlier instead of reading a stream
+    Tokenizer(const TokenList*);
+
+    // Append every token read from the stream to tokens; pushed back
+    // tokens are only recorded once.
+    void setRecorder(TokenList* tokens);
 
     TokenType nextToken();
     TokenType getTokenType();
@@ -67,7 +84,14 @@ private:
         UnicodeEscapeState  = 11,
     };
 
-    istream* in;
+    istream* in{ nullptr };
+
+    const TokenList* replayTokens{ nullptr };
+    size_t replayPosition{ 0 };
+    TokenList* recordedTokens{ nullptr };
+
+    TokenType lexToken();
+    TokenType replayToken();
 
     int nextChar { 0 };
     TokenType tokenType{ TokenBegin };
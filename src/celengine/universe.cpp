@@ -1084,7 +1084,8 @@ Selection Universe::findPath(const string& s,
 vector<string> Universe::getCompletion(const string& s,
                                                  Selection* contexts,
                                                  int nContexts,
-                                                 bool withLocations)
+                                                 bool withLocations,
+                                                 unsigned int maxResults)
 {
     vector<string> completion;
     int s_length = UTF8Length(s);
@@ -1121,14 +1122,14 @@ vector<string> Universe::getCompletion(const string& s,
     // Deep sky objects:
     if (dsoCatalog != nullptr)
     {
-        vector<string> dsos  = dsoCatalog->getCompletion(s);
+        vector<string> dsos  = dsoCatalog->getCompletion(s, maxResults);
         completion.insert(completion.end(), dsos.begin(), dsos.end());
     }
 
     // and finally stars;
     if (starCatalog != nullptr)
     {
-        vector<string> stars  = starCatalog->getCompletion(s);
+        vector<string> stars  = starCatalog->getCompletion(s, maxResults);
         completion.insert(completion.end(), stars.begin(), stars.end());
     }
 
@@ -1139,14 +1140,15 @@ vector<string> Universe::getCompletion(const string& s,
 vector<string> Universe::getCompletionPath(const string& s,
                                            Selection* contexts,
                                            int nContexts,
-                                           bool withLocations)
+                                           bool withLocations,
+                                           unsigned int maxResults)
 {
     vector<string> completion;
     vector<string> locationCompletion;
     string::size_type pos = s.rfind('/', s.length());
 
     if (pos == string::npos)
-        return getCompletion(s, contexts, nContexts, withLocations);
+        return getCompletion(s, contexts, nContexts, withLocations, maxResults);
 
     string base(s, 0, pos);
     Selection sel = findPath(base, contexts, nContexts, true);
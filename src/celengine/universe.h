@@ -68,14 +68,18 @@ class Universe
                                   const string& name,
                                   bool i18n = false) const;
 
+    // A nonzero maxResults limits the completions from each catalog to
+    // the best ones.
     std::vector<std::string> getCompletion(const std::string& s,
                                            Selection* contexts = nullptr,
                                            int nContexts = 0,
-                                           bool withLocations = false);
+                                           bool withLocations = false,
+                                           unsigned int maxResults = 0);
     std::vector<std::string> getCompletionPath(const std::string& s,
                                                Selection* contexts = nullptr,
                                                int nContexts = 0,
-                                               bool withLocations = false);
+                                               bool withLocations = false,
+                                               unsigned int maxResults = 0);
 
 
     SolarSystem* getNearestSolarSystem(const UniversalCoord& position) const;
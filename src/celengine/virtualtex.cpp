@@ -19,6 +19,7 @@
 #include <celutil/debug.h>
 #include <celcompat/filesystem.h>
 #include <celutil/filetype.h>
+#include <celutil/threadpool.h>
 #include "parser.h"
 #include "tokenizer.h"
 #include "virtualtex.h"
@@ -28,6 +29,15 @@ using namespace std;
 
 static const int MaxResolutionLevels = 13;
 
+// Uploading a tile to graphics memory is done while rendering, so limit the
+// number of uploads per texture use.
+static const unsigned int MaxTileUploads = 4;
+
+size_t VirtualTexture::memoryBudget = 0;
+unsigned int VirtualTexture::frameCounter = 0;
+list<VirtualTexture::Tile*> VirtualTexture::residentTiles;
+VirtualTexture::TileStats VirtualTexture::stats;
+
 
 // Virtual textures are composed of tiles that are loaded from the hard drive
 // as they become visible.  Hidden tiles may be evicted from graphics memory
@@ -67,7 +77,8 @@ VirtualTexture::VirtualTexture(const fs::path& _tilePath,
     baseSplit(_baseSplit),
     tileSize(_tileSize),
     ticks(0),
-    nResolutionLevels(0)
+    nResolutionLevels(0),
+    loadQueue(make_shared<LoadQueue>())
 {
     assert(tileSize != 0 && isPow2(tileSize));
     tileTree[0] = new TileQuadtreeNode();
@@ -80,6 +91,41 @@ VirtualTexture::VirtualTexture(const fs::path& _tilePath,
 }
 
 
+VirtualTexture::~VirtualTexture()
+{
+    deleteTileTree(tileTree[0]);
+    deleteTileTree(tileTree[1]);
+}
+
+
+void VirtualTexture::deleteTileTree(TileQuadtreeNode* node)
+{
+    for (auto child : node->children)
+    {
+        if (child != nullptr)
+            deleteTileTree(child);
+    }
+
+    Tile* tile = node->tile;
+    if (tile != nullptr)
+    {
+        if (tile->tex != nullptr)
+        {
+            residentTiles.erase(tile->lruPosition);
+            stats.residentBytes -= tile->memorySize;
+            stats.residentTiles--;
+            delete tile->tex;
+        }
+        // Decoded images still in the queue are deleted along with it
+        if (tile->loading)
+            stats.pendingTiles--;
+        delete tile;
+    }
+
+    delete node;
+}
+
+
 const TextureTile VirtualTexture::getTile(int lod, int u, int v)
 {
     tilesRequested++;
@@ -96,41 +142,39 @@ const TextureTile VirtualTexture::getTile(int lod, int u, int v)
         return TextureTile(0);
     }
 
-    TileQuadtreeNode* node = tileTree[u >> lod];
-    Tile* tile = node->tile;
     unsigned int tileLOD = 0;
-
-    for (int n = 0; n < lod; n++)
-    {
-        unsigned int mask = 1 << (lod - n - 1);
-        unsigned int child = (((v & mask) << 1) | (u & mask)) >> (lod - n - 1);
-        //int child = (((v << 1) | u) >> (lod - n - 1)) & 3;
-        if (!node->children[child])
-            break;
-
-        node = node->children[child];
-        if (node->tile != nullptr)
-        {
-            tile = node->tile;
-            tileLOD = n + 1;
-        }
-    }
+    Tile* tile = findTile(lod, u, v, false, tileLOD);
 
     // No tile was found at all--not even the base texture was found
     if (!tile)
         return TextureTile(0);
 
-    // Make the tile resident.
-    unsigned int tileU = u >> (lod - tileLOD);
-    unsigned int tileV = v >> (lod - tileLOD);
-    makeResident(tile, tileLOD, tileU, tileV);
+    if (tile->tex != nullptr)
+    {
+        stats.hits++;
+    }
+    else
+    {
+        // Start loading the tile in the background, and make do with the
+        // best resident tile of a lower LOD until it arrives. If there is
+        // none, load the base tile as well so that something is shown
+        // soon.
+        stats.misses++;
+        if (!tile->loadFailed)
+            requestTile(tile, tileLOD, u >> (lod - tileLOD), v >> (lod - tileLOD));
+
+        tile = findTile(lod, u, v, true, tileLOD);
+        if (!tile)
+        {
+            unsigned int shift = lod - baseSplit;
+            Tile* baseTile = findTile(baseSplit, u >> shift, v >> shift, false, tileLOD);
+            if (baseTile != nullptr && !baseTile->loadFailed)
+                requestTile(baseTile, tileLOD, u >> (lod - tileLOD), v >> (lod - tileLOD));
+            return TextureTile(0);
+        }
+    }
 
-    // It's possible that we failed to make the tile resident, either
-    // because the texture file was bad, or there was an unresolvable
-    // out of memory situation.  In that case there is nothing else to
-    // do but return a texture tile with a null texture name.
-    if (!tile->tex)
-        return TextureTile(0);
+    touchTile(tile);
 
     // Set up the texture subrect to be the entire texture
     float texU = 0.0f;
@@ -182,11 +226,105 @@ void VirtualTexture::beginUsage()
 {
     ticks++;
     tilesRequested = 0;
+    uploadLoadedTiles();
 }
 
 
 void VirtualTexture::endUsage()
 {
+    evictTiles();
+}
+
+
+void VirtualTexture::beginFrame()
+{
+    frameCounter++;
+}
+
+
+void VirtualTexture::setMemoryBudget(size_t bytes)
+{
+    memoryBudget = bytes;
+    evictTiles();
+}
+
+
+size_t VirtualTexture::getMemoryBudget()
+{
+    return memoryBudget;
+}
+
+
+VirtualTexture::TileStats VirtualTexture::getTileStats()
+{
+    return stats;
+}
+
+
+// Find the tile of the highest LOD covering the requested area, only
+// considering resident tiles if residentOnly is set.
+VirtualTexture::Tile* VirtualTexture::findTile(unsigned int lod,
+                                               unsigned int u, unsigned int v,
+                                               bool residentOnly,
+                                               unsigned int& tileLOD) const
+{
+    TileQuadtreeNode* node = tileTree[u >> lod];
+    Tile* tile = nullptr;
+    tileLOD = 0;
+
+    if (node->tile != nullptr && (!residentOnly || node->tile->tex != nullptr))
+        tile = node->tile;
+
+    for (unsigned int n = 0; n < lod; n++)
+    {
+        unsigned int mask = 1 << (lod - n - 1);
+        unsigned int child = (((v & mask) << 1) | (u & mask)) >> (lod - n - 1);
+        if (!node->children[child])
+            break;
+
+        node = node->children[child];
+        if (node->tile != nullptr && (!residentOnly || node->tile->tex != nullptr))
+        {
+            tile = node->tile;
+            tileLOD = n + 1;
+        }
+    }
+
+    return tile;
+}
+
+
+// Mark a tile as the most recently used one
+void VirtualTexture::touchTile(Tile* tile)
+{
+    tile->lastUsed = frameCounter;
+    residentTiles.splice(residentTiles.begin(), residentTiles, tile->lruPosition);
+}
+
+
+// Evict the least recently used tiles until the resident ones fit into the
+// budget. Tiles used since the last beginFrame() are kept, as they may
+// still be drawn by any virtual texture in the current frame.
+void VirtualTexture::evictTiles()
+{
+    if (memoryBudget == 0)
+        return;
+
+    while (stats.residentBytes > memoryBudget && !residentTiles.empty())
+    {
+        Tile* tile = residentTiles.back();
+        if (tile->lastUsed == frameCounter)
+            break;
+
+        residentTiles.pop_back();
+        stats.residentBytes -= tile->memorySize;
+        stats.residentTiles--;
+        stats.evictions++;
+
+        delete tile->tex;
+        tile->tex = nullptr;
+        tile->memorySize = 0;
+    }
 }
 
 
@@ -200,50 +338,86 @@ unsigned int VirtualTexture::tileIndex(unsigned int lod,
 #endif
 
 
-ImageTexture* VirtualTexture::loadTileTexture(unsigned int lod, unsigned int u, unsigned int v)
+VirtualTexture::LoadQueue::~LoadQueue()
 {
-    lod >>= baseSplit;
-    assert(lod < (unsigned)MaxResolutionLevels);
-
-    auto path = tilePath /
-                fmt::sprintf("level%d", lod) /
-                fmt::sprintf("%s%d_%d%s", tilePrefix, u, v, tileExt.string());
-
-    Image* img = LoadImageFromFile(path);
-    if (img == nullptr)
-        return nullptr;
+    for (const auto& loaded : tiles)
+        delete loaded.image;
+}
 
-    ImageTexture* tex = nullptr;
 
-    // Only use mip maps for the LOD 0; for higher LODs, the function of mip
-    // mapping is built into the texture.
-    MipMapMode mipMapMode = lod == 0 ? DefaultMipMaps : NoMipMaps;
+// Decode the image of a tile on the thread pool; it is uploaded by
+// uploadLoadedTiles().
+void VirtualTexture::requestTile(Tile* tile, unsigned int lod, unsigned int u, unsigned int v)
+{
+    if (tile->loading)
+        return;
 
-    if (isPow2(img->getWidth()) && isPow2(img->getHeight()))
-        tex = new ImageTexture(*img, EdgeClamp, mipMapMode);
+    assert(lod >= baseSplit && lod - baseSplit < (unsigned)MaxResolutionLevels);
 
-    // TODO: Virtual textures can have tiles in different formats, some
-    // compressed and some not. The compression flag doesn't make much
-    // sense for them.
-    compressed = img->isCompressed();
+    auto path = tilePath /
+                fmt::sprintf("level%d", lod - baseSplit) /
+                fmt::sprintf("%s%d_%d%s", tilePrefix, u, v, tileExt.string());
 
-    delete img;
+    tile->loading = true;
+    stats.pendingTiles++;
 
-    return tex;
+    shared_ptr<LoadQueue> queue = loadQueue;
+    ThreadPool::global().submit([queue, tile, lod, path]()
+    {
+        Image* img = LoadImageFromFile(path);
+        lock_guard<mutex> lock(queue->mutex);
+        queue->tiles.push_back({ tile, lod, img });
+    });
 }
 
 
-void VirtualTexture::makeResident(Tile* tile, unsigned int lod, unsigned int u, unsigned int v)
+void VirtualTexture::uploadLoadedTiles()
 {
-    if (tile->tex == nullptr && !tile->loadFailed)
+    for (unsigned int i = 0; i < MaxTileUploads; i++)
     {
-        // Potentially evict other tiles in order to make this one fit
-        tile->tex = loadTileTexture(lod, u, v);
-        if (tile->tex == nullptr)
+        LoadedTile loaded;
+        {
+            lock_guard<mutex> lock(loadQueue->mutex);
+            if (loadQueue->tiles.empty())
+                return;
+            loaded = loadQueue->tiles.front();
+            loadQueue->tiles.pop_front();
+        }
+
+        Tile* tile = loaded.tile;
+        Image* img = loaded.image;
+        tile->loading = false;
+        stats.pendingTiles--;
+
+        if (img != nullptr && isPow2(img->getWidth()) && isPow2(img->getHeight()))
+        {
+            // Only use mip maps for the LOD 0; for higher LODs, the function
+            // of mip mapping is built into the texture.
+            bool useMipMaps = loaded.lod == baseSplit;
+            tile->tex = new ImageTexture(*img, EdgeClamp, useMipMaps ? DefaultMipMaps : NoMipMaps);
+            tile->memorySize = img->getSize();
+            if (useMipMaps && img->getMipLevelCount() == 1)
+                tile->memorySize += tile->memorySize / 3;
+
+            residentTiles.push_front(tile);
+            tile->lruPosition = residentTiles.begin();
+            tile->lastUsed = frameCounter;
+            stats.residentBytes += tile->memorySize;
+            stats.residentTiles++;
+            stats.loads++;
+
+            // TODO: Virtual textures can have tiles in different formats, some
+            // compressed and some not. The compression flag doesn't make much
+            // sense for them.
+            compressed = img->isCompressed();
+        }
+        else
         {
-            // cout << "Texture load failed!\n";
             tile->loadFailed = true;
+            stats.failures++;
         }
+
+        delete img;
     }
 }
 
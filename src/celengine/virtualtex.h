@@ -10,9 +10,17 @@
 #ifndef _CELENGINE_VIRTUALTEX_H_
 #define _CELENGINE_VIRTUALTEX_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <celengine/texture.h>
 
+class Image;
+
 
 class VirtualTexture : public Texture
 {
@@ -22,7 +30,7 @@ class VirtualTexture : public Texture
                    unsigned int _tileSize,
                    const std::string& _tilePrefix,
                    const std::string& _tileType);
-    ~VirtualTexture() = default;
+    ~VirtualTexture();
 
     const TextureTile getTile(int lod, int u, int v) override;
     void bind() override;
@@ -33,13 +41,56 @@ class VirtualTexture : public Texture
     void beginUsage() override;
     void endUsage() override;
 
+    struct TileStats
+    {
+        uint64_t hits{ 0 };        // requested tile was resident
+        uint64_t misses{ 0 };      // an ancestor tile or nothing was returned
+        uint64_t loads{ 0 };       // tiles decoded and uploaded
+        uint64_t failures{ 0 };    // tiles which could not be loaded
+        uint64_t evictions{ 0 };
+        size_t   residentTiles{ 0 };
+        size_t   residentBytes{ 0 };
+        size_t   pendingTiles{ 0 };
+    };
+
+    // Tile memory is shared by all virtual textures; once it exceeds the
+    // budget, the least recently used tiles are evicted. Zero means no
+    // limit.
+    static void setMemoryBudget(size_t bytes);
+    // Called by the renderer once per frame; tiles used during the current
+    // frame are never evicted.
+    static void beginFrame();
+    static size_t getMemoryBudget();
+    static TileStats getTileStats();
+
  private:
     struct Tile
     {
         Tile() = default;
         unsigned int lastUsed{ 0 };
         ImageTexture* tex{ nullptr };
+        size_t memorySize{ 0 };
+        std::list<Tile*>::iterator lruPosition;
         bool loadFailed{ false };
+        bool loading{ false };
+    };
+
+    // Tiles decoded by the thread pool, waiting to be uploaded from the
+    // rendering thread. Shared with the decoding tasks, so that it
+    // outlives the texture if they are still running.
+    struct LoadedTile
+    {
+        Tile* tile;
+        unsigned int lod;
+        Image* image;
+    };
+
+    struct LoadQueue
+    {
+        ~LoadQueue();
+
+        std::mutex mutex;
+        std::deque<LoadedTile> tiles;
     };
 
     struct TileQuadtreeNode
@@ -51,12 +102,17 @@ class VirtualTexture : public Texture
 
     void populateTileTree();
     void addTileToTree(Tile* tile, unsigned int lod, unsigned int u, unsigned int v);
-    void makeResident(Tile* tile, unsigned int lod, unsigned int u, unsigned int v);
-    ImageTexture* loadTileTexture(unsigned int lod, unsigned int u, unsigned int v);
+    void deleteTileTree(TileQuadtreeNode* node);
+    void requestTile(Tile* tile, unsigned int lod, unsigned int u, unsigned int v);
+    void uploadLoadedTiles();
+    void touchTile(Tile* tile);
+    static void evictTiles();
 
     Tile* tiles{ nullptr };
     Tile* findTile(unsigned int lod,
-                   unsigned int u, unsigned int v);
+                   unsigned int u, unsigned int v,
+                   bool residentOnly,
+                   unsigned int& tileLOD) const;
 
  private:
     fs::path tilePath;
@@ -75,6 +131,14 @@ class VirtualTexture : public Texture
     };
 
     TileQuadtreeNode* tileTree[2];
+
+    std::shared_ptr<LoadQueue> loadQueue;
+
+    static size_t memoryBudget;
+    static unsigned int frameCounter;
+    // Resident tiles of all virtual textures, most recently used first
+    static std::list<Tile*> residentTiles;
+    static TileStats stats;
 };
 
 
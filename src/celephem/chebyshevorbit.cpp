@@ -0,0 +1,461 @@
+// chebyshevorbit.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Piecewise Chebyshev approximation of expensive orbits.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <fmt/printf.h>
+#include <celmath/mathlib.h>
+#include <celutil/debug.h>
+#include <celutil/threadpool.h>
+#include <celutil/util.h>
+#include "chebyshevorbit.h"
+
+using namespace Eigen;
+using namespace std;
+
+constexpr unsigned int ChebyshevOrbitCache::NCoeffs;
+
+namespace
+{
+// Spans are counted from J2000 so that their boundaries don't depend on
+// the time at which they were first needed.
+constexpr double SpanOrigin = 2451545.0;
+// Number of times a span may be halved to meet the tolerance
+constexpr int MaxDepth = 16;
+// Most segments a span can be fitted with
+constexpr uint32_t MaxSpanSegments = 1u << MaxDepth;
+
+const char     CACHE_MAGIC[8]   = { 'C', 'E', 'L', 'C', 'H', 'E', 'B', 'Y' };
+const uint32_t CACHE_VERSION    = 1;
+const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+fs::path cacheDirectory;
+double defaultTolerance = 0.0;
+
+// 64-bit FNV-1a
+uint64_t hashString(const string& s)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : s)
+    {
+        hash ^= (unsigned char) c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Sum of the Chebyshev series of the three coordinates at u in [-1, 1];
+// coeffs holds n coefficients for each coordinate.
+Vector3d chebyshevSum(const double* coeffs, unsigned int n, double u)
+{
+    // Same recurrence as JPLEphemeris::getPlanetPosition()
+    double sum[3];
+    for (int i = 0; i < 3; i++)
+        sum[i] = coeffs[i * n] + coeffs[i * n + 1] * u;
+
+    double c0 = 1.0;
+    double c1 = u;
+    for (unsigned int j = 2; j < n; j++)
+    {
+        double c = 2.0 * u * c1 - c0;
+        for (int i = 0; i < 3; i++)
+            sum[i] += coeffs[i * n + j] * c;
+        c0 = c1;
+        c1 = c;
+    }
+
+    return Vector3d(sum[0], sum[1], sum[2]);
+}
+
+template<typename T> bool readValue(istream& in, T& value)
+{
+    return (bool) in.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+template<typename T> void writeValue(ostream& out, const T& value)
+{
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+} // end unnamed namespace
+
+
+ChebyshevOrbitCache::ChebyshevOrbitCache(unique_ptr<Orbit> _orbit,
+                                         double _tolerance,
+                                         const string& cacheKey) :
+    orbit(std::move(_orbit)),
+    tolerance(_tolerance)
+{
+    orbit->getValidRange(validBegin, validEnd);
+
+    double period = orbit->getPeriod();
+    if (period > 0.0)
+        spanLength = period / 8.0;
+    else if (validBegin != validEnd)
+        spanLength = (validEnd - validBegin) / 64.0;
+    else
+        spanLength = 1.0;
+
+    if (!cacheKey.empty() && !cacheDirectory.empty())
+    {
+        // The tolerance is part of the key so that orbits fitted with
+        // different tolerances don't share a file.
+        string key = fmt::sprintf("%s;%.17g", cacheKey, tolerance);
+        cacheFile = cacheDirectory / fmt::sprintf("%016x.cheb", hashString(key));
+        loadSpans();
+    }
+}
+
+
+// The save tasks refer to the spans
+ChebyshevOrbitCache::~ChebyshevOrbitCache()
+{
+    unique_lock<mutex> lock(spansMutex);
+    savesDone.wait(lock, [this]() { return queuedSaves == 0; });
+}
+
+
+Vector3d ChebyshevOrbitCache::positionAtTime(double jd) const
+{
+    const Segment* seg = findSegment(jd);
+    if (seg == nullptr)
+        return orbit->positionAtTime(jd);
+
+    double u = 2.0 * (jd - seg->start) / seg->length - 1.0;
+    return chebyshevSum(seg->coeffs, NCoeffs, u);
+}
+
+
+Vector3d ChebyshevOrbitCache::velocityAtTime(double jd) const
+{
+    const Segment* seg = findSegment(jd);
+    if (seg == nullptr)
+        return orbit->velocityAtTime(jd);
+
+    // Derivatives of the Chebyshev polynomials from
+    // T'[j] = 2 T[j-1] + 2 u T'[j-1] - T'[j-2]
+    double u = 2.0 * (jd - seg->start) / seg->length - 1.0;
+    double cc[NCoeffs];
+    double dc[NCoeffs];
+    cc[0] = 1.0;
+    cc[1] = u;
+    dc[0] = 0.0;
+    dc[1] = 1.0;
+    for (unsigned int j = 2; j < NCoeffs; j++)
+    {
+        cc[j] = 2.0 * u * cc[j - 1] - cc[j - 2];
+        dc[j] = 2.0 * cc[j - 1] + 2.0 * u * dc[j - 1] - dc[j - 2];
+    }
+
+    double sum[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const double* coeffs = seg->coeffs + i * NCoeffs;
+        sum[i] = 0.0;
+        for (unsigned int j = 1; j < NCoeffs; j++)
+            sum[i] += coeffs[j] * dc[j];
+    }
+
+    // du/dt = 2 / length
+    return Vector3d(sum[0], sum[1], sum[2]) * (2.0 / seg->length);
+}
+
+
+double ChebyshevOrbitCache::getPeriod() const
+{
+    return orbit->getPeriod();
+}
+
+
+double ChebyshevOrbitCache::getBoundingRadius() const
+{
+    return orbit->getBoundingRadius();
+}
+
+
+/*! Orbit paths are sampled from the wrapped orbit, so that they keep its
+ *  sampling parameters.
+ */
+void ChebyshevOrbitCache::sample(double startTime, double endTime, OrbitSampleProc& proc) const
+{
+    orbit->sample(startTime, endTime, proc);
+}
+
+
+bool ChebyshevOrbitCache::isSampleThreadSafe() const
+{
+    return orbit->isSampleThreadSafe();
+}
+
+
+// Spans are fitted under the lock, but times outside the valid range are
+// passed on to the orbit.
+bool ChebyshevOrbitCache::isThreadSafe() const
+{
+    return orbit->isThreadSafe();
+}
+
+
+bool ChebyshevOrbitCache::isPeriodic() const
+{
+    return orbit->isPeriodic();
+}
+
+
+bool ChebyshevOrbitCache::isChebyshevApproximation() const
+{
+    return true;
+}
+
+
+void ChebyshevOrbitCache::getValidRange(double& begin, double& end) const
+{
+    orbit->getValidRange(begin, end);
+}
+
+
+ChebyshevOrbitCache::Stats ChebyshevOrbitCache::getStats() const
+{
+    lock_guard<mutex> lock(spansMutex);
+    return stats;
+}
+
+
+void ChebyshevOrbitCache::setCacheDirectory(const fs::path& dir)
+{
+    cacheDirectory = dir;
+}
+
+
+void ChebyshevOrbitCache::setDefaultTolerance(double tolerance)
+{
+    defaultTolerance = tolerance;
+}
+
+
+double ChebyshevOrbitCache::getDefaultTolerance()
+{
+    return defaultTolerance;
+}
+
+
+/*! Return the segment containing jd, fitting its span first if it hasn't
+ *  been, or nullptr when jd is outside the orbit's valid range. Spans are
+ *  never modified once fitted, so the segment stays valid after the lock
+ *  is released. Newly fitted spans are queued for saving, which is left
+ *  to the thread pool so that evaluating an orbit never waits for disk.
+ */
+const ChebyshevOrbitCache::Segment* ChebyshevOrbitCache::findSegment(double jd) const
+{
+    bool bounded = validBegin != validEnd;
+    if (bounded && (jd < validBegin || jd > validEnd))
+        return nullptr;
+
+    auto index = (int64_t) floor((jd - SpanOrigin) / spanLength);
+    bool queueSave = false;
+
+    unique_lock<mutex> lock(spansMutex);
+    auto iter = spans.find(index);
+    if (iter == spans.end())
+    {
+        double start = SpanOrigin + (double) index * spanLength;
+        double end = start + spanLength;
+        if (bounded)
+        {
+            start = max(start, validBegin);
+            end = min(end, validEnd);
+        }
+
+        Span span;
+        fitSegment(start, end - start, 0, span);
+        iter = spans.emplace(index, std::move(span)).first;
+        stats.spansFitted++;
+        stats.segments += iter->second.size();
+        if (!cacheFile.empty())
+        {
+            // A single queued task writes all spans fitted until it runs
+            queueSave = unsavedSpans.empty();
+            unsavedSpans.push_back(index);
+            if (queueSave)
+                queuedSaves++;
+        }
+    }
+
+    // Segments are sorted by start time and cover the span
+    const Span& span = iter->second;
+    auto seg = upper_bound(span.begin(), span.end(), jd,
+                           [](double t, const Segment& s) { return t < s.start; });
+    if (seg != span.begin())
+        --seg;
+
+    // A pool without workers runs the task right away, so submit it
+    // without holding the lock.
+    lock.unlock();
+    if (queueSave)
+        ThreadPool::global().submit([this]() { saveSpans(); });
+
+    return &*seg;
+}
+
+
+void ChebyshevOrbitCache::fitSegment(double start, double length, int depth, Span& span) const
+{
+    // Interpolate at the Chebyshev nodes
+    Vector3d values[NCoeffs];
+    for (unsigned int k = 0; k < NCoeffs; k++)
+    {
+        double u = cos(PI * (k + 0.5) / NCoeffs);
+        values[k] = orbit->positionAtTime(start + (u + 1.0) * 0.5 * length);
+    }
+    stats.orbitEvaluations += NCoeffs;
+
+    Segment seg;
+    seg.start = start;
+    seg.length = length;
+    for (unsigned int j = 0; j < NCoeffs; j++)
+    {
+        Vector3d c = Vector3d::Zero();
+        for (unsigned int k = 0; k < NCoeffs; k++)
+            c += values[k] * cos(PI * j * (k + 0.5) / NCoeffs);
+        c *= (j == 0 ? 1.0 : 2.0) / NCoeffs;
+        for (int i = 0; i < 3; i++)
+            seg.coeffs[i * NCoeffs + j] = c[i];
+    }
+
+    // Check the error at the extrema of the last polynomial, which lie
+    // between the nodes and include both ends of the segment.
+    double maxError = 0.0;
+    if (depth < MaxDepth)
+    {
+        for (unsigned int m = 0; m <= NCoeffs; m++)
+        {
+            double u = cos(PI * m / NCoeffs);
+            Vector3d exact = orbit->positionAtTime(start + (u + 1.0) * 0.5 * length);
+            Vector3d approx = chebyshevSum(seg.coeffs, NCoeffs, u);
+            maxError = max(maxError, (approx - exact).norm());
+        }
+        stats.orbitEvaluations += NCoeffs + 1;
+    }
+
+    if (maxError > tolerance)
+    {
+        fitSegment(start, length * 0.5, depth + 1, span);
+        fitSegment(start + length * 0.5, length * 0.5, depth + 1, span);
+    }
+    else
+    {
+        span.push_back(seg);
+    }
+}
+
+
+/*! The cache file holds a header followed by one record per fitted span;
+ *  records are appended as spans are fitted. A truncated or mismatched
+ *  file is rewritten on the next save.
+ */
+void ChebyshevOrbitCache::loadSpans()
+{
+    ifstream in(cacheFile.string(), ios::in | ios::binary);
+    if (!in.good())
+        return;
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t version, byteOrder, nCoeffs;
+    double fileSpanLength;
+    if (!in.read(magic, sizeof(magic)) ||
+        memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        !readValue(in, version) || version != CACHE_VERSION ||
+        !readValue(in, byteOrder) || byteOrder != CACHE_BYTE_ORDER ||
+        !readValue(in, nCoeffs) || nCoeffs != NCoeffs ||
+        !readValue(in, fileSpanLength) || fileSpanLength != spanLength)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        int64_t index;
+        uint32_t nSegments;
+        if (!readValue(in, index))
+        {
+            // Clean end of file
+            cacheFileValid = in.eof();
+            break;
+        }
+        // A count no span can have means the file is corrupt
+        if (!readValue(in, nSegments) || nSegments == 0 || nSegments > MaxSpanSegments)
+            break;
+
+        Span span(nSegments);
+        if (!in.read(reinterpret_cast<char*>(span.data()), nSegments * sizeof(Segment)))
+            break;
+
+        stats.spansLoaded++;
+        stats.segments += nSegments;
+        spans[index] = std::move(span);
+    }
+}
+
+
+void ChebyshevOrbitCache::saveSpans() const
+{
+    lock_guard<mutex> fileLock(fileMutex);
+
+    // The spans are written without holding spansMutex; they stay where
+    // they are in the map, and are never modified.
+    vector<pair<int64_t, const Span*>> records;
+    bool rewrite = !cacheFileValid;
+    {
+        lock_guard<mutex> lock(spansMutex);
+        if (rewrite)
+        {
+            // Start a new file with all the spans fitted so far
+            for (const auto& s : spans)
+                records.emplace_back(s.first, &s.second);
+        }
+        else
+        {
+            for (int64_t index : unsavedSpans)
+                records.emplace_back(index, &spans.find(index)->second);
+        }
+        unsavedSpans.clear();
+    }
+
+    if (rewrite && !MakeDirectories(cacheFile.parent_path()))
+    {
+        DPRINTF(LOG_LEVEL_WARNING, "Cannot create orbit cache directory %s\n", cacheFile.parent_path());
+    }
+    else
+    {
+        ofstream out(cacheFile.string(), ios::out | ios::binary | (rewrite ? ios::trunc : ios::app));
+        if (rewrite)
+        {
+            out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+            writeValue(out, CACHE_VERSION);
+            writeValue(out, CACHE_BYTE_ORDER);
+            writeValue(out, (uint32_t) NCoeffs);
+            writeValue(out, spanLength);
+        }
+        for (const auto& record : records)
+        {
+            const Span& span = *record.second;
+            writeValue(out, record.first);
+            writeValue(out, (uint32_t) span.size());
+            out.write(reinterpret_cast<const char*>(span.data()), span.size() * sizeof(Segment));
+        }
+        cacheFileValid = out.good();
+    }
+
+    lock_guard<mutex> lock(spansMutex);
+    queuedSaves--;
+    savesDone.notify_all();
+}
@@ -0,0 +1,112 @@
+// chebyshevorbit.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Piecewise Chebyshev approximation of expensive orbits.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <celcompat/filesystem.h>
+#include "orbit.h"
+
+/*! Wraps an orbit that is costly to evaluate (analytic theories, scripted
+ *  orbits) and replaces it with piecewise Chebyshev polynomials, in the
+ *  same way as the records of a JPL ephemeris. Time is split into spans
+ *  of an eighth of the orbital period, which are fitted the first time
+ *  they're needed. A fit whose error at the test points exceeds the
+ *  tolerance is split in half, down to a minimum length.
+ *
+ *  Fits of orbits that have a cache key can be kept in a directory set
+ *  with setCacheDirectory(), so that they're reused on the next run. The
+ *  key must identify the orbit's theory; only use it for orbits that
+ *  can't change between runs. New fits are written to the file by the
+ *  thread pool, not by the thread evaluating the orbit.
+ */
+class ChebyshevOrbitCache : public Orbit
+{
+ public:
+    ChebyshevOrbitCache(std::unique_ptr<Orbit> orbit,
+                        double tolerance,
+                        const std::string& cacheKey = std::string());
+    ~ChebyshevOrbitCache() override;
+
+    Eigen::Vector3d positionAtTime(double jd) const override;
+    Eigen::Vector3d velocityAtTime(double jd) const override;
+    double getPeriod() const override;
+    double getBoundingRadius() const override;
+    void sample(double startTime, double endTime, OrbitSampleProc& proc) const override;
+    bool isSampleThreadSafe() const override;
+    bool isThreadSafe() const override;
+    bool isPeriodic() const override;
+    bool isChebyshevApproximation() const override;
+    void getValidRange(double& begin, double& end) const override;
+
+    struct Stats
+    {
+        uint64_t spansFitted;
+        uint64_t spansLoaded;       // read from the cache file
+        uint64_t segments;
+        uint64_t orbitEvaluations;  // made by the fits
+    };
+    Stats getStats() const;
+
+    // File holding the fits, empty if they aren't kept on disk
+    const fs::path& getCacheFile() const { return cacheFile; }
+
+    static void setCacheDirectory(const fs::path& dir);
+
+    // Tolerance in km for objects that don't set OrbitCacheTolerance; zero
+    // leaves their orbits uncached.
+    static void setDefaultTolerance(double tolerance);
+    static double getDefaultTolerance();
+
+    // Coefficients per coordinate of each polynomial
+    static constexpr unsigned int NCoeffs = 12;
+
+ private:
+    struct Segment
+    {
+        double start;
+        double length;
+        double coeffs[3 * NCoeffs];
+    };
+    typedef std::vector<Segment> Span;
+
+    const Segment* findSegment(double jd) const;
+    void fitSegment(double start, double length, int depth, Span& span) const;
+    void loadSpans();
+    void saveSpans() const;
+
+    std::unique_ptr<Orbit> orbit;
+    double tolerance;
+    double spanLength;
+    double validBegin{ 0.0 };
+    double validEnd{ 0.0 };
+    fs::path cacheFile;
+
+    mutable std::mutex spansMutex;
+    mutable std::unordered_map<int64_t, Span> spans;
+    mutable Stats stats{ 0, 0, 0, 0 };
+
+    // Spans fitted but not written yet, and the number of queued save
+    // tasks; guarded by spansMutex.
+    mutable std::vector<int64_t> unsavedSpans;
+    mutable unsigned int queuedSaves{ 0 };
+    mutable std::condition_variable savesDone;
+
+    // Serializes the save tasks
+    mutable std::mutex fileMutex;
+    mutable bool cacheFileValid{ false };
+};
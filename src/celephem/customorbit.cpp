@@ -381,6 +381,20 @@ void ComputeGalileanElements(double t,
 
 
 
+//////////////////////////////////////////////////////////////////////////////
+
+// Base of the theories that only read their tables. Those of the planets
+// from Mercury to Pluto other than the Earth share gPlanetElements, and
+// can't be evaluated on several threads at once.
+class ReentrantOrbit : public CachingOrbit
+{
+ public:
+    bool isThreadSafe() const override
+    {
+        return true;
+    }
+};
+
 //////////////////////////////////////////////////////////////////////////////
 
 class MercuryOrbit : public CachingOrbit
@@ -521,7 +535,7 @@ class VenusOrbit : public CachingOrbit
     };
 };
 
-class EarthOrbit : public CachingOrbit
+class EarthOrbit : public ReentrantOrbit
 {
  public:
     ~EarthOrbit() override = default;
@@ -589,7 +603,7 @@ class EarthOrbit : public CachingOrbit
 };
 
 
-class LunarOrbit : public CachingOrbit
+class LunarOrbit : public ReentrantOrbit
 {
  public:
     ~LunarOrbit() override = default;
@@ -1333,7 +1347,7 @@ static Vector3d ellipsePosition(double a, double e, double M)
 }
 
 
-class PhobosOrbit : public CachingOrbit
+class PhobosOrbit : public ReentrantOrbit
 {
  public:
     ~PhobosOrbit() override = default;
@@ -1402,7 +1416,7 @@ class PhobosOrbit : public CachingOrbit
 };
 
 
-class DeimosOrbit : public CachingOrbit
+class DeimosOrbit : public ReentrantOrbit
 {
  public:
     ~DeimosOrbit() override = default;
@@ -1544,7 +1558,7 @@ class DeimosOrbit : public CachingOrbit
 // static const double JupAscendingNode = degToRad(20.453422);
 static const double JupAscendingNode = degToRad(22.203);
 
-class IoOrbit : public CachingOrbit
+class IoOrbit : public ReentrantOrbit
 {
  public:
     ~IoOrbit() override = default;
@@ -1625,7 +1639,7 @@ class IoOrbit : public CachingOrbit
     };
 };
 
-class EuropaOrbit : public CachingOrbit
+class EuropaOrbit : public ReentrantOrbit
 {
  public:
     ~EuropaOrbit() override = default;
@@ -1717,7 +1731,7 @@ class EuropaOrbit : public CachingOrbit
     };
 };
 
-class GanymedeOrbit : public CachingOrbit
+class GanymedeOrbit : public ReentrantOrbit
 {
  public:
     ~GanymedeOrbit() override = default;
@@ -1812,7 +1826,7 @@ class GanymedeOrbit : public CachingOrbit
     };
 };
 
-class CallistoOrbit : public CachingOrbit
+class CallistoOrbit : public ReentrantOrbit
 {
  public:
     ~CallistoOrbit() override = default;
@@ -2047,7 +2061,7 @@ static void OuterSaturnMoonParams(double a, double e, double i,
 }
 
 
-class MimasOrbit : public CachingOrbit
+class MimasOrbit : public ReentrantOrbit
 {
  public:
     ~MimasOrbit() override = default;
@@ -2089,7 +2103,7 @@ class MimasOrbit : public CachingOrbit
 };
 
 
-class EnceladusOrbit : public CachingOrbit
+class EnceladusOrbit : public ReentrantOrbit
 {
  public:
     ~EnceladusOrbit() override = default;
@@ -2130,7 +2144,7 @@ class EnceladusOrbit : public CachingOrbit
 };
 
 
-class TethysOrbit : public CachingOrbit
+class TethysOrbit : public ReentrantOrbit
 {
  public:
     ~TethysOrbit() override = default;
@@ -2167,7 +2181,7 @@ class TethysOrbit : public CachingOrbit
 };
 
 
-class DioneOrbit : public CachingOrbit
+class DioneOrbit : public ReentrantOrbit
 {
  public:
     ~DioneOrbit() override = default;
@@ -2209,7 +2223,7 @@ class DioneOrbit : public CachingOrbit
 };
 
 
-class RheaOrbit : public CachingOrbit
+class RheaOrbit : public ReentrantOrbit
 {
  public:
     ~RheaOrbit() override = default;
@@ -2258,7 +2272,7 @@ class RheaOrbit : public CachingOrbit
 };
 
 
-class TitanOrbit : public CachingOrbit
+class TitanOrbit : public ReentrantOrbit
 {
  public:
     ~TitanOrbit() override = default;
@@ -2326,7 +2340,7 @@ class TitanOrbit : public CachingOrbit
 };
 
 
-class HyperionOrbit : public CachingOrbit
+class HyperionOrbit : public ReentrantOrbit
 {
  public:
     ~HyperionOrbit() override = default;
@@ -2409,7 +2423,7 @@ class HyperionOrbit : public CachingOrbit
 };
 
 
-class IapetusOrbit : public CachingOrbit
+class IapetusOrbit : public ReentrantOrbit
 {
  public:
     ~IapetusOrbit() override = default;
@@ -2501,7 +2515,7 @@ class IapetusOrbit : public CachingOrbit
 };
 
 
-class PhoebeOrbit : public CachingOrbit
+class PhoebeOrbit : public ReentrantOrbit
 {
  public:
     ~PhoebeOrbit() override = default;
@@ -2537,7 +2551,7 @@ class PhoebeOrbit : public CachingOrbit
 };
 
 
-class UranianSatelliteOrbit : public CachingOrbit
+class UranianSatelliteOrbit : public ReentrantOrbit
 {
  private:
     double a;
@@ -2731,7 +2745,7 @@ static UranianSatelliteOrbit* CreateUranianSatelliteOrbit(int n)
  *  is calculated in Neptunocentric coordinates referred to the
  *  Earth equator/equinox of J2000.0.
  */
-class TritonOrbit : public CachingOrbit
+class TritonOrbit : public ReentrantOrbit
 {
  public:
     ~TritonOrbit() override = default;
@@ -2980,7 +2994,7 @@ static const HTC20Angles CalypsoAngles =
     3.25074880
 };
 
-class HTC20Orbit : public CachingOrbit
+class HTC20Orbit : public ReentrantOrbit
 {
  public:
     HTC20Orbit(int _nTerms, const double* _args, const double* _amplitudes,
@@ -3052,7 +3066,7 @@ class HTC20Orbit : public CachingOrbit
 };
 
 
-class JPLEphOrbit : public CachingOrbit
+class JPLEphOrbit : public ReentrantOrbit
 {
  public:
     JPLEphOrbit(const JPLEphemeris& e,
@@ -3079,6 +3093,12 @@ class JPLEphOrbit : public CachingOrbit
         return boundingRadius;
     }
 
+    // Ephemeris records are Chebyshev polynomials
+    bool isChebyshevApproximation() const override
+    {
+        return true;
+    }
+
     Vector3d computePosition(double tjd) const override
     {
         // Get the position relative to the Earth (for the Moon) or
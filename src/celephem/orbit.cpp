@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <cmath>
 #include <cassert>
+#include <mutex>
 
 using namespace Eigen;
 using namespace std;
@@ -437,39 +438,49 @@ double EllipticalOrbit::getBoundingRadius() const
 
 Vector3d CachingOrbit::positionAtTime(double jd) const
 {
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        if (jd == lastTime && positionCacheValid)
+            return lastPosition;
+    }
+
+    // The lock isn't held while computing, since computeVelocity() calls
+    // back into positionAtTime().
+    Vector3d position = computePosition(jd);
+
+    lock_guard<mutex> lock(cacheMutex);
     if (jd != lastTime)
     {
         lastTime = jd;
-        lastPosition = computePosition(jd);
-        positionCacheValid = true;
         velocityCacheValid = false;
     }
-    else if (!positionCacheValid)
-    {
-        lastPosition = computePosition(jd);
-        positionCacheValid = true;
-    }
+    lastPosition = position;
+    positionCacheValid = true;
 
-    return lastPosition;
+    return position;
 }
 
 
 Vector3d CachingOrbit::velocityAtTime(double jd) const
 {
-    if (jd != lastTime)
     {
-        lastVelocity = computeVelocity(jd);
-        lastTime = jd;  // must be set *after* call to computeVelocity
-        positionCacheValid = false;
-        velocityCacheValid = true;
+        lock_guard<mutex> lock(cacheMutex);
+        if (jd == lastTime && velocityCacheValid)
+            return lastVelocity;
     }
-    else if (!velocityCacheValid)
+
+    Vector3d velocity = computeVelocity(jd);
+
+    lock_guard<mutex> lock(cacheMutex);
+    if (jd != lastTime)
     {
-        lastVelocity = computeVelocity(jd);
-        velocityCacheValid = true;
+        lastTime = jd;
+        positionCacheValid = false;
     }
+    lastVelocity = velocity;
+    velocityCacheValid = true;
 
-    return lastVelocity;
+    return velocity;
 }
 
 
@@ -631,6 +642,26 @@ void MixedOrbit::sample(double startTime, double endTime, OrbitSampleProc& proc)
 }
 
 
+bool MixedOrbit::isSampleThreadSafe() const
+{
+    // The approximations before and after the span are elliptical
+    return primary->isSampleThreadSafe();
+}
+
+
+bool MixedOrbit::isThreadSafe() const
+{
+    return primary->isThreadSafe();
+}
+
+
+// The Keplerian approximations outside the valid range are cheap as well
+bool MixedOrbit::isChebyshevApproximation() const
+{
+    return primary->isChebyshevApproximation();
+}
+
+
 /*** FixedOrbit ***/
 
 FixedOrbit::FixedOrbit(const Vector3d& pos) :
@@ -10,6 +10,7 @@
 #ifndef _CELENGINE_ORBIT_H_
 #define _CELENGINE_ORBIT_H_
 
+#include <mutex>
 #include <Eigen/Core>
 
 
@@ -39,6 +40,20 @@ class Orbit
 
     virtual bool isPeriodic() const { return true; };
 
+    // Return true if sample() may run on another thread while the orbit is
+    // being evaluated. Orbits that cache results or call code which isn't
+    // reentrant (scripts, SPICE) must keep the default.
+    virtual bool isSampleThreadSafe() const { return false; };
+
+    // Return true if positionAtTime() and velocityAtTime() may be called
+    // from several threads at once.
+    virtual bool isThreadSafe() const { return false; };
+
+    // True if positions are already computed from Chebyshev polynomials,
+    // as with the JPL ephemerides; ChebyshevOrbitCache leaves such orbits
+    // alone.
+    virtual bool isChebyshevApproximation() const { return false; };
+
     // Return the time range over which the orbit is valid; if the orbit
     // is always valid, begin and end should be equal.
     virtual void getValidRange(double& begin, double& end) const
@@ -68,6 +83,8 @@ class EllipticalOrbit : public Orbit
     virtual Eigen::Vector3d velocityAtTime(double) const;
     double getPeriod() const;
     double getBoundingRadius() const;
+    virtual bool isSampleThreadSafe() const { return true; };
+    virtual bool isThreadSafe() const { return true; };
 
  private:
     double eccentricAnomaly(double) const;
@@ -104,7 +121,8 @@ class OrbitSampleProc
  * Celestia may need require position of a planet more than once per frame; in
  * order to avoid redundant calculation, the CachingOrbit class saves the
  * result of the last calculation and uses it if the time matches the cached
- * time.
+ * time. The cache may be used from several threads; subclasses whose
+ * computePosition() is reentrant can override isThreadSafe().
  */
 class CachingOrbit : public Orbit
 {
@@ -121,6 +139,7 @@ class CachingOrbit : public Orbit
     Eigen::Vector3d velocityAtTime(double jd) const;
 
  private:
+    mutable std::mutex cacheMutex;
     mutable Eigen::Vector3d lastPosition;
     mutable Eigen::Vector3d lastVelocity;
     mutable double lastTime{ -1.0e30 };
@@ -146,6 +165,9 @@ class MixedOrbit : public Orbit
     virtual double getPeriod() const;
     virtual double getBoundingRadius() const;
     virtual void sample(double startTime, double endTime, OrbitSampleProc& proc) const;
+    virtual bool isSampleThreadSafe() const;
+    virtual bool isThreadSafe() const;
+    virtual bool isChebyshevApproximation() const;
 
  private:
     Orbit* primary;
@@ -175,6 +197,7 @@ class SynchronousOrbit : public Orbit
     virtual double getPeriod() const;
     virtual double getBoundingRadius() const;
     virtual void sample(double, double, OrbitSampleProc& proc) const;
+    virtual bool isSampleThreadSafe() const { return true; };
 
  private:
     const Body& body;
@@ -197,6 +220,8 @@ class FixedOrbit : public Orbit
     virtual bool isPeriodic() const;
     virtual double getBoundingRadius() const;
     virtual void sample(double, double, OrbitSampleProc&) const;
+    virtual bool isSampleThreadSafe() const { return true; };
+    virtual bool isThreadSafe() const { return true; };
 
  private:
     Eigen::Vector3d position;
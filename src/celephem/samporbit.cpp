@@ -18,7 +18,9 @@
 #include <celutil/bytes.h>
 #include <celutil/gettext.h>
 #include <celutil/debug.h>
+#include <celutil/mappedfile.h>
 #include <cmath>
+#include <cstring>
 #include <string>
 #include <algorithm>
 #include <vector>
@@ -83,6 +85,8 @@ public:
     void getValidRange(double& begin, double& end) const override;
 
     void sample(double startTime, double endTime, OrbitSampleProc& proc) const override;
+    // Sampling only reads the samples
+    bool isSampleThreadSafe() const override { return true; }
 
 private:
     vector<Sample<T> > samples;
@@ -448,6 +452,8 @@ public:
     void getValidRange(double& begin, double& end) const override;
 
     void sample(double startTime, double endTime, OrbitSampleProc& proc) const override;
+    // Sampling only reads the samples
+    bool isSampleThreadSafe() const override { return true; }
 
 private:
     vector<SampleXYZV<T> > samples;
@@ -822,74 +828,307 @@ template <typename T> SampledOrbitXYZV<T>* LoadSampledOrbitXYZV(const fs::path&
     return orbit;
 }
 
-/* Load a binary xyzv sampled trajectory file.
- */
-template <typename T> SampledOrbitXYZV<T>*
-LoadSampledOrbitXYZVBinary(const fs::path& filename, TrajectoryInterpolation interpolation, T /*unused*/)
+// Binary xyzv trajectory used in place from a memory mapped file, so that
+// only the pages holding the samples actually used become resident. The
+// segment containing a time is found through a uniform time bucket index,
+// which takes constant time for evenly spaced samples however far time
+// jumps between calls.
+class MappedOrbitXYZV : public CachingOrbit
 {
-    ifstream in(filename.string(), ios::binary);
-    if (!in.good())
+public:
+    MappedOrbitXYZV(TrajectoryInterpolation _interpolation);
+    ~MappedOrbitXYZV() override = default;
+
+    bool load(const fs::path& filename);
+
+    double getPeriod() const override;
+    double getBoundingRadius() const override;
+    Vector3d computePosition(double jd) const override;
+    Vector3d computeVelocity(double jd) const override;
+
+    bool isPeriodic() const override;
+    void getValidRange(double& begin, double& end) const override;
+
+    void sample(double startTime, double endTime, OrbitSampleProc& proc) const override;
+    // Sampling only reads the samples
+    bool isSampleThreadSafe() const override { return true; }
+
+private:
+    size_t bucketOf(double t) const;
+    size_t findSample(double jd) const;
+    Vector3d position(size_t i) const;
+    Vector3d velocity(size_t i) const;
+
+    // Average number of samples per bucket
+    static constexpr size_t SamplesPerBucket = 4;
+
+    MappedFile file;
+    const XYZVBinaryData* samples{ nullptr };
+    size_t nSamples{ 0 };
+    double boundingRadius{ 0.0 };
+
+    // buckets[i] is the first sample whose bucket is at least i
+    vector<uint32_t> buckets;
+    double bucketOrigin{ 0.0 };
+    double bucketScale{ 0.0 };
+
+    TrajectoryInterpolation interpolation;
+};
+
+
+MappedOrbitXYZV::MappedOrbitXYZV(TrajectoryInterpolation _interpolation) :
+    interpolation(_interpolation)
+{
+}
+
+
+bool MappedOrbitXYZV::load(const fs::path& filename)
+{
+    if (!file.open(filename))
     {
         fmt::fprintf(cerr, _("Error openning %s.\n"), filename);
-        return nullptr;
+        return false;
     }
 
     XYZVBinaryHeader header;
-    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    if (file.size() < sizeof(header))
     {
         fmt::fprintf(cerr, _("Error reading header of %s.\n"), filename);
-        return nullptr;
+        return false;
     }
+    memcpy(&header, file.data(), sizeof(header));
 
-    if (string(header.magic) != "CELXYZV")
+    if (memcmp(header.magic, "CELXYZV", sizeof(header.magic)) != 0)
     {
         fmt::fprintf(cerr, _("Bad binary xyzv file %s.\n"), filename);
-        return nullptr;
+        return false;
     }
 
     if (header.byteOrder != __BYTE_ORDER__)
     {
         fmt::fprintf(cerr, _("Unsupported byte order %i, expected %i.\n"),
                      header.byteOrder, __BYTE_ORDER__);
-        return nullptr;
+        return false;
     }
 
-
     if (header.digits != std::numeric_limits<double>::digits)
     {
         fmt::fprintf(cerr, _("Unsupported digits number %i, expected %i.\n"),
                      header.digits, std::numeric_limits<double>::digits);
-        return nullptr;
+        return false;
     }
 
-    if (header.count == 0)
-        return nullptr;
+    // As before, read all the complete records in the file
+    nSamples = (file.size() - sizeof(header)) / sizeof(XYZVBinaryData);
+    if (header.count == 0 || nSamples == 0 || nSamples >= numeric_limits<uint32_t>::max())
+        return false;
+    samples = reinterpret_cast<const XYZVBinaryData*>(file.data() + sizeof(header));
+
+    size_t nBuckets = max(nSamples / SamplesPerBucket, (size_t) 1);
+    double span = samples[nSamples - 1].tdb - samples[0].tdb;
+    bucketOrigin = samples[0].tdb;
+    bucketScale = span > 0.0 ? (double) nBuckets / span : 0.0;
+    buckets.resize(nBuckets + 1);
+
+    // One pass over the file checks the ordering and builds the bounding
+    // radius and the index; the pages are released afterwards.
+    size_t nextBucket = 0;
+    for (size_t i = 0; i < nSamples; i++)
+    {
+        const XYZVBinaryData& s = samples[i];
+        if (i > 0 && s.tdb < samples[i - 1].tdb)
+        {
+            fmt::fprintf(cerr, _("Samples out of order in %s.\n"), filename);
+            return false;
+        }
 
-    SampledOrbitXYZV<T>* orbit = new SampledOrbitXYZV<T>(interpolation);
+        boundingRadius = max(boundingRadius, Map<const Vector3d>(s.position).norm());
 
-    double lastSampleTime = -numeric_limits<T>::infinity();
+        size_t b = bucketOf(s.tdb);
+        while (nextBucket <= b)
+            buckets[nextBucket++] = (uint32_t) i;
+    }
+    while (nextBucket <= nBuckets)
+        buckets[nextBucket++] = (uint32_t) nSamples;
 
-    while (in.good())
+    file.release();
+    return true;
+}
+
+
+size_t MappedOrbitXYZV::bucketOf(double t) const
+{
+    double b = (t - bucketOrigin) * bucketScale;
+    if (!(b > 0.0))
+        return 0;
+    return min((size_t) b, buckets.size() - 2);
+}
+
+
+// Index of the first sample at or after jd, or nSamples if there is none;
+// the same result as lower_bound().
+size_t MappedOrbitXYZV::findSample(double jd) const
+{
+    if (jd <= samples[0].tdb)
+        return 0;
+    if (jd > samples[nSamples - 1].tdb)
+        return nSamples;
+
+    // Samples in earlier buckets are before jd and those in later buckets
+    // after it, so the result lies in [ buckets[b], buckets[b + 1] ].
+    size_t b = bucketOf(jd);
+    const XYZVBinaryData* first = samples + buckets[b];
+    const XYZVBinaryData* last = samples + buckets[b + 1];
+    const XYZVBinaryData* iter = lower_bound(first, last, jd,
+                                             [](const XYZVBinaryData& s, double t) { return s.tdb < t; });
+    return iter - samples;
+}
+
+
+Vector3d MappedOrbitXYZV::position(size_t i) const
+{
+    return Map<const Vector3d>(samples[i].position);
+}
+
+
+// Velocities are stored in km/sec; return km/Julian day
+Vector3d MappedOrbitXYZV::velocity(size_t i) const
+{
+    return Map<const Vector3d>(samples[i].velocity) * astro::daysToSecs(1.0);
+}
+
+
+double MappedOrbitXYZV::getPeriod() const
+{
+    return samples[nSamples - 1].tdb - samples[0].tdb;
+}
+
+
+bool MappedOrbitXYZV::isPeriodic() const
+{
+    return false;
+}
+
+
+void MappedOrbitXYZV::getValidRange(double& begin, double& end) const
+{
+    begin = samples[0].tdb;
+    end = samples[nSamples - 1].tdb;
+}
+
+
+double MappedOrbitXYZV::getBoundingRadius() const
+{
+    return boundingRadius;
+}
+
+
+Vector3d MappedOrbitXYZV::computePosition(double jd) const
+{
+    Vector3d pos;
+    size_t n = findSample(jd);
+
+    if (n == 0)
+    {
+        pos = position(0);
+    }
+    else if (n < nSamples)
     {
-        XYZVBinaryData data;
+        double t0 = samples[n - 1].tdb;
+        double t1 = samples[n].tdb;
 
-        if (!in.read(reinterpret_cast<char*>(&data), sizeof(data)))
-            break;
+        if (interpolation == TrajectoryInterpolationLinear)
+        {
+            double t = (jd - t0) / (t1 - t0);
+            Vector3d p0 = position(n - 1);
+            pos = p0 + t * (position(n) - p0);
+        }
+        else if (interpolation == TrajectoryInterpolationCubic)
+        {
+            double h = t1 - t0;
+            double t = (jd - t0) / h;
+            pos = cubicInterpolate(position(n - 1), velocity(n - 1) * h,
+                                   position(n), velocity(n) * h,
+                                   t);
+        }
+        else
+        {
+            // Unknown interpolation type
+            pos = Vector3d::Zero();
+        }
+    }
+    else
+    {
+        pos = position(nSamples - 1);
+    }
 
-        double tdb = data.tdb;
-        Vector3d position = Map<Vector3d>(data.position);
-        Vector3d velocity = Map<Vector3d>(data.velocity);
+    // Add correction for Celestia's coordinate system
+    return Vector3d(pos.x(), pos.z(), -pos.y());
+}
 
-        // Convert velocities from km/sec to km/Julian day
-        velocity *= astro::daysToSecs(1.0);
 
-        if (tdb != lastSampleTime)
+// Velocity is computed as the derivative of the interpolating function
+// for position.
+Vector3d MappedOrbitXYZV::computeVelocity(double jd) const
+{
+    Vector3d vel(Vector3d::Zero());
+    size_t n = findSample(jd);
+
+    if (n > 0 && n < nSamples)
+    {
+        double t0 = samples[n - 1].tdb;
+        double t1 = samples[n].tdb;
+        double h = t1 - t0;
+
+        if (interpolation == TrajectoryInterpolationLinear)
+        {
+            vel = (position(n) - position(n - 1)) * (1.0 / h) * astro::daysToSecs(1.0);
+        }
+        else if (interpolation == TrajectoryInterpolationCubic)
         {
-            orbit->addSample(tdb, position, velocity);
-            lastSampleTime = tdb;
+            double ih = 1.0 / h;
+            double t = (jd - t0) * ih;
+            vel = cubicInterpolateVelocity(position(n - 1), velocity(n - 1) * h,
+                                           position(n), velocity(n) * h,
+                                           t) * ih;
         }
     }
 
+    // Add correction for Celestia's coordinate system
+    return Vector3d(vel.x(), vel.z(), -vel.y());
+}
+
+
+void MappedOrbitXYZV::sample(double /* startTime */, double /* endTime */,
+                             OrbitSampleProc& proc) const
+{
+    for (size_t i = 0; i < nSamples; i++)
+    {
+        // Skip repeated times, which the text loader drops
+        if (i > 0 && samples[i].tdb == samples[i - 1].tdb)
+            continue;
+
+        Vector3d p = position(i);
+        Vector3d v = velocity(i);
+        proc.sample(samples[i].tdb, Vector3d(p.x(), p.z(), -p.y()), Vector3d(v.x(), v.z(), -v.y()));
+    }
+}
+
+
+/* Load a binary xyzv sampled trajectory file.
+ */
+static Orbit* LoadMappedOrbitXYZV(const fs::path& filename, TrajectoryInterpolation interpolation)
+{
+    if (!fs::exists(filename))
+        return nullptr;
+
+    MappedOrbitXYZV* orbit = new MappedOrbitXYZV(interpolation);
+    if (!orbit->load(filename))
+    {
+        delete orbit;
+        return nullptr;
+    }
+
     return orbit;
 }
 
@@ -915,7 +1154,7 @@ Orbit* LoadSampledTrajectoryDoublePrec(const fs::path& filename, TrajectoryInter
 Orbit* LoadXYZVTrajectorySinglePrec(const fs::path& filename, TrajectoryInterpolation interpolation)
 {
     auto f = filename;
-    Orbit* ret = LoadSampledOrbitXYZVBinary(f += fs::path("bin"), interpolation, 0.0f); // FIXME
+    Orbit* ret = LoadMappedOrbitXYZV(f += fs::path("bin"), interpolation); // FIXME
     if (ret != nullptr)
         return ret;
 
@@ -928,7 +1167,7 @@ Orbit* LoadXYZVTrajectorySinglePrec(const fs::path& filename, TrajectoryInterpol
 Orbit* LoadXYZVTrajectoryDoublePrec(const fs::path& filename, TrajectoryInterpolation interpolation)
 {
     auto f = filename;
-    Orbit* ret = LoadSampledOrbitXYZVBinary(f += fs::path("bin"), interpolation, 0.0); // FIXME
+    Orbit* ret = LoadMappedOrbitXYZV(f += fs::path("bin"), interpolation); // FIXME
     if (ret != nullptr)
         return ret;
 
@@ -12,10 +12,13 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 #include <celmath/mathlib.h>
 #include <celengine/astro.h>
 #include "vsop87.h"
+#include "vsop87batch.h"
 
 using namespace Eigen;
 using namespace std;
@@ -11011,6 +11014,44 @@ static double SumSeries(const VSOPSeries& series, double t)
     return x;
 }
 
+static vector<VSOPTermTable> MakeTermTables(const VSOPSeries* series, int nSeries)
+{
+    vector<VSOPTermTable> tables(nSeries);
+    for (int i = 0; i < nSeries; i++)
+    {
+        VSOPTermTable& table = tables[i];
+        for (int j = 0; j < series[i].nTerms; j++)
+        {
+            table.A.push_back(series[i].terms[j].A);
+            table.B.push_back(series[i].terms[j].B);
+            table.C.push_back(series[i].terms[j].C);
+        }
+    }
+
+    return tables;
+}
+
+// Sum the series multiplied by increasing powers of t, at count instants
+static void SumSeriesBatch(const vector<VSOPTermTable>& tables,
+                           const double* t,
+                           size_t count,
+                           double* result,
+                           double* T,
+                           double* sums)
+{
+    fill(result, result + count, 0.0);
+    fill(T, T + count, 1.0);
+    for (const auto& table : tables)
+    {
+        SumVSOPSeries(table, t, count, sums);
+        for (size_t k = 0; k < count; k++)
+        {
+            result[k] += sums[k] * T[k];
+            T[k] = t[k] * T[k];
+        }
+    }
+}
+
 class VSOP87Orbit : public CachingOrbit
 {
  private:
@@ -11023,6 +11064,15 @@ class VSOP87Orbit : public CachingOrbit
     double period;
     double boundingRadius;
 
+    // Structure of arrays copies of the series for batch evaluation
+    vector<VSOPTermTable> tablesL;
+    vector<VSOPTermTable> tablesB;
+    vector<VSOPTermTable> tablesR;
+
+    // Maximum number of instants evaluated by one computePositions() call
+    // from sample()
+    static constexpr size_t SampleBatchSize = 256;
+
  public:
     VSOP87Orbit(VSOPSeries* _vsL, int _nL,
                 VSOPSeries* _vsB, int _nB,
@@ -11033,7 +11083,10 @@ class VSOP87Orbit : public CachingOrbit
         vsB(_vsB), nB(_nB),
         vsR(_vsR), nR(_nR),
         period(_period),
-        boundingRadius(_boundingRadius)
+        boundingRadius(_boundingRadius),
+        tablesL(MakeTermTables(_vsL, _nL)),
+        tablesB(MakeTermTables(_vsB, _nB)),
+        tablesR(MakeTermTables(_vsR, _nR))
     {
     };
     ~VSOP87Orbit() override = default;
@@ -11097,24 +11150,89 @@ class VSOP87Orbit : public CachingOrbit
     }
 
 
+    /** Compute positions at count instants with the vectorized series
+      * evaluator. The results match computePosition() to within the error
+      * of the vectorized cosine.
+      */
+    void computePositions(const double* jd, size_t count, Vector3d* positions) const
+    {
+        vector<double> t(count);
+        for (size_t k = 0; k < count; k++)
+            t[k] = (jd[k] - 2451545.0) / 365250.0;
+
+        vector<double> l(count), b(count), r(count), T(count), sums(count);
+        SumSeriesBatch(tablesL, t.data(), count, l.data(), T.data(), sums.data());
+        SumSeriesBatch(tablesB, t.data(), count, b.data(), T.data(), sums.data());
+        SumSeriesBatch(tablesR, t.data(), count, r.data(), T.data(), sums.data());
+
+        for (size_t k = 0; k < count; k++)
+        {
+            double rk = r[k] * KM_PER_AU;
+            double bk = b[k] - PI / 2;
+            double lk = l[k] + PI;
+            positions[k] = Vector3d(cos(lk) * sin(bk) * rk,
+                                    cos(bk) * rk,
+                                    -sin(lk) * sin(bk) * rk);
+        }
+    }
+
+
     /** Custom implementation of sample() for VSOP87 orbits. The default
       * implementation runs too slowly and produces too many samples.
+      * Samples are spaced uniformly, 150 per period, and evaluated in
+      * batches; the velocities are differentiated from positions one
+      * minute later, as CachingOrbit::computeVelocity() does.
       */
     void sample(double startTime, double endTime, OrbitSampleProc& proc) const override
     {
-        double span = getPeriod();
+        const double step = getPeriod() / 150.0;
+        const double dt = 1.0 / 1440.0;
+
+        vector<double> times;
+        vector<Vector3d> positions;
+        times.reserve(SampleBatchSize * 2);
+        positions.resize(SampleBatchSize * 2);
 
-        AdaptiveSamplingParameters samplingParams{};
-        samplingParams.tolerance = 1.0; // kilometers
+        double t = startTime;
+        bool first = true;
+        while (first || t < endTime)
+        {
+            // Same sequence of times as adaptiveSample() with equal start,
+            // minimum and maximum steps
+            times.clear();
+            if (first)
+            {
+                times.push_back(t);
+                first = false;
+            }
+            while (times.size() < SampleBatchSize && t < endTime)
+            {
+                t += min(step, endTime - t);
+                times.push_back(t);
+            }
+
+            size_t n = times.size();
+            for (size_t k = 0; k < n; k++)
+                times.push_back(times[k] + dt);
+            computePositions(times.data(), n * 2, positions.data());
+
+            for (size_t k = 0; k < n; k++)
+            {
+                Vector3d v = (positions[n + k] - positions[k]) * (1.0 / dt);
+                proc.sample(times[k], positions[k], v);
+            }
+        }
+    }
 
-        // startStep, minStep, and maxStep are all set to identical values,
-        // so the adaptive sampling function actuall behaves like uniform
-        // sampling.
-        samplingParams.startStep = span / 150.0;
-        samplingParams.minStep   = samplingParams.startStep;
-        samplingParams.maxStep   = samplingParams.startStep;
+    // The batches only read the term tables
+    bool isSampleThreadSafe() const override
+    {
+        return true;
+    }
 
-        adaptiveSample(startTime, endTime, proc, samplingParams);
+    bool isThreadSafe() const override
+    {
+        return true;
     }
 
 };
@@ -11202,6 +11320,11 @@ class VSOP87OrbitRect : public CachingOrbit
         // Corrections for internal coordinate system
         return Vector3d(v.x(), v.z(), -v.y());
     }
+
+    bool isThreadSafe() const override
+    {
+        return true;
+    }
 };
 
 
@@ -0,0 +1,263 @@
+// vsop87batch.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Vectorized evaluation of VSOP87 series at many instants at once.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "vsop87batch.h"
+
+// The instruction set is chosen at compile time, as for the star culling
+// kernel: AVX2 when the compiler targets it, otherwise SSE2, or NEON on
+// 64-bit ARM (32-bit NEON has no double precision vectors).
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VSOP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VSOP_SSE2
+#elif defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+#include <arm_neon.h>
+#define VSOP_NEON
+#endif
+
+using namespace std;
+
+namespace
+{
+
+// pi/2 split in three parts for the Cody-Waite argument reduction (from
+// fdlibm). The first two parts have 33 significant bits, so their products
+// with a quadrant number below 2^20 are exact.
+constexpr double PiOver2_1 = 1.57079632673412561417e+00;
+constexpr double PiOver2_2 = 6.07710050630396597660e-11;
+constexpr double PiOver2_3 = 2.02226624871116645580e-21;
+constexpr double TwoOverPi = 6.36619772367581382433e-01;
+
+// Adding 1.5 * 2^52 rounds a double below 2^51 to the nearest integer and
+// leaves that integer in the low bits of the mantissa.
+constexpr double RoundMagic = 6755399441055744.0;
+
+// Minimax coefficients of sin and cos on [-pi/4, pi/4] (fdlibm)
+constexpr double S1 = -1.66666666666666324348e-01;
+constexpr double S2 =  8.33333333332248946124e-03;
+constexpr double S3 = -1.98412698298579493134e-04;
+constexpr double S4 =  2.75573137070700676789e-06;
+constexpr double S5 = -2.50507602534068634195e-08;
+constexpr double S6 =  1.58969099521155010221e-10;
+
+constexpr double C1 =  4.16666666666666019037e-02;
+constexpr double C2 = -1.38888888888741095749e-03;
+constexpr double C3 =  2.48015872894767294178e-05;
+constexpr double C4 = -2.75573143513906633035e-07;
+constexpr double C5 =  2.08757232129817482790e-09;
+constexpr double C6 = -1.13596475577881948265e-11;
+
+#if defined(VSOP_AVX2)
+
+typedef __m256d Packet;
+constexpr size_t PacketSize = 4;
+
+inline Packet set1(double x)            { return _mm256_set1_pd(x); }
+inline Packet load(const double* p)     { return _mm256_loadu_pd(p); }
+inline void store(double* p, Packet x)  { _mm256_storeu_pd(p, x); }
+inline Packet add(Packet a, Packet b)   { return _mm256_add_pd(a, b); }
+inline Packet sub(Packet a, Packet b)   { return _mm256_sub_pd(a, b); }
+inline Packet mul(Packet a, Packet b)   { return _mm256_mul_pd(a, b); }
+
+inline Packet roundToInt(Packet x)
+{
+    return _mm256_round_pd(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+// cos(q * pi/2 + r) from sin(r) and cos(r): quadrants 1 and 3 use the
+// sine, quadrants 1 and 2 are negated.
+inline Packet selectQuadrant(Packet q, Packet s, Packet c)
+{
+    __m256i k    = _mm256_castpd_si256(_mm256_add_pd(q, _mm256_set1_pd(RoundMagic)));
+    __m256i one  = _mm256_set1_epi64x(1);
+    __m256i swap = _mm256_sub_epi64(_mm256_setzero_si256(), _mm256_and_si256(k, one));
+    __m256i sign = _mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(k, one),
+                                                      _mm256_set1_epi64x(2)), 62);
+    Packet r = _mm256_blendv_pd(c, s, _mm256_castsi256_pd(swap));
+    return _mm256_xor_pd(r, _mm256_castsi256_pd(sign));
+}
+
+const char* InstructionSet = "AVX2";
+
+#elif defined(VSOP_SSE2)
+
+typedef __m128d Packet;
+constexpr size_t PacketSize = 2;
+
+inline Packet set1(double x)            { return _mm_set1_pd(x); }
+inline Packet load(const double* p)     { return _mm_loadu_pd(p); }
+inline void store(double* p, Packet x)  { _mm_storeu_pd(p, x); }
+inline Packet add(Packet a, Packet b)   { return _mm_add_pd(a, b); }
+inline Packet sub(Packet a, Packet b)   { return _mm_sub_pd(a, b); }
+inline Packet mul(Packet a, Packet b)   { return _mm_mul_pd(a, b); }
+
+// SSE2 has no rounding instruction; use the magic number instead.
+inline Packet roundToInt(Packet x)
+{
+    Packet magic = _mm_set1_pd(RoundMagic);
+    return _mm_sub_pd(_mm_add_pd(x, magic), magic);
+}
+
+inline Packet selectQuadrant(Packet q, Packet s, Packet c)
+{
+    __m128i k    = _mm_castpd_si128(_mm_add_pd(q, _mm_set1_pd(RoundMagic)));
+    __m128i one  = _mm_set1_epi64x(1);
+    __m128i swap = _mm_sub_epi64(_mm_setzero_si128(), _mm_and_si128(k, one));
+    __m128i sign = _mm_slli_epi64(_mm_and_si128(_mm_add_epi64(k, one),
+                                                _mm_set1_epi64x(2)), 62);
+    Packet mask  = _mm_castsi128_pd(swap);
+    Packet r     = _mm_or_pd(_mm_and_pd(mask, s), _mm_andnot_pd(mask, c));
+    return _mm_xor_pd(r, _mm_castsi128_pd(sign));
+}
+
+const char* InstructionSet = "SSE2";
+
+#elif defined(VSOP_NEON)
+
+typedef float64x2_t Packet;
+constexpr size_t PacketSize = 2;
+
+inline Packet set1(double x)            { return vdupq_n_f64(x); }
+inline Packet load(const double* p)     { return vld1q_f64(p); }
+inline void store(double* p, Packet x)  { vst1q_f64(p, x); }
+inline Packet add(Packet a, Packet b)   { return vaddq_f64(a, b); }
+inline Packet sub(Packet a, Packet b)   { return vsubq_f64(a, b); }
+inline Packet mul(Packet a, Packet b)   { return vmulq_f64(a, b); }
+inline Packet roundToInt(Packet x)      { return vrndnq_f64(x); }
+
+inline Packet selectQuadrant(Packet q, Packet s, Packet c)
+{
+    uint64x2_t k    = vreinterpretq_u64_f64(vaddq_f64(q, vdupq_n_f64(RoundMagic)));
+    uint64x2_t one  = vdupq_n_u64(1);
+    uint64x2_t swap = vsubq_u64(vdupq_n_u64(0), vandq_u64(k, one));
+    uint64x2_t sign = vshlq_n_u64(vandq_u64(vaddq_u64(k, one), vdupq_n_u64(2)), 62);
+    Packet r = vbslq_f64(swap, s, c);
+    return vreinterpretq_f64_u64(veorq_u64(vreinterpretq_u64_f64(r), sign));
+}
+
+const char* InstructionSet = "NEON";
+
+#else
+
+typedef double Packet;
+constexpr size_t PacketSize = 1;
+
+inline Packet set1(double x)            { return x; }
+inline Packet load(const double* p)     { return *p; }
+inline void store(double* p, Packet x)  { *p = x; }
+inline Packet add(Packet a, Packet b)   { return a + b; }
+inline Packet sub(Packet a, Packet b)   { return a - b; }
+inline Packet mul(Packet a, Packet b)   { return a * b; }
+inline Packet roundToInt(Packet x)      { return nearbyint(x); }
+
+inline Packet selectQuadrant(Packet q, Packet s, Packet c)
+{
+    int64_t k = (int64_t) q;
+    double r = (k & 1) != 0 ? s : c;
+    return ((k + 1) & 2) != 0 ? -r : r;
+}
+
+const char* InstructionSet = "scalar";
+
+#endif
+
+
+inline Packet cosPacket(Packet x)
+{
+    // Reduce to x = q * pi/2 + r with |r| <= pi/4
+    Packet q = roundToInt(mul(x, set1(TwoOverPi)));
+    Packet r = sub(x, mul(q, set1(PiOver2_1)));
+    r = sub(r, mul(q, set1(PiOver2_2)));
+    r = sub(r, mul(q, set1(PiOver2_3)));
+
+    Packet z = mul(r, r);
+
+    Packet ps = add(set1(S5), mul(z, set1(S6)));
+    ps = add(set1(S4), mul(z, ps));
+    ps = add(set1(S3), mul(z, ps));
+    ps = add(set1(S2), mul(z, ps));
+    ps = add(set1(S1), mul(z, ps));
+    Packet s = add(r, mul(mul(z, r), ps));
+
+    Packet pc = add(set1(C5), mul(z, set1(C6)));
+    pc = add(set1(C4), mul(z, pc));
+    pc = add(set1(C3), mul(z, pc));
+    pc = add(set1(C2), mul(z, pc));
+    pc = add(set1(C1), mul(z, pc));
+    Packet c = add(sub(set1(1.0), mul(z, set1(0.5))), mul(mul(z, z), pc));
+
+    return selectQuadrant(q, s, c);
+}
+
+} // end unnamed namespace
+
+
+void SumVSOPSeries(const VSOPTermTable& table,
+                   const double* t,
+                   size_t count,
+                   double* result)
+{
+    const double* A = table.A.data();
+    const double* B = table.B.data();
+    const double* C = table.C.data();
+    size_t nTerms = table.size();
+
+    // The last, partial packet is padded by repeating its final time so
+    // that every result comes from the same code path.
+    double tBuf[PacketSize];
+    double sumBuf[PacketSize];
+    for (size_t i = 0; i < count; i += PacketSize)
+    {
+        size_t n = min(PacketSize, count - i);
+        for (size_t lane = 0; lane < PacketSize; lane++)
+            tBuf[lane] = t[i + min(lane, n - 1)];
+
+        Packet tv = load(tBuf);
+        Packet sum = set1(0.0);
+        for (size_t j = 0; j < nTerms; j++)
+        {
+            Packet arg = add(set1(B[j]), mul(set1(C[j]), tv));
+            sum = add(sum, mul(set1(A[j]), cosPacket(arg)));
+        }
+
+        store(sumBuf, sum);
+        memcpy(result + i, sumBuf, n * sizeof(double));
+    }
+}
+
+
+void CosBatch(const double* x, size_t count, double* result)
+{
+    size_t i = 0;
+    for (; i + PacketSize <= count; i += PacketSize)
+        store(result + i, cosPacket(load(x + i)));
+
+    if (i < count)
+    {
+        double buf[PacketSize];
+        for (size_t lane = 0; lane < PacketSize; lane++)
+            buf[lane] = x[min(i + lane, count - 1)];
+        store(buf, cosPacket(load(buf)));
+        memcpy(result + i, buf, (count - i) * sizeof(double));
+    }
+}
+
+
+const char* VSOPBatchInstructionSet()
+{
+    return InstructionSet;
+}
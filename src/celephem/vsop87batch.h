@@ -0,0 +1,46 @@
+// vsop87batch.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Vectorized evaluation of VSOP87 series at many instants at once.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <celutil/align.h>
+
+// The terms A * cos(B + C * t) of one VSOP87 series stored as a structure
+// of arrays.
+struct VSOPTermTable
+{
+    typedef std::vector<double, AlignedAllocator<double, 32>> Column;
+
+    Column A;
+    Column B;
+    Column C;
+
+    size_t size() const { return A.size(); }
+};
+
+// Evaluate the series at count values of t (Julian millennia since J2000)
+// and store the sums in result. The terms are added in table order, so the
+// result differs from a scalar loop over std::cos() only by the error of
+// the vectorized cosine.
+void SumVSOPSeries(const VSOPTermTable& table,
+                   const double* t,
+                   size_t count,
+                   double* result);
+
+// Cosine of count values. For |x| up to about 1.6e6 (the largest argument
+// found in the VSOP87 tables over the years -4000 to 4000) the absolute
+// error is within a few units in the last place of 1.
+void CosBatch(const double* x, size_t count, double* result);
+
+// Name of the instruction set the kernels were compiled for
+const char* VSOPBatchInstructionSet();
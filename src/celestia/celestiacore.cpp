@@ -24,6 +24,9 @@
 #include <celscript/legacy/execution.h>
 #include <celscript/legacy/cmdparser.h>
 #include <celengine/multitexture.h>
+#include <celengine/virtualtex.h>
+#include <celengine/catalogcache.h>
+#include <celephem/chebyshevorbit.h>
 #ifdef USE_SPICE
 #include <celephem/spiceinterface.h>
 #endif
@@ -37,6 +40,7 @@
 #include <celutil/debug.h>
 #include <celutil/gettext.h>
 #include <celutil/utf8.h>
+#include <celutil/threadpool.h>
 #include <celcompat/filesystem.h>
 #include <Eigen/Geometry>
 #include <iostream>
@@ -49,6 +53,8 @@
 #include <cassert>
 #include <ctime>
 #include <set>
+#include <deque>
+#include <future>
 #include <celengine/rectangle.h>
 
 #ifdef CELX
@@ -2110,6 +2116,25 @@ void CelestiaCore::draw()
         fps = (double) nFrames / (sysTime - fpsCounterStartTime);
         nFrames = 0;
         fpsCounterStartTime = sysTime;
+
+        // Along with the frame rate, log what the orbit path cache and the
+        // body state snapshot of the last frame did
+        if (showFPSCounter)
+        {
+            OrbitPathCache::Stats orbitStats = renderer->getOrbitCacheStats();
+            DPRINTF(LOG_LEVEL_DEBUG, "Orbit paths: %u cached in %u kB, %u jobs pending, %u samples at %.0f/s per thread, %u evicted\n",
+                         orbitStats.paths, orbitStats.bytes / 1024,
+                         orbitStats.pendingJobs,
+                         orbitStats.samplesGenerated, orbitStats.samplesPerSecond,
+                         orbitStats.evictions);
+
+            const BodyStateSnapshot::Stats& bodyStats = renderer->getBodyStateStats();
+            DPRINTF(LOG_LEVEL_DEBUG, "Body states: %u bodies evaluated, %u lookups saved %u orbit, %u frame and %u rotation evaluations\n",
+                         bodyStats.bodies, bodyStats.lookups,
+                         bodyStats.orbitEvaluationsAvoided,
+                         bodyStats.frameEvaluationsAvoided,
+                         bodyStats.rotationEvaluationsAvoided);
+        }
     }
 
 #if 0
@@ -3491,27 +3516,31 @@ class SolarSystemLoader
     {
     }
 
-    void process(const fs::path& filepath)
+    bool accept(const fs::path& filepath) const
     {
         if (DetermineFileType(filepath) != Content_CelestiaCatalog)
-            return;
+            return false;
 
         if (find(begin(skip), end(skip), filepath) != end(skip))
         {
             fmt::fprintf(clog, _("Skipping skiped solar system catalog: %s\n"), filepath.string());
-            return;
+            return false;
         }
+        return true;
+    }
+
+    static void parse(Tokenizer& tokenizer, ParsedCatalog& catalog)
+    {
+        ParseSolarSystemObjects(tokenizer, catalog);
+    }
+
+    void load(const fs::path& filepath, const ParsedCatalog& catalog)
+    {
         fmt::fprintf(clog, _("Loading solar system catalog: %s\n"), filepath.string());
         if (notifier != nullptr)
             notifier->update(filepath.filename().string());
 
-        ifstream solarSysFile(filepath.string(), ios::in);
-        if (solarSysFile.good())
-        {
-            LoadSolarSystemObjects(solarSysFile,
-                                   *universe,
-                                   filepath.parent_path());
-        }
+        LoadSolarSystemObjects(catalog, *universe, filepath.parent_path());
     }
 };
 
@@ -3537,26 +3566,32 @@ template <class OBJDB> class CatalogLoader
     {
     }
 
-    void process(const fs::path& filepath)
+    bool accept(const fs::path& filepath) const
     {
         if (DetermineFileType(filepath) != contentType)
-            return;
+            return false;
 
         if (find(begin(skip), end(skip), filepath) != end(skip))
         {
             fmt::fprintf(clog, _("Skipping skiped %s catalog: %s\n"), typeDesc, filepath.string());
-            return;
+            return false;
         }
+        return true;
+    }
+
+    static void parse(Tokenizer& tokenizer, ParsedCatalog& catalog)
+    {
+        OBJDB::parse(tokenizer, catalog);
+    }
+
+    void load(const fs::path& filepath, const ParsedCatalog& catalog)
+    {
         fmt::fprintf(clog, _("Loading %s catalog: %s\n"), typeDesc, filepath.string());
         if (notifier != nullptr)
             notifier->update(filepath.filename().string());
 
-        ifstream catalogFile(filepath.string(), ios::in);
-        if (catalogFile.good())
-        {
-            if (!objDB->load(catalogFile, filepath.parent_path()))
-                DPRINTF(LOG_LEVEL_ERROR, "Error reading %s catalog file: %s\n", typeDesc, filepath.string());
-        }
+        if (!objDB->load(catalog, filepath.parent_path()))
+            DPRINTF(LOG_LEVEL_ERROR, "Error reading %s catalog file: %s\n", typeDesc, filepath.string());
     }
 };
 
@@ -3564,6 +3599,62 @@ using StarLoader = CatalogLoader<StarDatabase>;
 using DeepSkyLoader = CatalogLoader<DSODatabase>;
 
 
+// Load the catalog files accepted by the loader, in order. Reading,
+// tokenizing and parsing the files into object definitions is independent
+// work done on the thread pool a bounded number of files ahead; the loader
+// adds the definitions to the database on this thread, so that files later
+// in the list still modify or replace the objects of earlier ones.
+template <class LOADER> static void LoadCatalogFiles(LOADER& loader,
+                                                     const vector<fs::path>& entries,
+                                                     CatalogCache& cache)
+{
+    struct ParsedFile
+    {
+        bool opened{ false };
+        ParsedCatalog catalog;
+    };
+
+    vector<fs::path> files;
+    for (const auto& fn : entries)
+    {
+        if (loader.accept(fn))
+            files.push_back(fn);
+    }
+
+    ThreadPool& pool = ThreadPool::global();
+    const size_t maxInFlight = 4 * (pool.size() + 1);
+
+    deque<future<ParsedFile>> inFlight;
+    size_t nextFile = 0;
+    for (const auto& fn : files)
+    {
+        while (nextFile < files.size() && inFlight.size() < maxInFlight)
+        {
+            fs::path path = files[nextFile++];
+            inFlight.push_back(pool.async([&cache, path]()
+            {
+                ParsedFile file;
+                ifstream in(path.string(), ios::in);
+                if (in.good())
+                {
+                    file.opened = true;
+                    Tokenizer::TokenList tokens;
+                    cache.getTokens(path, in, tokens);
+                    Tokenizer tokenizer(&tokens);
+                    LOADER::parse(tokenizer, file.catalog);
+                }
+                return file;
+            }));
+        }
+
+        ParsedFile file = inFlight.front().get();
+        inFlight.pop_front();
+        if (file.opened)
+            loader.load(fn, file.catalog);
+    }
+}
+
+
 bool CelestiaCore::initSimulation(const fs::path& configFileName,
                                   const vector<fs::path>& extrasDirs,
                                   ProgressNotifier* progressNotifier)
@@ -3632,10 +3723,24 @@ bool CelestiaCore::initSimulation(const fs::path& configFileName,
 
     universe = new Universe();
 
+    // Parsed catalog files are cached on disk, so that unchanged ones are
+    // loaded faster on the next start.
+    fs::path cacheDir;
+    if (!config->catalogCacheDir.empty())
+        cacheDir = PathExp(config->catalogCacheDir);
+    else if (!config->disableCatalogCache)
+        cacheDir = CatalogCache::defaultDirectory();
+    CatalogCache catalogCache(config->disableCatalogCache ? fs::path() : cacheDir);
+    catalogCache.setRebuild(config->rebuildCatalogCache || rebuildCatalogCache);
+    ChebyshevOrbitCache::setDefaultTolerance(config->orbitCacheTolerance);
+    if (!config->disableCatalogCache && !config->rebuildCatalogCache && !rebuildCatalogCache)
+        ChebyshevOrbitCache::setCacheDirectory(cacheDir);
+    Timer catalogTimer;
+
 
     /***** Load star catalogs *****/
 
-    if (!readStars(*config, progressNotifier))
+    if (!readStars(*config, progressNotifier, catalogCache))
     {
         fatalError(_("Cannot read star database."), false);
         return false;
@@ -3655,12 +3760,21 @@ bool CelestiaCore::initSimulation(const fs::path& configFileName,
         if (progressNotifier)
             progressNotifier->update(file.string());
 
+        // Binary catalogs are mapped as a whole and not cached
+        if (DSODatabase::isBinaryFile(file))
+        {
+            if (!dsoDB->loadBinary(file))
+                warning(fmt::sprintf(_("Cannot read Deep Sky Objects database %s.\n"), file));
+            continue;
+        }
+
         ifstream dsoFile(file.string(), ios::in);
         if (!dsoFile.good())
         {
             warning(fmt::sprintf(_("Error opening deepsky catalog file %s.\n"), file));
         }
-        if (!dsoDB->load(dsoFile, ""))
+        auto load = [dsoDB](Tokenizer& tokenizer) { return dsoDB->load(tokenizer, ""); };
+        if (!catalogCache.load(file, dsoFile, load))
         {
             warning(fmt::sprintf(_("Cannot read Deep Sky Objects database %s.\n"), file));
         }
@@ -3685,8 +3799,7 @@ bool CelestiaCore::initSimulation(const fs::path& configFileName,
                 if (!fs::is_directory(fn.path(), ec))
                     entries.push_back(fn.path());
             }
-            for (const auto& fn : entries)
-                loader.process(fn);
+            LoadCatalogFiles(loader, entries, catalogCache);
         }
     }
     dsoDB->finish();
@@ -3711,7 +3824,10 @@ bool CelestiaCore::initSimulation(const fs::path& configFileName,
             }
             else
             {
-                LoadSolarSystemObjects(solarSysFile, *universe);
+                catalogCache.load(file, solarSysFile, [this](Tokenizer& tokenizer)
+                {
+                    return LoadSolarSystemObjects(tokenizer, *universe);
+                });
             }
         }
     }
@@ -3733,11 +3849,16 @@ bool CelestiaCore::initSimulation(const fs::path& configFileName,
                     entries.push_back(fn.path());
             }
             sort(begin(entries), end(entries));
-            for(const auto& fn : entries)
-                loader.process(fn);
+            LoadCatalogFiles(loader, entries, catalogCache);
         }
     }
 
+    const CatalogCache::Stats& cacheStats = catalogCache.getStats();
+    fmt::fprintf(clog, _("Loaded catalogs in %.3f s; %u catalog files from the cache in %.3f s, %u parsed in %.3f s\n"),
+                 catalogTimer.getTime(),
+                 cacheStats.hits, cacheStats.hitTime,
+                 cacheStats.misses, cacheStats.missTime);
+
     // Load asterisms:
     if (!config->asterismsFile.empty())
     {
@@ -3841,6 +3962,9 @@ bool CelestiaCore::initRenderer()
     detailOptions.orbitWindowEnd = config->orbitWindowEnd;
     detailOptions.orbitPeriodsShown = config->orbitPeriodsShown;
     detailOptions.linearFadeFraction = config->linearFadeFraction;
+    detailOptions.orbitPathCacheMemory = (size_t) config->orbitPathCacheMemory << 20;
+
+    VirtualTexture::setMemoryBudget((size_t) config->virtualTextureMemory << 20);
 
     // Prepare the scene for rendering.
 #ifdef USE_GLCONTEXT
@@ -3922,7 +4046,8 @@ static void loadCrossIndex(StarDatabase* starDB,
 
 
 bool CelestiaCore::readStars(const CelestiaConfig& cfg,
-                             ProgressNotifier* progressNotifier)
+                             ProgressNotifier* progressNotifier,
+                             CatalogCache& catalogCache)
 {
     StarDetails::SetStarTextures(cfg.starTextures);
 
@@ -3947,16 +4072,7 @@ bool CelestiaCore::readStars(const CelestiaConfig& cfg,
         if (progressNotifier)
             progressNotifier->update(cfg.starDatabaseFile.string());
 
-        ifstream starFile(cfg.starDatabaseFile.string(), ios::in | ios::binary);
-        if (!starFile.good())
-        {
-            fmt::fprintf(cerr, _("Error opening %s\n"), cfg.starDatabaseFile);
-            delete starDB;
-            delete starNameDB;
-            return false;
-        }
-
-        if (!starDB->loadBinary(starFile))
+        if (!starDB->loadBinary(cfg.starDatabaseFile))
         {
             cerr << _("Error reading stars file\n");
             delete starDB;
@@ -3982,7 +4098,12 @@ bool CelestiaCore::readStars(const CelestiaConfig& cfg,
 
         ifstream starFile(file.string(), ios::in);
         if (starFile.good())
-            starDB->load(starFile);
+        {
+            catalogCache.load(file, starFile, [starDB](Tokenizer& tokenizer)
+            {
+                return starDB->load(tokenizer);
+            });
+        }
         else
             fmt::fprintf(cerr, _("Error opening star catalog %s\n"), file);
     }
@@ -4008,8 +4129,7 @@ bool CelestiaCore::readStars(const CelestiaConfig& cfg,
                     entries.push_back(fn.path());
             }
             std::sort(begin(entries), end(entries));
-            for (const auto& fn : entries)
-                loader.process(fn);
+            LoadCatalogFiles(loader, entries, catalogCache);
         }
     }
 
@@ -35,6 +35,7 @@
 #include <celscript/common/scriptmaps.h>
 
 class Url;
+class CatalogCache;
 // class CelestiaWatcher;
 class CelestiaCore;
 // class astro::Date;
@@ -180,6 +181,8 @@ class CelestiaCore // : public Watchable<CelestiaCore>
                         const std::vector<fs::path>& extrasDirs = {},
                         ProgressNotifier* progressNotifier = nullptr);
     bool initRenderer();
+    // Ignore the catalog cache and rebuild it in the next initSimulation()
+    void setRebuildCatalogCache(bool rebuild) { rebuildCatalogCache = rebuild; }
     void start(double t);
     void start();
     void getLightTravelDelay(double distanceKm, int&, int&, float&);
@@ -345,7 +348,7 @@ class CelestiaCore // : public Watchable<CelestiaCore>
     bool saveScreenShot(const fs::path&, ContentType = Content_Unknown) const;
 
  protected:
-    bool readStars(const CelestiaConfig&, ProgressNotifier*);
+    bool readStars(const CelestiaConfig&, ProgressNotifier*, CatalogCache&);
     void renderOverlay();
 #ifdef CELX
     bool initLuaHook(ProgressNotifier*);
@@ -393,6 +396,7 @@ class CelestiaCore // : public Watchable<CelestiaCore>
     int overlayElements{ ShowTime | ShowVelocity | ShowSelection | ShowFrame };
     bool wireframe{ false };
     bool editMode{ false };
+    bool rebuildCatalogCache{ false };
     bool altAzimuthMode{ false };
     bool showConsole{ false };
     bool lightTravelFlag{ false };
@@ -92,6 +92,13 @@ CelestiaConfig* ReadCelestiaConfig(const fs::path& filename, CelestiaConfig *con
     configParams->getString("LabelFont", config->labelFont);
     configParams->getString("TitleFont", config->titleFont);
     configParams->getPath("LogoTexture", config->logoTextureFile);
+    configParams->getPath("CatalogCacheDirectory", config->catalogCacheDir);
+    config->disableCatalogCache = false;
+    configParams->getBoolean("DisableCatalogCache", config->disableCatalogCache);
+    config->rebuildCatalogCache = false;
+    configParams->getBoolean("RebuildCatalogCache", config->rebuildCatalogCache);
+    config->orbitCacheTolerance = 0.0;
+    configParams->getNumber("OrbitCacheTolerance", config->orbitCacheTolerance);
     configParams->getString("Cursor", config->cursor);
 
     float maxDist = 1.0;
@@ -127,6 +134,8 @@ CelestiaConfig* ReadCelestiaConfig(const fs::path& filename, CelestiaConfig *con
     config->orbitPathSamplePoints = getUint(configParams, "OrbitPathSamplePoints", 100);
     config->shadowTextureSize = getUint(configParams, "ShadowTextureSize", 256);
     config->eclipseTextureSize = getUint(configParams, "EclipseTextureSize", 128);
+    config->virtualTextureMemory = getUint(configParams, "VirtualTextureMemory", 512);
+    config->orbitPathCacheMemory = getUint(configParams, "OrbitPathCacheMemory", 64);
 
     config->consoleLogRows = getUint(configParams, "LogSize", 200);
 
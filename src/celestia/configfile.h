@@ -27,6 +27,10 @@ public:
     std::vector<fs::path> dsoCatalogFiles;
     std::vector<fs::path> extrasDirs;
     std::vector<fs::path> skipExtras;
+    fs::path catalogCacheDir;
+    bool disableCatalogCache;
+    bool rebuildCatalogCache;
+    double orbitCacheTolerance; // in kilometers
     fs::path deepSkyCatalog;
     fs::path asterismsFile;
     fs::path boundariesFile;
@@ -64,6 +68,8 @@ public:
     unsigned int shadowTextureSize;
     unsigned int eclipseTextureSize;
     unsigned int orbitPathSamplePoints;
+    unsigned int virtualTextureMemory; // in megabytes
+    unsigned int orbitPathCacheMemory; // in megabytes
 
     unsigned int aaSamples;
 
@@ -10,8 +10,13 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
-#include <cstring>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <celengine/frame.h>
+#include <celutil/threadpool.h>
 #include "eclipsefinder.h"
 #include "celmath/ray.h"
 #include "celmath/distance.h"
@@ -21,7 +26,6 @@ using namespace std;
 using namespace celmath;
 
 
-constexpr const double dT = 1.0 / (24.0 * 60.0);
 constexpr const int EclipseObjectMask = Body::Planet      |
                                         Body::Moon        |
                                         Body::MinorMoon   |
@@ -31,173 +35,439 @@ constexpr const int EclipseObjectMask = Body::Planet      |
 // TODO: share this constant and function with render.cpp
 static const float MinRelativeOccluderRadius = 0.005f;
 
+// Samples per synodic period of a pair of bodies. A dip of the distance
+// to the shadow spans about half the period, so it can't slip between
+// samples.
+static const double SamplesPerPeriod = 16.0;
+
+// Step for satellites without a period, as the old fixed step search
+static const double DefaultSearchStep = 1.0 / 24.0;
+
+// Samples of each pair in a stretch of the search given to one task
+static const double SamplesPerWindow = 32.0;
+
+// Stretches searched between calls to the watcher, per pool thread
+static const unsigned int WindowsPerThread = 2;
+
+// Longest eclipse, in search steps, before giving up on finding its end
+static const int MaxEclipseSteps = 64;
+
+static const int MaxMinimizeIterations = 100;
+
 EclipseFinder::EclipseFinder(Body* _body,
                              EclipseFinderWatcher* _watcher) :
     body(_body),
-    watcher(_watcher)
+    watcher(_watcher),
+    precision(1.0 / 86400.0)
 {
 }
 
 
-bool testEclipse(const Body& receiver, const Body& caster, double now)
+static bool CastsShadow(const Body& receiver, const Body& caster)
 {
     // Ignore situations where the shadow casting body is much smaller than
     // the receiver, as these shadows aren't likely to be relevant.  Also,
     // ignore eclipses where the caster is not an ellipsoid, since we can't
     // generate correct shadows in this case.
-    if (caster.getRadius() >= receiver.getRadius() * MinRelativeOccluderRadius &&
-        caster.isEllipsoid())
-    {
-        // All of the eclipse related code assumes that both the caster
-        // and receiver are spherical.  Irregular receivers will work more
-        // or less correctly, but casters that are sufficiently non-spherical
-        // will produce obviously incorrect shadows.  Another assumption we
-        // make is that the distance between the caster and receiver is much
-        // less than the distance between the sun and the receiver.  This
-        // approximation works everywhere in the solar system, and likely
-        // works for any orbitally stable pair of objects orbiting a star.
-        Vector3d posReceiver = receiver.getAstrocentricPosition(now);
-        Vector3d posCaster = caster.getAstrocentricPosition(now);
-
-        const Star* sun = receiver.getSystem()->getStar();
-        assert(sun != nullptr);
-        double distToSun = posReceiver.norm();
-        float appSunRadius = (float) (sun->getRadius() / distToSun);
-
-        Vector3d dir = posCaster - posReceiver;
-        double distToCaster = dir.norm() - receiver.getRadius();
-        float appOccluderRadius = (float) (caster.getRadius() / distToCaster);
-
-        // The shadow radius is the radius of the occluder plus some additional
-        // amount that depends upon the apparent radius of the sun.  For
-        // a sun that's distant/small and effectively a point, the shadow
-        // radius will be the same as the radius of the occluder.
-        float shadowRadius = (1 + appSunRadius / appOccluderRadius) *
-            caster.getRadius();
-
-        // Test whether a shadow is cast on the receiver.  We want to know
-        // if the receiver lies within the shadow volume of the caster.  Since
-        // we're assuming that everything is a sphere and the sun is far
-        // away relative to the caster, the shadow volume is a
-        // cylinder capped at one end.  Testing for the intersection of a
-        // singly capped cylinder is as simple as checking the distance
-        // from the center of the receiver to the axis of the shadow cylinder.
-        // If the distance is less than the sum of the caster's and receiver's
-        // radii, then we have an eclipse.
-        float R = receiver.getRadius() + shadowRadius;
-        double dist = distance(posReceiver, Ray3d(posCaster, posCaster));
-        if (dist < R)
-        {
-            // Ignore "eclipses" where the caster and receiver have
-            // intersecting bounding spheres.
-            if (distToCaster > caster.getRadius())
-                return true;
-        }
-    }
+    return caster.getRadius() >= receiver.getRadius() * MinRelativeOccluderRadius &&
+           caster.isEllipsoid();
+}
 
-    return false;
+
+// Distance of the receiver to the shadow of the caster, negative when
+// they overlap; eclipsed is set when that makes an eclipse.
+static double ShadowDistance(const Body& receiver, const Body& caster,
+                             double now, bool& eclipsed)
+{
+    // All of the eclipse related code assumes that both the caster
+    // and receiver are spherical.  Irregular receivers will work more
+    // or less correctly, but casters that are sufficiently non-spherical
+    // will produce obviously incorrect shadows.  Another assumption we
+    // make is that the distance between the caster and receiver is much
+    // less than the distance between the sun and the receiver.  This
+    // approximation works everywhere in the solar system, and likely
+    // works for any orbitally stable pair of objects orbiting a star.
+    Vector3d posReceiver = receiver.getAstrocentricPosition(now);
+    Vector3d posCaster = caster.getAstrocentricPosition(now);
+
+    const Star* sun = receiver.getSystem()->getStar();
+    assert(sun != nullptr);
+    double distToSun = posReceiver.norm();
+    float appSunRadius = (float) (sun->getRadius() / distToSun);
+
+    Vector3d dir = posCaster - posReceiver;
+    double distToCaster = dir.norm() - receiver.getRadius();
+    float appOccluderRadius = (float) (caster.getRadius() / distToCaster);
+
+    // The shadow radius is the radius of the occluder plus some additional
+    // amount that depends upon the apparent radius of the sun.  For
+    // a sun that's distant/small and effectively a point, the shadow
+    // radius will be the same as the radius of the occluder.
+    float shadowRadius = (1 + appSunRadius / appOccluderRadius) *
+        caster.getRadius();
+
+    // Test whether a shadow is cast on the receiver.  We want to know
+    // if the receiver lies within the shadow volume of the caster.  Since
+    // we're assuming that everything is a sphere and the sun is far
+    // away relative to the caster, the shadow volume is a
+    // cylinder capped at one end.  Testing for the intersection of a
+    // singly capped cylinder is as simple as checking the distance
+    // from the center of the receiver to the axis of the shadow cylinder.
+    // If the distance is less than the sum of the caster's and receiver's
+    // radii, then we have an eclipse.
+    float R = receiver.getRadius() + shadowRadius;
+    double dist = distance(posReceiver, Ray3d(posCaster, posCaster));
+
+    // Ignore "eclipses" where the caster and receiver have
+    // intersecting bounding spheres.
+    eclipsed = dist < R && distToCaster > caster.getRadius();
+
+    return dist - R;
+}
+
+
+bool testEclipse(const Body& receiver, const Body& caster, double now)
+{
+    bool eclipsed = false;
+    if (CastsShadow(receiver, caster))
+        ShadowDistance(receiver, caster, now, eclipsed);
+    return eclipsed;
 }
 
-#if 1
-double findEclipseSpan(const Body& receiver, const Body& caster,
-                       double now, double dt)
+
+namespace
+{
+
+// One receiver and caster, sampled every step days from startTime
+struct EclipseSearch
+{
+    const Body* receiver;
+    const Body* caster;
+    double step;
+    int64_t nSamples;
+    double lastEndTime;
+};
+
+
+double Distance(const EclipseSearch& search, double t, bool& eclipsed)
 {
-    double t = now;
-    while (testEclipse(receiver, caster, t))
-        t += dt;
+    return ShadowDistance(*search.receiver, *search.caster, t, eclipsed);
+}
+
 
-    return t;
+bool Eclipsed(const EclipseSearch& search, double t)
+{
+    bool eclipsed;
+    Distance(search, t, eclipsed);
+    return eclipsed;
 }
-#else
-// Given a time during an eclipse, find the start of the eclipse to
-// a precision of minStep.
-double findEclipseStart(const Body& receiver, const Body& occulter,
-                        double now,
-                        double startStep,
-                        double minStep)
+
+
+// Brent's method for the minimum of the distance to the shadow in [a, b],
+// stopping at the first eclipsed time.
+double FindClosestApproach(const EclipseSearch& search,
+                           double a, double b,
+                           double tolerance,
+                           bool& eclipsed)
 {
-    double step = startStep / 2;
-    double t = now - step;
-    bool eclipsed = true;
+    const double Golden = 0.3819660112501051;
+
+    double x = a + Golden * (b - a);
+    double fx = Distance(search, x, eclipsed);
+    if (eclipsed)
+        return x;
 
-    // Perform a binary search to find the end of the eclipse
-    while (step > minStep)
+    double w = x, v = x;
+    double fw = fx, fv = fx;
+    double d = 0.0, e = 0.0;
+    for (int iter = 0; iter < MaxMinimizeIterations; iter++)
     {
-        eclipsed = testEclipse(receiver, occulter, t);
-        step *= 0.5;
+        double xm = 0.5 * (a + b);
+        if (abs(x - xm) <= 2.0 * tolerance - 0.5 * (b - a))
+            break;
+
+        bool parabolic = false;
+        if (abs(e) > tolerance)
+        {
+            // Try a parabola through x, v and w
+            double r = (x - w) * (fx - fv);
+            double q = (x - v) * (fx - fw);
+            double p = (x - v) * q - (x - w) * r;
+            q = 2.0 * (q - r);
+            if (q > 0.0)
+                p = -p;
+            q = abs(q);
+            if (abs(p) < abs(0.5 * q * e) && p > q * (a - x) && p < q * (b - x))
+            {
+                e = d;
+                d = p / q;
+                double u = x + d;
+                if (u - a < 2.0 * tolerance || b - u < 2.0 * tolerance)
+                    d = xm >= x ? tolerance : -tolerance;
+                parabolic = true;
+            }
+        }
+        if (!parabolic)
+        {
+            e = x >= xm ? a - x : b - x;
+            d = Golden * e;
+        }
+
+        double u = abs(d) >= tolerance ? x + d : x + (d > 0.0 ? tolerance : -tolerance);
+        double fu = Distance(search, u, eclipsed);
         if (eclipsed)
-            t -= step;
+            return u;
+
+        if (fu <= fx)
+        {
+            if (u >= x)
+                a = x;
+            else
+                b = x;
+            v = w; fv = fw;
+            w = x; fw = fx;
+            x = u; fx = fu;
+        }
         else
-            t += step;
+        {
+            if (u < x)
+                a = u;
+            else
+                b = u;
+            if (fu <= fw || w == x)
+            {
+                v = w; fv = fw;
+                w = u; fw = fu;
+            }
+            else if (fu <= fv || v == x || v == w)
+            {
+                v = u; fv = fu;
+            }
+        }
     }
 
-    // Always return a time when the receiver is /not/ in eclipse
-    if (eclipsed)
-        t -= step;
-
-    return t;
+    eclipsed = false;
+    return x;
 }
 
-// Given a time during an eclipse, find the end of the eclipse to
-// a precision of minStep.
-double findEclipseEnd(const Body& receiver, const Body& occulter,
-                      double now,
-                      double startStep,
-                      double minStep)
-{
-    // First do a coarse search to find the eclipse end to within the precision
-    // of startStep.
-    while (testEclipse(receiver, occulter, now + startStep))
-        now += startStep;
 
-    double step = startStep / 2;
-    double t = now + step;
-    bool eclipsed = true;
+// Given a time during an eclipse, find its start (step < 0) or end
+// (step > 0) to the given precision: Brent's method for the time when the
+// distance to the shadow is zero, or bisection where the eclipse ends with
+// the bodies intersecting. As the fixed step search did, the time returned
+// is one when the receiver is /not/ in eclipse.
+double FindEclipseEdge(const EclipseSearch& search,
+                       double now,
+                       double step,
+                       double precision)
+{
+    double inside = now;
+    double outside = now + step;
+    bool eclipsed;
+    double fOutside = Distance(search, outside, eclipsed);
+    for (int i = 0; i < MaxEclipseSteps && eclipsed; i++)
+    {
+        inside = outside;
+        outside += step;
+        fOutside = Distance(search, outside, eclipsed);
+    }
 
+    double fInside = Distance(search, inside, eclipsed);
+    if (fOutside <= 0.0 || fInside >= 0.0)
+    {
+        while (abs(outside - inside) > precision)
+        {
+            double t = 0.5 * (inside + outside);
+            if (Eclipsed(search, t))
+                inside = t;
+            else
+                outside = t;
+        }
+        return outside;
+    }
 
-    // Perform a binary search to find the end of the eclipse
-    while (step > minStep)
+    // b is the best estimate and c the other end of the bracket; a is the
+    // previous estimate.
+    double a = outside, b = inside, c = outside;
+    double fa = fOutside, fb = fInside, fc = fOutside;
+    double d = b - a, e = d;
+    for (;;)
     {
-        eclipsed = testEclipse(receiver, occulter, t);
-        step *= 0.5;
-        if (eclipsed)
-            t += step;
+        if ((fb > 0.0) == (fc > 0.0))
+        {
+            c = a; fc = fa;
+            d = e = b - a;
+        }
+        if (abs(fc) < abs(fb))
+        {
+            a = b; b = c; c = a;
+            fa = fb; fb = fc; fc = fa;
+        }
+
+        double tolerance = 0.5 * precision;
+        double m = 0.5 * (c - b);
+        if (abs(m) <= tolerance || fb == 0.0)
+            break;
+
+        if (abs(e) >= tolerance && abs(fa) > abs(fb))
+        {
+            // Secant or inverse quadratic interpolation
+            double p, q;
+            double s = fb / fa;
+            if (a == c)
+            {
+                p = 2.0 * m * s;
+                q = 1.0 - s;
+            }
+            else
+            {
+                double qa = fa / fc;
+                double r = fb / fc;
+                p = s * (2.0 * m * qa * (qa - r) - (b - a) * (r - 1.0));
+                q = (qa - 1.0) * (r - 1.0) * (s - 1.0);
+            }
+            if (p > 0.0)
+                q = -q;
+            else
+                p = -p;
+
+            if (2.0 * p < 3.0 * m * q - abs(tolerance * q) && p < abs(0.5 * e * q))
+            {
+                e = d;
+                d = p / q;
+            }
+            else
+            {
+                d = e = m;
+            }
+        }
         else
-            t -= step;
-    }
+        {
+            d = e = m;
+        }
 
-    // Always return a time when the receiver is /not/ in eclipse
-    if (eclipsed)
-        t += step;
+        a = b; fa = fb;
+        b += abs(d) > tolerance ? d : (m > 0.0 ? tolerance : -tolerance);
+        fb = Distance(search, b, eclipsed);
+    }
 
-    return t;
+    // The bracket is now within the precision
+    return fb >= 0.0 ? b : c;
 }
-#endif
 
-void addEclipse(const Body& receiver, const Body& occulter,
-                double now,
-                double /*startStep*/, double /*minStep*/,
-                vector<Eclipse>& eclipses,
-                vector<double>& previousEclipseEndTimes, int i)
+
+// Search the samples of a pair from firstSample up to lastSample.
+vector<Eclipse> SearchSamples(const EclipseSearch& search,
+                              double startTime, double endTime,
+                              int64_t firstSample, int64_t lastSample,
+                              double precision)
 {
-    if (testEclipse(receiver, occulter, now))
+    vector<Eclipse> eclipses;
+    if (firstSample >= lastSample)
+        return eclipses;
+
+    // Distances at the samples and their neighbors on either side
+    size_t nDistances = (size_t) (lastSample - firstSample + 2);
+    vector<double> distances(nDistances);
+    vector<bool> eclipsed(nDistances);
+    for (size_t k = 0; k < nDistances; k++)
     {
+        bool e;
+        double t = startTime + (double) (firstSample + (int64_t) k - 1) * search.step;
+        distances[k] = Distance(search, t, e);
+        eclipsed[k] = e;
+    }
+
+    double lastEndTime = -numeric_limits<double>::infinity();
+    for (size_t k = 1; k + 1 < nDistances; k++)
+    {
+        double t = startTime + (double) (firstSample + (int64_t) k - 1) * search.step;
+
+        // Only look for an eclipse if we're not in the middle of the
+        // previous one.
+        if (t <= lastEndTime)
+            continue;
+
+        double tEclipse = t;
+        if (!eclipsed[k])
+        {
+            // A local minimum of the distance, if the distance could drop
+            // below zero between the neighbors
+            double d = distances[k];
+            double dPrev = distances[k - 1];
+            double dNext = distances[k + 1];
+            if (!(d < dPrev && d <= dNext) || d - 2.0 * max(dPrev - d, dNext - d) >= 0.0)
+                continue;
+
+            bool found;
+            tEclipse = FindClosestApproach(search,
+                                           t - search.step, t + search.step,
+                                           precision, found);
+            if (!found)
+                continue;
+        }
+
         Eclipse eclipse;
-#if 1
-        eclipse.startTime = findEclipseSpan(receiver, occulter, now, -dT);
-        eclipse.endTime = findEclipseSpan(receiver, occulter, now, dT);
-#else
-        eclipse.startTime = findEclipseStart(receiver, occulter, now, searchStep, minStep);
-        eclipse.endTime = findEclipseEnd(receiver, occulter, now, searchStep, minStep);
-#endif
-        eclipse.receiver = const_cast<Body*>(&receiver);
-        eclipse.occulter = const_cast<Body*>(&occulter);
-        eclipses.emplace_back(eclipse);
-
-        previousEclipseEndTimes[i] = eclipse.endTime;
+        eclipse.startTime = FindEclipseEdge(search, tEclipse, -search.step, precision);
+        eclipse.endTime = FindEclipseEdge(search, tEclipse, search.step, precision);
+        lastEndTime = eclipse.endTime;
+        if (eclipse.endTime < startTime || eclipse.startTime > endTime)
+            continue;
+
+        eclipse.receiver = const_cast<Body*>(search.receiver);
+        eclipse.occulter = const_cast<Body*>(search.caster);
+        eclipses.push_back(eclipse);
     }
+
+    return eclipses;
 }
 
+
+double SearchStep(const Body& primary, const Body& satellite, double t)
+{
+    const Orbit* orbit = satellite.getOrbit(t);
+    if (!orbit->isPeriodic() || orbit->getPeriod() <= 0.0)
+        return DefaultSearchStep;
+
+    // The synodic period of a retrograde orbit, P * Pp / (P + Pp), which is
+    // shorter than that of a prograde one. Sampling it is conservative:
+    // the step is small enough whichever way the satellite orbits.
+    double period = orbit->getPeriod();
+    const Orbit* primaryOrbit = primary.getOrbit(t);
+    if (primaryOrbit->isPeriodic() && primaryOrbit->getPeriod() > 0.0)
+        period = period * primaryOrbit->getPeriod() / (period + primaryOrbit->getPeriod());
+
+    return period / SamplesPerPeriod;
+}
+
+
+// Whether the astrocentric position of the body may be computed on several
+// threads at once: its orbits and those of the bodies they are relative
+// to must allow it, in frames that have no state.
+bool IsThreadSafe(const Body& body)
+{
+    const Timeline* timeline = body.getTimeline();
+    for (unsigned int i = 0; i < timeline->phaseCount(); i++)
+    {
+        const auto& phase = timeline->getPhase(i);
+        const ReferenceFrame* frame = phase->orbitFrame().get();
+        if (!phase->orbit()->isThreadSafe())
+            return false;
+        if (dynamic_cast<const J2000EclipticFrame*>(frame) == nullptr &&
+            dynamic_cast<const J2000EquatorFrame*>(frame) == nullptr)
+            return false;
+
+        const Body* center = frame->getCenter().body();
+        if (center != nullptr && !IsThreadSafe(*center))
+            return false;
+    }
+
+    return true;
+}
+
+} // anonymous namespace
+
+
 void EclipseFinder::findEclipses(double startDate,
                                  double endDate,
                                  int eclipseTypeMask,
@@ -209,53 +479,97 @@ void EclipseFinder::findEclipses(double startDate,
     if (satellites == nullptr)
         return;
 
-    // For each body, we'll need to store the time when the last eclipse ended
-    vector<double> previousEclipseEndTimes;
-
-    // Make a list of satellites that we'll actually test for eclipses; ignore
+    // Make a list of pairs that we'll actually test for eclipses; ignore
     // spacecraft and very small objects.
-    vector<Body*> testBodies;
+    vector<EclipseSearch> searches;
+    bool threadSafe = IsThreadSafe(*body);
+    double maxStep = 0.0;
     for (int i = 0; i < satellites->getSystemSize(); i++)
     {
         Body* obj = satellites->getBody(i);
-        if ((obj->getClassification() & EclipseObjectMask) != 0 &&
-            obj->getRadius() >= body->getRadius() * MinRelativeOccluderRadius)
+        if ((obj->getClassification() & EclipseObjectMask) == 0 ||
+            obj->getRadius() < body->getRadius() * MinRelativeOccluderRadius)
         {
-            testBodies.push_back(obj);
-            previousEclipseEndTimes.push_back(startDate - 1.0);
+            continue;
         }
+
+        double step = SearchStep(*body, *obj, startDate);
+        int64_t nSamples = (int64_t) ceil((endDate - startDate) / step) + 1;
+        if ((eclipseTypeMask & Eclipse::Solar) != 0 && CastsShadow(*body, *obj))
+            searches.push_back({ body, obj, step, nSamples, -numeric_limits<double>::infinity() });
+        if ((eclipseTypeMask & Eclipse::Lunar) != 0 && CastsShadow(*obj, *body))
+            searches.push_back({ obj, body, step, nSamples, -numeric_limits<double>::infinity() });
+        threadSafe = threadSafe && IsThreadSafe(*obj);
+        maxStep = max(maxStep, step);
     }
 
-    if (testBodies.empty())
+    if (searches.empty())
         return;
 
-    // TODO: Use a fixed step of one hour for now; we should use a binary
-    // search instead.
-    double searchStep = 1.0 / 24.0; // one hour
-
-    // Precision of eclipse duration calculation
-    double durationPrecision = 1.0 / (24.0 * 360.0); // ten seconds
+    ThreadPool& pool = ThreadPool::global();
+    double windowSpan = maxStep * SamplesPerWindow;
+    size_t nWindows = threadSafe ? (pool.size() + 1) * WindowsPerThread : 1;
+    size_t nTasks = nWindows * searches.size();
+    vector<vector<Eclipse>> results(nTasks);
 
-    for (double t = startDate; t <= endDate; t += searchStep)
+    for (size_t firstWindow = 0;
+         startDate + windowSpan * (double) firstWindow <= endDate + maxStep;
+         firstWindow += nWindows)
     {
         if (watcher != nullptr)
         {
+            double t = min(startDate + windowSpan * (double) firstWindow, endDate);
             if (watcher->eclipseFinderProgressUpdate(t) == EclipseFinderWatcher::AbortOperation)
                 return;
         }
 
-        for (unsigned int i = 0; i < testBodies.size(); i++)
+        // Each task searches the samples of one pair in one window
+        auto searchWindow = [&](size_t task)
         {
-            // Only test for an eclipse if we're not in the middle of
-            // of previous one.
-            if (t <= previousEclipseEndTimes[i])
-                continue;
+            const EclipseSearch& search = searches[task % searches.size()];
+            size_t window = firstWindow + task / searches.size();
+            double windowStart = startDate + windowSpan * (double) window;
+            double windowEnd = startDate + windowSpan * (double) (window + 1);
+            auto firstSample = (int64_t) ceil((windowStart - startDate) / search.step);
+            auto lastSample = (int64_t) ceil((windowEnd - startDate) / search.step);
+            results[task] = SearchSamples(search, startDate, endDate,
+                                          min(firstSample, search.nSamples),
+                                          min(lastSample, search.nSamples),
+                                          precision);
+        };
+
+        if (threadSafe)
+        {
+            pool.parallelFor(nTasks, searchWindow);
+        }
+        else
+        {
+            for (size_t task = 0; task < nTasks; task++)
+                searchWindow(task);
+        }
 
-            if (eclipseTypeMask & Eclipse::Solar)
-                addEclipse(*body, *testBodies[i], t, searchStep, durationPrecision, eclipses, previousEclipseEndTimes, i);
+        // An eclipse spanning windows is found in each of them
+        vector<Eclipse> found;
+        for (size_t task = 0; task < nTasks; task++)
+        {
+            EclipseSearch& search = searches[task % searches.size()];
+            for (const auto& eclipse : results[task])
+            {
+                if (eclipse.startTime > search.lastEndTime)
+                {
+                    found.push_back(eclipse);
+                    search.lastEndTime = eclipse.endTime;
+                }
+            }
+        }
 
-            if (eclipseTypeMask & Eclipse::Lunar)
-                addEclipse(*testBodies[i], *body, t, searchStep, durationPrecision, eclipses, previousEclipseEndTimes, i);
+        stable_sort(found.begin(), found.end(),
+                    [](const Eclipse& e0, const Eclipse& e1) { return e0.startTime < e1.startTime; });
+        for (const auto& eclipse : found)
+        {
+            eclipses.push_back(eclipse);
+            if (watcher != nullptr)
+                watcher->eclipseFinderEclipseFound(eclipse);
         }
     }
 }
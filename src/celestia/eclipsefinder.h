@@ -41,9 +41,24 @@ class EclipseFinderWatcher
     };
 
     virtual Status eclipseFinderProgressUpdate(double t) = 0;
+
+    // Called with each eclipse as soon as it's found, before
+    // findEclipses() returns.
+    virtual void eclipseFinderEclipseFound(const Eclipse&) {};
+
     virtual ~EclipseFinderWatcher() = default;
 };
 
+/*! The search looks for the times when a body gets closest to the shadow
+ *  of another, sampling each pair of bodies a few times per synodic
+ *  period. Minima close enough to the shadow are refined with Brent's
+ *  method, and the ends of the eclipses found by bisection.
+ *
+ *  The search is split into stretches of time, each searched for all
+ *  pairs on the global thread pool when the orbits of the bodies may be
+ *  evaluated on several threads; otherwise on the calling thread. The
+ *  watcher is only called from the calling thread, between stretches.
+ */
 class EclipseFinder
 {
  public:
@@ -53,9 +68,17 @@ class EclipseFinder
                       double endDate,
                       int eclipseTypeMask,
                       vector<Eclipse>& eclipses);
+
+    // Precision of the start and end times, in days; one second by default
+    void setPrecision(double days) { precision = days; };
+
  private:
     Body* body;
     EclipseFinderWatcher* watcher;
+    double precision;
 };
+
+// Whether receiver is in the shadow of caster at time now
+bool testEclipse(const Body& receiver, const Body& caster, double now);
 #endif // _ECLIPSEFINDER_H_
 
@@ -0,0 +1,393 @@
+// headlessmain.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Offscreen front-end for Celestia: renders a list of views to image files
+// without a window, for batch jobs.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <config.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// celengine/glsupport.h must be included before epoxy/egl.h
+#include <celengine/glsupport.h>
+#include <epoxy/egl.h>
+#include <fmt/printf.h>
+#include <celutil/debug.h>
+#include <celutil/filetype.h>
+#include <celutil/gettext.h>
+#include <celutil/threadpool.h>
+#include <celmath/geomutil.h>
+#include <celmath/mathlib.h>
+#include <celengine/astro.h>
+#include <celengine/simulation.h>
+#include <celestia/celestiacore.h>
+#include <celestia/imagecapture.h>
+
+using namespace celestia;
+using namespace celmath;
+using namespace Eigen;
+using namespace std;
+
+
+char AppName[] = "Celestia";
+
+// Images waiting to be written, per encoding thread, before rendering
+// waits for the oldest one
+static const unsigned int PendingImagesPerThread = 2;
+
+
+/*! A frame of a job file: one line of
+ *
+ *    <time> <object> <x> <y> <z> <fov> <image file>
+ *
+ *  The time is a Julian date or a date like 2020-06-21T12:30:00, both UTC.
+ *  The observer is placed at x, y, z kilometers from the object in
+ *  Celestia's J2000 ecliptic frame, where y points to the north ecliptic
+ *  pole, and looks at the object with a vertical field of view of fov
+ *  degrees. The image type follows the file extension, PNG or JPEG.
+ *  Blank lines and lines starting with # are skipped.
+ */
+struct Job
+{
+    double tdb;
+    string object;
+    Vector3d offset;
+    float fov;
+    fs::path filename;
+};
+
+
+static bool ParseTime(const string& s, double& tdb)
+{
+    char* end;
+    double jd = strtod(s.c_str(), &end);
+    if (*end == '\0')
+    {
+        tdb = astro::UTCtoTDB(astro::Date(jd));
+        return true;
+    }
+
+    // astro::parseDate() expects the fields separated by blanks
+    string date = s;
+    for (size_t i = 1; i < date.size(); i++)
+    {
+        if (date[i] == '-' || date[i] == 'T')
+            date[i] = ' ';
+    }
+
+    astro::Date d;
+    if (!astro::parseDate(date, d))
+        return false;
+    tdb = astro::UTCtoTDB(d);
+    return true;
+}
+
+
+static bool ReadJobs(istream& in, vector<Job>& jobs)
+{
+    string line;
+    for (int lineNumber = 1; getline(in, line); lineNumber++)
+    {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == string::npos || line[start] == '#')
+            continue;
+
+        istringstream fields(line);
+        string time, filename;
+        Job job;
+        if (!(fields >> time >> job.object
+                     >> job.offset.x() >> job.offset.y() >> job.offset.z()
+                     >> job.fov >> filename) ||
+            !ParseTime(time, job.tdb) ||
+            job.fov <= 0.0f || job.fov >= 180.0f ||
+            job.offset.isZero())
+        {
+            cerr << fmt::sprintf(_("Bad frame on line %d of the job file\n"), lineNumber);
+            return false;
+        }
+        job.filename = filename;
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+
+// Make a GL context current on a pbuffer of the frame size. Mesa's
+// surfaceless platform needs neither a display server nor a GPU.
+static bool CreateContext(int width, int height)
+{
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (epoxy_has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless"))
+        display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        return false;
+
+#ifdef GL_ES
+    const EGLint renderableType = EGL_OPENGL_ES2_BIT;
+    const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    if (!eglBindAPI(EGL_OPENGL_ES_API))
+        return false;
+#else
+    const EGLint renderableType = EGL_OPENGL_BIT;
+    const EGLint contextAttribs[] = { EGL_NONE };
+    if (!eglBindAPI(EGL_OPENGL_API))
+        return false;
+#endif
+
+    const EGLint configAttribs[] =
+    {
+        EGL_SURFACE_TYPE,    EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, renderableType,
+        EGL_RED_SIZE,        8,
+        EGL_GREEN_SIZE,      8,
+        EGL_BLUE_SIZE,       8,
+        EGL_DEPTH_SIZE,      24,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint nConfigs = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &nConfigs) || nConfigs == 0)
+        return false;
+
+    const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if (surface == EGL_NO_SURFACE)
+        return false;
+
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT)
+        return false;
+
+    return eglMakeCurrent(display, surface, surface, context) == EGL_TRUE;
+}
+
+
+// Paths given on the command line and in the job file are relative to the
+// working directory, which is left for the data directory
+static fs::path Absolute(const fs::path& p)
+{
+    if (p.empty() || p.is_absolute())
+        return p;
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr)
+        return p;
+    return fs::path(cwd) / p;
+}
+
+
+static void Usage()
+{
+    cout << _("Usage: celestia-headless [-v level] [-c config file] [-d data dir]\n"
+              "                         [-s width x height] <job file>\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    setlocale(LC_ALL, "");
+    setlocale(LC_NUMERIC, "C");
+    bindtextdomain(PACKAGE, LOCALEDIR);
+    bind_textdomain_codeset(PACKAGE, "UTF-8");
+    textdomain(PACKAGE);
+
+    int width = 1920;
+    int height = 1080;
+    string dataDir = CONFIG_DATA_DIR;
+    fs::path configFile;
+
+    int c;
+    while ((c = getopt(argc, argv, "v:c:d:s:")) > -1)
+    {
+        switch (c)
+        {
+        case 'v':
+            SetDebugVerbosity(atoi(optarg));
+            break;
+        case 'c':
+            configFile = Absolute(optarg);
+            break;
+        case 'd':
+            dataDir = optarg;
+            break;
+        case 's':
+            if (sscanf(optarg, "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+            {
+                Usage();
+                return 1;
+            }
+            break;
+        default:
+            Usage();
+            return 1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        Usage();
+        return 1;
+    }
+
+    fs::path jobFile = Absolute(argv[optind]);
+    vector<Job> jobs;
+    ifstream in(jobFile.string());
+    if (!in.good())
+    {
+        cerr << fmt::sprintf(_("Error opening job file %s\n"), jobFile.string());
+        return 1;
+    }
+    if (!ReadJobs(in, jobs))
+        return 1;
+    for (auto& job : jobs)
+    {
+        job.filename = Absolute(job.filename);
+        ContentType type = DetermineFileType(job.filename);
+        if (type != Content_PNG && type != Content_JPEG)
+        {
+            cerr << fmt::sprintf(_("Unsupported image type %s\n"), job.filename.string());
+            return 1;
+        }
+    }
+
+    if (chdir(dataDir.c_str()) == -1)
+    {
+        cerr << fmt::sprintf(_("Cannot chdir to '%s', probably due to improper installation\n"), dataDir);
+        return 1;
+    }
+
+    if (!CreateContext(width, height))
+    {
+        cerr << _("Unable to create an offscreen OpenGL context.\n");
+        return 1;
+    }
+
+    if (!gl::init() || !gl::checkVersion(gl::GL_2_1))
+    {
+        cerr << _("Celestia was unable to initialize OpenGL 2.1.\n");
+        return 1;
+    }
+
+    // CelestiaCore sends cerr to its console; errors about the frames
+    // still belong on the terminal.
+    ostream err(cerr.rdbuf());
+    unique_ptr<CelestiaCore> appCore(new CelestiaCore());
+    if (!appCore->initSimulation(configFile))
+    {
+        err << _("Error initializing simulation.\n");
+        return 1;
+    }
+
+    appCore->initRenderer();
+    appCore->getRenderer()->setSolarSystemMaxDistance(appCore->getConfig()->SolarSystemMaxDistance);
+    appCore->getRenderer()->setShadowMapSize(appCore->getConfig()->ShadowMapSize);
+    appCore->resize(width, height);
+    appCore->setHudDetail(0);
+    appCore->start();
+
+    Simulation* sim = appCore->getSimulation();
+    sim->setTimeScale(0.0);
+
+    // Frames are rendered back to back; writing the images, which takes
+    // longer than rendering small frames, is left to the thread pool.
+    ThreadPool& pool = ThreadPool::global();
+    size_t maxPending = max(1u, pool.size()) * PendingImagesPerThread;
+    deque<future<bool>> pending;
+    int nFailed = 0;
+    int nRendered = 0;
+    // Time spent waiting for images to be written, which isn't rendering
+    chrono::steady_clock::duration waitTime{ 0 };
+
+    auto startTime = chrono::steady_clock::now();
+    for (const auto& job : jobs)
+    {
+        Selection sel = sim->findObjectFromPath(job.object);
+        if (sel.empty())
+        {
+            err << fmt::sprintf(_("Object %s not found, skipping %s\n"), job.object, job.filename.string());
+            nFailed++;
+            continue;
+        }
+
+        sim->setTime(job.tdb);
+        sim->setFrame(ObserverFrame::Universal, Selection());
+
+        Vector3d up = Vector3d::UnitY();
+        if (job.offset.normalized().cross(up).isZero(1.0e-6))
+            up = Vector3d::UnitZ();
+        sim->setObserverPosition(sel.getPosition(job.tdb).offsetKm(job.offset));
+        sim->setObserverOrientation(LookAt<double>(job.offset, Vector3d::Zero(), up).cast<float>());
+        sim->getActiveObserver()->setFOV((float) degToRad(job.fov));
+        sim->update(0.0);
+
+        appCore->setViewChanged();
+        appCore->draw();
+
+        auto pixels = make_shared<vector<unsigned char>>(height * ((width * 3 + 3) & ~0x3));
+        if (!appCore->getRenderer()->captureFrame(0, 0, width, height,
+                                                  Renderer::PixelFormat::RGB,
+                                                  pixels->data(), true))
+        {
+            err << fmt::sprintf(_("Error reading back %s\n"), job.filename.string());
+            nFailed++;
+            continue;
+        }
+        nRendered++;
+
+        if (pending.size() >= maxPending)
+        {
+            auto waitStart = chrono::steady_clock::now();
+            nFailed += pending.front().get() ? 0 : 1;
+            waitTime += chrono::steady_clock::now() - waitStart;
+            pending.pop_front();
+        }
+
+        fs::path filename = job.filename;
+        pending.push_back(pool.async([=]()
+        {
+            if (DetermineFileType(filename) == Content_JPEG)
+                return SaveRGBImageToJPEG(filename, width, height, pixels->data());
+            return SaveRGBImageToPNG(filename, width, height, pixels->data());
+        }));
+    }
+    auto renderTime = chrono::steady_clock::now();
+
+    for (auto& result : pending)
+        nFailed += result.get() ? 0 : 1;
+    auto endTime = chrono::steady_clock::now();
+
+    // The overall rate counts the images written, the rendering rate the
+    // frames read back.
+    double renderSeconds = chrono::duration<double>(renderTime - startTime - waitTime).count();
+    double totalSeconds = chrono::duration<double>(endTime - startTime).count();
+    int nFrames = (int) jobs.size() - nFailed;
+    cout << fmt::sprintf(_("%d frames of %dx%d in %.2f s: %.2f frames/s, %.2f frames/s rendering only\n"),
+                         nFrames, width, height, totalSeconds,
+                         nFrames / max(totalSeconds, 1.0e-6),
+                         nRendered / max(renderSeconds, 1.0e-6));
+    if (nFailed > 0)
+    {
+        err << fmt::sprintf(_("%d frames failed\n"), nFailed);
+        return 1;
+    }
+
+    return 0;
+}
@@ -15,27 +15,42 @@ extern "C" {
 #include <jpeglib.h>
 }
 #include <png.h>
+#include <vector>
 #include <zlib.h>
 
 using namespace std;
 
 
+static int RGBRowStride(int width)
+{
+    return (width * 3 + 3) & ~0x3;
+}
+
+
 bool CaptureGLBufferToJPEG(const fs::path& filename,
                            int x, int y,
                            int width, int height,
                            const Renderer *renderer)
 {
-    int rowStride = (width * 3 + 3) & ~0x3;
-    int imageSize = height * rowStride;
-    auto* pixels = new unsigned char[imageSize];
+    vector<unsigned char> pixels(height * RGBRowStride(width));
 
     if (!renderer->captureFrame(x, y, width, height,
                                 Renderer::PixelFormat::RGB,
-                                pixels, true))
+                                pixels.data(), true))
     {
         return false;
     }
 
+    return SaveRGBImageToJPEG(filename, width, height, pixels.data());
+}
+
+
+bool SaveRGBImageToJPEG(const fs::path& filename,
+                        int width, int height,
+                        const unsigned char* pixels)
+{
+    int rowStride = RGBRowStride(width);
+
     FILE* out;
 #ifdef _WIN32
     out = _wfopen(filename.c_str(), L"wb");
@@ -45,7 +60,6 @@ bool CaptureGLBufferToJPEG(const fs::path& filename,
     if (out == nullptr)
     {
         DPRINTF(LOG_LEVEL_ERROR, "Can't open screen capture file '%s'\n", filename);
-        delete[] pixels;
         return false;
     }
 
@@ -72,7 +86,7 @@ bool CaptureGLBufferToJPEG(const fs::path& filename,
 
     while (cinfo.next_scanline < cinfo.image_height)
     {
-        row[0] = &pixels[rowStride * (cinfo.image_height - cinfo.next_scanline - 1)];
+        row[0] = (JSAMPROW) &pixels[rowStride * (cinfo.image_height - cinfo.next_scanline - 1)];
         (void) jpeg_write_scanlines(&cinfo, row, 1);
     }
 
@@ -80,8 +94,6 @@ bool CaptureGLBufferToJPEG(const fs::path& filename,
     fclose(out);
     jpeg_destroy_compress(&cinfo);
 
-    delete[] pixels;
-
     return true;
 }
 
@@ -98,17 +110,25 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
                            int width, int height,
                            const Renderer *renderer)
 {
-    int rowStride = (width * 3 + 3) & ~0x3;
-    int imageSize = height * rowStride;
-    auto* pixels = new unsigned char[imageSize];
+    vector<unsigned char> pixels(height * RGBRowStride(width));
 
     if (!renderer->captureFrame(x, y, width, height,
                                 Renderer::PixelFormat::RGB,
-                                pixels, true))
+                                pixels.data(), true))
     {
         return false;
     }
 
+    return SaveRGBImageToPNG(filename, width, height, pixels.data());
+}
+
+
+bool SaveRGBImageToPNG(const fs::path& filename,
+                       int width, int height,
+                       const unsigned char* pixels)
+{
+    int rowStride = RGBRowStride(width);
+
 #ifdef _WIN32
     FILE* out = _wfopen(filename.c_str(), L"wb");
 #else
@@ -117,7 +137,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     if (out == nullptr)
     {
         DPRINTF(LOG_LEVEL_ERROR, "Can't open screen capture file '%s'\n", filename);
-        delete[] pixels;
         return false;
     }
 
@@ -135,7 +154,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     {
         DPRINTF(LOG_LEVEL_ERROR, "Screen capture: error allocating png_ptr\n");
         fclose(out);
-        delete[] pixels;
         delete[] row_pointers;
         return false;
     }
@@ -145,7 +163,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     {
         DPRINTF(LOG_LEVEL_ERROR, "Screen capture: error allocating info_ptr\n");
         fclose(out);
-        delete[] pixels;
         delete[] row_pointers;
         png_destroy_write_struct(&png_ptr, (png_infopp) nullptr);
         return false;
@@ -155,7 +172,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     {
         DPRINTF(LOG_LEVEL_ERROR, "Error writing PNG file '%s'\n", filename);
         fclose(out);
-        delete[] pixels;
         delete[] row_pointers;
         png_destroy_write_struct(&png_ptr, &info_ptr);
         return false;
@@ -180,7 +196,6 @@ bool CaptureGLBufferToPNG(const fs::path& filename,
     // Clean up everything . . .
     png_destroy_write_struct(&png_ptr, &info_ptr);
     delete[] row_pointers;
-    delete[] pixels;
     fclose(out);
 
     return true;
@@ -23,4 +23,14 @@ extern bool CaptureGLBufferToPNG(const fs::path& filename,
                                  int width, int height,
                                  const Renderer *renderer);
 
+// Write an RGB image as captured by Renderer::captureFrame(): rows padded
+// to a multiple of four bytes, bottom row first. These don't touch GL and
+// may be called from any thread.
+extern bool SaveRGBImageToJPEG(const fs::path& filename,
+                               int width, int height,
+                               const unsigned char* pixels);
+extern bool SaveRGBImageToPNG(const fs::path& filename,
+                              int width, int height,
+                              const unsigned char* pixels);
+
 #endif // _IMAGECAPTURE_H_
@@ -65,14 +65,24 @@
 
 #include <cstdlib>
 #include <cmath>
+#include <celengine/framereadback.h>
 #include <celutil/debug.h>
 #include <celutil/gettext.h>
+#include <celutil/threadpool.h>
 #include <string>
 #include <theora/theora.h>
 
 using namespace std;
 
 #include "oggtheoracapture.h"
+#include "yuvconvert.h"
+
+// Frames retrieved from the readback that may wait for the encoder before
+// captureFrame() blocks
+static const unsigned int MaxQueuedFrames = 4;
+
+// Rows of a frame converted by one task
+static const int ConversionBandHeight = 64;
 
 //  {"video-rate-target",required_argument,nullptr,'V'},
 //  {"video-quality",required_argument,nullptr,'v'},
@@ -99,8 +109,7 @@ OggTheoraCapture::OggTheoraCapture(const Renderer *r):
     capturing(false),
     video_frame_count(0),
     video_bytesout(0),
-    rowStride(0),
-    pixels(nullptr),
+    encoderStopping(false),
     outfile(nullptr)
 {
     yuvframe[0] = nullptr;
@@ -280,33 +289,37 @@ bool OggTheoraCapture::start(const std::string& filename,
         fwrite(videopage.header,1,videopage.header_len,outfile);
         fwrite(videopage.body,1,  videopage.body_len,outfile);
     }
-    /* Initialize the double frame buffer.
-     * We allocate enough for a 4:4:4 color sampling
+    /* Initialize the double frame buffer of 4:2:0 frames, and clear them
+     * as they may be larger than actual video data: the Y plane to 0x10
+     * and the UV planes to 0x80, for black. Only the actual video data is
+     * written afterwards.
      */
-    yuvframe[0]= new unsigned char[video_x*video_y*3];
-    yuvframe[1]= new unsigned char[video_x*video_y*3];
-
-    // Now the buffer for reading the GL RGB pixels
-    rowStride = (frame_x * 3 + 3) & ~0x3;
-    pixels = new unsigned char[rowStride*frame_y];
+    for (int i = 0; i < 2; i++)
+    {
+        yuvframe[i] = new unsigned char[video_x*video_y*3/2];
+        memset(yuvframe[i],0x10,video_x*video_y);
+        memset(yuvframe[i]+video_x*video_y,0x80,video_x*video_y/2);
+    }
 
-        /* clear initial frame as it may be larger than actual video data */
-        /* fill Y plane with 0x10 and UV planes with 0x80, for black data */
-    // The UV plane must be 4:2:0
-    memset(yuvframe[0],0x10,video_x*video_y);
-    memset(yuvframe[0]+video_x*video_y,0x80,video_x*video_y*2);
-    memset(yuvframe[1],0x10,video_x*video_y);
-    memset(yuvframe[1]+video_x*video_y,0x80,video_x*video_y*2);
+    // The buffers for the GL RGBA pixels waiting to be encoded
+    rgbaBuffers.resize(MaxQueuedFrames);
+    for (auto& buffer : rgbaBuffers)
+    {
+        buffer.resize(frame_x*frame_y*4);
+        freeFrames.push_back(buffer.data());
+    }
 
     yuv.y_width=video_x;
     yuv.y_height=video_y;
     yuv.y_stride=video_x;
 
-    // Note we lie here by saying it's 4:2:0 and we will convert 4:4:4 to 4:2;0 later
     yuv.uv_width=video_x/2;
     yuv.uv_height=video_y/2;
     yuv.uv_stride=video_x/2;
 
+    encoderStopping = false;
+    encoder = std::thread(&OggTheoraCapture::encoderLoop, this);
+
     DPRINTF(LOG_LEVEL_VERBOSE,
             _("OggTheoraCapture::start() - Theora video: %s %.2f(%d/%d) fps quality %d %dx%d offset (%dx%d)\n"),
             filename.c_str(),
@@ -325,14 +338,12 @@ bool OggTheoraCapture::captureFrame()
     if (!capturing)
         return false;
 
-    while (ogg_stream_pageout(&to,&videopage)>0)
-    {
-        /* flush a video page */
-        video_bytesout+=fwrite(videopage.header,1,videopage.header_len,outfile);
-        video_bytesout+=fwrite(videopage.body,1,videopage.body_len,outfile);
+    if (readback == nullptr)
+        readback.reset(new FrameReadback(frame_x, frame_y));
 
-    }
-    if(ogg_stream_eos(&to)) return false;
+    // Make room in the ring for this frame
+    if (readback->full() && !queueReadbackFrame())
+        return false;
 
     // Get the dimensions of the current viewport
     int x, y, w, h;
@@ -340,82 +351,122 @@ bool OggTheoraCapture::captureFrame()
 
     x += (w - frame_x) / 2;
     y += (h - frame_y) / 2;
-    renderer->captureFrame(x, y, frame_x, frame_y,
-                           Renderer::PixelFormat::RGB,
-                           pixels);
-
-    unsigned char *ybase = yuvframe[0];
-    unsigned char *ubase = yuvframe[0]+ video_x*video_y;
-    unsigned char *vbase = yuvframe[0]+ video_x*video_y*2;
-    // We go ahead and build 4:4:4 frames
-    for (int y=0; y<frame_y; y++)
+    if (!readback->read(*renderer, x, y))
+        return false;
+
+    video_frame_count += 1;
+    //if ((video_frame_count % 10) == 0)
+    //    DPRINTF(LOG_LEVEL_VERBOSE, "Writing frame %d\n", video_frame_count);
+    frameCaptured();
+
+    return true;
+}
+
+// Retrieve the oldest frame of the readback ring and pass it to the
+// encoder, waiting for a free buffer if the encoder is behind.
+bool OggTheoraCapture::queueReadbackFrame()
+{
+    unsigned char* frame;
     {
-        unsigned char *yptr = ybase + (video_x*(y+frame_y_offset))+frame_x_offset;
-        unsigned char *uptr = ubase + (video_x*(y+frame_y_offset))+frame_x_offset;
-        unsigned char *vptr = vbase + (video_x*(y+frame_y_offset))+frame_x_offset;
-        unsigned char *rgb = pixels + ((frame_y-1-y)*rowStride); // The video is inverted
-        for (int x=0; x<frame_x; x++)
-        {
-            unsigned char r = *rgb++;
-            unsigned char g = *rgb++;
-            unsigned char b = *rgb++;
-            *yptr++ = min(abs(r * 2104 + g * 4130 + b * 802 + 4096 + 131072) >> 13,235);
-            *uptr++ = min(abs(r * -1214 + g * -2384 + b * 3598 + 4096 + 1048576) >> 13,240);
-            *vptr++ = min(abs(r * 3598 + g * -3013 + b * -585 + 4096 + 1048576) >> 13,240);
-        }
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueChanged.wait(lock, [this] { return !freeFrames.empty(); });
+        frame = freeFrames.back();
+        freeFrames.pop_back();
     }
 
+    bool ok = readback->retrieve(frame);
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (ok)
+            queuedFrames.push_back(frame);
+        else
+            freeFrames.push_back(frame);
+    }
+    queueChanged.notify_all();
+
+    return ok;
+}
+
+void OggTheoraCapture::encoderLoop()
+{
     /*
-     * The video strategy is to capture one frame ahead so when we're at end of
-     * stream we can mark last video frame as such.  Have two YUV frames before
-     * encoding. Theora is a one-frame-in,one-frame-out system; submit a frame
-     * for compression and pull out the packet
+     * The video strategy is to encode one frame behind so when we're at end
+     * of stream we can mark last video frame as such.  Have two YUV frames
+     * before encoding. Theora is a one-frame-in,one-frame-out system; submit
+     * a frame for compression and pull out the packet
      */
-
-    if (video_frame_count > 0)
+    bool havePrevious = false;
+    for (;;)
     {
-        yuv.y= yuvframe[1];
-        yuv.u= yuvframe[1]+ video_x*video_y;
-        yuv.v= yuvframe[1]+ video_x*video_y*2;
-        // Convert to 4:2:0
-        unsigned char * uin0 = yuv.u;
-        unsigned char * uin1 = yuv.u + video_x;
-        unsigned char * uout = yuv.u;
-        unsigned char * vin0 = yuv.v;
-        unsigned char * vin1 = yuv.v + video_x;
-        unsigned char * vout = yuv.v;
-        for (int y = 0; y < video_y; y += 2)
+        unsigned char* rgba;
         {
-            for (int x = 0; x < video_x; x += 2)
-            {
-                *uout = (uin0[0] + uin0[1] + uin1[0] + uin1[1]) >> 2;
-                uin0 += 2;
-                uin1 += 2;
-                uout++;
-                *vout = (vin0[0] + vin0[1] + vin1[0] + vin1[1]) >> 2;
-                vin0 += 2;
-                vin1 += 2;
-                vout++;
-            }
-            uin0 += video_x;
-            uin1 += video_x;
-            vin0 += video_x;
-            vin1 += video_x;
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this] { return !queuedFrames.empty() || encoderStopping; });
+            if (queuedFrames.empty())
+                break;
+            rgba = queuedFrames.front();
+            queuedFrames.pop_front();
         }
-        theora_encode_YUVin(&td,&yuv);
-        theora_encode_packetout(&td,0,&op);
-        ogg_stream_packetin(&to,&op);
+
+        convertFrame(rgba, yuvframe[0]);
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            freeFrames.push_back(rgba);
+        }
+        queueChanged.notify_all();
+
+        if (havePrevious)
+            encodeFrame(yuvframe[1], false);
+        std::swap(yuvframe[0], yuvframe[1]);
+        havePrevious = true;
     }
-    video_frame_count += 1;
-    //if ((video_frame_count % 10) == 0)
-    //    DPRINTF(LOG_LEVEL_VERBOSE, "Writing frame %d\n", video_frame_count);
-    unsigned char *temp = yuvframe[0];
-    yuvframe[0] = yuvframe[1];
-    yuvframe[1] = temp;
-    frameCaptured();
 
-    return true;
+    if (havePrevious)
+        encodeFrame(yuvframe[1], true);
+}
+
+void OggTheoraCapture::convertFrame(const unsigned char* rgba, unsigned char* frame)
+{
+    YUV420Planes planes;
+    planes.y = frame + video_x*frame_y_offset + frame_x_offset;
+    planes.u = frame + video_x*video_y + (video_x/2)*(frame_y_offset/2) + frame_x_offset/2;
+    planes.v = planes.u + video_x*video_y/4;
+    planes.yStride = video_x;
+    planes.uvStride = video_x/2;
+
+    // The video is inverted; the conversion flips it
+    size_t nBands = (frame_y + ConversionBandHeight - 1) / ConversionBandHeight;
+    ThreadPool::global().parallelFor(nBands, [&](size_t band)
+    {
+        int firstRow = band * ConversionBandHeight;
+        int lastRow = min(firstRow + ConversionBandHeight, frame_y);
+        ConvertRGBAToYUV420(rgba, frame_x, frame_y, firstRow, lastRow, planes);
+    });
+}
+
+void OggTheoraCapture::encodeFrame(unsigned char* frame, bool last)
+{
+    yuv.y= frame;
+    yuv.u= frame+ video_x*video_y;
+    yuv.v= frame+ video_x*video_y*5/4;
+    theora_encode_YUVin(&td,&yuv);
+    theora_encode_packetout(&td,last ? 1 : 0,&op);
+    ogg_stream_packetin(&to,&op);
+    writePages();
+}
+
+void OggTheoraCapture::writePages()
+{
+    while (ogg_stream_pageout(&to,&videopage)>0)
+    {
+        /* flush a video page */
+        video_bytesout+=fwrite(videopage.header,1,videopage.header_len,outfile);
+        video_bytesout+=fwrite(videopage.body,1,videopage.body_len,outfile);
+    }
 }
+
 void OggTheoraCapture::cleanup()
 {
     capturing = false;
@@ -423,48 +474,22 @@ void OggTheoraCapture::cleanup()
 
     if(outfile)
     {
-        DPRINTF(LOG_LEVEL_VERBOSE, _("OggTheoraCapture::cleanup() - wrote %d frames\n"), video_frame_count);
-        if (video_frame_count > 0)
+        // Pass the frames still being read back to the encoder, then let it
+        // encode everything queued and finish the stream.
+        while (readback != nullptr && readback->pending() > 0)
+            queueReadbackFrame();
+        readback.reset();
+
         {
-            yuv.y= yuvframe[1];
-            yuv.u= yuvframe[1]+ video_x*video_y;
-            yuv.v= yuvframe[1]+ video_x*video_y*2 ;
-            // Convert to 4:2:0
-            unsigned char * uin0 = yuv.u;
-            unsigned char * uin1 = yuv.u + video_x;
-            unsigned char * uout = yuv.u;
-            unsigned char * vin0 = yuv.v;
-            unsigned char * vin1 = yuv.v + video_x;
-            unsigned char * vout = yuv.v;
-            for (int y = 0; y < video_y; y += 2)
-            {
-                for (int x = 0; x < video_x; x += 2)
-                {
-                    *uout = (uin0[0] + uin0[1] + uin1[0] + uin1[1]) >> 2;
-                    uin0 += 2;
-                    uin1 += 2;
-                    uout++;
-                    *vout = (vin0[0] + vin0[1] + vin1[0] + vin1[1]) >> 2;
-                    vin0 += 2;
-                    vin1 += 2;
-                    vout++;
-                }
-                uin0 += video_x;
-                uin1 += video_x;
-                vin0 += video_x;
-                vin1 += video_x;
-            }
-            theora_encode_YUVin(&td,&yuv);
-            theora_encode_packetout(&td,1,&op);
-            ogg_stream_packetin(&to,&op);
+            std::lock_guard<std::mutex> lock(queueMutex);
+            encoderStopping = true;
         }
-        while(ogg_stream_pageout(&to,&videopage)>0)
-        {
-            /* flush a video page */
-            video_bytesout+=fwrite(videopage.header,1,videopage.header_len,outfile);
-            video_bytesout+=fwrite(videopage.body,1,videopage.body_len,outfile);
+        queueChanged.notify_all();
+        if (encoder.joinable())
+            encoder.join();
 
-        }
+        DPRINTF(LOG_LEVEL_VERBOSE, _("OggTheoraCapture::cleanup() - wrote %d frames\n"), video_frame_count);
+        writePages();
         if(ogg_stream_flush(&to,&videopage)>0)
         {
             /* flush a video page */
@@ -480,7 +505,11 @@ void OggTheoraCapture::cleanup()
         outfile = nullptr;
         delete [] yuvframe[0];
         delete [] yuvframe[1];
-        delete [] pixels;
+        yuvframe[0] = nullptr;
+        yuvframe[1] = nullptr;
+        queuedFrames.clear();
+        freeFrames.clear();
+        rgbaBuffers.clear();
     }
 }
 
@@ -2,9 +2,23 @@
 #ifndef _OGGTHEORACAPTURE_H_
 #define _OGGTHEORACAPTURE_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "theora/theora.h"
 #include "moviecapture.h"
 
+class FrameReadback;
+
+// Frames are read back through a ring of pixel buffers on the render
+// thread, then converted to YUV and encoded on a thread of their own.
+// captureFrame() only waits when the encoder falls behind by more than a
+// few frames. end() retrieves the frames still being read back, so like
+// captureFrame() it must be called with the GL context current.
 class OggTheoraCapture : public MovieCapture
 {
 public:
@@ -26,6 +40,11 @@ public:
 
 private:
     void cleanup();
+    bool queueReadbackFrame();
+    void encoderLoop();
+    void convertFrame(const unsigned char* rgba, unsigned char* frame);
+    void encodeFrame(unsigned char* frame, bool last);
+    void writePages();
 
 private:
     int video_x;
@@ -43,14 +62,22 @@ private:
 
     bool       capturing;
     int        video_frame_count;
-    int        video_bytesout;
+    std::atomic<int> video_bytesout;
+
+    std::unique_ptr<FrameReadback> readback;
 
-    // Consider RGB to YUV Color converstion table - jpeglib has one
-    // but according the standards it's incorrect (generates values 0-255,
-    // instead of clamped to 16-240).
+    // RGBA frames retrieved from the readback and waiting for the encoder,
+    // and the buffers free to retrieve frames into.
+    std::vector<std::vector<unsigned char>> rgbaBuffers;
+    std::deque<unsigned char*> queuedFrames;
+    std::vector<unsigned char*> freeFrames;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    bool encoderStopping;
+    std::thread encoder;
 
-    int            rowStride;
-    unsigned char  *pixels;
+    // The encoder holds back one converted frame so that the last frame
+    // can be marked as the end of the stream.
     unsigned char  *yuvframe[2];
     yuv_buffer     yuv;
     FILE           *outfile;
@@ -194,7 +194,8 @@ CelestiaAppWindow::~CelestiaAppWindow()
 
 
 void CelestiaAppWindow::init(const QString& qConfigFileName,
-                             const QStringList& qExtrasDirectories)
+                             const QStringList& qExtrasDirectories,
+                             bool rebuildCatalogCache)
 {
     QString celestia_data_dir = QString::fromLocal8Bit(::getenv("CELESTIA_DATA_DIR"));
 
@@ -233,6 +234,7 @@ void CelestiaAppWindow::init(const QString& qConfigFileName,
     auto* progress = new AppProgressNotifier(this);
     alerter = new AppAlerter(this);
     m_appCore->setAlerter(alerter);
+    m_appCore->setRebuildCatalogCache(rebuildCatalogCache);
 
     setWindowIcon(QIcon(":/icons/celestia.png"));
 
@@ -45,6 +45,7 @@ static QStringList extrasDirectories;
 static QString configFileName;
 static bool useAlternateConfigFile = false;
 static bool skipSplashScreen = false;
+static bool rebuildCatalogCache = false;
 
 static bool ParseCommandLine();
 
@@ -111,7 +112,7 @@ int main(int argc, char *argv[])
     QObject::connect(&window, SIGNAL(progressUpdate(const QString&, int, const QColor&)),
                      &splash, SLOT(showMessage(const QString&, int, const QColor&)));
 
-    window.init(configFileName, extrasDirectories);
+    window.init(configFileName, extrasDirectories, rebuildCatalogCache);
     window.show();
 
     splash.finish(&window);
@@ -199,6 +200,10 @@ bool ParseCommandLine()
         {
             skipSplashScreen = true;
         }
+        else if (args.at(i) == "--rebuild-cache")
+        {
+            rebuildCatalogCache = true;
+        }
         else
         {
             string buf = fmt::sprintf("Invalid command line option '%s'", args.at(i).toUtf8().data());
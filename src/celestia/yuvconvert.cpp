@@ -0,0 +1,225 @@
+// yuvconvert.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Conversion of captured frames to planar 4:2:0 YUV for video encoding.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "yuvconvert.h"
+
+// SSE2 is enabled by every x86-64 compiler; other targets use the plain
+// C++ version.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define YUV_SSE2
+#endif
+
+namespace
+{
+
+// Fixed point Rec. 601 coefficients scaled by 2^13, with the offsets of
+// the luma and chroma ranges and rounding folded into the constant terms.
+// The sums are positive for all inputs.
+constexpr int YR = 2104, YG = 4130, YB = 802, YC = 4096 + 131072;
+constexpr int UR = -1214, UG = -2384, UB = 3598, UC = 4096 + 1048576;
+constexpr int VR = 3598, VG = -3013, VB = -585, VC = 4096 + 1048576;
+constexpr int MaxLuma = 235;
+constexpr int MaxChroma = 240;
+constexpr int BlackChroma = 0x80;
+
+inline int Luma(int r, int g, int b)
+{
+    return std::min((r * YR + g * YG + b * YB + YC) >> 13, MaxLuma);
+}
+
+inline int Cb(int r, int g, int b)
+{
+    return std::min((r * UR + g * UG + b * UB + UC) >> 13, MaxChroma);
+}
+
+inline int Cr(int r, int g, int b)
+{
+    return std::min((r * VR + g * VG + b * VB + VC) >> 13, MaxChroma);
+}
+
+inline const unsigned char* SourceRow(const unsigned char* rgba, int width, int height, int row)
+{
+    return rgba + (size_t) (height - 1 - row) * width * 4;
+}
+
+// Convert the 2x2 blocks of pixels from column x up to column xEnd of the
+// row pair starting at row.
+void ConvertBlocks(const unsigned char* rgba,
+                   int width, int height,
+                   int row, int x, int xEnd,
+                   const YUV420Planes& planes)
+{
+    const unsigned char* src[2] = { SourceRow(rgba, width, height, row), nullptr };
+    unsigned char* y[2] = { planes.y + (size_t) row * planes.yStride, nullptr };
+    int nRows = 1;
+    if (row + 1 < height)
+    {
+        src[1] = SourceRow(rgba, width, height, row + 1);
+        y[1] = y[0] + planes.yStride;
+        nRows = 2;
+    }
+    unsigned char* u = planes.u + (size_t) (row / 2) * planes.uvStride;
+    unsigned char* v = planes.v + (size_t) (row / 2) * planes.uvStride;
+
+    for (; x < xEnd; x += 2)
+    {
+        int uSum = 0;
+        int vSum = 0;
+        for (int i = 0; i < 2; i++)
+        {
+            for (int j = 0; j < 2; j++)
+            {
+                if (i >= nRows || x + j >= width)
+                {
+                    uSum += BlackChroma;
+                    vSum += BlackChroma;
+                    continue;
+                }
+
+                const unsigned char* p = src[i] + (x + j) * 4;
+                y[i][x + j] = (unsigned char) Luma(p[0], p[1], p[2]);
+                uSum += Cb(p[0], p[1], p[2]);
+                vSum += Cr(p[0], p[1], p[2]);
+            }
+        }
+        u[x / 2] = (unsigned char) (uSum >> 2);
+        v[x / 2] = (unsigned char) (vSum >> 2);
+    }
+}
+
+
+#ifdef YUV_SSE2
+
+// Luma and chroma of four RGBA pixels as 32 bit lanes
+inline void Convert4(__m128i pixels, __m128i& y, __m128i& u, __m128i& v)
+{
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    __m128i r = _mm_and_si128(pixels, byteMask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask);
+
+    // Red and green as the 16 bit halves of each lane, so that one
+    // multiply-add gives r * cr + g * cg.
+    __m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+
+    y = _mm_add_epi32(_mm_madd_epi16(rg, _mm_setr_epi16(YR, YG, YR, YG, YR, YG, YR, YG)),
+                      _mm_madd_epi16(b, _mm_set1_epi32(YB)));
+    u = _mm_add_epi32(_mm_madd_epi16(rg, _mm_setr_epi16(UR, UG, UR, UG, UR, UG, UR, UG)),
+                      _mm_madd_epi16(b, _mm_set1_epi32(UB & 0xffff)));
+    v = _mm_add_epi32(_mm_madd_epi16(rg, _mm_setr_epi16(VR, VG, VR, VG, VR, VG, VR, VG)),
+                      _mm_madd_epi16(b, _mm_set1_epi32(VB & 0xffff)));
+
+    y = _mm_srai_epi32(_mm_add_epi32(y, _mm_set1_epi32(YC)), 13);
+    u = _mm_srai_epi32(_mm_add_epi32(u, _mm_set1_epi32(UC)), 13);
+    v = _mm_srai_epi32(_mm_add_epi32(v, _mm_set1_epi32(VC)), 13);
+}
+
+// Luma of eight pixels of a row, and their clamped chroma as 16 bit lanes
+inline void Convert8(const unsigned char* src, unsigned char* y, __m128i& u, __m128i& v)
+{
+    __m128i y0, u0, v0, y1, u1, v1;
+    Convert4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), y0, u0, v0);
+    Convert4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), y1, u1, v1);
+
+    __m128i luma = _mm_min_epi16(_mm_packs_epi32(y0, y1), _mm_set1_epi16(MaxLuma));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(y), _mm_packus_epi16(luma, luma));
+
+    u = _mm_min_epi16(_mm_packs_epi32(u0, u1), _mm_set1_epi16(MaxChroma));
+    v = _mm_min_epi16(_mm_packs_epi32(v0, v1), _mm_set1_epi16(MaxChroma));
+}
+
+// Average of the 2x2 blocks of chroma of two rows of eight pixels
+inline void StoreChroma(__m128i c0, __m128i c1, unsigned char* dst)
+{
+    __m128i sums = _mm_madd_epi16(_mm_add_epi16(c0, c1), _mm_set1_epi16(1));
+    __m128i avg = _mm_srli_epi32(sums, 2);
+    avg = _mm_packs_epi32(avg, avg);
+    int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(avg, avg));
+    std::memcpy(dst, &packed, sizeof packed);
+}
+
+#endif
+
+} // anonymous namespace
+
+
+void ConvertRGBAToYUV420Scalar(const unsigned char* rgba,
+                               int width, int height,
+                               int firstRow, int lastRow,
+                               const YUV420Planes& planes)
+{
+    for (int row = firstRow; row < lastRow; row += 2)
+        ConvertBlocks(rgba, width, height, row, 0, width, planes);
+}
+
+
+#ifdef YUV_SSE2
+
+void ConvertRGBAToYUV420(const unsigned char* rgba,
+                         int width, int height,
+                         int firstRow, int lastRow,
+                         const YUV420Planes& planes)
+{
+    for (int row = firstRow; row < lastRow; row += 2)
+    {
+        if (row + 1 >= height)
+        {
+            ConvertBlocks(rgba, width, height, row, 0, width, planes);
+            continue;
+        }
+
+        const unsigned char* src0 = SourceRow(rgba, width, height, row);
+        const unsigned char* src1 = SourceRow(rgba, width, height, row + 1);
+        unsigned char* y0 = planes.y + (size_t) row * planes.yStride;
+        unsigned char* y1 = y0 + planes.yStride;
+        unsigned char* u = planes.u + (size_t) (row / 2) * planes.uvStride;
+        unsigned char* v = planes.v + (size_t) (row / 2) * planes.uvStride;
+
+        int x = 0;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i u0, v0, u1, v1;
+            Convert8(src0 + x * 4, y0 + x, u0, v0);
+            Convert8(src1 + x * 4, y1 + x, u1, v1);
+            StoreChroma(u0, u1, u + x / 2);
+            StoreChroma(v0, v1, v + x / 2);
+        }
+
+        ConvertBlocks(rgba, width, height, row, x, width, planes);
+    }
+}
+
+#else
+
+void ConvertRGBAToYUV420(const unsigned char* rgba,
+                         int width, int height,
+                         int firstRow, int lastRow,
+                         const YUV420Planes& planes)
+{
+    ConvertRGBAToYUV420Scalar(rgba, width, height, firstRow, lastRow, planes);
+}
+
+#endif
+
+
+const char* ConvertRGBAToYUV420InstructionSet()
+{
+#ifdef YUV_SSE2
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
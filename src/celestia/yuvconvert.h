@@ -0,0 +1,45 @@
+// yuvconvert.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Conversion of captured frames to planar 4:2:0 YUV for video encoding.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+// The planes of a 4:2:0 frame, each pointing at the top left sample of
+// the region a conversion writes.
+struct YUV420Planes
+{
+    unsigned char* y;
+    unsigned char* u;
+    unsigned char* v;
+    int yStride;
+    int uvStride;
+};
+
+// Convert rows [firstRow, lastRow) of a width x height RGBA frame to 4:2:0
+// YUV with the coefficients of Rec. 601 and luma in [16, 235], chroma in
+// [16, 240]. Rows are counted from the top, but the source has its bottom
+// row first as OpenGL reads it back. firstRow must be even and lastRow
+// even or height, so each call writes whole rows of chroma; chroma samples
+// on a right or bottom edge of odd length average the missing pixels as
+// black.
+void ConvertRGBAToYUV420(const unsigned char* rgba,
+                         int width, int height,
+                         int firstRow, int lastRow,
+                         const YUV420Planes& planes);
+
+// Plain C++ version of ConvertRGBAToYUV420(), used for the edges of a
+// frame and as the reference for the vectorized version.
+void ConvertRGBAToYUV420Scalar(const unsigned char* rgba,
+                               int width, int height,
+                               int firstRow, int lastRow,
+                               const YUV420Planes& planes);
+
+// Name of the instruction set ConvertRGBAToYUV420() was compiled for
+const char* ConvertRGBAToYUV420InstructionSet();
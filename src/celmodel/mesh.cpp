@@ -9,6 +9,7 @@
 // of the License, or (at your option) any later version.
 
 #include "mesh.h"
+#include "meshbvh.h"
 #include <cassert>
 #include <iostream>
 #include <algorithm>
@@ -163,6 +164,10 @@ Mesh::PrimitiveGroup::getPrimitiveCount() const
 }
 
 
+// Out of line, where MeshBVH is complete
+Mesh::Mesh() = default;
+
+
 Mesh::~Mesh()
 {
     for (const auto group : groups)
@@ -181,6 +186,8 @@ Mesh::setVertices(unsigned int _nVertices, void* vertexData)
     if (vertexData == vertices)
         return;
 
+    pickTree.reset();
+
     // TODO: this is just to cast away void* and shut up GCC warnings;
     // should probably be static_cast<VertexList::VertexPart*>
     delete[] static_cast<char*>(vertices);
@@ -197,6 +204,7 @@ Mesh::setVertexDescription(const VertexDescription& desc)
         return false;
 
     vertexDesc = desc;
+    pickTree.reset();
 
     return true;
 }
@@ -232,6 +240,7 @@ unsigned int
 Mesh::addGroup(PrimitiveGroup* group)
 {
     groups.push_back(group);
+    pickTree.reset();
     return groups.size();
 }
 
@@ -266,6 +275,7 @@ Mesh::clearGroups()
         delete group;
 
     groups.clear();
+    pickTree.reset();
 }
 
 
@@ -293,6 +303,7 @@ Mesh::remapIndices(const vector<index32>& indexMap)
             group->indices[i] = indexMap[group->indices[i]];
         }
     }
+    pickTree.reset();
 }
 
 
@@ -317,11 +328,27 @@ void
 Mesh::aggregateByMaterial()
 {
     sort(groups.begin(), groups.end(), PrimitiveGroupComparator());
+    pickTree.reset();
 }
 
 
 bool
 Mesh::pick(const Vector3d& rayOrigin, const Vector3d& rayDirection, PickResult* result) const
+{
+    const MeshBVH* tree;
+    {
+        lock_guard<mutex> lock(pickTreeMutex);
+        if (pickTree == nullptr)
+            pickTree.reset(new MeshBVH(*this));
+        tree = pickTree.get();
+    }
+
+    return tree->pick(rayOrigin, rayDirection, result);
+}
+
+
+bool
+Mesh::pickLinear(const Vector3d& rayOrigin, const Vector3d& rayDirection, PickResult* result) const
 {
     double maxDistance = 1.0e30;
     double closest = maxDistance;
@@ -337,119 +364,30 @@ Mesh::pick(const Vector3d& rayOrigin, const Vector3d& rayDirection, PickResult*
     unsigned int posOffset = vertexDesc.getAttribute(Position).offset;
     auto* vdata = reinterpret_cast<char*>(vertices);
 
-    // Iterate over all primitive groups in the mesh
-    for (const auto group : groups)
+    ForEachTriangle(*this, [&](unsigned int groupIndex, unsigned int primitiveIndex,
+                               index32 i0, index32 i1, index32 i2)
     {
-        Mesh::PrimitiveGroupType primType = group->prim;
-        index32 nIndices = group->nIndices;
-
-        // Only attempt to compute the intersection of the ray with triangle
-        // groups.
-        if ((primType == TriList || primType == TriStrip || primType == TriFan) &&
-            (nIndices >= 3) &&
-            !(primType == TriList && nIndices % 3 != 0))
+        // Get the triangle vertices v0, v1, and v2
+        Vector3d v0 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i0 * vertexDesc.stride + posOffset)).cast<double>();
+        Vector3d v1 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i1 * vertexDesc.stride + posOffset)).cast<double>();
+        Vector3d v2 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i2 * vertexDesc.stride + posOffset)).cast<double>();
+
+        double t;
+        if (IntersectTriangle(v0, v1, v2, rayOrigin, rayDirection, t) && t < closest)
         {
-            unsigned int primitiveIndex = 0;
-            index32 index = 0;
-            index32 i0 = group->indices[0];
-            index32 i1 = group->indices[1];
-            index32 i2 = group->indices[2];
-
-            // Iterate over the triangles in the primitive group
-            do
+            closest = t;
+            if (result)
             {
-                // Get the triangle vertices v0, v1, and v2
-                Vector3d v0 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i0 * vertexDesc.stride + posOffset)).cast<double>();
-                Vector3d v1 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i1 * vertexDesc.stride + posOffset)).cast<double>();
-                Vector3d v2 = Map<Vector3f>(reinterpret_cast<float*>(vdata + i2 * vertexDesc.stride + posOffset)).cast<double>();
-
-                // Compute the edge vectors e0 and e1, and the normal n
-                Vector3d e0 = v1 - v0;
-                Vector3d e1 = v2 - v0;
-                Vector3d n = e0.cross(e1);
-
-                // c is the cosine of the angle between the ray and triangle normal
-                double c = n.dot(rayDirection);
-
-                // If the ray is parallel to the triangle, it either misses the
-                // triangle completely, or is contained in the triangle's plane.
-                // If it's contained in the plane, we'll still call it a miss.
-                if (c != 0.0)
-                {
-                    double t = (n.dot(v0 - rayOrigin)) / c;
-                    if (t < closest && t > 0.0)
-                    {
-                        double m00 = e0.dot(e0);
-                        double m01 = e0.dot(e1);
-                        double m10 = e1.dot(e0);
-                        double m11 = e1.dot(e1);
-                        double det = m00 * m11 - m01 * m10;
-                        if (det != 0.0)
-                        {
-                            Vector3d p = rayOrigin + rayDirection * t;
-                            Vector3d q = p - v0;
-                            double q0 = e0.dot(q);
-                            double q1 = e1.dot(q);
-                            double d = 1.0 / det;
-                            double s0 = (m11 * q0 - m01 * q1) * d;
-                            double s1 = (m00 * q1 - m10 * q0) * d;
-                            if (s0 >= 0.0 && s1 >= 0.0 && s0 + s1 <= 1.0)
-                            {
-                                closest = t;
-                                if (result)
-                                {
-                                    result->group = group;
-                                    result->primitiveIndex = primitiveIndex;
-                                    result->distance = closest;
-                                }
-                            }
-                        }
-                    }
-                }
-
-                // Get the indices for the next triangle
-                if (primType == TriList)
-                {
-                    index += 3;
-                    if (index < nIndices)
-                    {
-                        i0 = group->indices[index + 0];
-                        i1 = group->indices[index + 1];
-                        i2 = group->indices[index + 2];
-                    }
-                }
-                else if (primType == TriStrip)
-                {
-                    index += 1;
-                    if (index < nIndices)
-                    {
-                        i0 = i1;
-                        i1 = i2;
-                        i2 = group->indices[index];
-                        // TODO: alternate orientation of triangles in a strip
-                    }
-                }
-                else // primType == TriFan
-                {
-                    index += 1;
-                    if (index < nIndices)
-                    {
-                        index += 1;
-                        i1 = i2;
-                        i2 = group->indices[index];
-                    }
-                }
-
-                primitiveIndex++;
-
-            } while (index < nIndices);
+                result->group = groups[groupIndex];
+                result->primitiveIndex = primitiveIndex;
+                result->distance = closest;
+            }
         }
-    }
+    });
 
     return closest != maxDistance;
 }
 
-
 bool
 Mesh::pick(const Vector3d& rayOrigin, const Vector3d& rayDirection, double& distance) const
 {
@@ -517,6 +455,7 @@ Mesh::transform(const Vector3f& translation, float scale)
         const Vector3f tv = (Map<Vector3f>(reinterpret_cast<float*>(vdata)) + translation) * scale;
         Map<Vector3f>(reinterpret_cast<float*>(vdata)) = tv;
     }
+    pickTree.reset();
 
     // Point sizes need to be scaled as well
     if (vertexDesc.getAttribute(PointSize).format == Float1)
@@ -14,6 +14,8 @@
 #include "material.h"
 #include <Eigen/Core>
 #include <Eigen/Geometry>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -21,6 +23,8 @@
 namespace cmod
 {
 
+class MeshBVH;
+
 class Mesh
 {
  public:
@@ -147,7 +151,7 @@ class Mesh
         double distance{ -1.0 };
     };
 
-    Mesh() = default;
+    Mesh();
     ~Mesh();
 
     void setVertices(unsigned int _nVertices, void* vertexData);
@@ -176,8 +180,14 @@ class Mesh
     const std::string& getName() const;
     void setName(const std::string&);
 
+    /*! Find the closest triangle hit by a ray. The first pick builds a
+     *  bounding volume hierarchy of the triangles, which is kept until the
+     *  vertices or primitive groups of the mesh change.
+     */
     bool pick(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, PickResult* result) const;
     bool pick(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, double& distance) const;
+    /*! The same as pick(), testing every triangle in turn */
+    bool pickLinear(const Eigen::Vector3d& origin, const Eigen::Vector3d& direction, PickResult* result) const;
 
     Eigen::AlignedBox<float, 3> getBoundingBox() const;
     void transform(const Eigen::Vector3f& translation, float scale);
@@ -206,6 +216,9 @@ class Mesh
     std::vector<PrimitiveGroup*> groups;
 
     std::string name;
+
+    mutable std::mutex pickTreeMutex;
+    mutable std::unique_ptr<MeshBVH> pickTree;
 };
 
 } // namespace cmod
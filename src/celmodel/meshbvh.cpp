@@ -0,0 +1,336 @@
+// meshbvh.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Bounding volume hierarchy over the triangles of a mesh, for picking.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include "meshbvh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <Eigen/Geometry>
+
+using namespace cmod;
+using namespace Eigen;
+using namespace std;
+
+
+// Number of bins of centroids over which split costs are evaluated
+static const unsigned int SplitBins = 16;
+
+// Cost of visiting a node relative to intersecting a triangle
+static const float TraversalCost = 0.125f;
+
+// Leaves hold at most this many triangles; nodes with fewer than
+// MinSplitTriangles aren't split, which keeps the tree small.
+static const uint32_t MaxLeafTriangles = 8;
+static const uint32_t MinSplitTriangles = 4;
+
+// Below this depth nodes are split at the median, which bounds the depth
+// of the tree, and so the traversal stack, to MaxSAHDepth + 32.
+static const unsigned int MaxSAHDepth = 48;
+static const unsigned int StackSize = MaxSAHDepth + 32;
+
+// Farthest distance at which a ray hits a triangle; the same as the
+// linear search.
+static const double MaxDistance = 1.0e30;
+
+
+struct MeshBVH::BuildTriangle
+{
+    AlignedBox3f bounds;
+    Vector3f centroid;
+    uint32_t index;
+};
+
+
+static float HalfArea(const AlignedBox3f& box)
+{
+    Vector3f size = box.sizes();
+    return size.x() * size.y() + size.y() * size.z() + size.z() * size.x();
+}
+
+
+// Slab test of a ray against a node. The far distance is enlarged by the
+// rounding error of its computation, 3 epsilon, so that rays grazing a
+// face of the box don't miss it.
+static bool IntersectBox(const float lower[3],
+                         const float upper[3],
+                         const Vector3d& origin,
+                         const Vector3d& invDirection,
+                         double maxDistance)
+{
+    const double Gamma3 = 3.0 * numeric_limits<double>::epsilon();
+
+    double tNear = 0.0;
+    double tFar = maxDistance;
+    for (int i = 0; i < 3; i++)
+    {
+        // A direction parallel to the slab gives 0 * inf, which is NaN;
+        // the comparisons below are written to ignore it.
+        double t0 = (lower[i] - origin[i]) * invDirection[i];
+        double t1 = (upper[i] - origin[i]) * invDirection[i];
+        if (t0 > t1)
+            swap(t0, t1);
+        t1 *= 1.0 + 2.0 * Gamma3;
+        tNear = t0 > tNear ? t0 : tNear;
+        tFar = t1 < tFar ? t1 : tFar;
+        if (tNear > tFar)
+            return false;
+    }
+
+    return true;
+}
+
+
+MeshBVH::MeshBVH(const Mesh& _mesh) :
+    mesh(_mesh)
+{
+    const Mesh::VertexAttribute& position = mesh.getVertexDescription().getAttribute(Mesh::Position);
+    if (position.semantic != Mesh::Position || position.format != Mesh::Float3)
+        return;
+
+    positions = reinterpret_cast<const char*>(mesh.getVertexData()) + position.offset;
+    stride = mesh.getVertexStride();
+
+    vector<Triangle> source;
+    source.reserve(mesh.getPrimitiveCount());
+    ForEachTriangle(mesh, [&](unsigned int group, unsigned int primitive,
+                              Mesh::index32 i0, Mesh::index32 i1, Mesh::index32 i2)
+    {
+        source.push_back({ { i0, i1, i2 }, group, primitive });
+    });
+    if (source.empty())
+        return;
+
+    vector<BuildTriangle> work(source.size());
+    for (uint32_t i = 0; i < source.size(); i++)
+    {
+        AlignedBox3f bounds;
+        for (Mesh::index32 v : source[i].vertices)
+            bounds.extend(vertex(v).cast<float>());
+        work[i] = { bounds, bounds.center(), i };
+    }
+
+    nodes.reserve(2 * source.size() / MaxLeafTriangles + 1);
+    build(work, 0, (uint32_t) work.size(), 0);
+
+    // Leaves refer to ranges of the partitioned work list
+    triangles.reserve(work.size());
+    for (const auto& t : work)
+        triangles.push_back(source[t.index]);
+}
+
+
+Vector3d
+MeshBVH::vertex(Mesh::index32 index) const
+{
+    return Map<const Vector3f>(reinterpret_cast<const float*>(positions + index * stride)).cast<double>();
+}
+
+
+uint32_t
+MeshBVH::build(vector<BuildTriangle>& work, uint32_t begin, uint32_t end, unsigned int level)
+{
+    auto nodeIndex = (uint32_t) nodes.size();
+    nodes.emplace_back();
+    depth = max(depth, level + 1);
+
+    AlignedBox3f bounds;
+    AlignedBox3f centroidBounds;
+    for (uint32_t i = begin; i < end; i++)
+    {
+        bounds.extend(work[i].bounds);
+        centroidBounds.extend(work[i].centroid);
+    }
+
+    // Pad the bounds so that the hits of the triangle test, which computes
+    // the hit point in double precision, always lie inside them.
+    float pad = 1.0e-6f * (bounds.sizes().maxCoeff() +
+                           max(bounds.min().cwiseAbs().maxCoeff(), bounds.max().cwiseAbs().maxCoeff()));
+    for (int i = 0; i < 3; i++)
+    {
+        nodes[nodeIndex].lower[i] = bounds.min()[i] - pad;
+        nodes[nodeIndex].upper[i] = bounds.max()[i] + pad;
+    }
+
+    uint32_t count = end - begin;
+    Vector3f extent = centroidBounds.sizes();
+    int axis;
+    extent.maxCoeff(&axis);
+
+    uint32_t mid = begin;
+    if (count >= MinSplitTriangles && extent[axis] > 0.0f && level < MaxSAHDepth)
+    {
+        struct Bin
+        {
+            AlignedBox3f bounds;
+            uint32_t count{ 0 };
+        } bins[SplitBins];
+
+        float binScale = SplitBins / extent[axis];
+        float binOrigin = centroidBounds.min()[axis];
+        auto binOf = [=](const BuildTriangle& t)
+        {
+            auto bin = (unsigned int) ((t.centroid[axis] - binOrigin) * binScale);
+            return min(bin, SplitBins - 1);
+        };
+
+        for (uint32_t i = begin; i < end; i++)
+        {
+            Bin& bin = bins[binOf(work[i])];
+            bin.bounds.extend(work[i].bounds);
+            bin.count++;
+        }
+
+        // Sweep from the right for the cost of the triangles right of
+        // each split, then from the left for the whole cost.
+        float rightCost[SplitBins];
+        AlignedBox3f rightBounds;
+        uint32_t rightCount = 0;
+        for (unsigned int i = SplitBins - 1; i > 0; i--)
+        {
+            rightBounds.extend(bins[i].bounds);
+            rightCount += bins[i].count;
+            rightCost[i - 1] = rightCount > 0 ? rightCount * HalfArea(rightBounds) : 0.0f;
+        }
+
+        float bestCost = numeric_limits<float>::max();
+        unsigned int bestSplit = 0;
+        AlignedBox3f leftBounds;
+        uint32_t leftCount = 0;
+        for (unsigned int i = 0; i < SplitBins - 1; i++)
+        {
+            leftBounds.extend(bins[i].bounds);
+            leftCount += bins[i].count;
+            float cost = (leftCount > 0 ? leftCount * HalfArea(leftBounds) : 0.0f) + rightCost[i];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+        bestCost = TraversalCost + bestCost / HalfArea(bounds);
+
+        if (count > MaxLeafTriangles || bestCost < (float) count)
+        {
+            auto split = partition(work.begin() + begin, work.begin() + end,
+                                   [&](const BuildTriangle& t) { return binOf(t) <= bestSplit; });
+            mid = (uint32_t) (split - work.begin());
+        }
+    }
+
+    if ((mid == begin || mid == end) && count <= MaxLeafTriangles)
+    {
+        nodes[nodeIndex].offset = begin;
+        nodes[nodeIndex].count = (uint16_t) count;
+        nodes[nodeIndex].axis = 0;
+        return nodeIndex;
+    }
+
+    // Too deep, or too many triangles with the same centroid: split at the
+    // median along the longest axis.
+    if (mid == begin || mid == end)
+    {
+        mid = begin + count / 2;
+        nth_element(work.begin() + begin, work.begin() + mid, work.begin() + end,
+                    [axis](const BuildTriangle& t0, const BuildTriangle& t1)
+                    {
+                        return t0.centroid[axis] < t1.centroid[axis];
+                    });
+    }
+
+    build(work, begin, mid, level + 1);
+    uint32_t secondChild = build(work, mid, end, level + 1);
+    nodes[nodeIndex].offset = secondChild;
+    nodes[nodeIndex].count = 0;
+    nodes[nodeIndex].axis = (uint16_t) axis;
+
+    return nodeIndex;
+}
+
+
+bool
+MeshBVH::pick(const Vector3d& origin,
+              const Vector3d& direction,
+              Mesh::PickResult* result) const
+{
+    if (nodes.empty())
+        return false;
+
+    Vector3d invDirection = direction.cwiseInverse();
+    bool negative[3] = { invDirection.x() < 0.0, invDirection.y() < 0.0, invDirection.z() < 0.0 };
+
+    double closest = MaxDistance;
+    const Triangle* hit = nullptr;
+
+    // Children are visited nearest first; the farther one waits on the stack
+    uint32_t stack[StackSize];
+    unsigned int stackSize = 0;
+    uint32_t current = 0;
+    for (;;)
+    {
+        const Node& node = nodes[current];
+        if (IntersectBox(node.lower, node.upper, origin, invDirection, closest))
+        {
+            if (node.count == 0)
+            {
+                if (negative[node.axis])
+                {
+                    stack[stackSize++] = current + 1;
+                    current = node.offset;
+                }
+                else
+                {
+                    stack[stackSize++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+
+            for (uint32_t i = node.offset; i < node.offset + node.count; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                double t;
+                if (!IntersectTriangle(vertex(triangle.vertices[0]),
+                                       vertex(triangle.vertices[1]),
+                                       vertex(triangle.vertices[2]),
+                                       origin, direction, t))
+                {
+                    continue;
+                }
+
+                // Ties go to the triangle drawn first
+                if (t < closest ||
+                    (t == closest && hit != nullptr &&
+                     (triangle.group < hit->group ||
+                      (triangle.group == hit->group && triangle.primitive < hit->primitive))))
+                {
+                    closest = t;
+                    hit = &triangle;
+                }
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+        current = stack[--stackSize];
+    }
+
+    if (hit == nullptr)
+        return false;
+
+    if (result != nullptr)
+    {
+        result->group = const_cast<Mesh::PrimitiveGroup*>(mesh.getGroup(hit->group));
+        result->primitiveIndex = hit->primitive;
+        result->distance = closest;
+    }
+
+    return true;
+}
@@ -0,0 +1,167 @@
+// meshbvh.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Bounding volume hierarchy over the triangles of a mesh, for picking.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#ifndef _CELMODEL_MESHBVH_H_
+#define _CELMODEL_MESHBVH_H_
+
+#include "mesh.h"
+#include <cstdint>
+#include <vector>
+#include <Eigen/Core>
+
+
+namespace cmod
+{
+
+/*! Call f(groupIndex, primitiveIndex, i0, i1, i2) for each triangle of the
+ *  triangle list, strip and fan groups of a mesh, in the order they are
+ *  drawn. Groups of other primitives and malformed groups are skipped.
+ */
+template<class F> void ForEachTriangle(const Mesh& mesh, F f)
+{
+    for (unsigned int g = 0; g < mesh.getGroupCount(); g++)
+    {
+        const Mesh::PrimitiveGroup* group = mesh.getGroup(g);
+        const Mesh::index32* indices = group->indices;
+        unsigned int nIndices = group->nIndices;
+        if (nIndices < 3)
+            continue;
+
+        switch (group->prim)
+        {
+        case Mesh::TriList:
+            if (nIndices % 3 != 0)
+                break;
+            for (unsigned int i = 0; i < nIndices / 3; i++)
+                f(g, i, indices[i * 3], indices[i * 3 + 1], indices[i * 3 + 2]);
+            break;
+        case Mesh::TriStrip:
+            for (unsigned int i = 0; i < nIndices - 2; i++)
+                f(g, i, indices[i], indices[i + 1], indices[i + 2]);
+            break;
+        case Mesh::TriFan:
+            for (unsigned int i = 0; i < nIndices - 2; i++)
+                f(g, i, indices[0], indices[i + 1], indices[i + 2]);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+
+/*! Intersect a ray with the triangle v0 v1 v2. On a hit, set t to the
+ *  distance along the ray in units of the direction vector. Rays in the
+ *  plane of the triangle miss it.
+ */
+inline bool IntersectTriangle(const Eigen::Vector3d& v0,
+                              const Eigen::Vector3d& v1,
+                              const Eigen::Vector3d& v2,
+                              const Eigen::Vector3d& origin,
+                              const Eigen::Vector3d& direction,
+                              double& t)
+{
+    // Compute the edge vectors e0 and e1, and the normal n
+    Eigen::Vector3d e0 = v1 - v0;
+    Eigen::Vector3d e1 = v2 - v0;
+    Eigen::Vector3d n = e0.cross(e1);
+
+    // c is the cosine of the angle between the ray and triangle normal
+    double c = n.dot(direction);
+    if (c == 0.0)
+        return false;
+
+    t = n.dot(v0 - origin) / c;
+    if (!(t > 0.0))
+        return false;
+
+    double m00 = e0.dot(e0);
+    double m01 = e0.dot(e1);
+    double m11 = e1.dot(e1);
+    double det = m00 * m11 - m01 * m01;
+    if (det == 0.0)
+        return false;
+
+    Eigen::Vector3d q = origin + direction * t - v0;
+    double q0 = e0.dot(q);
+    double q1 = e1.dot(q);
+    double d = 1.0 / det;
+    double s0 = (m11 * q0 - m01 * q1) * d;
+    double s1 = (m00 * q1 - m01 * q0) * d;
+    return s0 >= 0.0 && s1 >= 0.0 && s0 + s1 <= 1.0;
+}
+
+
+/*! A bounding volume hierarchy over the triangles of a mesh, split by the
+ *  surface area heuristic evaluated over bins of triangle centroids. The
+ *  nodes are flattened depth first into one array: the first child of an
+ *  interior node follows it, and the node holds the index of the second.
+ *
+ *  The hierarchy refers to the vertex data of the mesh, and must be
+ *  rebuilt when the vertices or groups of the mesh change.
+ */
+class MeshBVH
+{
+ public:
+    explicit MeshBVH(const Mesh& mesh);
+    ~MeshBVH() = default;
+    MeshBVH(const MeshBVH&) = delete;
+    MeshBVH& operator=(const MeshBVH&) = delete;
+
+    /*! Find the closest triangle hit by a ray. Of triangles hit at the
+     *  same distance, the first drawn is picked, so that the result is
+     *  that of Mesh::pickLinear().
+     */
+    bool pick(const Eigen::Vector3d& origin,
+              const Eigen::Vector3d& direction,
+              Mesh::PickResult* result) const;
+
+    size_t getNodeCount() const { return nodes.size(); }
+    size_t getTriangleCount() const { return triangles.size(); }
+    unsigned int getDepth() const { return depth; }
+
+ private:
+    // 32 bytes, two to a cache line
+    struct Node
+    {
+        float lower[3];
+        float upper[3];
+        // First triangle of a leaf, or second child of an interior node
+        uint32_t offset;
+        // Number of triangles of a leaf, zero for interior nodes
+        uint16_t count;
+        // Axis along which the children of an interior node are split
+        uint16_t axis;
+    };
+
+    struct Triangle
+    {
+        Mesh::index32 vertices[3];
+        uint32_t group;
+        uint32_t primitive;
+    };
+
+    struct BuildTriangle;
+
+    uint32_t build(std::vector<BuildTriangle>& work, uint32_t begin, uint32_t end, unsigned int level);
+    Eigen::Vector3d vertex(Mesh::index32 index) const;
+
+    const Mesh& mesh;
+    const char* positions{ nullptr };
+    unsigned int stride{ 0 };
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+    unsigned int depth{ 0 };
+};
+
+} // namespace cmod
+
+#endif // !_CELMODEL_MESHBVH_H_
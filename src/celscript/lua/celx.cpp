@@ -11,6 +11,7 @@
 // of the License, or (at your option) any later version.
 
 #include <config.h>
+#include <algorithm>
 #include <cassert>
 #include <ctime>
 #include <map>
@@ -69,6 +70,16 @@ const char* CelxLua::ClassNames[] =
 // returning control to celestia
 static const double MaxTimeslice = 5.0;
 
+// Number of instructions between checks of the timeslice, and between
+// samples while the script is profiled
+static const int TimesliceCheckInterval = 1000;
+static const int ProfileSampleInterval = 100;
+
+// Registry keys of the app core and LuaState objects. Light userdata
+// keys are looked up without interning a string first.
+static char AppCoreKey;
+static char LuaStateKey;
+
 // names of callback-functions in Lua:
 const char* KbdCallback = "celestia_keyboard_callback";
 const char* CleanupCallback = "celestia_cleanup_callback";
@@ -113,11 +124,41 @@ void PushClass(lua_State* l, int id)
     lua_pushlstring(l, CelxLua::ClassNames[id], strlen(CelxLua::ClassNames[id]));
 }
 
+// Push the registry entry with a light userdata key
+void Celx_GetRegistry(lua_State* l, const void* key)
+{
+#if LUA_VERSION_NUM >= 502
+    lua_rawgetp(l, LUA_REGISTRYINDEX, key);
+#else
+    lua_pushlightuserdata(l, const_cast<void*>(key));
+    lua_rawget(l, LUA_REGISTRYINDEX);
+#endif
+}
+
+// Set the registry entry with a light userdata key to the value on top
+// of the stack, which is popped
+void Celx_SetRegistry(lua_State* l, const void* key)
+{
+#if LUA_VERSION_NUM >= 502
+    lua_rawsetp(l, LUA_REGISTRYINDEX, key);
+#else
+    lua_pushlightuserdata(l, const_cast<void*>(key));
+    lua_insert(l, -2);
+    lua_rawset(l, LUA_REGISTRYINDEX);
+#endif
+}
+
+// The metatables of the classes are also stored with the address of
+// their name as the key, for type checks without string comparisons.
+static const void* ClassKey(int id)
+{
+    return &CelxLua::ClassNames[id];
+}
+
 // Set the class (metatable) of the object on top of the stack
 void Celx_SetClass(lua_State* l, int id)
 {
-    PushClass(l, id);
-    lua_rawget(l, LUA_REGISTRYINDEX);
+    Celx_GetRegistry(l, ClassKey(id));
     if (lua_type(l, -1) != LUA_TTABLE)
         cout << "Metatable for " << CelxLua::ClassNames[id] << " not found!\n";
     if (lua_setmetatable(l, -2) == 0)
@@ -135,18 +176,22 @@ void Celx_CreateClassMetatable(lua_State* l, int id)
     lua_pushvalue(l, -1);
     PushClass(l, id);
     lua_rawset(l, LUA_REGISTRYINDEX); // registry.metatable = name
+    lua_pushvalue(l, -1);
+    Celx_SetRegistry(l, ClassKey(id));
 
     lua_pushliteral(l, "__index");
     lua_pushvalue(l, -2);
     lua_rawset(l, -3);
 }
 
-// Register a class 'method' in the metatable (assumed to be on top of the stack)
+// Register a class 'method' in the metatable (assumed to be on top of the stack).
+// The metatable and the app core are the upvalues of the method.
 void Celx_RegisterMethod(lua_State* l, const char* name, lua_CFunction fn)
 {
     lua_pushstring(l, name);
     lua_pushvalue(l, -2);
-    lua_pushcclosure(l, fn, 1);
+    Celx_GetRegistry(l, &AppCoreKey);
+    lua_pushcclosure(l, fn, 2);
     lua_settable(l, -3);
 }
 
@@ -155,21 +200,13 @@ void Celx_RegisterMethod(lua_State* l, const char* name, lua_CFunction fn)
 // specified class
 bool Celx_istype(lua_State* l, int index, int id)
 {
-    // get registry[metatable]
     if (!lua_getmetatable(l, index))
         return false;
-    lua_rawget(l, LUA_REGISTRYINDEX);
-
-    if (lua_type(l, -1) != LUA_TSTRING)
-    {
-        cout << "Celx_istype failed!  Unregistered class.\n";
-        lua_pop(l, 1);
-        return false;
-    }
 
-    const char* classname = lua_tostring(l, -1);
-    lua_pop(l, 1);
-    return classname != nullptr && strcmp(classname, CelxLua::ClassNames[id]) == 0;
+    Celx_GetRegistry(l, ClassKey(id));
+    bool isType = lua_rawequal(l, -1, -2) != 0;
+    lua_pop(l, 2);
+    return isType;
 }
 
 // Verify that an object at location index on the stack is of the
@@ -182,11 +219,10 @@ void* Celx_CheckUserData(lua_State* l, int index, int id)
     return nullptr;
 }
 
-// Return the CelestiaCore object stored in the globals table
+// Return the CelestiaCore object stored in the registry
 CelestiaCore* getAppCore(lua_State* l, FatalErrors fatalErrors)
 {
-    lua_pushstring(l, "celestia-appcore");
-    lua_gettable(l, LUA_REGISTRYINDEX);
+    Celx_GetRegistry(l, &AppCoreKey);
 
     if (!lua_islightuserdata(l, -1))
     {
@@ -209,6 +245,10 @@ LuaState::LuaState() :
     state = luaL_newstate();
     timer = new Timer();
     screenshotCount = 0;
+
+    // Count the memory allocated by the script for the profiler
+    baseAlloc = lua_getallocf(state, &baseAllocData);
+    lua_setallocf(state, allocate, this);
 }
 
 LuaState::~LuaState()
@@ -234,12 +274,22 @@ double LuaState::getTime() const
 }
 
 
+void* LuaState::allocate(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    auto* luastate = static_cast<LuaState*>(ud);
+    // osize is the type of a new object rather than a size since Lua 5.2
+    size_t oldSize = ptr != nullptr ? osize : 0;
+    if (nsize > oldSize)
+        luastate->allocated += nsize - oldSize;
+    return luastate->baseAlloc(luastate->baseAllocData, ptr, osize, nsize);
+}
+
+
 // Check if the running script has exceeded its allowed timeslice
 // and terminate it if it has:
 static void checkTimeslice(lua_State* l, lua_Debug* /*ar*/)
 {
-    lua_pushstring(l, "celestia-luastate");
-    lua_gettable(l, LUA_REGISTRYINDEX);
+    Celx_GetRegistry(l, &LuaStateKey);
     if (!lua_islightuserdata(l, -1))
     {
         lua_pushstring(l, "Internal Error: Invalid table entry in checkTimeslice");
@@ -260,6 +310,9 @@ static void checkTimeslice(lua_State* l, lua_Debug* /*ar*/)
         lua_pushstring(l, errormsg);
         lua_error(l);
     }
+
+    if (luastate->isProfiling())
+        luastate->sampleProfile(l);
 }
 
 
@@ -310,7 +363,7 @@ bool LuaState::createThread()
     if (costate == nullptr)
         return false;
 
-    lua_sethook(costate, checkTimeslice, LUA_MASKCOUNT, 1000);
+    lua_sethook(costate, checkTimeslice, LUA_MASKCOUNT, TimesliceCheckInterval);
     lua_pushvalue(state, -2);
     lua_xmove(state, costate, 1);  // move function from L to NL/
     alive = true;
@@ -604,6 +657,8 @@ bool LuaState::handleTickEvent(double dt)
         lua_settable(costate, -3);
 
         timeout = getTime() + 1.0;
+        if (profiling)
+            startProfileSlice();
         if (lua_pcall(costate, 1, 1, 0) != 0)
         {
             cerr << "Error while executing tick callback: " << lua_tostring(costate, -1) << "\n";
@@ -781,9 +836,14 @@ bool LuaState::tick(double dt)
         return false;
     }
 
+    if (profiling)
+        profileTicks++;
+
     if (dt == 0 || scriptAwakenTime > getTime())
         return false;
 
+    if (profiling)
+        startProfileSlice();
     int nArgs = resume();
     if (!isAlive()) // The script is complete
         return true;
@@ -806,6 +866,88 @@ bool LuaState::tick(double dt)
 }
 
 
+// Start or stop sampling the script; starting discards earlier samples.
+void LuaState::setProfiling(bool enable)
+{
+    if (enable)
+    {
+        profile.clear();
+        profileTicks = 0;
+        startProfileSlice();
+    }
+    profiling = enable;
+
+    if (costate != nullptr)
+    {
+        lua_sethook(costate, checkTimeslice, LUA_MASKCOUNT,
+                    enable ? ProfileSampleInterval : TimesliceCheckInterval);
+    }
+}
+
+
+// Charge the time and memory used since the previous sample to the
+// function running in l. Time spent in C functions is charged to the
+// Lua function calling them.
+void LuaState::sampleProfile(lua_State* l)
+{
+    lua_Debug ar;
+    if (lua_getstack(l, 0, &ar) == 0 || lua_getinfo(l, "Sn", &ar) == 0)
+        return;
+
+    ProfileEntry& entry = profile[make_pair(string(ar.short_src), ar.linedefined)];
+    if (entry.samples == 0)
+    {
+        entry.source = ar.short_src;
+        entry.line = ar.linedefined;
+    }
+    if (entry.name.empty() && ar.name != nullptr)
+        entry.name = ar.name;
+
+    double now = getTime();
+    entry.samples++;
+    entry.time += now - lastSampleTime;
+    entry.allocated += allocated - lastSampleAllocated;
+    lastSampleTime = now;
+    lastSampleAllocated = allocated;
+}
+
+
+// Called when the script is resumed, so that the first sample isn't
+// charged with the time since the last sample before the script yielded.
+void LuaState::startProfileSlice()
+{
+    lastSampleTime = getTime();
+    lastSampleAllocated = allocated;
+}
+
+
+// Return the sampled functions with their time and allocations per
+// tick, the slowest first.
+vector<LuaState::ProfileEntry> LuaState::getProfile() const
+{
+    double ticks = max(profileTicks, 1u);
+    vector<ProfileEntry> entries;
+    entries.reserve(profile.size());
+    for (const auto& p : profile)
+    {
+        ProfileEntry entry = p.second;
+        entry.time /= ticks;
+        entry.allocated = (size_t) (entry.allocated / ticks);
+        entries.push_back(entry);
+    }
+
+    sort(entries.begin(), entries.end(),
+         [](const ProfileEntry& a, const ProfileEntry& b) { return a.time > b.time; });
+    return entries;
+}
+
+
+unsigned int LuaState::getProfileTicks() const
+{
+    return profileTicks;
+}
+
+
 void LuaState::requestIO()
 {
     // the script requested IO, set the mode
@@ -878,8 +1020,7 @@ ObserverFrame::CoordinateSystem parseCoordSys(const string& name)
 LuaState* getLuaStateObject(lua_State* l)
 {
     int stackSize = lua_gettop(l);
-    lua_pushstring(l, "celestia-luastate");
-    lua_gettable(l, LUA_REGISTRYINDEX);
+    Celx_GetRegistry(l, &LuaStateKey);
 
     if (!lua_islightuserdata(l, -1))
     {
@@ -1060,19 +1201,19 @@ bool LuaState::init(CelestiaCore* appCore)
     lua_pushnumber(state, (lua_Number)KM_PER_LY/1e6);
     lua_setglobal(state, "KM_PER_MICROLY");
 
+    // add reference to appCore in the registry; the methods of the
+    // classes get it as an upvalue when they're registered
+    lua_pushlightuserdata(state, static_cast<void*>(appCore));
+    Celx_SetRegistry(state, &AppCoreKey);
+    // add a reference to the LuaState-object in the registry
+    lua_pushlightuserdata(state, static_cast<void*>(this));
+    Celx_SetRegistry(state, &LuaStateKey);
+
     loadLuaLibs(state);
 
     // Create the celestia object
     celestia_new(state, appCore);
     lua_setglobal(state, "celestia");
-    // add reference to appCore in the registry
-    lua_pushstring(state, "celestia-appcore");
-    lua_pushlightuserdata(state, static_cast<void*>(appCore));
-    lua_settable(state, LUA_REGISTRYINDEX);
-    // add a reference to the LuaState-object in the registry
-    lua_pushstring(state, "celestia-luastate");
-    lua_pushlightuserdata(state, static_cast<void*>(this));
-    lua_settable(state, LUA_REGISTRYINDEX);
 
     lua_pushstring(state, EventHandlers);
     lua_newtable(state);
@@ -1635,10 +1776,14 @@ void CelxLua::push(const CelxValue& v1, const CelxValue& v2)
 }
 
 
+// Must only be called from C functions, which have the app core as their
+// second upvalue if they were registered with registerMethod().
 CelestiaCore* CelxLua::appCore(FatalErrors fatalErrors)
 {
-    push("celestia-appcore");
-    lua_gettable(m_lua, LUA_REGISTRYINDEX);
+    if (lua_islightuserdata(m_lua, lua_upvalueindex(2)))
+        return static_cast<CelestiaCore*>(lua_touserdata(m_lua, lua_upvalueindex(2)));
+
+    Celx_GetRegistry(m_lua, &AppCoreKey);
 
     if (!lua_islightuserdata(m_lua, -1))
     {
@@ -1660,8 +1805,7 @@ CelestiaCore* CelxLua::appCore(FatalErrors fatalErrors)
 LuaState* CelxLua::getLuaStateObject()
 {
     int stackSize = lua_gettop(m_lua);
-    lua_pushstring(m_lua, "celestia-luastate");
-    lua_gettable(m_lua, LUA_REGISTRYINDEX);
+    Celx_GetRegistry(m_lua, &LuaStateKey);
 
     if (!lua_islightuserdata(m_lua, -1))
     {
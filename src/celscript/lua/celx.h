@@ -13,7 +13,9 @@
 #define _CELESTIA_CELX_H_
 
 #include <iostream>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 #include "lua.hpp"
 #include <celcompat/filesystem.h>
@@ -74,6 +76,23 @@ public:
     bool callLuaHook(void* obj, const char* method, float x, float y, int b);
     bool callLuaHook(void* obj, const char* method, double dt);
 
+    // Sampling profiler, see celestia:profile()
+    struct ProfileEntry
+    {
+        std::string name;
+        std::string source;
+        int line{ 0 };
+        unsigned int samples{ 0 };
+        double time{ 0.0 };
+        size_t allocated{ 0 };
+    };
+
+    void setProfiling(bool);
+    bool isProfiling() const { return profiling; }
+    void sampleProfile(lua_State*);
+    std::vector<ProfileEntry> getProfile() const;
+    unsigned int getProfileTicks() const;
+
     enum IOMode {
         NoIO = 1,
         Asking = 2,
@@ -89,6 +108,19 @@ private:
     double scriptAwakenTime{ 0.0 };
     IOMode ioMode{ NoIO };
     bool eventHandlerEnabled{ false };
+
+    static void* allocate(void*, void*, size_t, size_t);
+    void startProfileSlice();
+
+    lua_Alloc baseAlloc{ nullptr };
+    void* baseAllocData{ nullptr };
+    size_t allocated{ 0 };
+
+    bool profiling{ false };
+    std::map<std::pair<std::string, int>, ProfileEntry> profile;
+    unsigned int profileTicks{ 0 };
+    double lastSampleTime{ 0.0 };
+    size_t lastSampleAllocated{ 0 };
 };
 
 View* getViewByObserver(CelestiaCore*, Observer*);
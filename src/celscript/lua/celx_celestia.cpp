@@ -1733,6 +1733,65 @@ static int celestia_getscripttime(lua_State* l)
     return 1;
 }
 
+/*! celestia:profile([enable])
+*
+* celestia:profile(true) starts sampling the running script, discarding
+* earlier samples, and celestia:profile(false) stops it. Called without
+* an argument or with false, it returns a table with the number of ticks
+* sampled and, slowest first, a table for each sampled function with its
+* name, source, line, samples, time in seconds per tick and bytes
+* allocated per tick.
+*
+* \verbatim
+* -- Example: log the three slowest functions of a script
+* --
+* celestia:profile(true)
+* wait(5)
+* local profile = celestia:profile(false)
+* for i = 1, math.min(3, #profile) do
+*     local f = profile[i]
+*     celestia:log(string.format("%s (%s:%d): %.3f ms, %d bytes", f.name,
+*                  f.source, f.line, f.time * 1000, f.allocated))
+* end
+*
+* \endverbatim
+*/
+static int celestia_profile(lua_State* l)
+{
+    CelxLua celx(l);
+    celx.checkArgs(1, 2, "One or no arguments expected for celestia:profile");
+
+    LuaState* luastate = celx.getLuaStateObject();
+    if (celx.isValid(2))
+    {
+        bool enable = celx.safeGetBoolean(2, AllErrors, "Argument to celestia:profile must be a boolean");
+        luastate->setProfiling(enable);
+        if (enable)
+            return 0;
+    }
+
+    auto entries = luastate->getProfile();
+    lua_createtable(l, (int) entries.size(), 1);
+    celx.setTable("ticks", (lua_Number) luastate->getProfileTicks());
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const auto& entry = entries[i];
+        lua_createtable(l, 0, 6);
+        if (!entry.name.empty())
+            celx.setTable("name", entry.name.c_str());
+        else
+            celx.setTable("name", entry.line == 0 ? "main chunk" : "?");
+        celx.setTable("source", entry.source.c_str());
+        celx.setTable("line", (lua_Number) entry.line);
+        celx.setTable("samples", (lua_Number) entry.samples);
+        celx.setTable("time", entry.time);
+        celx.setTable("allocated", (lua_Number) entry.allocated);
+        lua_rawseti(l, -2, (int) i + 1);
+    }
+
+    return 1;
+}
+
 static int celestia_newframe(lua_State* l)
 {
     Celx_CheckArgs(l, 2, 4, "One to three arguments expected for function celestia:newframe");
@@ -2217,6 +2276,7 @@ void CreateCelestiaMetaTable(lua_State* l)
     Celx_RegisterMethod(l, "newposition", celestia_newposition);
     Celx_RegisterMethod(l, "newrotation", celestia_newrotation);
     Celx_RegisterMethod(l, "getscripttime", celestia_getscripttime);
+    Celx_RegisterMethod(l, "profile", celestia_profile);
     Celx_RegisterMethod(l, "requestkeyboard", celestia_requestkeyboard);
     Celx_RegisterMethod(l, "takescreenshot", celestia_takescreenshot);
     Celx_RegisterMethod(l, "createcelscript", celestia_createcelscript);
@@ -334,6 +334,8 @@ private:
     lua_State* m_lua;
 };
 
+void Celx_GetRegistry(lua_State*, const void*);
+void Celx_SetRegistry(lua_State*, const void*);
 void Celx_SetClass(lua_State*, int);
 void Celx_CreateClassMetatable(lua_State*, int);
 void Celx_RegisterMethod(lua_State*, const char*, lua_CFunction);
@@ -14,6 +14,7 @@
 #include "celx_internal.h"
 #include "celx_object.h"
 #include "celx_category.h"
+#include "celx_position.h"
 #include <celengine/body.h>
 #include <celengine/timelinephase.h>
 #include <celengine/axisarrow.h>
@@ -89,16 +90,38 @@ static MarkerRepresentation::Symbol parseMarkerSymbol(const string& name)
 
 
 // ==================== Object ====================
+// Objects can't be modified by scripts, so the same userdata is returned
+// for an object as long as the script holds on to it. The userdata are
+// found by the address of the object in a table with weak values.
+static char ObjectCacheKey;
+
 // star, planet, or deep-sky object
 int object_new(lua_State* l, const Selection& sel)
 {
     CelxLua celx(l);
 
+    Celx_GetRegistry(l, &ObjectCacheKey);
+    int cache = lua_gettop(l);
+    lua_pushlightuserdata(l, sel.object());
+    lua_rawget(l, cache);
+    auto* cached = static_cast<Selection*>(lua_touserdata(l, -1));
+    if (cached != nullptr && *cached == sel)
+    {
+        lua_remove(l, cache);
+        return 1;
+    }
+    lua_pop(l, 1);
+
     Selection* ud = reinterpret_cast<Selection*>(lua_newuserdata(l, sizeof(Selection)));
     *ud = sel;
 
     celx.setClass(Celx_Object);
 
+    lua_pushlightuserdata(l, sel.object());
+    lua_pushvalue(l, -2);
+    lua_rawset(l, cache);
+    lua_remove(l, cache);
+
     return 1;
 }
 
@@ -814,16 +837,24 @@ static int object_unmark(lua_State* l)
 static int object_getposition(lua_State* l)
 {
     CelxLua celx(l);
-    celx.checkArgs(1, 2, "Expected no or one argument to object:getposition");
+    celx.checkArgs(1, 3, "Expected no more than two arguments to object:getposition");
 
     Selection* sel = this_object(l);
     CelestiaCore* appCore = celx.appCore(AllErrors);
 
-    double t = celx.safeGetNumber(2, WrongType, "Time expected as argument to object:getposition",
-                                  appCore->getSimulation()->getTime());
-    celx.newPosition(sel->getPosition(t));
+    // An optional position after the time receives the result
+    int nArgs = lua_gettop(l);
+    int result = 0;
+    if (nArgs > 1 && celx.isType(nArgs, Celx_Position))
+        result = nArgs--;
+    else if (nArgs > 2)
+        celx.doError("Position expected as second argument to object:getposition");
 
-    return 1;
+    double t = appCore->getSimulation()->getTime();
+    if (nArgs > 1)
+        t = celx.safeGetNumber(2, WrongType, "Time expected as argument to object:getposition", t);
+
+    return position_reuse(l, result, sel->getPosition(t));
 }
 
 static int object_getchildren(lua_State* l)
@@ -1375,6 +1406,12 @@ void CreateObjectMetaTable(lua_State* l)
 {
     CelxLua celx(l);
 
+    lua_newtable(l);
+    lua_newtable(l);
+    celx.setTable("__mode", "v");
+    lua_setmetatable(l, -2);
+    Celx_SetRegistry(l, &ObjectCacheKey);
+
     celx.createClassMetatable(Celx_Object);
 
     celx.registerMethod("__tostring", object_tostring);
@@ -13,6 +13,7 @@
 #include "celx.h"
 #include "celx_internal.h"
 #include "celx_observer.h"
+#include "celx_position.h"
 //#include <celengine/body.h>
 //#include <celengine/timelinephase.h>
 #include <celestia/celestiacore.h>
@@ -658,12 +659,20 @@ static int observer_gettime(lua_State* l)
 static int observer_getposition(lua_State* l)
 {
     CelxLua celx(l);
-    celx.checkArgs(1, 1, "No arguments expected to observer:getposition");
+    celx.checkArgs(1, 2, "No arguments or a position expected to observer:getposition");
 
     Observer* o = this_observer(l);
-    celx.newPosition(o->getPosition());
 
-    return 1;
+    // An optional position receives the result
+    int result = 0;
+    if (celx.isValid(2))
+    {
+        if (!celx.isType(2, Celx_Position))
+            celx.doError("Argument to observer:getposition must be a position");
+        result = 2;
+    }
+
+    return position_reuse(l, result, o->getPosition());
 }
 
 static int observer_getsurface(lua_State* l)
@@ -9,9 +9,11 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <cstring>
 #include "celx.h"
 #include "celx_internal.h"
 #include "celx_position.h"
+#include "celx_vector.h"
 #include <Eigen/Geometry>
 
 
@@ -31,6 +33,21 @@ int position_new(lua_State* l, const UniversalCoord& uc)
     return 1;
 }
 
+// Push uc, stored in the position at index unless index is 0 or there
+// is no position there. Scripts updating many positions per tick pass
+// in the positions they got earlier rather than allocate new ones.
+int position_reuse(lua_State* l, int index, const UniversalCoord& uc)
+{
+    UniversalCoord* ud = index != 0 ? to_position(l, index) : nullptr;
+    if (ud == nullptr)
+        return position_new(l, uc);
+
+    *ud = uc;
+    lua_pushvalue(l, index);
+
+    return 1;
+}
+
 UniversalCoord* to_position(lua_State* l, int index)
 {
     CelxLua celx(l);
@@ -59,24 +76,19 @@ static int position_get(lua_State* l)
 
     celx.checkArgs(2, 2, "Invalid access of position-component");
     UniversalCoord* uc = this_position(l);
-    string key = celx.safeGetString(2, AllErrors, "Invalid key in position-access");
+    const char* key = celx.safeGetString(2, AllErrors, "Invalid key in position-access");
     double value = 0.0;
-    if (key == "x")
+    if (strcmp(key, "x") == 0)
         value = uc->x;
-    else if (key == "y")
+    else if (strcmp(key, "y") == 0)
         value = uc->y;
-    else if (key == "z")
+    else if (strcmp(key, "z") == 0)
         value = uc->z;
     else
     {
-        if (!lua_getmetatable(l, 1))
-        {
-            celx.doError("Internal error: couldn't get metatable");
-            return 0;
-        }
-
+        // Methods are looked up in the metatable, the first upvalue
         lua_pushvalue(l, 2);
-        lua_rawget(l, -2);
+        lua_rawget(l, CelxLua::localIndex(1));
         return 1;
     }
     lua_pushnumber(l, (lua_Number)value);
@@ -90,13 +102,13 @@ static int position_set(lua_State* l)
 
     celx.checkArgs(3, 3, "Invalid access of position-component");
     UniversalCoord* uc = this_position(l);
-    string key = celx.safeGetString(2, AllErrors, "Invalid key in position-access");
+    const char* key = celx.safeGetString(2, AllErrors, "Invalid key in position-access");
     double value = celx.safeGetNumber(3, AllErrors, "Position components must be numbers");
-    if (key == "x")
+    if (strcmp(key, "x") == 0)
         uc->x = value;
-    else if (key == "y")
+    else if (strcmp(key, "y") == 0)
         uc->y = value;
-    else if (key == "z")
+    else if (strcmp(key, "z") == 0)
         uc->z = value;
     else
     {
@@ -155,7 +167,7 @@ static int position_vectorto(lua_State* l)
 {
     CelxLua celx(l);
 
-    celx.checkArgs(2, 2, "One argument expected to position:vectorto");
+    celx.checkArgs(2, 3, "One or two arguments expected to position:vectorto");
 
     UniversalCoord* uc = this_position(l);
     UniversalCoord* uc2 = to_position(l, 2);
@@ -166,9 +178,16 @@ static int position_vectorto(lua_State* l)
         return 0;
     }
 
-    celx.newVector(uc2->offsetFromUly(*uc));
+    // An optional vector receives the result
+    int result = 0;
+    if (celx.isValid(3))
+    {
+        if (!celx.isType(3, Celx_Vec3))
+            celx.doError("Second argument to position:vectorto must be a vector");
+        result = 3;
+    }
 
-    return 1;
+    return vector_reuse(l, result, uc2->offsetFromUly(*uc));
 }
 
 
@@ -300,7 +319,7 @@ static int position_addvector(lua_State* l)
 {
     CelxLua celx(l);
 
-    celx.checkArgs(2, 2, "One argument expected to position:addvector()");
+    celx.checkArgs(2, 3, "One or two arguments expected to position:addvector()");
     UniversalCoord* uc = this_position(l);
     if (uc == nullptr)
         return 0;
@@ -312,9 +331,17 @@ static int position_addvector(lua_State* l)
         return 0;
     }
 
+    // An optional position receives the result
+    int result = 0;
+    if (celx.isValid(3))
+    {
+        if (!celx.isType(3, Celx_Position))
+            celx.doError("Second argument to position:addvector must be a position");
+        result = 3;
+    }
+
     UniversalCoord ucnew = uc->offsetUly(*v3d);
-    position_new(l, ucnew);
-    return 1;
+    return position_reuse(l, result, ucnew);
 }
 
 
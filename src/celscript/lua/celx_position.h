@@ -16,6 +16,7 @@ struct lua_State;
 
 extern void CreatePositionMetaTable(lua_State* l);
 extern int position_new(lua_State* l, const UniversalCoord& uc);
+extern int position_reuse(lua_State* l, int index, const UniversalCoord& uc);
 extern UniversalCoord* to_position(lua_State* l, int index);
 
 #endif // _CELX_POSITION_H_
@@ -9,6 +9,7 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <cstring>
 #include "celx.h"
 #include "celx_internal.h"
 #include "celx_vector.h"
@@ -192,26 +193,21 @@ static int rotation_get(lua_State* l)
 
     celx.checkArgs(2, 2, "Invalid access of rotation-component");
     auto q3 = this_rotation(l);
-    string key = celx.safeGetString(2, AllErrors, "Invalid key in rotation-access");
+    const char* key = celx.safeGetString(2, AllErrors, "Invalid key in rotation-access");
     double value = 0.0;
-    if (key == "x")
+    if (strcmp(key, "x") == 0)
         value = q3->x();
-    else if (key == "y")
+    else if (strcmp(key, "y") == 0)
         value = q3->y();
-    else if (key == "z")
+    else if (strcmp(key, "z") == 0)
         value = q3->z();
-    else if (key == "w")
+    else if (strcmp(key, "w") == 0)
         value = q3->w();
     else
     {
-        if (!lua_getmetatable(l, 1))
-        {
-            celx.doError("Internal error: couldn't get metatable");
-            return 0;
-        }
-
+        // Methods are looked up in the metatable, the first upvalue
         lua_pushvalue(l, 2);
-        lua_rawget(l, -2);
+        lua_rawget(l, CelxLua::localIndex(1));
         return 1;
     }
     lua_pushnumber(l, (lua_Number)value);
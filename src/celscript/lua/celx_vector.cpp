@@ -9,6 +9,7 @@
 // as published by the Free Software Foundation; either version 2
 // of the License, or (at your option) any later version.
 
+#include <cstring>
 #include "celx.h"
 #include "celx_internal.h"
 #include "celx_vector.h"
@@ -28,6 +29,20 @@ int vector_new(lua_State* l, const Vector3d& v)
     return 1;
 }
 
+// Push v, stored in the vector at index unless index is 0 or there is
+// no vector there, like position_reuse().
+int vector_reuse(lua_State* l, int index, const Vector3d& v)
+{
+    Vector3d* ud = index != 0 ? to_vector(l, index) : nullptr;
+    if (ud == nullptr)
+        return vector_new(l, v);
+
+    *ud = v;
+    lua_pushvalue(l, index);
+
+    return 1;
+}
+
 Vector3d* to_vector(lua_State* l, int index)
 {
     CelxLua celx(l);
@@ -75,24 +90,19 @@ static int vector_get(lua_State* l)
 
     celx.checkArgs(2, 2, "Invalid access of vector-component");
     auto v3 = this_vector(l);
-    string key = celx.safeGetString(2, AllErrors, "Invalid key in vector-access");
+    const char* key = celx.safeGetString(2, AllErrors, "Invalid key in vector-access");
     double value = 0.0;
-    if (key == "x")
+    if (strcmp(key, "x") == 0)
         value = v3->x();
-    else if (key == "y")
+    else if (strcmp(key, "y") == 0)
         value = v3->y();
-    else if (key == "z")
+    else if (strcmp(key, "z") == 0)
         value = v3->z();
     else
     {
-        if (!lua_getmetatable(l, 1))
-        {
-            celx.doError("Internal error: couldn't get metatable");
-            return 0;
-        }
-
+        // Methods are looked up in the metatable, the first upvalue
         lua_pushvalue(l, 2);
-        lua_rawget(l, -2);
+        lua_rawget(l, CelxLua::localIndex(1));
         return 1;
     }
     lua_pushnumber(l, (lua_Number)value);
@@ -105,13 +115,13 @@ static int vector_set(lua_State* l)
 
     celx.checkArgs(3, 3, "Invalid access of vector-component");
     auto v3 = this_vector(l);
-    string key = celx.safeGetString(2, AllErrors, "Invalid key in vector-access");
+    const char* key = celx.safeGetString(2, AllErrors, "Invalid key in vector-access");
     double value = celx.safeGetNumber(3, AllErrors, "Vector components must be numbers");
-    if (key == "x")
+    if (strcmp(key, "x") == 0)
         v3->x() = value;
-    else if (key == "y")
+    else if (strcmp(key, "y") == 0)
         v3->y() = value;
-    else if (key == "z")
+    else if (strcmp(key, "z") == 0)
         v3->z() = value;
     else
     {
@@ -18,6 +18,7 @@ struct lua_State;
 
 extern void CreateVectorMetaTable(lua_State* l);
 extern int vector_new(lua_State* l, const Eigen::Vector3d& v);
+extern int vector_reuse(lua_State* l, int index, const Eigen::Vector3d& v);
 extern Eigen::Vector3d* to_vector(lua_State* l, int index);
 
 #endif // _CELX_VECTOR_H_
@@ -0,0 +1,115 @@
+// skylinepacker.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Packing of rectangles into a fixed size area, for glyph atlases.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include "skylinepacker.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+
+SkylinePacker::SkylinePacker(int _width, int _height) :
+    width(_width),
+    height(_height)
+{
+    skyline.push_back({ 0, 0, width });
+}
+
+
+// The height at which a rectangle of width w rests on the skyline when its
+// left edge is at the start of segment index, or -1 if it runs off the
+// right of the area.
+int SkylinePacker::fit(std::size_t index, int w) const
+{
+    if (skyline[index].x + w > width)
+        return -1;
+
+    int y = 0;
+    int remaining = w;
+    for (size_t i = index; remaining > 0; i++)
+    {
+        y = max(y, skyline[i].y);
+        remaining -= skyline[i].width;
+    }
+
+    return y;
+}
+
+
+bool SkylinePacker::insert(int w, int h, int& x, int& y)
+{
+    if (w <= 0 || h <= 0 || w > width || h > height)
+        return false;
+
+    // Lowest top first; of those, the narrowest segment, which leaves the
+    // wider ones for wider rectangles.
+    int bestTop = numeric_limits<int>::max();
+    int bestWidth = numeric_limits<int>::max();
+    size_t bestIndex = skyline.size();
+    int bestY = 0;
+    for (size_t i = 0; i < skyline.size(); i++)
+    {
+        int y0 = fit(i, w);
+        if (y0 < 0)
+            break;
+        if (y0 + h > height)
+            continue;
+
+        if (y0 + h < bestTop || (y0 + h == bestTop && skyline[i].width < bestWidth))
+        {
+            bestTop = y0 + h;
+            bestWidth = skyline[i].width;
+            bestIndex = i;
+            bestY = y0;
+        }
+    }
+
+    if (bestIndex == skyline.size())
+        return false;
+
+    x = skyline[bestIndex].x;
+    y = bestY;
+    usedArea += (long) w * h;
+
+    // The new segment covers the ones it rests on, wholly or in part
+    skyline.insert(skyline.begin() + bestIndex, { x, y + h, w });
+    size_t next = bestIndex + 1;
+    while (next < skyline.size() && skyline[next].x < x + w)
+    {
+        int overlap = x + w - skyline[next].x;
+        if (skyline[next].width <= overlap)
+        {
+            skyline.erase(skyline.begin() + next);
+        }
+        else
+        {
+            skyline[next].x += overlap;
+            skyline[next].width -= overlap;
+            break;
+        }
+    }
+
+    // Merge neighbours at the same height
+    for (size_t i = 0; i + 1 < skyline.size(); )
+    {
+        if (skyline[i].y == skyline[i + 1].y)
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,54 @@
+// skylinepacker.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Packing of rectangles into a fixed size area, for glyph atlases.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/*! Packs rectangles one at a time into an area of fixed size, keeping
+ *  track of the skyline: the top edge of the rectangles packed so far, as
+ *  horizontal segments from left to right. A rectangle is placed on the
+ *  skyline where its top ends lowest, so rows of glyphs of similar height
+ *  fill up with little waste. Rectangles are never moved once placed.
+ */
+class SkylinePacker
+{
+ public:
+    SkylinePacker(int width, int height);
+
+    /*! Find room for a rectangle of width w and height h, and return the
+     *  position of its lower left corner in x and y. Returns false when
+     *  the rectangle doesn't fit anywhere.
+     */
+    bool insert(int w, int h, int& x, int& y);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // Area covered by the rectangles packed so far
+    long getUsedArea() const { return usedArea; }
+
+ private:
+    struct Segment
+    {
+        int x;
+        int y;
+        int width;
+    };
+
+    int fit(std::size_t index, int w) const;
+
+    int width;
+    int height;
+    long usedArea{ 0 };
+    std::vector<Segment> skyline;
+};
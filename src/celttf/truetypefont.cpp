@@ -10,6 +10,7 @@
 #include <algorithm>
 #include <array>
 #include <iostream>
+#include <unordered_map>
 #include <vector>
 #include <fmt/printf.h>
 #include <celutil/utf8.h>
@@ -17,6 +18,7 @@
 #include <celengine/render.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include "skylinepacker.h"
 #include "truetypefont.h"
 
 #define DUMP_TEXTURE 0
@@ -44,6 +46,8 @@ struct Glyph
 
     float tx;  // x offset of glyph in texture coordinates
     float ty;  // y offset of glyph in texture coordinates
+
+    int page;  // atlas page holding the glyph bitmap
 };
 
 struct UnicodeBlock
@@ -64,6 +68,14 @@ struct TextureFontPrivate
         float u, v;
     };
 
+    // A texture of the glyph atlas; glyphs are added to the free space of
+    // a page until it is full, and then to a new page.
+    struct AtlasPage
+    {
+        GLuint texName;
+        SkylinePacker packer;
+    };
+
     TextureFontPrivate() = delete;
     TextureFontPrivate(const Renderer *renderer);
     ~TextureFontPrivate();
@@ -77,13 +89,15 @@ struct TextureFontPrivate
 
     bool buildAtlas();
     void computeTextureSize();
+    bool addPage();
     bool loadGlyphInfo(wchar_t, Glyph&);
+    bool placeGlyph(Glyph&);
     void initCommonGlyphs();
     int getCommonGlyphsCount();
     Glyph& getGlyph(wchar_t);
     Glyph& getGlyph(wchar_t, wchar_t);
     int toPos(wchar_t) const;
-    void optimize();
+    void usePage(int);
     CelestiaGLProgram* getProgram();
     void flush();
 
@@ -96,17 +110,22 @@ struct TextureFontPrivate
     int m_maxDescent;
     int m_maxWidth;
 
-    int m_texWidth;
+    int m_texWidth;         // size of each atlas page
     int m_texHeight;
 
-    GLuint m_texName { 0 };       // texture object
+    vector<AtlasPage> m_pages;
+    int m_currentPage { 0 };  // page bound for rendering
     vector<Glyph> m_glyphs; // character information
     GLint m_maxTextureSize; // max supported texture size
 
     array<UnicodeBlock, 2> m_unicodeBlocks;
     int m_commonGlyphsCount { 0 };
 
-    int m_inserted { 0 };
+    // Positions in m_glyphs of the glyphs outside the common blocks,
+    // including those which failed to load.
+    unordered_map<wchar_t, size_t> m_glyphIndex;
+
+    TextureFont::AtlasStats m_stats;
 
     Eigen::Matrix4f m_MVP;
     bool m_shaderInUse { false };
@@ -136,8 +155,8 @@ TextureFontPrivate::~TextureFontPrivate()
 {
     if (m_face)
         FT_Done_Face(m_face);
-    if (m_texName != 0)
-        glDeleteTextures(1, &m_texName);
+    for (const auto &page : m_pages)
+        glDeleteTextures(1, &page.texName);
 }
 
 bool TextureFontPrivate::loadGlyphInfo(wchar_t ch, Glyph &c)
@@ -170,8 +189,8 @@ void TextureFontPrivate::initCommonGlyphs()
     {
         for (wchar_t ch = block.first, e = block.last; ch <= e; ch++)
         {
-            Glyph c;
-            if (!loadGlyphInfo(ch, c))
+            Glyph c = {};
+            if (!loadGlyphInfo(ch, c) || !placeGlyph(c))
                 fmt::fprintf(cerr, "Loading character %x failed!\n", (unsigned)ch);
             m_glyphs.push_back(c); // still pushing empty
         }
@@ -180,54 +199,29 @@ void TextureFontPrivate::initCommonGlyphs()
 
 void TextureFontPrivate::computeTextureSize()
 {
-    int roww = 0;
-    int rowh = 0;
-    int w = 0;
-    int h = 0;
-
-    // Find minimum size for a texture holding all visible ASCII characters
-    for (const auto &c : m_glyphs)
-    {
-        if (c.ch == 0) continue; // skip bad glyphs
+    // Pages hold a few hundred glyphs of the font's size: enough for the
+    // common glyphs and a good many others on the first page.
+    int lineHeight = max(1, (int)(m_face->size->metrics.height >> 6));
+    int size = 256;
+    while (size < lineHeight * 16 && size < 2048)
+        size *= 2;
 
-        if (roww + c.bw + 1 >= m_maxTextureSize)
-        {
-            w = max(w, roww);
-            h += rowh;
-            roww = 0;
-            rowh = 0;
-        }
-        roww += c.bw + 1;
-        rowh = max(rowh, (int)c.bh);
-    }
-
-    w = max(w, roww);
-    h += rowh;
-
-    m_texWidth = w;
-    m_texHeight = h;
+    m_texWidth = min(size, (int)m_maxTextureSize);
+    m_texHeight = m_texWidth;
 }
 
-bool TextureFontPrivate::buildAtlas()
+bool TextureFontPrivate::addPage()
 {
-    FT_GlyphSlot g = m_face->glyph;
-
-    initCommonGlyphs();
-    computeTextureSize();
-
-    // Create a texture that will be used to hold all glyphs
-    glActiveTexture(GL_TEXTURE0);
-    if (m_texName != 0)
-        glDeleteTextures(1, &m_texName);
-    glGenTextures(1, &m_texName);
-    if (m_texName == 0)
+    GLuint texName = 0;
+    glGenTextures(1, &texName);
+    if (texName == 0)
         return false;
 
-    glBindTexture(GL_TEXTURE_2D, m_texName);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, m_texWidth, m_texHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE, 0);
-
-    // We require 1 byte alignment when uploading texture data
+    // Clear the page, so that glyphs are surrounded by transparent texels
+    vector<uint8_t> blank(m_texWidth * m_texHeight, 0);
+    glBindTexture(GL_TEXTURE_2D, texName);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, m_texWidth, m_texHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE, blank.data());
 
     // Clamping to edges is important to prevent artifacts when scaling
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -237,42 +231,69 @@ bool TextureFontPrivate::buildAtlas()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    // Paste all glyph bitmaps into the texture, remembering the offset
-    int ox = 0;
-    int oy = 0;
+    m_pages.push_back({ texName, SkylinePacker(m_texWidth, m_texHeight) });
+    m_stats.pages = (unsigned int) m_pages.size();
+    return true;
+}
 
-    int rowh = 0;
+// Copy the bitmap of the glyph just loaded by loadGlyphInfo() into free
+// space of the atlas, adding a page if none has room for it. Only the
+// glyph's texels are uploaded, so glyphs already drawn are unaffected.
+bool TextureFontPrivate::placeGlyph(Glyph &c)
+{
+    c.page = 0;
+    c.tx = c.ty = 0.0f;
+    if (c.bw == 0 || c.bh == 0)
+        return true;
 
-    for (auto &c : m_glyphs)
+    // Keep the texture bound to the first unit, where text is drawn from
+    glActiveTexture(GL_TEXTURE0);
+    GLint boundTexture = 0;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+
+    // One texel of padding keeps neighbours from bleeding in when filtered
+    int x = 0;
+    int y = 0;
+    auto page = find_if(m_pages.begin(), m_pages.end(),
+                        [&](AtlasPage &p) { return p.packer.insert(c.bw + 1, c.bh + 1, x, y); });
+    if (page == m_pages.end())
     {
-        if (c.ch == 0) continue; // skip bad glyphs
-
-        if (FT_Load_Char(m_face, c.ch, FT_LOAD_RENDER))
+        if (!addPage() || !m_pages.back().packer.insert(c.bw + 1, c.bh + 1, x, y))
         {
-           fmt::fprintf(cerr, "Loading character %x failed!\n", (unsigned)c.ch);
-           c.ch = 0;
-           continue;
+            glBindTexture(GL_TEXTURE_2D, boundTexture);
+            return false;
         }
+        page = m_pages.end() - 1;
+    }
 
-        if (ox + int(g->bitmap.width) > int(m_texWidth))
-        {
-            oy += rowh;
-            rowh = 0;
-            ox = 0;
-        }
+    FT_GlyphSlot g = m_face->glyph;
+    glBindTexture(GL_TEXTURE_2D, page->texName);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, g->bitmap.width, g->bitmap.rows, GL_ALPHA, GL_UNSIGNED_BYTE, g->bitmap.buffer);
+    glBindTexture(GL_TEXTURE_2D, boundTexture);
 
-        glTexSubImage2D(GL_TEXTURE_2D, 0, ox, oy, g->bitmap.width, g->bitmap.rows, GL_ALPHA, GL_UNSIGNED_BYTE, g->bitmap.buffer);
-        c.tx = (float)ox / (float)m_texWidth;
-        c.ty = (float)oy / (float)m_texHeight;
+    c.page = (int)(page - m_pages.begin());
+    c.tx = (float)x / (float)m_texWidth;
+    c.ty = (float)y / (float)m_texHeight;
 
-        rowh = max(rowh, (int)g->bitmap.rows);
-        ox += g->bitmap.width + 1;
-    }
+    m_stats.atlasUploads++;
+    m_stats.uploadedBytes += c.bw * c.bh;
+    return true;
+}
+
+bool TextureFontPrivate::buildAtlas()
+{
+    computeTextureSize();
+    if (!addPage())
+        return false;
+
+    initCommonGlyphs();
 
 #if DUMP_TEXTURE
     fmt::fprintf(cout/*cerr*/, "Generated a %d x %d (%d kb) texture atlas\n", m_texWidth, m_texHeight, m_texWidth * m_texHeight / 1024);
     size_t img_size = sizeof(uint8_t) * m_texWidth * m_texHeight * 4;
     uint8_t *raw_img = new uint8_t[img_size];
+    glBindTexture(GL_TEXTURE_2D, m_pages[0].texName);
     glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, raw_img);
     ofstream f(fmt::sprintf("/tmp/texture_%ix%i.data", m_texWidth, m_texHeight), ios::binary);
     f.write(reinterpret_cast<char*>(raw_img), img_size);
@@ -320,37 +341,40 @@ Glyph& TextureFontPrivate::getGlyph(wchar_t ch, wchar_t fallback)
     return g.ch == ch ? g : getGlyph(fallback);
 }
 
-Glyph g_badGlyph = {0, 0, 0, 0, 0, 0, 0, 0.0f, 0.0f};
 Glyph& TextureFontPrivate::getGlyph(wchar_t ch)
 {
     auto pos = toPos(ch);
     if (pos != -1)
         return m_glyphs[pos];
 
-    auto it = find_if(m_glyphs.begin() + getCommonGlyphsCount(),
-                      m_glyphs.end(),
-                      [ch](Glyph &g) { return g.ch == ch; });
+    auto it = m_glyphIndex.find(ch);
+    if (it != m_glyphIndex.end())
+        return m_glyphs[it->second];
 
-    if (it != m_glyphs.end())
-        return *it;
-
-    Glyph c;
-    if (!loadGlyphInfo(ch, c))
-        return g_badGlyph;
-
-    flush(); // render text to avoid garbled output due to changed texture
+    // Glyphs which fail to load are kept too, so that they're only tried
+    // once; getGlyph(ch, fallback) tells them by their ch of 0.
+    m_stats.glyphMisses++;
+    Glyph c = {};
+    if (loadGlyphInfo(ch, c) && !placeGlyph(c))
+    {
+        fmt::fprintf(cerr, "No room for character %x in the atlas!\n", (unsigned)ch);
+        c.ch = 0;
+    }
 
+    m_glyphIndex.emplace(ch, m_glyphs.size());
     m_glyphs.push_back(c);
-    if (++m_inserted == 10)
-        optimize();
-    buildAtlas();
-
     return m_glyphs.back();
 }
 
-void TextureFontPrivate::optimize()
+void TextureFontPrivate::usePage(int page)
 {
-    m_inserted = 0;
+    if (page == m_currentPage)
+        return;
+
+    // Vertices already added refer to the page bound before
+    flush();
+    m_currentPage = page;
+    glBindTexture(GL_TEXTURE_2D, m_pages[page].texName);
 }
 
 /*
@@ -360,11 +384,11 @@ void TextureFontPrivate::optimize()
  */
 float TextureFontPrivate::render(const string &s, float x, float y)
 {
-    if (m_texName == 0)
+    if (m_pages.empty())
         return 0;
 
-    // Use the texture containing the atlas
-    glBindTexture(GL_TEXTURE_2D, m_texName);
+    // Use the atlas page drawn from last
+    glBindTexture(GL_TEXTURE_2D, m_pages[m_currentPage].texName);
 
     // Loop through all characters
     int len = s.length();
@@ -397,6 +421,8 @@ float TextureFontPrivate::render(const string &s, float x, float y)
         if (g.bw == 0 || g.bh == 0)
             continue;
 
+        usePage(g.page);
+
         const float tx1 = g.tx;
         const float ty1 = g.ty;
         const float tx2 = tx1 + w / m_texWidth;
@@ -415,6 +441,8 @@ float TextureFontPrivate::render(wchar_t ch, float xoffset, float yoffset)
 {
 
     auto& g = getGlyph(ch, L'?');
+    if (g.bw != 0 && g.bh != 0)
+        usePage(g.page);
 
     // Calculate the vertex and texture coordinates
     const float x1 = xoffset + g.bl;
@@ -579,7 +607,12 @@ void TextureFont::setMaxDescent(int _maxDescent)
 
 int TextureFont::getTextureName() const
 {
-    return impl->m_texName;
+    return impl->m_pages.empty() ? 0 : impl->m_pages[impl->m_currentPage].texName;
+}
+
+TextureFont::AtlasStats TextureFont::getAtlasStats() const
+{
+    return impl->m_stats;
 }
 
 void TextureFont::bind()
@@ -588,10 +621,10 @@ void TextureFont::bind()
     if (prog == nullptr)
         return;
 
-    if (impl->m_texName != 0)
+    if (!impl->m_pages.empty())
     {
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, impl->m_texName);
+        glBindTexture(GL_TEXTURE_2D, impl->m_pages[impl->m_currentPage].texName);
         prog->use();
         prog->samplerParam("atlasTex") = 0;
         impl->m_shaderInUse = true;
@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <celcompat/filesystem.h>
 #include <Eigen/Core>
@@ -45,6 +46,16 @@ class TextureFont
     short getAdvance(wchar_t c) const;
 
     int getTextureName() const;
+
+    struct AtlasStats
+    {
+        uint64_t glyphMisses{ 0 };    // glyphs looked up for the first time
+        uint64_t atlasUploads{ 0 };   // glyph bitmaps copied to the atlas
+        uint64_t uploadedBytes{ 0 };
+        unsigned int pages{ 0 };      // textures of the atlas
+    };
+    AtlasStats getAtlasStats() const;
+
     void bind();
     void unbind();
     bool buildTexture();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <new>
 #include <type_traits>
 
 /*! Returns aligned position for type T inside memory region.
@@ -24,3 +26,39 @@ template<typename T> size_t aligned_sizeof()
 {
     return sizeof(T) + std::alignment_of<T>::value - 1;
 }
+
+/*! Allocator returning memory aligned to Alignment bytes, for containers
+ *  holding data processed with aligned vector loads.
+ */
+template<typename T, size_t Alignment> class AlignedAllocator
+{
+ public:
+    typedef T value_type;
+
+    template<typename U> struct rebind
+    {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+    template<typename U> AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n)
+    {
+        // Over-allocate and keep the original pointer just below the
+        // aligned block so that deallocate() can recover it.
+        size_t size = n * sizeof(T) + Alignment + sizeof(void*);
+        char* raw = static_cast<char*>(::operator new(size));
+        char* addr = aligned_addr(raw + sizeof(void*), Alignment);
+        reinterpret_cast<void**>(addr)[-1] = raw;
+        return reinterpret_cast<T*>(addr);
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        ::operator delete(reinterpret_cast<void**>(p)[-1]);
+    }
+
+    template<typename U> bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template<typename U> bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
@@ -0,0 +1,149 @@
+// mappedfile.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Read-only memory mapping of a whole file.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <config.h>
+#include <fstream>
+#include "mappedfile.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+
+bool MappedFile::open(const fs::path& filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(filename.wstring().c_str(), GENERIC_READ,
+                              FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr)
+            {
+                void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view != nullptr)
+                {
+                    m_file = file;
+                    m_mapping = mapping;
+                    m_data = static_cast<const char*>(view);
+                    m_size = static_cast<size_t>(fileSize.QuadPart);
+                    m_mapped = true;
+                    return true;
+                }
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+    }
+#else
+    int fd = ::open(filename.string().c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                ::close(fd);
+                m_data = static_cast<const char*>(addr);
+                m_size = static_cast<size_t>(st.st_size);
+                m_mapped = true;
+                return true;
+            }
+        }
+        ::close(fd);
+    }
+#endif
+
+    // Mapping isn't available; fall back to reading the whole file.
+    ifstream in(filename.string(), ios::in | ios::binary);
+    if (!in.good())
+        return false;
+
+    in.seekg(0, ios::end);
+    auto length = in.tellg();
+    if (length <= 0)
+        return false;
+    in.seekg(0, ios::beg);
+
+    char* buffer = new char[static_cast<size_t>(length)];
+    if (!in.read(buffer, length))
+    {
+        delete[] buffer;
+        return false;
+    }
+
+    m_data = buffer;
+    m_size = static_cast<size_t>(length);
+    m_mapped = false;
+    return true;
+}
+
+
+void MappedFile::release() const
+{
+    if (!m_mapped)
+        return;
+
+#ifdef _WIN32
+    // Unlocking pages that aren't locked removes them from the working set
+    VirtualUnlock(const_cast<char*>(m_data), m_size);
+#else
+    madvise(const_cast<char*>(m_data), m_size, MADV_DONTNEED);
+#endif
+}
+
+
+void MappedFile::close()
+{
+    if (m_data == nullptr)
+        return;
+
+    if (m_mapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file = nullptr;
+#else
+        munmap(const_cast<char*>(m_data), m_size);
+#endif
+    }
+    else
+    {
+        delete[] m_data;
+    }
+
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+}
@@ -0,0 +1,49 @@
+// mappedfile.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Read-only memory mapping of a whole file.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <cstddef>
+#include <celcompat/filesystem.h>
+
+// A read-only view of the contents of a file. The file is mapped into
+// memory when the platform supports it, so only the pages actually touched
+// become resident; otherwise the contents are read into a heap buffer.
+class MappedFile
+{
+ public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const fs::path& filename);
+    void close();
+
+    // Let the system drop the pages of a mapped file from memory; they're
+    // read back from the file when touched again. Does nothing when the
+    // file was read into memory.
+    void release() const;
+
+    bool isOpen() const { return m_data != nullptr; }
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+ private:
+    const char* m_data{ nullptr };
+    std::size_t m_size{ 0 };
+    bool m_mapped{ false };
+#ifdef _WIN32
+    void* m_file{ nullptr };
+    void* m_mapping{ nullptr };
+#endif
+};
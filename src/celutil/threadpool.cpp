@@ -0,0 +1,181 @@
+// threadpool.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// A small work-stealing thread pool.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <algorithm>
+#include "threadpool.h"
+
+using namespace std;
+
+namespace
+{
+// Pool and queue index of the current thread, if it is a worker
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local unsigned int currentQueue = 0;
+}
+
+
+ThreadPool::ThreadPool(unsigned int nThreads)
+{
+    if (nThreads == 0)
+        nThreads = max(1u, thread::hardware_concurrency()) - 1;
+
+    // The queues must all exist before the first worker starts
+    for (unsigned int i = 0; i < nThreads; i++)
+        queues.emplace_back(new Queue());
+    workers.reserve(nThreads);
+    for (unsigned int i = 0; i < nThreads; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+
+void ThreadPool::submit(Task task)
+{
+    // Without workers, run the task right away
+    if (queues.empty())
+    {
+        task();
+        return;
+    }
+
+    unsigned int index = currentPool == this
+                       ? currentQueue
+                       : nextQueue.fetch_add(1, memory_order_relaxed) % size();
+    {
+        lock_guard<mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+        // Taking the lock orders this with a worker deciding to sleep
+        lock_guard<mutex> lock(sleepMutex);
+        pending.fetch_add(1);
+    }
+    wakeUp.notify_one();
+}
+
+
+bool ThreadPool::takeTask(unsigned int index, Task& task)
+{
+    // Own queue first, newest task first for locality . . .
+    {
+        Queue& queue = *queues[index];
+        lock_guard<mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // . . . then steal the oldest task of another worker.
+    for (unsigned int i = 1; i < size(); i++)
+    {
+        Queue& queue = *queues[(index + i) % size()];
+        lock_guard<mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void ThreadPool::workerLoop(unsigned int index)
+{
+    currentPool = this;
+    currentQueue = index;
+
+    for (;;)
+    {
+        Task task;
+        if (takeTask(index, task))
+        {
+            task();
+            continue;
+        }
+
+        unique_lock<mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this]() { return stopping || pending.load() > 0; });
+        if (stopping)
+            return;
+    }
+}
+
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)>& body)
+{
+    if (count == 0)
+        return;
+
+    // Shared with the helper tasks, which may outlive this call if they
+    // only get to run after all indices have been claimed.
+    struct State
+    {
+        atomic<size_t> next{ 0 };
+        size_t done{ 0 };
+        mutex doneMutex;
+        condition_variable allDone;
+    };
+    auto state = make_shared<State>();
+    const function<void(size_t)>* bodyPtr = &body;
+    size_t total = count;
+
+    auto run = [state, bodyPtr, total]()
+    {
+        size_t nDone = 0;
+        for (size_t i; (i = state->next.fetch_add(1)) < total; nDone++)
+            (*bodyPtr)(i);
+
+        if (nDone > 0)
+        {
+            lock_guard<mutex> lock(state->doneMutex);
+            state->done += nDone;
+            if (state->done == total)
+                state->allDone.notify_all();
+        }
+    };
+
+    size_t nHelpers = min(count - 1, (size_t) size());
+    for (size_t i = 0; i < nHelpers; i++)
+        submit(run);
+
+    run();
+
+    unique_lock<mutex> lock(state->doneMutex);
+    state->allDone.wait(lock, [state, total]() { return state->done == total; });
+}
+
+
+ThreadPool& ThreadPool::global()
+{
+    static ThreadPool pool;
+    return pool;
+}
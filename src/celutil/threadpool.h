@@ -0,0 +1,81 @@
+// threadpool.h
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// A small work-stealing thread pool.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Each worker owns a task queue: it takes its own tasks newest first and,
+// when that runs dry, steals the oldest tasks of the other workers. Tasks
+// submitted from outside the pool are spread over the queues round robin.
+class ThreadPool
+{
+ public:
+    typedef std::function<void()> Task;
+
+    // A pool with nThreads workers; zero means one less than the number
+    // of hardware threads, since the submitting thread usually works too.
+    explicit ThreadPool(unsigned int nThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int size() const { return (unsigned int) queues.size(); }
+
+    void submit(Task task);
+
+    // Run a function on the pool and return a future for its result.
+    template<class F> auto async(F f) -> std::future<decltype(f())>
+    {
+        typedef decltype(f()) R;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::move(f));
+        std::future<R> result = task->get_future();
+        submit([task]() { (*task)(); });
+        return result;
+    }
+
+    // Call body(i) for every i in [0, count) and wait for all calls to
+    // finish. The calling thread takes part, so this may also be called
+    // from inside a task.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    // Process-wide pool shared by the engine.
+    static ThreadPool& global();
+
+ private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(unsigned int index);
+    bool takeTask(unsigned int index, Task& task);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<size_t> pending{ 0 };
+    std::atomic<unsigned int> nextQueue{ 0 };
+    bool stopping{ false };
+};
@@ -607,6 +607,36 @@ int UTF8StringCompare(const std::string& s0, const std::string& s1, size_t n, bo
 }
 
 
+//! Return a copy of a UTF-8 string with the normalization and case folding
+//! of UTF8StringCompare(s0, s1, n, true) applied, so that byte comparisons
+//! of folded strings agree with it. Invalid bytes are copied unchanged.
+std::string UTF8FoldCase(const std::string& s)
+{
+    std::string folded;
+    folded.reserve(s.length());
+
+    int len = s.length();
+    int i = 0;
+    char buf[8];
+    while (i < len)
+    {
+        wchar_t ch = 0;
+        if (!UTF8Decode(s, i, ch))
+        {
+            folded += s[i++];
+            continue;
+        }
+        i += UTF8EncodedSize(ch);
+
+        ch = UTF8Normalize(ch);
+        if (ch < 0x80)
+            ch = std::tolower(ch);
+        folded.append(buf, UTF8Encode(ch, buf));
+    }
+
+    return folded;
+}
+
 #if 0
 //! Currently incomplete, but could be a helpful class for dealing with
 //! UTF-8 streams
@@ -809,16 +839,16 @@ std::string ReplaceGreekLetterAbbr(const std::string& str)
         // Linear search through all letter abbreviations
         for (int i = 0; i < instance->nLetters; i++)
         {
-            std::string prefix = instance->abbrevs[i];
-            if (len != prefix.length() || UTF8StringCompare(str, prefix, len, true) != 0)
+            const std::string* prefix = &instance->abbrevs[i];
+            if (len != prefix->length() || UTF8StringCompare(str, *prefix, len, true) != 0)
             {
-                prefix = instance->names[i];
-                if (len != prefix.length() || UTF8StringCompare(str, prefix, len, true) != 0)
+                prefix = &instance->names[i];
+                if (len != prefix->length() || UTF8StringCompare(str, *prefix, len, true) != 0)
                     continue;
             }
 
             std::string ret = greekAlphabetUTF8[i];
-            auto len = prefix.length();
+            auto len = prefix->length();
             for (; str.length() > len && isdigit(str[len]); len++)
                 ret += toSuperscript(str[len]);
             ret += str.substr(len);
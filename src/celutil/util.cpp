@@ -10,10 +10,13 @@
 // of the License, or (at your option) any later version.
 
 #include <config.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <celutil/debug.h>
 #include "util.h"
 #include "gettext.h"
 #ifdef _WIN32
+#include <direct.h>
 #include <shlobj.h>
 #include "winutil.h"
 #else
@@ -172,6 +175,20 @@ fs::path homeDir()
     return fs::path();
 }
 
+bool MakeDirectories(const fs::path& path)
+{
+    std::error_code ec;
+    if (path.empty() || fs::is_directory(path, ec))
+        return true;
+    if (!MakeDirectories(path.parent_path()))
+        return false;
+#ifdef _WIN32
+    return _wmkdir(path.c_str()) == 0 || fs::is_directory(path, ec);
+#else
+    return mkdir(path.c_str(), 0755) == 0 || fs::is_directory(path, ec);
+#endif
+}
+
 bool GetTZInfo(std::string &tzName, int &dstBias)
 {
 #ifdef _WIN32
@@ -46,6 +46,8 @@ template<typename T> constexpr typename T::size_type memsize(const T &c)
 
 fs::path PathExp(const fs::path& filename);
 fs::path homeDir();
+// Create a directory and any missing parents; true if it exists afterwards
+bool MakeDirectories(const fs::path& path);
 
 bool GetTZInfo(std::string&, int&);
 
@@ -14,12 +14,15 @@
 #include <cstdlib>
 #include <cmath>
 #include <algorithm>
+#include <chrono>
 #include <map>
+#include <vector>
 #include <celmath/mathlib.h>
 #include <celmath/geomutil.h>
 #include <celmath/ray.h>
 #include <celmath/sphere.h>
 #include <celmath/intersect.h>
+#include <celutil/threadpool.h>
 #include <zlib.h>
 #include <png.h>
 
@@ -299,8 +302,8 @@ public:
 
     double sunAngularDiameter;
 
-    LUT2* extinctionLUT;
-    LUT3* scatteringLUT;
+    LUT2* extinctionLUT{nullptr};
+    LUT3* scatteringLUT{nullptr};
 };
 
 
@@ -365,7 +368,9 @@ public:
 
 void usage()
 {
-    cerr << "Usage: scattersim [options] <config file>\n";
+    cerr << "Usage: scattersim [options] <config file> [<config file> ...]\n";
+    cerr << "   With several config files, the images are named after them\n";
+    cerr << "   instead of the --image option.\n";
     cerr << "   --lut (or -l)              : accelerate calculation by using a lookup table\n";
     cerr << "   --fisheye (or -f)          : use wide angle cameras on surface\n";
     cerr << "   --exposure <value> (or -e) : set exposure for HDR\n";
@@ -1003,6 +1008,82 @@ Vector4d integrateInscatteringFactors(const Scene& scene,
 }
 
 
+// The parts of integrateInscatteringFactors() that depend only on the view
+// path, computed once for all light directions.
+struct ViewPathSample
+{
+    Vector3d point;
+    OpticalDepths eyeDepth;
+    double rayleighDensity;
+    double mieDensity;
+};
+
+vector<ViewPathSample> sampleViewPath(const Scene& scene,
+                                      const Vector3d& atmStart,
+                                      const Vector3d& atmEnd,
+                                      double& stepDist)
+{
+    const unsigned int nSteps = IntegrateScatterSteps;
+
+    Vector3d dir = atmEnd - atmStart;
+    Vector3d origin = Vector3d::Zero() + (atmStart - scene.planet.center);
+    stepDist = dir.norm() / (double) nSteps;
+    dir.normalize();
+
+    Vector3d samplePoint = origin + 0.5 * stepDist * dir;
+
+    vector<ViewPathSample> samples(nSteps);
+    for (auto& sample : samples)
+    {
+        double h = samplePoint.norm() - scene.planet.radius;
+        sample.point = samplePoint;
+        sample.eyeDepth = integrateOpticalDepth(scene, samplePoint, atmStart);
+        sample.rayleighDensity = scene.atmosphere.rayleighDensity(h);
+        sample.mieDensity = scene.atmosphere.mieDensity(h);
+
+        samplePoint += stepDist * dir;
+    }
+
+    return samples;
+}
+
+
+// Same as integrateInscatteringFactors(), over a view path sampled by
+// sampleViewPath(); the results are identical.
+Vector4d integrateInscatteringFactors(const Scene& scene,
+                                      const vector<ViewPathSample>& samples,
+                                      double stepDist,
+                                      const Vector3d& lightDir)
+{
+    Vector3d rayleighScatter = Vector3d::Zero();
+    Vector3d mieScatter = Vector3d::Zero();
+
+    Sphered shell = Sphered(Vector3d::Zero(),
+                            scene.planet.radius + scene.atmosphereShellHeight);
+
+    for (const auto& sample : samples)
+    {
+        Ray3d sunRay(sample.point, lightDir);
+        double sunDist = 0.0;
+        testIntersection(sunRay, shell, sunDist);
+
+        OpticalDepths sunDepth = integrateOpticalDepth(scene, sample.point, sunRay.point(sunDist));
+        OpticalDepths totalDepth = sumOpticalDepths(sunDepth, sample.eyeDepth);
+        totalDepth.rayleigh *= 4.0 * PI;
+        totalDepth.mie      *= 4.0 * PI;
+
+        Vector3d extinction = scene.atmosphere.computeExtinction(totalDepth);
+
+        rayleighScatter += sample.rayleighDensity * stepDist * extinction;
+        mieScatter +=      sample.mieDensity      * stepDist * extinction;
+    }
+
+    Vector4d r = Vector4d::Zero();
+    r.head(3) = rayleighScatter;
+    return r;
+}
+
+
 
 /**** Lookup table acceleration of scattering ****/
 
@@ -1021,6 +1102,18 @@ double unpackSNorm(double un)
 }
 
 
+// Report the number of texels or pixels computed since start, and the
+// rate at which they were computed.
+void reportRate(unsigned long texels, chrono::steady_clock::time_point start)
+{
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << "Complete: " << texels << " texels in " << elapsed.count() << " s";
+    if (elapsed.count() > 0.0)
+        cout << " (" << (unsigned long) (texels / elapsed.count()) << " texels/s)";
+    cout << '\n';
+}
+
+
 LUT2*
 buildExtinctionLUT(const Scene& scene)
 {
@@ -1030,8 +1123,11 @@ buildExtinctionLUT(const Scene& scene)
     //Sphered planet = Sphered(scene.planet.radius);
     Sphered shell = Sphered(scene.planet.radius + scene.atmosphereShellHeight);
 
-    for (unsigned int i = 0; i < ExtinctionLUTHeightSteps; i++)
+    // Each row of heights is computed on its own; the texels don't depend
+    // on the order the rows are computed in.
+    ThreadPool::global().parallelFor(ExtinctionLUTHeightSteps, [&](size_t row)
     {
+        auto i = (unsigned int) row;
         double h = (double) i / (double) (ExtinctionLUTHeightSteps - 1) *
             scene.atmosphereShellHeight * 0.9999;
         Vector3d atmStart = Vector3d::Zero() +
@@ -1057,7 +1153,7 @@ buildExtinctionLUT(const Scene& scene)
 
             lut->setValue(i, j, ext.cwiseMax(1.0e-18));
         }
-    }
+    });
 
     return lut;
 }
@@ -1090,8 +1186,9 @@ buildOpticalDepthLUT(const Scene& scene)
     //Sphered planet = Sphered(scene.planet.radius);
     Sphered shell = Sphered(scene.planet.radius + scene.atmosphereShellHeight);
 
-    for (unsigned int i = 0; i < ExtinctionLUTHeightSteps; i++)
+    ThreadPool::global().parallelFor(ExtinctionLUTHeightSteps, [&](size_t row)
     {
+        auto i = (unsigned int) row;
         double h = (double) i / (double) (ExtinctionLUTHeightSteps - 1) *
             scene.atmosphereShellHeight;
         Vector3d atmStart = Vector3d::Zero() +
@@ -1116,7 +1213,7 @@ buildOpticalDepthLUT(const Scene& scene)
 
             lut->setValue(i, j, Vector3d(depth.rayleigh, depth.mie, depth.absorption));
         }
-    }
+    });
 
     return lut;
 }
@@ -1307,48 +1404,53 @@ buildScatteringLUT(const Scene& scene)
 
     Sphered shell = Sphered(scene.planet.radius + scene.atmosphereShellHeight);
 
-    for (unsigned int i = 0; i < ScatteringLUTHeightSteps; i++)
+    // There are few height slices, so the work is split into the rows of
+    // light angles of each height and view angle for an even load.
+    ThreadPool::global().parallelFor(ScatteringLUTHeightSteps * ScatteringLUTViewAngleSteps, [&](size_t row)
     {
+        auto i = (unsigned int) (row / ScatteringLUTViewAngleSteps);
+        auto j = (unsigned int) (row % ScatteringLUTViewAngleSteps);
         double h = (double) i / (double) (ScatteringLUTHeightSteps - 1) *
             scene.atmosphereShellHeight * 0.9999;
         Vector3d atmStart = Vector3d::Zero() +
             Vector3d::UnitX() * (h + scene.planet.radius);
 
-        for (unsigned int j = 0; j < ScatteringLUTViewAngleSteps; j++)
-        {
-            double cosAngle = unpackSNorm((double) j / (ScatteringLUTViewAngleSteps - 1));
-            double sinAngle = sqrt(1.0 - min(1.0, cosAngle * cosAngle));
-            Vector3d viewDir(cosAngle, sinAngle, 0.0);
+        double cosAngle = unpackSNorm((double) j / (ScatteringLUTViewAngleSteps - 1));
+        double sinAngle = sqrt(1.0 - min(1.0, cosAngle * cosAngle));
+        Vector3d viewDir(cosAngle, sinAngle, 0.0);
 
-            Ray3d viewRay(atmStart, viewDir);
-            double dist = 0.0;
-            if (!testIntersection(viewRay, shell, dist))
-                dist = 0.0;
+        Ray3d viewRay(atmStart, viewDir);
+        double dist = 0.0;
+        if (!testIntersection(viewRay, shell, dist))
+            dist = 0.0;
 
-            Vector3d atmEnd = viewRay.point(dist);
+        Vector3d atmEnd = viewRay.point(dist);
 
-            for (unsigned int k = 0; k < ScatteringLUTLightAngleSteps; k++)
-            {
-                double cosLightAngle = unpackSNorm((double) k / (ScatteringLUTLightAngleSteps - 1));
-                double sinLightAngle = sqrt(1.0 - min(1.0, cosLightAngle * cosLightAngle));
-                Vector3d lightDir(cosLightAngle, sinLightAngle, 0.0);
+        // The view path is shared by all light angles
+        double stepDist = 0.0;
+        vector<ViewPathSample> samples = sampleViewPath(scene, atmStart, atmEnd, stepDist);
+
+        for (unsigned int k = 0; k < ScatteringLUTLightAngleSteps; k++)
+        {
+            double cosLightAngle = unpackSNorm((double) k / (ScatteringLUTLightAngleSteps - 1));
+            double sinLightAngle = sqrt(1.0 - min(1.0, cosLightAngle * cosLightAngle));
+            Vector3d lightDir(cosLightAngle, sinLightAngle, 0.0);
 
 #if 0
-                Vector4d inscatter = integrateInscatteringFactors_LUT(scene,
-                                                                   atmStart,
-                                                                   atmEnd,
-                                                                   lightDir,
-                                                                   true);
-#else
-                Vector4d inscatter = integrateInscatteringFactors(scene,
+            Vector4d inscatter = integrateInscatteringFactors_LUT(scene,
                                                                atmStart,
                                                                atmEnd,
-                                                               lightDir);
+                                                               lightDir,
+                                                               true);
+#else
+            Vector4d inscatter = integrateInscatteringFactors(scene,
+                                                           samples,
+                                                           stepDist,
+                                                           lightDir);
 #endif
-                lut->setValue(i, j, k, inscatter);
-            }
+            lut->setValue(i, j, k, inscatter);
         }
-    }
+    });
 
     return lut;
 }
@@ -1600,14 +1702,12 @@ void render(const Scene& scene,
     unsigned int bottom = min(image.height, viewport.y + viewport.height);
 
     cout << "Rendering " << viewport.width << "x" << viewport.height << " view" << endl;
-    for (unsigned int i = viewport.y; i < bottom; i++)
-    {
-        unsigned int row = i - viewport.y;
-        if (row % 50 == 49)
-            cout << row + 1 << endl;
-        else if (row % 10 == 0)
-            cout << ".";
+    auto start = chrono::steady_clock::now();
 
+    // Rows are rendered in parallel; each pixel is written by one row only.
+    ThreadPool::global().parallelFor(bottom - viewport.y, [&](size_t row)
+    {
+        auto i = (unsigned int) (viewport.y + row);
         for (unsigned int j = viewport.x; j < right; j++)
         {
             double viewportX = ((double) (j - viewport.x) / (double) (viewport.width - 1) - 0.5) * aspectRatio;
@@ -1626,8 +1726,8 @@ void render(const Scene& scene,
 
             image.setPixel(j, i, color);
         }
-    }
-    cout << endl << "Complete" << endl;
+    });
+    reportRate((unsigned long) (bottom - viewport.y) * (right - viewport.x), start);
 }
 
 
@@ -1803,13 +1903,12 @@ Camera lookAt(const Vector3d& cameraPos,
 
 
 
-string configFilename;
+vector<string> configFilenames;
 string outputImageName("out.png");
 
 bool parseCommandLine(int argc, char* argv[])
 {
     int i = 1;
-    int fileCount = 0;
 
     while (i < argc)
     {
@@ -1890,17 +1989,7 @@ bool parseCommandLine(int argc, char* argv[])
         }
         else
         {
-            if (fileCount == 0)
-            {
-                // input filename first
-                configFilename = string(argv[i]);
-                fileCount++;
-            }
-            else
-            {
-                // more than one filenames on the command line is an error
-                return false;
-            }
+            configFilenames.emplace_back(argv[i]);
             i++;
         }
     }
@@ -1909,20 +1998,17 @@ bool parseCommandLine(int argc, char* argv[])
 }
 
 
-int main(int argc, char* argv[])
+// Build the lookup tables of an atmosphere profile and render the preview
+// image; the lookup table images are named with lutPrefix.
+bool processProfile(const string& configFilename,
+                    const string& imageName,
+                    const string& lutPrefix)
 {
-    bool commandLineOK = parseCommandLine(argc, argv);
-    if (!commandLineOK || configFilename.empty())
-    {
-        usage();
-        exit(1);
-    }
-
     ParameterSet sceneParams;
     setSceneDefaults(sceneParams);
     if (!LoadParameterSet(sceneParams, configFilename))
     {
-        exit(1);
+        return false;
     }
 
     Scene scene;
@@ -1953,17 +2039,19 @@ int main(int argc, char* argv[])
     if (LUTUsage != NoLUT)
     {
         cout << "Building extinction LUT...\n";
+        auto start = chrono::steady_clock::now();
         scene.extinctionLUT = buildExtinctionLUT(scene);
-        cout << "Complete!\n";
-        DumpLUT(*scene.extinctionLUT, "extlut.png");
+        reportRate(ExtinctionLUTHeightSteps * ExtinctionLUTViewAngleSteps, start);
+        DumpLUT(*scene.extinctionLUT, lutPrefix + "extlut.png");
     }
 
     if (LUTUsage == UseScatteringLUT)
     {
         cout << "Building scattering LUT...\n";
+        auto start = chrono::steady_clock::now();
         scene.scatteringLUT = buildScatteringLUT(scene);
-        cout << "Complete!\n";
-        DumpLUT(*scene.scatteringLUT, "lut.png");
+        reportRate(ScatteringLUTHeightSteps * ScatteringLUTViewAngleSteps * ScatteringLUTLightAngleSteps, start);
+        DumpLUT(*scene.scatteringLUT, lutPrefix + "lut.png");
     }
 
     double planetRadius = scene.planet.radius;
@@ -2046,7 +2134,53 @@ int main(int argc, char* argv[])
         render(scene, cameraSurface, botright, image);
     }
 
-    WritePNG(outputImageName, image);
+    delete scene.extinctionLUT;
+    delete scene.scatteringLUT;
+
+    return WritePNG(imageName, image);
+}
+
+
+// The name of a config file without its directory and extension
+string profileName(const string& configFilename)
+{
+    string name = configFilename.substr(configFilename.find_last_of("/\\") + 1);
+    return name.substr(0, name.rfind('.'));
+}
+
+
+int main(int argc, char* argv[])
+{
+    bool commandLineOK = parseCommandLine(argc, argv);
+    if (!commandLineOK || configFilenames.empty())
+    {
+        usage();
+        exit(1);
+    }
+
+    cout << "Using " << ThreadPool::global().size() + 1 << " threads\n";
+
+    // In batch mode, the images of each profile are named after it
+    if (configFilenames.size() == 1)
+    {
+        if (!processProfile(configFilenames[0], outputImageName, ""))
+            exit(1);
+        exit(0);
+    }
+
+    auto start = chrono::steady_clock::now();
+    unsigned int failures = 0;
+    for (const auto& configFilename : configFilenames)
+    {
+        string name = profileName(configFilename);
+        cout << "Profile " << name << '\n';
+        if (!processProfile(configFilename, name + ".png", name + "-"))
+            failures++;
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    cout << configFilenames.size() - failures << " of " << configFilenames.size()
+         << " profiles processed in " << elapsed.count() << " s\n";
 
-    exit(0);
+    exit(failures == 0 ? 0 : 1);
 }
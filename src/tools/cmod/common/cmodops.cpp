@@ -14,6 +14,8 @@
 #include <celmath/mathlib.h>
 #include <Eigen/Core>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <vector>
 #ifdef TRISTRIP
 #include <NvTriStrip.h>
@@ -36,34 +38,6 @@ struct VertexComparator
 };
 
 
-class FullComparator : public VertexComparator
-{
-public:
-    FullComparator(int _vertexSize) :
-        vertexSize(_vertexSize)
-    {
-    }
-
-    bool compare(const Vertex& a, const Vertex& b) const override
-    {
-        const auto* s0 = reinterpret_cast<const char*>(a.attributes);
-        const auto* s1 = reinterpret_cast<const char*>(b.attributes);
-        for (int i = 0; i < vertexSize; i++)
-        {
-            if (s0[i] < s1[i])
-                return true;
-            if (s0[i] > s1[i])
-                return false;
-        }
-
-        return false;
-    }
-
-private:
-    int vertexSize;
-};
-
-
 class PointOrderingPredicate : public VertexComparator
 {
 public:
@@ -236,21 +210,6 @@ private:
 };
 
 
-bool equal(const Vertex& a, const Vertex& b, uint32_t vertexSize)
-{
-    const auto* s0 = reinterpret_cast<const char*>(a.attributes);
-    const auto* s1 = reinterpret_cast<const char*>(b.attributes);
-
-    for (uint32_t i = 0; i < vertexSize; i++)
-    {
-        if (s0[i] != s1[i])
-            return false;
-    }
-
-    return true;
-}
-
-
 bool equalPoint(const Vertex& a, const Vertex& b)
 {
     const Vector3f* p0 = reinterpret_cast<const Vector3f*>(a.attributes);
@@ -342,6 +301,21 @@ struct MeshVertexDescComparator
 };
 
 
+// FNV-1a hash of the bytes of a vertex
+static uint32_t
+hashVertex(const char* vertex, uint32_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < size; i++)
+        hash = (hash ^ (unsigned char) vertex[i]) * 16777619u;
+    return hash;
+}
+
+
+/** Merge vertices that are identical byte for byte. The distinct vertices
+  * are found through a hash table and keep the order in which they first
+  * appear.
+  */
 bool
 UniquifyVertices(Mesh& mesh)
 {
@@ -355,46 +329,45 @@ UniquifyVertices(Mesh& mesh)
     if (vertexData == nullptr)
         return false;
 
-    // Initialize the array of vertices
-    vector<Vertex> vertices(nVertices);
-    uint32_t i;
-    for (i = 0; i < nVertices; i++)
+    // Open addressing with linear probing, in a table at most half full.
+    // Slots hold indices into the list of distinct vertices.
+    const uint32_t EmptySlot = ~0u;
+    size_t tableSize = 1;
+    while (tableSize < (size_t) nVertices * 2)
+        tableSize *= 2;
+    vector<uint32_t> table(tableSize, EmptySlot);
+    vector<uint32_t> uniqueVertices;
+    vector<uint32_t> vertexMap(nVertices);
+    for (uint32_t i = 0; i < nVertices; i++)
     {
-        vertices[i] = Vertex(i, vertexData + i * desc.stride);
-    }
-
-    // Sort the vertices so that identical ones will be ordered consecutively
-    sort(vertices.begin(), vertices.end(), FullComparator(desc.stride));
+        const char* vertex = vertexData + i * desc.stride;
+        size_t slot = hashVertex(vertex, desc.stride) & (tableSize - 1);
+        while (table[slot] != EmptySlot &&
+               memcmp(vertexData + uniqueVertices[table[slot]] * desc.stride, vertex, desc.stride) != 0)
+        {
+            slot = (slot + 1) & (tableSize - 1);
+        }
 
-    // Count the number of unique vertices
-    uint32_t uniqueVertexCount = 0;
-    for (i = 0; i < nVertices; i++)
-    {
-        if (i == 0 || !equal(vertices[i - 1], vertices[i], desc.stride))
-            uniqueVertexCount++;
+        if (table[slot] == EmptySlot)
+        {
+            table[slot] = (uint32_t) uniqueVertices.size();
+            uniqueVertices.push_back(i);
+        }
+        vertexMap[i] = table[slot];
     }
 
     // No work left to do if we couldn't eliminate any vertices
+    auto uniqueVertexCount = (uint32_t) uniqueVertices.size();
     if (uniqueVertexCount == nVertices)
         return true;
 
-    // Build the vertex map and the uniquified vertex data
-    vector<uint32_t> vertexMap(nVertices);
+    // Build the uniquified vertex data
     auto* newVertexData = new char[uniqueVertexCount * desc.stride];
-    const char* oldVertexData = reinterpret_cast<const char*>(mesh.getVertexData());
-    uint32_t j = 0;
-    for (i = 0; i < nVertices; i++)
+    for (uint32_t j = 0; j < uniqueVertexCount; j++)
     {
-        if (i == 0 || !equal(vertices[i - 1], vertices[i], desc.stride))
-        {
-            if (i != 0)
-                j++;
-            assert(j < uniqueVertexCount);
-            memcpy(newVertexData + j * desc.stride,
-                   oldVertexData + vertices[i].index * desc.stride,
-                   desc.stride);
-        }
-        vertexMap[vertices[i].index] = j;
+        memcpy(newVertexData + j * desc.stride,
+               vertexData + uniqueVertices[j] * desc.stride,
+               desc.stride);
     }
 
     // Replace the vertex data with the compacted data
@@ -1287,9 +1260,316 @@ GenerateModelNormals(const Model& model, float smoothAngle, bool weldVertices, f
 }
 
 
+// Vertex scores of Tom Forsyth's "Linear-Speed Vertex Cache Optimisation",
+// which models a least recently used cache of 32 vertices.
+static const unsigned int ModelCacheSize = 32;
+static const unsigned int MaxScoredValence = 32;
+static const float CacheDecayPower = 1.5f;
+static const float LastTriangleScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+
+struct VertexScoreTable
+{
+    float cache[ModelCacheSize];
+    float valence[MaxScoredValence + 1];
+
+    VertexScoreTable()
+    {
+        for (unsigned int i = 0; i < ModelCacheSize; i++)
+        {
+            // The three vertices of the last triangle score the same, so
+            // that the next triangle isn't drawn back on them.
+            if (i < 3)
+                cache[i] = LastTriangleScore;
+            else
+                cache[i] = pow(1.0f - (float) (i - 3) / (ModelCacheSize - 3), CacheDecayPower);
+        }
+
+        // Vertices with few triangles left are favored, so that no
+        // lone triangles are left behind.
+        valence[0] = 0.0f;
+        for (unsigned int i = 1; i <= MaxScoredValence; i++)
+            valence[i] = ValenceBoostScale * pow((float) i, -ValenceBoostPower);
+    }
+
+    float score(int cachePosition, uint32_t liveTriangles) const
+    {
+        if (liveTriangles == 0)
+            return -1.0f;
+
+        float s = valence[min(liveTriangles, MaxScoredValence)];
+        if (cachePosition >= 0)
+            s += cache[cachePosition];
+        return s;
+    }
+};
+
+
+// Reorder the triangles of a triangle list in place, greedily drawing the
+// triangle whose vertices score highest.
+static void
+optimizeTriangleOrder(Mesh::index32* indices, uint32_t nIndices, uint32_t nVertices)
+{
+    static const VertexScoreTable scores;
+
+    uint32_t nTriangles = nIndices / 3;
+
+    // The triangles using each vertex; those not yet drawn come first
+    vector<uint32_t> triangleStart(nVertices + 1, 0);
+    for (uint32_t i = 0; i < nIndices; i++)
+        triangleStart[indices[i] + 1]++;
+    for (uint32_t v = 0; v < nVertices; v++)
+        triangleStart[v + 1] += triangleStart[v];
+
+    vector<uint32_t> liveTriangles(nVertices, 0);
+    vector<uint32_t> vertexTriangles(nIndices);
+    for (uint32_t i = 0; i < nIndices; i++)
+    {
+        uint32_t v = indices[i];
+        vertexTriangles[triangleStart[v] + liveTriangles[v]++] = i / 3;
+    }
+
+    vector<int> cachePosition(nVertices, -1);
+    vector<float> vertexScore(nVertices);
+    for (uint32_t v = 0; v < nVertices; v++)
+        vertexScore[v] = scores.score(-1, liveTriangles[v]);
+
+    auto triangleScore = [&](uint32_t t)
+    {
+        return vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+    };
+
+    vector<bool> drawn(nTriangles, false);
+    vector<Mesh::index32> newIndices;
+    newIndices.reserve(nIndices);
+
+    // The cache holds up to three extra vertices while it's updated
+    uint32_t cache[ModelCacheSize + 3];
+    uint32_t cacheSize = 0;
+
+    const uint32_t NoTriangle = ~0u;
+    uint32_t best = NoTriangle;
+    uint32_t nextUndrawn = 0;
+    for (uint32_t n = 0; n < nTriangles; n++)
+    {
+        // When no triangle shares a vertex with the cache, start again from
+        // the first triangle not drawn.
+        if (best == NoTriangle)
+        {
+            while (drawn[nextUndrawn])
+                nextUndrawn++;
+            best = nextUndrawn;
+        }
+
+        drawn[best] = true;
+        uint32_t newCache[ModelCacheSize + 3];
+        uint32_t newCacheSize = 0;
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[best * 3 + k];
+            newIndices.push_back(v);
+            if (find(newCache, newCache + newCacheSize, v) == newCache + newCacheSize)
+                newCache[newCacheSize++] = v;
+
+            // Move the triangle past the live ones of the vertex
+            uint32_t* first = vertexTriangles.data() + triangleStart[v];
+            uint32_t* end = first + liveTriangles[v];
+            uint32_t* t = find(first, end, best);
+            if (t != end)
+            {
+                swap(*t, *(end - 1));
+                liveTriangles[v]--;
+            }
+        }
+
+        uint32_t nTriangleVertices = newCacheSize;
+        for (uint32_t i = 0; i < cacheSize; i++)
+        {
+            uint32_t v = cache[i];
+            if (find(newCache, newCache + nTriangleVertices, v) == newCache + nTriangleVertices)
+                newCache[newCacheSize++] = v;
+        }
+
+        // Vertices pushed out of the cache lose their cache score
+        for (uint32_t i = ModelCacheSize; i < newCacheSize; i++)
+        {
+            uint32_t v = newCache[i];
+            cachePosition[v] = -1;
+            vertexScore[v] = scores.score(-1, liveTriangles[v]);
+        }
+        cacheSize = min(newCacheSize, ModelCacheSize);
+        for (uint32_t i = 0; i < cacheSize; i++)
+        {
+            uint32_t v = newCache[i];
+            cache[i] = v;
+            cachePosition[v] = (int) i;
+            vertexScore[v] = scores.score((int) i, liveTriangles[v]);
+        }
+
+        // The next triangle is the best of those using a cached vertex
+        best = NoTriangle;
+        float bestScore = -1.0f;
+        for (uint32_t i = 0; i < cacheSize; i++)
+        {
+            uint32_t v = cache[i];
+            for (uint32_t j = 0; j < liveTriangles[v]; j++)
+            {
+                uint32_t t = vertexTriangles[triangleStart[v] + j];
+                float s = triangleScore(t);
+                if (s > bestScore)
+                {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+    }
+
+    copy(newIndices.begin(), newIndices.end(), indices);
+}
+
+
+/** Reorder the triangles of the triangle lists of a mesh so that the
+  * vertices they share are found in the post-transform vertex cache. The
+  * indices are 32-bit, so unlike conversion to strips this works on meshes
+  * of any size. Strips, fans and other primitives are left alone.
+  */
+bool
+OptimizeVertexCache(Mesh& mesh)
+{
+    uint32_t nVertices = mesh.getVertexCount();
+    for (uint32_t i = 0; i < mesh.getGroupCount(); i++)
+    {
+        Mesh::PrimitiveGroup* group = mesh.getGroup(i);
+        if (group->prim != Mesh::TriList || group->nIndices % 3 != 0)
+            continue;
+
+        if (any_of(group->indices, group->indices + group->nIndices,
+                   [nVertices](Mesh::index32 index) { return index >= nVertices; }))
+        {
+            return false;
+        }
+
+        optimizeTriangleOrder(group->indices, group->nIndices, nVertices);
+    }
+
+    return true;
+}
+
+
+/** Reorder the vertices of a mesh in the order the primitives first use
+  * them, so that vertices are fetched from memory mostly in sequence.
+  * Vertices no primitive uses are moved to the end.
+  */
+bool
+OptimizeVertexFetch(Mesh& mesh)
+{
+    uint32_t nVertices = mesh.getVertexCount();
+    const Mesh::VertexDescription& desc = mesh.getVertexDescription();
+    const char* vertexData = reinterpret_cast<const char*>(mesh.getVertexData());
+    if (nVertices == 0 || vertexData == nullptr)
+        return false;
+
+    const uint32_t Unused = ~0u;
+    vector<uint32_t> vertexMap(nVertices, Unused);
+    uint32_t nextVertex = 0;
+    for (uint32_t i = 0; i < mesh.getGroupCount(); i++)
+    {
+        const Mesh::PrimitiveGroup* group = mesh.getGroup(i);
+        for (uint32_t j = 0; j < group->nIndices; j++)
+        {
+            uint32_t index = group->indices[j];
+            if (index >= nVertices)
+                return false;
+            if (vertexMap[index] == Unused)
+                vertexMap[index] = nextVertex++;
+        }
+    }
+
+    bool reordered = false;
+    for (uint32_t v = 0; v < nVertices; v++)
+    {
+        if (vertexMap[v] == Unused)
+            vertexMap[v] = nextVertex++;
+        reordered = reordered || vertexMap[v] != v;
+    }
+
+    if (!reordered)
+        return true;
+
+    auto* newVertexData = new char[nVertices * desc.stride];
+    for (uint32_t v = 0; v < nVertices; v++)
+    {
+        memcpy(newVertexData + vertexMap[v] * desc.stride,
+               vertexData + v * desc.stride,
+               desc.stride);
+    }
+
+    mesh.setVertices(nVertices, newVertexData);
+    mesh.remapIndices(vertexMap);
+
+    return true;
+}
+
+
+/** Compute the average number of vertices transformed per triangle of the
+  * triangle lists, strips and fans of a model, with a first in, first out
+  * vertex cache of cacheSize entries that is emptied between primitive
+  * groups. Zero if the model has no triangles.
+  */
+double
+AverageCacheMissRatio(const Model& model, unsigned int cacheSize)
+{
+    uint64_t misses = 0;
+    uint64_t nTriangles = 0;
+    for (uint32_t i = 0; i < model.getMeshCount(); i++)
+    {
+        const Mesh* mesh = model.getMesh(i);
+        uint32_t nVertices = mesh->getVertexCount();
+
+        // A vertex is cached if it was inserted after the start of the
+        // group and less than cacheSize insertions ago.
+        vector<uint64_t> insertionTime(nVertices, 0);
+        uint64_t time = 0;
+        for (uint32_t j = 0; j < mesh->getGroupCount(); j++)
+        {
+            const Mesh::PrimitiveGroup* group = mesh->getGroup(j);
+            if (group->prim != Mesh::TriList &&
+                group->prim != Mesh::TriStrip &&
+                group->prim != Mesh::TriFan)
+            {
+                continue;
+            }
+
+            uint64_t groupStart = time;
+            for (uint32_t k = 0; k < group->nIndices; k++)
+            {
+                uint32_t index = group->indices[k];
+                if (index < nVertices &&
+                    insertionTime[index] > groupStart &&
+                    time - insertionTime[index] < cacheSize)
+                {
+                    continue;
+                }
+
+                misses++;
+                time++;
+                if (index < nVertices)
+                    insertionTime[index] = time;
+            }
+            nTriangles += group->getPrimitiveCount();
+        }
+    }
+
+    return nTriangles == 0 ? 0.0 : (double) misses / (double) nTriangles;
+}
+
+
 #ifdef TRISTRIP
 bool
-convertToStrips(Mesh& mesh)
+ConvertToStrips(Mesh& mesh)
 {
     vector<Mesh::PrimitiveGroup*> groups;
 
@@ -42,10 +42,16 @@ struct Face
 extern cmod::Mesh* GenerateNormals(const cmod::Mesh& mesh, float smoothAngle, bool weld, float weldTolerance = 0.0f);
 extern cmod::Mesh* GenerateTangents(const cmod::Mesh& mesh, bool weld);
 extern bool UniquifyVertices(cmod::Mesh& mesh);
+extern bool OptimizeVertexCache(cmod::Mesh& mesh);
+extern bool OptimizeVertexFetch(cmod::Mesh& mesh);
+#ifdef TRISTRIP
+extern bool ConvertToStrips(cmod::Mesh& mesh);
+#endif
 
 // Model operations
 extern cmod::Model* MergeModelMeshes(const cmod::Model& model);
 extern cmod::Model* GenerateModelNormals(const cmod::Model& model, float smoothAngle, bool weldVertices, float weldTolerance);
+extern double AverageCacheMissRatio(const cmod::Model& model, unsigned int cacheSize);
 
 
 template<typename T, typename U> void
@@ -0,0 +1,96 @@
+// makedsodb.cpp
+//
+// Copyright (C) 2020, Celestia Development Team
+//
+// Convert deep sky catalogs to the pre-sorted binary catalog format.
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <celengine/dsodb.h>
+
+using namespace std;
+
+
+static vector<string> inputFilenames;
+static string outputFilename;
+
+
+void Usage()
+{
+    cerr << "Usage: makedsodb <input catalog>... <output catalog>\n";
+    cerr << "  The input catalogs are .dsc files, loaded in order.\n";
+    cerr << "  Run it from the data directory, which meshes and galaxy templates\n";
+    cerr << "  are relative to, as they are when Celestia loads its catalogs.\n";
+}
+
+
+bool parseCommandLine(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (argv[i][0] == '-')
+        {
+            cerr << "Unknown command line switch: " << argv[i] << '\n';
+            return false;
+        }
+        inputFilenames.push_back(argv[i]);
+    }
+
+    if (inputFilenames.size() < 2)
+        return false;
+
+    outputFilename = inputFilenames.back();
+    inputFilenames.pop_back();
+    return true;
+}
+
+
+int main(int argc, char* argv[])
+{
+    if (!parseCommandLine(argc, argv))
+    {
+        Usage();
+        return 1;
+    }
+
+    DSODatabase dsoDB;
+    dsoDB.setNameDatabase(new DSONameDatabase());
+    for (const auto& filename : inputFilenames)
+    {
+        ifstream in(filename, ios::in);
+        if (!in.good())
+        {
+            cerr << "Error opening input file " << filename << '\n';
+            return 1;
+        }
+
+        if (!dsoDB.load(in))
+        {
+            cerr << "Error reading deep sky catalog " << filename << '\n';
+            return 1;
+        }
+    }
+    dsoDB.finish();
+
+    ofstream out(outputFilename, ios::out | ios::binary);
+    if (!out.good())
+    {
+        cerr << "Error opening output file " << outputFilename << '\n';
+        return 1;
+    }
+
+    if (!dsoDB.writeBinary(out))
+    {
+        cerr << "Error writing binary deep sky catalog " << outputFilename << '\n';
+        return 1;
+    }
+
+    return 0;
+}
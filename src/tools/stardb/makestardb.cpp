@@ -11,12 +11,17 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <iomanip>
+#include <iterator>
+#include <unordered_map>
 #include <cctype>
+#include <cstring>
 #include <cassert>
 #include <celutil/bytes.h>
 #include <celengine/astro.h>
 #include <celengine/star.h>
+#include <celengine/stardb.h>
 
 using namespace std;
 
@@ -24,6 +29,7 @@ using namespace std;
 static string inputFilename;
 static string outputFilename;
 static bool useSphericalCoords = false;
+static bool useOctreeFormat = false;
 
 
 void Usage()
@@ -31,6 +37,8 @@ void Usage()
     cerr << "Usage: makestardb [options] <input file> <output star database>\n";
     cerr << "  Options:\n";
     cerr << "    --spherical (or -s) : input file has spherical coords (RA/dec/distance\n";
+    cerr << "    --octree (or -o)    : write a pre-sorted octree database; the input\n";
+    cerr << "                          may also be an existing binary star database\n";
 }
 
 
@@ -47,6 +55,10 @@ bool parseCommandLine(int argc, char* argv[])
             {
                 useSphericalCoords = true;
             }
+            else if (!strcmp(argv[i], "--octree") || !strcmp(argv[i], "-o"))
+            {
+                useOctreeFormat = true;
+            }
             else
             {
                 cerr << "Unknown command line switch: " << argv[i] << '\n';
@@ -213,6 +225,52 @@ bool WriteStarDatabase(istream& in, ostream& out, bool sphericalCoords)
 }
 
 
+// Convert a star database in the plain binary format into the pre-sorted
+// octree format. The stars are sorted by loading them into a StarDatabase;
+// their spectral types are taken from the input records, since the database
+// only keeps the derived star details.
+bool WriteOctreeStarDatabase(const string& binaryDatabase, ostream& out)
+{
+    const size_t headerSize = 8 + sizeof(uint16_t) + sizeof(uint32_t);
+    const size_t recordSize = sizeof(uint32_t) + 3 * sizeof(float) +
+                              sizeof(int16_t) + sizeof(uint16_t);
+
+    unordered_map<uint32_t, uint16_t> spectralTypes;
+    for (size_t offset = headerSize; offset + recordSize <= binaryDatabase.size(); offset += recordSize)
+    {
+        uint32_t catalogNumber;
+        uint16_t spectralType;
+        memcpy(&catalogNumber, binaryDatabase.data() + offset, sizeof catalogNumber);
+        LE_TO_CPU_INT32(catalogNumber, catalogNumber);
+        memcpy(&spectralType, binaryDatabase.data() + offset + recordSize - sizeof spectralType,
+               sizeof spectralType);
+        LE_TO_CPU_INT16(spectralType, spectralType);
+
+        StellarClass sc;
+        if (!sc.unpackV1(spectralType))
+        {
+            cerr << "Bad spectral type for star " << catalogNumber << '\n';
+            return false;
+        }
+        spectralTypes[catalogNumber] = sc.packV2();
+    }
+
+    StarDatabase starDB;
+    istringstream in(binaryDatabase, ios::in | ios::binary);
+    if (!starDB.loadBinary(in))
+    {
+        cerr << "Error reading binary star database\n";
+        return false;
+    }
+    starDB.finish();
+
+    return starDB.writeOctreeBinary(out, [&spectralTypes](const Star& star)
+                                         {
+                                             return spectralTypes[star.getIndex()];
+                                         });
+}
+
+
 int main(int argc, char* argv[])
 {
     if (!parseCommandLine(argc, argv) || inputFilename.empty())
@@ -221,7 +279,7 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    ifstream inputFile(inputFilename, ios::in);
+    ifstream inputFile(inputFilename, useOctreeFormat ? ios::in | ios::binary : ios::in);
     if (!inputFile.good())
     {
         cerr << "Error opening input file " << inputFilename << '\n';
@@ -235,7 +293,24 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    bool success = WriteStarDatabase(inputFile, stardbFile, useSphericalCoords);
+    bool success;
+    if (useOctreeFormat)
+    {
+        string contents((istreambuf_iterator<char>(inputFile)), istreambuf_iterator<char>());
+        if (contents.compare(0, 8, "CELSTARS") != 0)
+        {
+            istringstream textInput(contents);
+            ostringstream binaryOutput(ios::out | ios::binary);
+            if (!WriteStarDatabase(textInput, binaryOutput, useSphericalCoords))
+                return 1;
+            contents = binaryOutput.str();
+        }
+        success = WriteOctreeStarDatabase(contents, stardbFile);
+    }
+    else
+    {
+        success = WriteStarDatabase(inputFile, stardbFile, useSphericalCoords);
+    }
 
     return success ? 0 : 1;
 }
@@ -0,0 +1,138 @@
+#include <vector>
+#include <celengine/bodystate.h>
+#include <celengine/frame.h>
+#include <celmath/mathlib.h>
+#include "testsystem.h"
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+namespace
+{
+
+const double J2000 = 2451545.0;
+
+// A planet with a moon and a moon of the moon, the moons orbiting in the
+// equatorial frames of their primaries, so that positions depend on the
+// rotation models up the chain.
+class PlanetWithMoons : public TestSystem
+{
+ public:
+    PlanetWithMoons()
+    {
+        auto eclipticFrame = system->getFrameTree()->getDefaultReferenceFrame();
+        planet = addBody(system->getPlanets(), eclipticFrame, 1.5e8, 0.1, 1.0, 365.25, 1.0);
+        moon = addMoon(planet, 4.0e5, 0.3, 27.3, 3.0);
+        moonlet = addMoon(moon, 1.0e4, 0.01, 0.5, 0.2);
+    }
+
+    Body* addBody(PlanetarySystem* parent,
+                  const ReferenceFrame::SharedConstPtr& frame,
+                  double a, double e, double inclination,
+                  double period, double rotationPeriod)
+    {
+        return TestSystem::addBody(parent, frame, frame,
+                                   new EllipticalOrbit(a * (1.0 - e), e, inclination, 0.5, 1.0, 2.0,
+                                                       period, J2000),
+                                   new UniformRotationModel(rotationPeriod, 0.3f, J2000, 0.4f, 0.7f));
+    }
+
+    Body* addMoon(Body* primary, double a, double e, double period, double rotationPeriod)
+    {
+        ReferenceFrame::SharedConstPtr frame =
+            std::make_shared<BodyMeanEquatorFrame>(Selection(primary), Selection(primary));
+        return addBody(getSatellites(primary), frame, a, e, 0.2, period, rotationPeriod);
+    }
+
+    Body* planet;
+    Body* moon;
+    Body* moonlet;
+};
+
+struct BodyValues
+{
+    UniversalCoord position;
+    Eigen::Vector3d astrocentricPosition;
+    Eigen::Quaterniond orientation;
+    Eigen::Quaterniond eclipticToFrame;
+    Eigen::Quaterniond eclipticToEquatorial;
+    Eigen::Quaterniond eclipticToBodyFixed;
+    Eigen::Quaterniond equatorialToBodyFixed;
+};
+
+BodyValues GetValues(const Body* body, double t)
+{
+    return BodyValues{ body->getPosition(t),
+                       body->getAstrocentricPosition(t),
+                       body->getOrientation(t),
+                       body->getEclipticToFrame(t),
+                       body->getEclipticToEquatorial(t),
+                       body->getEclipticToBodyFixed(t),
+                       body->getEquatorialToBodyFixed(t) };
+}
+
+void CompareValues(const BodyValues& a, const BodyValues& b)
+{
+    REQUIRE(a.position.offsetFromKm(b.position).norm() < 1.0e-6);
+    REQUIRE((a.astrocentricPosition - b.astrocentricPosition).norm() < 1.0e-6);
+    REQUIRE(a.orientation.angularDistance(b.orientation) < 1.0e-12);
+    REQUIRE(a.eclipticToFrame.angularDistance(b.eclipticToFrame) < 1.0e-12);
+    REQUIRE(a.eclipticToEquatorial.angularDistance(b.eclipticToEquatorial) < 1.0e-12);
+    REQUIRE(a.eclipticToBodyFixed.angularDistance(b.eclipticToBodyFixed) < 1.0e-12);
+    REQUIRE(a.equatorialToBodyFixed.angularDistance(b.equatorialToBodyFixed) < 1.0e-12);
+}
+
+}
+
+TEST_CASE("BodyStateSnapshot", "[BodyStateSnapshot]")
+{
+    PlanetWithMoons system;
+    std::vector<Body*> bodies = { system.planet, system.moon, system.moonlet };
+
+    SECTION("Lookups give the results of direct evaluation")
+    {
+        for (double t : { J2000, J2000 + 12.345, J2000 - 1000.5 })
+        {
+            INFO("t = " << t);
+            BodyStateSnapshot::setCurrent(nullptr);
+            std::vector<BodyValues> expected;
+            for (const Body* body : bodies)
+                expected.push_back(GetValues(body, t));
+
+            BodyStateSnapshot snapshot;
+            snapshot.begin(t);
+            snapshot.evaluate(system.system->getFrameTree(), system.sun.getPosition(t));
+            REQUIRE(snapshot.getStats().bodies == bodies.size());
+
+            BodyStateSnapshot::setCurrent(&snapshot);
+            for (size_t i = 0; i < bodies.size(); i++)
+            {
+                REQUIRE(snapshot.lookup(bodies[i], t, BodyStateSnapshot::PositionQuery) != nullptr);
+                CompareValues(GetValues(bodies[i], t), expected[i]);
+            }
+            REQUIRE(snapshot.getStats().lookups > 0);
+            BodyStateSnapshot::setCurrent(nullptr);
+        }
+    }
+
+    SECTION("No lookups at other times or after a change")
+    {
+        BodyStateSnapshot snapshot;
+        snapshot.begin(J2000);
+        snapshot.evaluate(system.system->getFrameTree(), system.sun.getPosition(J2000));
+        BodyStateSnapshot::setCurrent(&snapshot);
+
+        REQUIRE(snapshot.lookup(system.moon, J2000 + 1.0, BodyStateSnapshot::PositionQuery) == nullptr);
+        system.moon->markChanged();
+        REQUIRE(BodyStateSnapshot::getCurrent() == nullptr);
+    }
+
+    SECTION("A destroyed snapshot isn't current")
+    {
+        {
+            BodyStateSnapshot snapshot;
+            BodyStateSnapshot::setCurrent(&snapshot);
+        }
+        REQUIRE(BodyStateSnapshot::getCurrent() == nullptr);
+    }
+}
@@ -0,0 +1,176 @@
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+#include <celengine/catalogcache.h>
+#include <celutil/util.h>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+namespace
+{
+
+const char* const Catalog =
+    "\"Test\" \"Sol\"\n"
+    "{\n"
+    "    Radius 1234.5\n"
+    "    Texture \"test.jpg\" # comment\n"
+    "    Color [ 1 0.5 -2e-3 ]\n"
+    "}\n";
+
+// Read all tokens as the catalog loaders would
+std::vector<Tokenizer::Token> ReadTokens(Tokenizer& tokenizer)
+{
+    std::vector<Tokenizer::Token> tokens;
+    while (tokenizer.nextToken() != Tokenizer::TokenEnd)
+    {
+        Tokenizer::Token token = { tokenizer.getTokenType(), tokenizer.getLineNumber(),
+                                   tokenizer.getNumberValue(), tokenizer.getStringValue() };
+        if (token.type != Tokenizer::TokenNumber)
+            token.number = 0.0;
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+void WriteFile(const fs::path& path, const std::string& contents)
+{
+    std::ofstream out(path.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+    out << contents;
+}
+
+// Set the modification time of a file to the given number of seconds ago
+void SetFileAge(const fs::path& path, time_t age)
+{
+    struct utimbuf times;
+    times.actime = times.modtime = time(nullptr) - age;
+    utime(path.string().c_str(), &times);
+}
+
+std::vector<Tokenizer::Token> LoadThroughCache(CatalogCache& cache, const fs::path& path,
+                                               std::istream& in)
+{
+    std::vector<Tokenizer::Token> tokens;
+    cache.load(path, in, [&](Tokenizer& tokenizer)
+    {
+        tokens = ReadTokens(tokenizer);
+        return true;
+    });
+    return tokens;
+}
+
+std::vector<Tokenizer::Token> LoadThroughCache(CatalogCache& cache, const fs::path& path)
+{
+    std::ifstream in(path.string(), std::ios::in);
+    return LoadThroughCache(cache, path, in);
+}
+
+bool SameTokens(const std::vector<Tokenizer::Token>& a, const std::vector<Tokenizer::Token>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].type != b[i].type || a[i].line != b[i].line ||
+            a[i].number != b[i].number || a[i].text != b[i].text)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+TEST_CASE("CatalogCache", "[CatalogCache]")
+{
+    fs::path testDir = fs::temp_directory_path() / "celestia_catalogcache_test";
+    fs::remove_all(testDir);
+    REQUIRE(MakeDirectories(testDir));
+    fs::path dir = testDir / "cache";
+    fs::path file = testDir / "catalog.ssc";
+    WriteFile(file, Catalog);
+
+    std::istringstream text(Catalog);
+    Tokenizer tokenizer(&text);
+    auto expected = ReadTokens(tokenizer);
+    REQUIRE(expected.size() == 14);
+
+    SECTION("Replays cached tokens")
+    {
+        CatalogCache cache(dir);
+        cache.setRebuild(true);
+        REQUIRE(SameTokens(LoadThroughCache(cache, file), expected));
+        REQUIRE(cache.getStats().misses == 1);
+        REQUIRE(cache.getStats().stored == 1);
+
+        CatalogCache cache2(dir);
+        REQUIRE(SameTokens(LoadThroughCache(cache2, file), expected));
+        REQUIRE(cache2.getStats().hits == 1);
+        REQUIRE(cache2.getStats().misses == 0);
+    }
+
+    SECTION("Changed files are parsed again")
+    {
+        CatalogCache cache(dir);
+        LoadThroughCache(cache, file);
+
+        std::string changed(Catalog);
+        changed.replace(changed.find("1234.5"), 6, "4321.5");
+        WriteFile(file, changed);
+
+        CatalogCache cache2(dir);
+        auto tokens = LoadThroughCache(cache2, file);
+        REQUIRE(cache2.getStats().misses == 1);
+        REQUIRE(tokens.size() == expected.size());
+        REQUIRE(tokens[4].number == 4321.5);
+    }
+
+    SECTION("Files with an unchanged time stamp and size aren't read")
+    {
+        SetFileAge(file, 3600);
+        CatalogCache cache(dir);
+        cache.setRebuild(true);
+        LoadThroughCache(cache, file);
+
+        CatalogCache cache2(dir);
+        std::istringstream empty;
+        REQUIRE(SameTokens(LoadThroughCache(cache2, file, empty), expected));
+        REQUIRE(cache2.getStats().hits == 1);
+    }
+
+    SECTION("Touched files with unchanged contents use the cache")
+    {
+        SetFileAge(file, 3600);
+        CatalogCache cache(dir);
+        cache.setRebuild(true);
+        LoadThroughCache(cache, file);
+
+        SetFileAge(file, 1800);
+        CatalogCache cache2(dir);
+        REQUIRE(SameTokens(LoadThroughCache(cache2, file), expected));
+        REQUIRE(cache2.getStats().hits == 1);
+
+        // The entry now has the new time stamp
+        CatalogCache cache3(dir);
+        std::istringstream empty;
+        REQUIRE(SameTokens(LoadThroughCache(cache3, file, empty), expected));
+        REQUIRE(cache3.getStats().hits == 1);
+    }
+
+    SECTION("Disabled cache")
+    {
+        CatalogCache cache{ fs::path() };
+        REQUIRE(SameTokens(LoadThroughCache(cache, file), expected));
+        REQUIRE(cache.getStats().stored == 0);
+    }
+
+    fs::remove_all(testDir);
+}
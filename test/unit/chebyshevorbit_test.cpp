@@ -0,0 +1,114 @@
+#include <fstream>
+#include <memory>
+#include <random>
+#include <celephem/chebyshevorbit.h>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+namespace
+{
+
+constexpr double J2000 = 2451545.0;
+constexpr double Tolerance = 1.0e-3; // km
+
+// An eccentric orbit with a period of 30 days
+EllipticalOrbit MakeOrbit()
+{
+    return EllipticalOrbit(2.0e6, 0.4, 0.3, 1.0, 2.0, 0.5, 30.0, J2000);
+}
+
+std::unique_ptr<Orbit> MakeCachedOrbit()
+{
+    return std::unique_ptr<Orbit>(new EllipticalOrbit(MakeOrbit()));
+}
+
+}
+
+
+TEST_CASE("ChebyshevOrbitCache", "[ChebyshevOrbitCache]")
+{
+    EllipticalOrbit orbit = MakeOrbit();
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<double> dist(J2000 - 100.0, J2000 + 100.0);
+
+    fs::path cacheDir = fs::temp_directory_path() / "celestia_chebyshevorbit_test";
+    fs::remove_all(cacheDir);
+
+    SECTION("Fits stay within the tolerance")
+    {
+        ChebyshevOrbitCache cache(MakeCachedOrbit(), Tolerance);
+        for (int i = 0; i < 2000; i++)
+        {
+            double t = dist(gen);
+            INFO("t = " << t);
+            REQUIRE((cache.positionAtTime(t) - orbit.positionAtTime(t)).norm() < Tolerance);
+            Eigen::Vector3d v = orbit.velocityAtTime(t);
+            REQUIRE((cache.velocityAtTime(t) - v).norm() < 1.0e-4 * v.norm());
+        }
+
+        // 200 days in spans of 30/8 days
+        auto stats = cache.getStats();
+        REQUIRE(stats.spansFitted >= 53);
+        REQUIRE(stats.spansFitted <= 55);
+        REQUIRE(stats.segments > stats.spansFitted);
+
+        cache.positionAtTime(J2000);
+        REQUIRE(cache.getStats().orbitEvaluations == stats.orbitEvaluations);
+        REQUIRE(cache.isChebyshevApproximation());
+        REQUIRE(!orbit.isChebyshevApproximation());
+    }
+
+    SECTION("Fits are reused from disk")
+    {
+        ChebyshevOrbitCache::setCacheDirectory(cacheDir);
+
+        std::vector<double> times;
+        for (int i = 0; i < 100; i++)
+            times.push_back(dist(gen));
+
+        std::vector<Eigen::Vector3d> positions;
+        {
+            ChebyshevOrbitCache cache(MakeCachedOrbit(), Tolerance, "test orbit");
+            for (double t : times)
+                positions.push_back(cache.positionAtTime(t));
+            REQUIRE(cache.getStats().spansLoaded == 0);
+        }
+
+        ChebyshevOrbitCache cache(MakeCachedOrbit(), Tolerance, "test orbit");
+        REQUIRE(cache.getStats().spansLoaded > 0);
+        for (size_t i = 0; i < times.size(); i++)
+            REQUIRE(cache.positionAtTime(times[i]) == positions[i]);
+        REQUIRE(cache.getStats().spansFitted == 0);
+        REQUIRE(cache.getStats().orbitEvaluations == 0);
+    }
+
+    SECTION("Files with an impossible segment count are discarded")
+    {
+        ChebyshevOrbitCache::setCacheDirectory(cacheDir);
+        fs::path cacheFile;
+        {
+            ChebyshevOrbitCache cache(MakeCachedOrbit(), Tolerance, "test orbit");
+            cacheFile = cache.getCacheFile();
+            cache.positionAtTime(J2000);
+        }
+        REQUIRE(fs::exists(cacheFile));
+
+        // The segment count of the first record follows the header and the
+        // span index.
+        {
+            std::fstream file(cacheFile.string(), std::ios::in | std::ios::out | std::ios::binary);
+            uint32_t nSegments = 0xffffffff;
+            file.seekp(8 + 3 * sizeof(uint32_t) + sizeof(double) + sizeof(int64_t));
+            file.write(reinterpret_cast<const char*>(&nSegments), sizeof(nSegments));
+            REQUIRE(file.good());
+        }
+
+        ChebyshevOrbitCache cache(MakeCachedOrbit(), Tolerance, "test orbit");
+        REQUIRE(cache.getStats().spansLoaded == 0);
+        REQUIRE((cache.positionAtTime(J2000) - orbit.positionAtTime(J2000)).norm() < Tolerance);
+    }
+
+    ChebyshevOrbitCache::setCacheDirectory(fs::path());
+    fs::remove_all(cacheDir);
+}
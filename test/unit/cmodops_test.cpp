@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <random>
+#include <vector>
+#include <celmodel/model.h>
+#include <tools/cmod/common/cmodops.h>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+using namespace cmod;
+
+namespace
+{
+
+typedef std::array<float, 3> Position;
+typedef std::array<Position, 3> Triangle;
+
+// A model of a grid of size * size quads, as a list of triangles in random
+// order with three vertices of their own each.
+std::unique_ptr<Model> ShuffledGrid(unsigned int size)
+{
+    std::vector<Triangle> triangles;
+    for (unsigned int i = 0; i < size; i++)
+    {
+        for (unsigned int j = 0; j < size; j++)
+        {
+            Position p00{ (float) i, (float) j, 0.0f };
+            Position p01{ (float) i, (float) j + 1, 0.0f };
+            Position p10{ (float) i + 1, (float) j, 0.0f };
+            Position p11{ (float) i + 1, (float) j + 1, 0.0f };
+            triangles.push_back({ p00, p10, p01 });
+            triangles.push_back({ p01, p10, p11 });
+        }
+    }
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1234));
+
+    auto nVertices = (unsigned int) triangles.size() * 3;
+    auto* vertices = new char[nVertices * 12];
+    auto* indices = new Mesh::index32[nVertices];
+    for (unsigned int i = 0; i < nVertices; i++)
+    {
+        std::copy_n(triangles[i / 3][i % 3].data(), 3, reinterpret_cast<float*>(vertices) + i * 3);
+        indices[i] = i;
+    }
+
+    Mesh::VertexAttribute position(Mesh::Position, Mesh::Float3, 0);
+    auto* mesh = new Mesh();
+    mesh->setVertexDescription(Mesh::VertexDescription(12, 1, &position));
+    mesh->setVertices(nVertices, vertices);
+    mesh->addGroup(Mesh::TriList, 0, nVertices, indices);
+
+    std::unique_ptr<Model> model(new Model());
+    model->addMesh(mesh);
+    return model;
+}
+
+// The triangles of a mesh by vertex positions, each starting at its least
+// vertex, in order.
+std::vector<Triangle> SortedTriangles(const Mesh& mesh)
+{
+    const auto* vertices = reinterpret_cast<const float*>(mesh.getVertexData());
+    const Mesh::PrimitiveGroup* group = mesh.getGroup(0);
+    std::vector<Triangle> triangles;
+    for (unsigned int i = 0; i < group->nIndices; i += 3)
+    {
+        Triangle t;
+        for (unsigned int k = 0; k < 3; k++)
+            std::copy_n(vertices + group->indices[i + k] * 3, 3, t[k].data());
+        std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+        triangles.push_back(t);
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+}
+
+TEST_CASE("Mesh vertex and triangle reordering", "[cmodops]")
+{
+    auto model = ShuffledGrid(50);
+    Mesh* mesh = model->getMesh(0);
+    std::vector<Triangle> triangles = SortedTriangles(*mesh);
+
+    SECTION("Identical vertices are merged, in the order they appear")
+    {
+        REQUIRE(UniquifyVertices(*mesh));
+        REQUIRE(mesh->getVertexCount() == 51 * 51);
+        REQUIRE(SortedTriangles(*mesh) == triangles);
+
+        const Mesh::PrimitiveGroup* group = mesh->getGroup(0);
+        Mesh::index32 next = 0;
+        for (unsigned int i = 0; i < group->nIndices; i++)
+        {
+            REQUIRE(group->indices[i] <= next);
+            if (group->indices[i] == next)
+                next++;
+        }
+    }
+
+    SECTION("Reordering for the cache keeps the triangles and cuts misses")
+    {
+        REQUIRE(UniquifyVertices(*mesh));
+        double before = AverageCacheMissRatio(*model, 16);
+        REQUIRE(OptimizeVertexCache(*mesh));
+        double after = AverageCacheMissRatio(*model, 16);
+        REQUIRE(SortedTriangles(*mesh) == triangles);
+        REQUIRE(before > 2.0);
+        REQUIRE(after < 0.8);
+    }
+
+    SECTION("Vertices are fetched in the order they are used")
+    {
+        REQUIRE(UniquifyVertices(*mesh));
+        REQUIRE(OptimizeVertexCache(*mesh));
+        REQUIRE(OptimizeVertexFetch(*mesh));
+        REQUIRE(SortedTriangles(*mesh) == triangles);
+
+        const Mesh::PrimitiveGroup* group = mesh->getGroup(0);
+        Mesh::index32 next = 0;
+        for (unsigned int i = 0; i < group->nIndices; i++)
+        {
+            REQUIRE(group->indices[i] <= next);
+            if (group->indices[i] == next)
+                next++;
+        }
+        REQUIRE(next == mesh->getVertexCount());
+    }
+}
+
+TEST_CASE("Average cache miss ratio", "[cmodops]")
+{
+    // The index lists aren't owned by meshes
+    Mesh::index32 list[] = { 0, 1, 2, 2, 1, 3, 0, 1, 2 };
+    Mesh::index32 strip[] = { 0, 1, 2, 3 };
+    Mesh::VertexAttribute position(Mesh::Position, Mesh::Float3, 0);
+
+    auto* mesh = new Mesh();
+    mesh->setVertexDescription(Mesh::VertexDescription(12, 1, &position));
+    mesh->setVertices(4, new char[4 * 12]);
+    mesh->addGroup(Mesh::TriList, 0, 9, list);
+    Model model;
+    model.addMesh(mesh);
+
+    // With room for three vertices, those of the third triangle are gone
+    REQUIRE(AverageCacheMissRatio(model, 3) == Approx(7.0 / 3.0));
+    REQUIRE(AverageCacheMissRatio(model, 4) == Approx(4.0 / 3.0));
+
+    // The cache starts empty for each group
+    mesh->addGroup(Mesh::TriStrip, 0, 4, strip);
+    REQUIRE(AverageCacheMissRatio(model, 4) == Approx(8.0 / 5.0));
+}
+
+TEST_CASE("Mesh reordering benchmark", "[.][benchmark]")
+{
+    // 500k triangles
+    BENCHMARK_ADVANCED("Merge vertices of 500k triangles")(Catch::Benchmark::Chronometer meter)
+    {
+        std::vector<std::unique_ptr<Model>> models;
+        for (int i = 0; i < meter.runs(); i++)
+            models.push_back(ShuffledGrid(500));
+        meter.measure([&](int i) { return UniquifyVertices(*models[i]->getMesh(0)); });
+    };
+
+    BENCHMARK_ADVANCED("Reorder 500k triangles for the vertex cache")(Catch::Benchmark::Chronometer meter)
+    {
+        std::vector<std::unique_ptr<Model>> models;
+        for (int i = 0; i < meter.runs(); i++)
+        {
+            models.push_back(ShuffledGrid(500));
+            UniquifyVertices(*models.back()->getMesh(0));
+        }
+        meter.measure([&](int i) { return OptimizeVertexCache(*models[i]->getMesh(0)); });
+    };
+}
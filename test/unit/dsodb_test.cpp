@@ -0,0 +1,228 @@
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <celengine/dsodb.h>
+#include <celengine/galaxy.h>
+#include <celengine/globular.h>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+namespace
+{
+
+const char Catalog[] =
+    "Galaxy \"NGC 100:Test Galaxy\"\n"
+    "{ Type \"Sb\" RA 1.0 Dec 20.0 Distance 3.0e7 Radius 5.0e4 AbsMag -20.5\n"
+    "  Axis [0 1 0] Angle 30 InfoURL \"http://example.com/ngc100\" }\n"
+    "Globular \"Test Globular\"\n"
+    "{ RA 10.0 Dec -40.0 Distance 1.5e4 Radius 100 CoreRadius 0.5\n"
+    "  KingConcentration 1.8 AbsMag -8.0 }\n"
+    "Globular \"Plain Globular\" { RA 11.0 Dec -41.0 Distance 2.0e4 Radius 90 }\n"
+    "OpenCluster \"Test Cluster\"\n"
+    "{ RA 5.0 Dec 10.0 Distance 1.0e3 Radius 10 Clickable false Visible false }\n"
+    "Nebula \"Test Nebula\" { RA 5.5 Dec -5.0 Distance 1.3e3 Radius 12 Mesh \"nebula.cms\" }\n";
+
+std::unique_ptr<DSODatabase> LoadText(const std::string& catalog)
+{
+    std::unique_ptr<DSODatabase> db(new DSODatabase());
+    db->setNameDatabase(new DSONameDatabase());
+    std::istringstream in(catalog);
+    REQUIRE(db->load(in));
+    return db;
+}
+
+std::string WriteBinary(const std::string& catalog)
+{
+    auto db = LoadText(catalog);
+    db->finish();
+    std::ostringstream out(std::ios::out | std::ios::binary);
+    REQUIRE(db->writeBinary(out));
+    return out.str();
+}
+
+std::unique_ptr<DSODatabase> LoadBinary(const std::string& binary)
+{
+    std::unique_ptr<DSODatabase> db(new DSODatabase());
+    db->setNameDatabase(new DSONameDatabase());
+    std::istringstream in(binary, std::ios::in | std::ios::binary);
+    REQUIRE(db->loadBinary(in));
+    return db;
+}
+
+// Collects the catalog numbers of the objects handed out by the octree
+class CountingHandler : public DSOHandler
+{
+ public:
+    void process(DeepSkyObject* const & dso, double, float) override
+    {
+        count++;
+        sum += dso->getIndex();
+    }
+
+    unsigned int count{ 0 };
+    uint64_t sum{ 0 };
+};
+
+std::string GalaxyCatalog(unsigned int count)
+{
+    std::ostringstream out;
+    char buf[256];
+    for (unsigned int i = 0; i < count; i++)
+    {
+        double ra = (i * 7919 % 86400) / 3600.0;
+        double dec = (i * 104729 % 18000) / 100.0 - 90.0;
+        double distance = 1.0e6 + (i * 15485863ull % 1000000000ull) * 10.0;
+        std::snprintf(buf, sizeof(buf),
+                      "Galaxy \"PGC %u\"\n{ Type \"Sc\" RA %.4f Dec %.4f Distance %.4e"
+                      " Radius 3.0e4 Axis [0 0.7071 0.7071] Angle 45 AbsMag -19.5 }\n",
+                      i + 1, ra, dec, distance);
+        out << buf;
+    }
+    return out.str();
+}
+
+}
+
+TEST_CASE("Binary deep sky catalog", "[DSODatabase]")
+{
+    auto text = LoadText(Catalog);
+    text->finish();
+    auto binary = LoadBinary(WriteBinary(Catalog));
+    binary->finish();
+
+    REQUIRE(binary->size() == text->size());
+
+    SECTION("Objects keep their parameters")
+    {
+        for (uint32_t i = 0; i < text->size(); i++)
+        {
+            const DeepSkyObject* expected = text->getDSO(i);
+            const DeepSkyObject* obj = binary->find(expected->getIndex());
+            REQUIRE(obj != nullptr);
+            REQUIRE(std::string(obj->getObjTypeName()) == expected->getObjTypeName());
+            REQUIRE(std::string(obj->getType()) == expected->getType());
+            REQUIRE(obj->getPosition() == expected->getPosition());
+            REQUIRE(obj->getOrientation().coeffs() == expected->getOrientation().coeffs());
+            REQUIRE(obj->getRadius() == expected->getRadius());
+            REQUIRE(obj->getAbsoluteMagnitude() == expected->getAbsoluteMagnitude());
+            REQUIRE(obj->getInfoURL() == expected->getInfoURL());
+            REQUIRE(obj->isVisible() == expected->isVisible());
+            REQUIRE(obj->isClickable() == expected->isClickable());
+            REQUIRE(binary->getDSONameList(obj) == text->getDSONameList(expected));
+        }
+
+        auto globular = dynamic_cast<const Globular*>(binary->find("Test Globular"));
+        auto expected = dynamic_cast<const Globular*>(text->find("Test Globular"));
+        REQUIRE(globular != nullptr);
+        REQUIRE(globular->getCoreRadius() == expected->getCoreRadius());
+        REQUIRE(globular->getConcentration() == 1.8f);
+        REQUIRE(globular->getForm() != nullptr);
+
+        auto plain = dynamic_cast<const Globular*>(binary->find("Plain Globular"));
+        REQUIRE(plain != nullptr);
+        REQUIRE(plain->getForm() == nullptr);
+    }
+
+    SECTION("Names are found")
+    {
+        REQUIRE(binary->find("Test Galaxy") == binary->find(text->find("Test Galaxy")->getIndex()));
+        REQUIRE(binary->find("NGC 100") != nullptr);
+        REQUIRE(binary->find("Test Globular")->getIndex() == text->find("Test Globular")->getIndex());
+    }
+
+    SECTION("The restored octree holds every object")
+    {
+        CountingHandler expected, restored;
+        text->findCloseDSOs(expected, Eigen::Vector3d::Zero(), 1.0e10f);
+        binary->findCloseDSOs(restored, Eigen::Vector3d::Zero(), 1.0e10f);
+        REQUIRE(restored.count == text->size());
+        REQUIRE(restored.sum == expected.sum);
+    }
+
+    SECTION("Written again, the catalog is unchanged")
+    {
+        std::ostringstream out(std::ios::out | std::ios::binary);
+        REQUIRE(binary->writeBinary(out));
+        REQUIRE(out.str() == WriteBinary(Catalog));
+    }
+}
+
+TEST_CASE("Text catalogs after a binary one", "[DSODatabase]")
+{
+    auto db = LoadBinary(WriteBinary(Catalog));
+    std::istringstream in("OpenCluster \"Added Cluster\" { RA 1.0 Dec 1.0 Distance 500 Radius 5 }\n");
+    REQUIRE(db->load(in));
+    db->finish();
+
+    REQUIRE(db->size() == 6);
+    const DeepSkyObject* added = db->find("Added Cluster");
+    REQUIRE(added != nullptr);
+    REQUIRE(added != db->find("Test Globular"));
+
+    CountingHandler handler;
+    db->findCloseDSOs(handler, Eigen::Vector3d::Zero(), 1.0e10f);
+    REQUIRE(handler.count == 6);
+
+    // Only a database in a single octree can be written
+    std::ostringstream out(std::ios::out | std::ios::binary);
+    REQUIRE_FALSE(db->writeBinary(out));
+}
+
+TEST_CASE("A binary catalog after a text one", "[DSODatabase]")
+{
+    auto db = LoadText("OpenCluster \"Added Cluster\" { RA 1.0 Dec 1.0 Distance 500 Radius 5 }\n");
+    std::string binary = WriteBinary(Catalog);
+    std::istringstream in(binary, std::ios::in | std::ios::binary);
+    REQUIRE(db->loadBinary(in));
+    db->finish();
+
+    REQUIRE(db->size() == 6);
+    std::set<AstroCatalog::IndexNumber> numbers;
+    for (uint32_t i = 0; i < db->size(); i++)
+        numbers.insert(db->getDSO(i)->getIndex());
+    REQUIRE(numbers.size() == 6);
+    REQUIRE(db->find("Added Cluster") != db->find("Test Galaxy"));
+    REQUIRE(db->getDSONameList(db->find("Test Galaxy")) == "NGC 100 / Test Galaxy");
+}
+
+TEST_CASE("Bad binary deep sky catalogs", "[DSODatabase]")
+{
+    std::string binary = WriteBinary(Catalog);
+    DSODatabase db;
+
+    std::string truncated = binary.substr(0, binary.size() - 1);
+    std::istringstream in1(truncated, std::ios::in | std::ios::binary);
+    REQUIRE_FALSE(db.loadBinary(in1));
+
+    std::string badVersion = binary;
+    badVersion[8] = 0x7f;
+    std::istringstream in2(badVersion, std::ios::in | std::ios::binary);
+    REQUIRE_FALSE(db.loadBinary(in2));
+
+    REQUIRE(db.size() == 0);
+}
+
+TEST_CASE("Deep sky catalog benchmark", "[.][benchmark]")
+{
+    std::string catalog = GalaxyCatalog(200000);
+    std::string binary = WriteBinary(catalog);
+
+    BENCHMARK("Load 200k galaxies from text")
+    {
+        auto db = LoadText(catalog);
+        db->finish();
+        return db->size();
+    };
+
+    BENCHMARK("Load 200k galaxies from binary")
+    {
+        auto db = LoadBinary(binary);
+        db->finish();
+        return db->size();
+    };
+}
@@ -0,0 +1,257 @@
+#include <cmath>
+#include <memory>
+#include <vector>
+#include <celestia/eclipsefinder.h>
+#include <celmath/mathlib.h>
+#include "testsystem.h"
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+namespace
+{
+
+const double J2000 = 2451545.0;
+const double OneMinute = 1.0 / 1440.0;
+
+// A star with planets and moons on elliptical orbits, in frames that
+// allow searches on several threads.
+class PlanetsAndMoons : public TestSystem
+{
+ public:
+    Body* addBody(PlanetarySystem* parent, const ReferenceFrame::SharedConstPtr& frame,
+                  int classification, float radius,
+                  double a, double e, double inclination, double node,
+                  double period, double meanAnomaly)
+    {
+        auto* orbit = new EllipticalOrbit(a * (1.0 - e), e,
+                                          celmath::degToRad(inclination),
+                                          celmath::degToRad(node),
+                                          0.0,
+                                          celmath::degToRad(meanAnomaly),
+                                          period, J2000);
+        auto* rotation = new ConstantOrientation(Eigen::Quaterniond::Identity());
+        Body* body = TestSystem::addBody(parent, frame, frame, orbit, rotation);
+        body->setClassification(classification);
+        body->setSemiAxes(Eigen::Vector3f::Constant(radius));
+        return body;
+    }
+
+    Body* addPlanet(float radius, double a, double period)
+    {
+        return addBody(system->getPlanets(),
+                       system->getFrameTree()->getDefaultReferenceFrame(),
+                       Body::Planet, radius, a, 0.02, 0.0, 0.0, period, 0.0);
+    }
+
+    Body* addMoon(Body* planet, float radius, double a, double e,
+                  double inclination, double node, double period, double meanAnomaly)
+    {
+        return addBody(getSatellites(planet),
+                       planet->getOrCreateFrameTree()->getDefaultReferenceFrame(),
+                       Body::Moon, radius, a, e, inclination, node, period, meanAnomaly);
+    }
+};
+
+// The search used before: hourly steps, and one minute steps to the
+// start and end of each eclipse found.
+std::vector<Eclipse> SteppingSearch(Body* body, double startDate, double endDate)
+{
+    std::vector<Eclipse> eclipses;
+    PlanetarySystem* satellites = body->getSatellites();
+    std::vector<double> previousEndTimes(satellites->getSystemSize(), startDate - 1.0);
+    for (double t = startDate; t <= endDate; t += 1.0 / 24.0)
+    {
+        for (int i = 0; i < satellites->getSystemSize(); i++)
+        {
+            if (t <= previousEndTimes[i])
+                continue;
+
+            Body* satellite = satellites->getBody(i);
+            Body* receivers[] = { body, satellite };
+            Body* casters[] = { satellite, body };
+            for (int j = 0; j < 2; j++)
+            {
+                if (!testEclipse(*receivers[j], *casters[j], t))
+                    continue;
+
+                Eclipse eclipse;
+                eclipse.receiver = receivers[j];
+                eclipse.occulter = casters[j];
+                eclipse.startTime = t;
+                while (testEclipse(*receivers[j], *casters[j], eclipse.startTime))
+                    eclipse.startTime -= OneMinute;
+                eclipse.endTime = t;
+                while (testEclipse(*receivers[j], *casters[j], eclipse.endTime))
+                    eclipse.endTime += OneMinute;
+                eclipses.push_back(eclipse);
+                previousEndTimes[i] = eclipse.endTime;
+            }
+        }
+    }
+    return eclipses;
+}
+
+// Every eclipse the stepping search finds is found within its precision;
+// the others are too short for hourly steps.
+void CompareEclipses(const std::vector<Eclipse>& found, const std::vector<Eclipse>& expected)
+{
+    REQUIRE(!expected.empty());
+    std::vector<bool> matched(found.size(), false);
+    for (const auto& e : expected)
+    {
+        INFO("Eclipse at " << e.startTime);
+        bool match = false;
+        for (size_t i = 0; i < found.size(); i++)
+        {
+            if (found[i].receiver == e.receiver && found[i].occulter == e.occulter &&
+                std::abs(found[i].startTime - e.startTime) < OneMinute * 1.1 &&
+                std::abs(found[i].endTime - e.endTime) < OneMinute * 1.1)
+            {
+                match = !matched[i];
+                matched[i] = true;
+                break;
+            }
+        }
+        REQUIRE(match);
+    }
+
+    for (size_t i = 0; i < found.size(); i++)
+    {
+        if (!matched[i])
+            REQUIRE(found[i].endTime - found[i].startTime < 1.0 / 24.0);
+    }
+}
+
+class CountingWatcher : public EclipseFinderWatcher
+{
+ public:
+    explicit CountingWatcher(bool _abort = false) : abort(_abort) {}
+
+    Status eclipseFinderProgressUpdate(double t) override
+    {
+        REQUIRE(t >= lastProgress);
+        lastProgress = t;
+        updates++;
+        return abort ? AbortOperation : ContinueOperation;
+    }
+
+    void eclipseFinderEclipseFound(const Eclipse& eclipse) override
+    {
+        found.push_back(eclipse);
+    }
+
+    bool abort;
+    double lastProgress{ -1.0e30 };
+    int updates{ 0 };
+    std::vector<Eclipse> found;
+};
+
+}
+
+TEST_CASE("Eclipses of a planet and its moon", "[EclipseFinder]")
+{
+    PlanetsAndMoons system;
+    Body* earth = system.addPlanet(6378.0f, 1.496e8, 365.25);
+    system.addMoon(earth, 1737.0f, 384400.0, 0.0549, 5.145, 125.0, 27.3217, 135.0);
+
+    double startDate = J2000;
+    double endDate = J2000 + 3 * 365.25;
+    std::vector<Eclipse> expected = SteppingSearch(earth, startDate, endDate);
+
+    SECTION("The stepping search results are found")
+    {
+        EclipseFinder finder(earth);
+        std::vector<Eclipse> eclipses;
+        finder.findEclipses(startDate, endDate, Eclipse::Solar | Eclipse::Lunar, eclipses);
+        CompareEclipses(eclipses, expected);
+    }
+
+    SECTION("Eclipses are reported to the watcher as they're found")
+    {
+        CountingWatcher watcher;
+        EclipseFinder finder(earth, &watcher);
+        std::vector<Eclipse> eclipses;
+        finder.findEclipses(startDate, endDate, Eclipse::Solar, eclipses);
+        REQUIRE(watcher.updates > 0);
+        REQUIRE(watcher.found.size() == eclipses.size());
+        for (const auto& eclipse : eclipses)
+            REQUIRE(eclipse.receiver == earth);
+    }
+
+    SECTION("The search stops when the watcher asks")
+    {
+        CountingWatcher watcher(true);
+        EclipseFinder finder(earth, &watcher);
+        std::vector<Eclipse> eclipses;
+        finder.findEclipses(startDate, endDate, Eclipse::Solar | Eclipse::Lunar, eclipses);
+        REQUIRE(watcher.updates == 1);
+        REQUIRE(eclipses.empty());
+    }
+
+    SECTION("Start and end times have the requested precision")
+    {
+        const double precision = 1.0e-6;
+        EclipseFinder finder(earth);
+        finder.setPrecision(precision);
+        std::vector<Eclipse> eclipses;
+        finder.findEclipses(startDate, endDate, Eclipse::Lunar, eclipses);
+        REQUIRE(!eclipses.empty());
+        for (const auto& e : eclipses)
+        {
+            REQUIRE(!testEclipse(*e.receiver, *e.occulter, e.startTime));
+            REQUIRE(testEclipse(*e.receiver, *e.occulter, e.startTime + precision));
+            REQUIRE(!testEclipse(*e.receiver, *e.occulter, e.endTime));
+            REQUIRE(testEclipse(*e.receiver, *e.occulter, e.endTime - precision));
+        }
+    }
+}
+
+TEST_CASE("Eclipses of a planet with several moons", "[EclipseFinder]")
+{
+    PlanetsAndMoons system;
+    Body* jupiter = system.addPlanet(71492.0f, 7.785e8, 4332.59);
+    system.addMoon(jupiter, 1821.0f, 421700.0, 0.004, 0.05, 40.0, 1.769, 10.0);
+    system.addMoon(jupiter, 1560.0f, 671034.0, 0.009, 0.47, 200.0, 3.551, 100.0);
+    system.addMoon(jupiter, 2634.0f, 1070412.0, 0.001, 0.2, 300.0, 7.155, 200.0);
+    system.addMoon(jupiter, 2410.0f, 1882709.0, 0.007, 0.2, 20.0, 16.689, 300.0);
+
+    double startDate = J2000 + 1000.0;
+    double endDate = startDate + 90.0;
+    EclipseFinder finder(jupiter);
+    std::vector<Eclipse> eclipses;
+    finder.findEclipses(startDate, endDate, Eclipse::Solar | Eclipse::Lunar, eclipses);
+    CompareEclipses(eclipses, SteppingSearch(jupiter, startDate, endDate));
+}
+
+TEST_CASE("Eclipse search benchmark", "[.][benchmark]")
+{
+    PlanetsAndMoons system;
+    Body* jupiter = system.addPlanet(71492.0f, 7.785e8, 4332.59);
+    system.addMoon(jupiter, 1821.0f, 421700.0, 0.004, 0.05, 40.0, 1.769, 10.0);
+    system.addMoon(jupiter, 1560.0f, 671034.0, 0.009, 0.47, 200.0, 3.551, 100.0);
+    system.addMoon(jupiter, 2634.0f, 1070412.0, 0.001, 0.2, 300.0, 7.155, 200.0);
+    system.addMoon(jupiter, 2410.0f, 1882709.0, 0.007, 0.2, 20.0, 16.689, 300.0);
+
+    BENCHMARK("Stepping search of Jupiter's moons, 10 years")
+    {
+        return SteppingSearch(jupiter, J2000, J2000 + 3652.5).size();
+    };
+
+    BENCHMARK("Search of Jupiter's moons, 10 years")
+    {
+        EclipseFinder finder(jupiter);
+        std::vector<Eclipse> eclipses;
+        finder.findEclipses(J2000, J2000 + 3652.5, Eclipse::Solar | Eclipse::Lunar, eclipses);
+        return eclipses.size();
+    };
+
+    BENCHMARK("Search of Jupiter's moons, 100 years")
+    {
+        EclipseFinder finder(jupiter);
+        std::vector<Eclipse> eclipses;
+        finder.findEclipses(J2000, J2000 + 36525.0, Eclipse::Solar | Eclipse::Lunar, eclipses);
+        return eclipses.size();
+    };
+}
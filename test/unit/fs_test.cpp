@@ -1,3 +1,4 @@
+#include <fstream>
 #if 1
 #include <celcompat/fs.h>
 namespace fs = celestia::filesystem;
@@ -53,4 +54,17 @@ TEST_CASE("filesystem", "[filesystem]")
         REQUIRE(fs::path(L"c:\\foo\\bar.txt") == "c:/foo/bar.txt");
 #endif
     }
+
+    SECTION("fs::temp_directory_path() and fs::remove_all()")
+    {
+        fs::path dir = fs::temp_directory_path();
+        REQUIRE(fs::is_directory(dir));
+
+        fs::path file = dir / "celestia_fs_test.txt";
+        std::ofstream(file.string()) << "test";
+        REQUIRE(fs::exists(file));
+        REQUIRE(fs::remove_all(file) == 1);
+        REQUIRE(!fs::exists(file));
+        REQUIRE(fs::remove_all(file) == 0);
+    }
 }
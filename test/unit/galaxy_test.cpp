@@ -0,0 +1,94 @@
+#include <cmath>
+#include <random>
+#include <vector>
+#include <celengine/galaxy.h>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+namespace
+{
+
+// Irregular galaxies, whose form is built without the templates in models/
+std::vector<Galaxy*> RandomGalaxies(size_t count)
+{
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> coord(-1.0e6f, 1.0e6f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> radius(1.0e3f, 5.0e4f);
+
+    std::vector<Galaxy*> galaxies;
+    galaxies.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        auto* galaxy = new Galaxy();
+        galaxy->setType("Irr");
+        galaxy->setPosition(Eigen::Vector3d(coord(gen), coord(gen), coord(gen)));
+        galaxy->setOrientation(Eigen::Quaternionf(unit(gen), unit(gen), unit(gen), unit(gen)).normalized());
+        galaxy->setRadius(radius(gen));
+        galaxies.push_back(galaxy);
+    }
+    return galaxies;
+}
+
+}
+
+TEST_CASE("Galaxy instances", "[Galaxy]")
+{
+    Galaxy galaxy;
+    galaxy.setType("Irr");
+    REQUIRE(galaxy.getForm() != nullptr);
+    galaxy.setRadius(10.0f);
+    galaxy.setDetail(0.5f);
+    Galaxy::setLightGain(0.0f);
+
+    SECTION("Instance parameters")
+    {
+        GalaxyInstance instance;
+        REQUIRE(galaxy.getInstance(Eigen::Vector3f(0.0f, 0.0f, -1000.0f), 0.5f, 0.001f, instance));
+
+        REQUIRE(instance.offset[2] == -1000.0f);
+        REQUIRE(instance.size == 20.0f);
+        REQUIRE(instance.minimumFeatureSize == Approx(0.99f));
+        REQUIRE(instance.blobCount == Approx(1750.0f));
+
+        // Irregular forms are scaled by half, and the correction for an
+        // edge-on view bottoms out at 0.45
+        REQUIRE(instance.alphaScale == Approx(5.0f * 0.45f * 0.5f));
+        REQUIRE(instance.axes[0] == Approx(10.0f));
+        REQUIRE(instance.axes[4] == Approx(10.0f));
+        REQUIRE(instance.axes[8] == Approx(10.0f));
+        REQUIRE(instance.axes[1] == Approx(0.0f).margin(1.0e-6));
+    }
+
+    SECTION("Galaxies smaller than a pixel have no instance")
+    {
+        GalaxyInstance instance;
+        REQUIRE(!galaxy.getInstance(Eigen::Vector3f(0.0f, 0.0f, -1.0e6f), 0.5f, 0.01f, instance));
+    }
+}
+
+TEST_CASE("Galaxy instance benchmark", "[.][benchmark]")
+{
+    auto galaxies = RandomGalaxies(100000);
+    std::vector<GalaxyInstance> instances;
+    instances.reserve(galaxies.size());
+    Eigen::Vector3d observer(1.0e3, -2.0e3, 5.0e2);
+
+    BENCHMARK("Instances of 100k galaxies")
+    {
+        instances.clear();
+        GalaxyInstance instance;
+        for (const auto* galaxy : galaxies)
+        {
+            Eigen::Vector3f offset = (galaxy->getPosition() - observer).cast<float>();
+            if (galaxy->getInstance(offset, 0.5f, 1.0e-3f, instance))
+                instances.push_back(instance);
+        }
+        return instances.size();
+    };
+
+    for (auto* galaxy : galaxies)
+        delete galaxy;
+}
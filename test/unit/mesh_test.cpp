@@ -0,0 +1,269 @@
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include <celmodel/mesh.h>
+#include <celmodel/meshbvh.h>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+using namespace cmod;
+
+namespace
+{
+
+// A mesh with a normal before the position of each vertex; the index
+// lists must outlive it.
+struct TestMesh
+{
+    Mesh mesh;
+    std::vector<std::vector<Mesh::index32>> indexLists;
+
+    explicit TestMesh(const std::vector<Eigen::Vector3f>& positions)
+    {
+        Mesh::VertexAttribute attributes[] =
+        {
+            Mesh::VertexAttribute(Mesh::Normal, Mesh::Float3, 0),
+            Mesh::VertexAttribute(Mesh::Position, Mesh::Float3, 12),
+        };
+        mesh.setVertexDescription(Mesh::VertexDescription(24, 2, attributes));
+
+        auto* vertices = new char[positions.size() * 24];
+        auto* data = reinterpret_cast<float*>(vertices);
+        for (const auto& p : positions)
+        {
+            Eigen::Map<Eigen::Vector3f> normal(data);
+            Eigen::Map<Eigen::Vector3f> position(data + 3);
+            normal = p.normalized();
+            position = p;
+            data += 6;
+        }
+        mesh.setVertices((unsigned int) positions.size(), vertices);
+    }
+
+    void addGroup(Mesh::PrimitiveGroupType prim, const std::vector<Mesh::index32>& indices)
+    {
+        indexLists.push_back(indices);
+        mesh.addGroup(prim, 0, (unsigned int) indices.size(), indexLists.back().data());
+    }
+};
+
+// A sphere with a bumpy surface, of rings * slices * 2 triangles in one
+// list, and a strip and a fan beside it.
+std::unique_ptr<TestMesh> BumpySphere(unsigned int rings, unsigned int slices)
+{
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> bump(-0.02f, 0.02f);
+
+    std::vector<Eigen::Vector3f> positions;
+    for (unsigned int i = 0; i <= rings; i++)
+    {
+        float phi = (float) M_PI * i / rings;
+        for (unsigned int j = 0; j < slices; j++)
+        {
+            float theta = 2.0f * (float) M_PI * j / slices;
+            float r = 1.0f + bump(gen);
+            positions.emplace_back(r * std::sin(phi) * std::cos(theta),
+                                   r * std::cos(phi),
+                                   r * std::sin(phi) * std::sin(theta));
+        }
+    }
+
+    auto stripStart = (Mesh::index32) positions.size();
+    for (unsigned int i = 0; i < 10; i++)
+    {
+        positions.emplace_back(1.5f + 0.1f * i, -0.2f, 0.0f);
+        positions.emplace_back(1.5f + 0.1f * i, 0.2f, 0.1f);
+    }
+
+    auto fanStart = (Mesh::index32) positions.size();
+    positions.emplace_back(0.0f, 0.0f, -1.5f);
+    for (unsigned int i = 0; i < 8; i++)
+    {
+        float theta = 2.0f * (float) M_PI * i / 7;
+        positions.emplace_back(0.3f * std::cos(theta), 0.3f * std::sin(theta), -1.4f);
+    }
+
+    auto* test = new TestMesh(positions);
+
+    std::vector<Mesh::index32> list;
+    for (unsigned int i = 0; i < rings; i++)
+    {
+        for (unsigned int j = 0; j < slices; j++)
+        {
+            Mesh::index32 v00 = i * slices + j;
+            Mesh::index32 v01 = i * slices + (j + 1) % slices;
+            Mesh::index32 v10 = v00 + slices;
+            Mesh::index32 v11 = v01 + slices;
+            list.insert(list.end(), { v00, v10, v01, v01, v10, v11 });
+        }
+    }
+    test->addGroup(Mesh::TriList, list);
+
+    std::vector<Mesh::index32> strip;
+    for (Mesh::index32 i = 0; i < 20; i++)
+        strip.push_back(stripStart + i);
+    test->addGroup(Mesh::TriStrip, strip);
+
+    std::vector<Mesh::index32> fan;
+    for (Mesh::index32 i = 0; i < 9; i++)
+        fan.push_back(fanStart + i);
+    test->addGroup(Mesh::TriFan, fan);
+
+    return std::unique_ptr<TestMesh>(test);
+}
+
+struct Ray
+{
+    Eigen::Vector3d origin;
+    Eigen::Vector3d direction;
+};
+
+// Rays from outside the mesh toward points around it, and from inside
+std::vector<Ray> RandomRays(size_t count)
+{
+    std::mt19937 gen(5678);
+    std::normal_distribution<double> normal;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    std::vector<Ray> rays;
+    for (size_t i = 0; i < count; i++)
+    {
+        Eigen::Vector3d origin(normal(gen), normal(gen), normal(gen));
+        Eigen::Vector3d target(normal(gen), normal(gen), normal(gen));
+        origin = origin.normalized() * (i % 8 == 0 ? 0.5 : 4.0);
+        target = target.normalized() * 1.8 * unit(gen);
+        rays.push_back({ origin, (target - origin) * (0.5 + unit(gen)) });
+    }
+    return rays;
+}
+
+void RequireSamePick(const Mesh& mesh, const Ray& ray)
+{
+    Mesh::PickResult linear;
+    Mesh::PickResult tree;
+    bool linearHit = mesh.pickLinear(ray.origin, ray.direction, &linear);
+    bool treeHit = mesh.pick(ray.origin, ray.direction, &tree);
+    REQUIRE(treeHit == linearHit);
+    if (linearHit)
+    {
+        REQUIRE(tree.group == linear.group);
+        REQUIRE(tree.primitiveIndex == linear.primitiveIndex);
+        REQUIRE(tree.distance == linear.distance);
+    }
+}
+
+}
+
+TEST_CASE("Mesh picking", "[Mesh]")
+{
+    auto test = BumpySphere(40, 60);
+    const Mesh& mesh = test->mesh;
+
+    SECTION("The hierarchy picks the triangles the linear search picks")
+    {
+        size_t hits = 0;
+        for (const auto& ray : RandomRays(20000))
+        {
+            RequireSamePick(mesh, ray);
+            hits += mesh.pick(ray.origin, ray.direction, nullptr) ? 1 : 0;
+        }
+        REQUIRE(hits > 10000);
+        REQUIRE(hits < 20000);
+    }
+
+    SECTION("Rays through vertices and edges")
+    {
+        Ray rays[] =
+        {
+            { Eigen::Vector3d(0.0, 3.0, 0.0), Eigen::Vector3d(0.0, -1.0, 0.0) },
+            { Eigen::Vector3d(0.0, -3.0, 0.0), Eigen::Vector3d(0.0, 1.0, 0.0) },
+            { Eigen::Vector3d(3.0, 0.0, 0.0), Eigen::Vector3d(-1.0, 0.0, 0.0) },
+            { Eigen::Vector3d(0.0, 0.0, 3.0), Eigen::Vector3d(0.0, 0.0, -1.0) },
+        };
+        for (const auto& ray : rays)
+            RequireSamePick(mesh, ray);
+    }
+
+    SECTION("Triangles of strips and fans")
+    {
+        Mesh::PickResult result;
+
+        // The strip lies along x from 1.5; triangle k starts at vertex k
+        REQUIRE(mesh.pick(Eigen::Vector3d(1.62, 0.15, 3.0), Eigen::Vector3d(0.0, 0.0, -1.0), &result));
+        REQUIRE(result.group == mesh.getGroup(1));
+        REQUIRE(result.primitiveIndex == 3);
+
+        // The fan lies beyond the sphere along -z; triangle k is between
+        // the vertices k and k + 1 of the rim.
+        double angle = 2.0 * M_PI * 2.5 / 7;
+        REQUIRE(mesh.pick(Eigen::Vector3d(0.2 * std::cos(angle), 0.2 * std::sin(angle), -3.0),
+                          Eigen::Vector3d(0.0, 0.0, 1.0), &result));
+        REQUIRE(result.group == mesh.getGroup(2));
+        REQUIRE(result.primitiveIndex == 2);
+    }
+
+    SECTION("The hierarchy is rebuilt when the mesh changes")
+    {
+        Eigen::Vector3d origin(0.0, 0.0, -10.0);
+        Eigen::Vector3d direction(0.0, 0.0, 1.0);
+        double before;
+        REQUIRE(mesh.pick(origin, direction, before));
+
+        test->mesh.transform(Eigen::Vector3f(0.0f, 0.0f, 2.0f), 0.5f);
+        double after;
+        REQUIRE(mesh.pick(origin, direction, after));
+        REQUIRE(after == Approx(10.0 + 0.5 * (before - 8.0)));
+
+        test->mesh.clearGroups();
+        REQUIRE(!mesh.pick(origin, direction, after));
+    }
+
+    SECTION("Meshes without triangles miss")
+    {
+        TestMesh empty({ Eigen::Vector3f(0.0f, 0.0f, 0.0f), Eigen::Vector3f(1.0f, 0.0f, 0.0f) });
+        empty.addGroup(Mesh::LineList, { 0, 1 });
+        REQUIRE(!empty.mesh.pick(Eigen::Vector3d(0.5, 0.0, -1.0), Eigen::Vector3d(0.0, 0.0, 1.0), nullptr));
+    }
+}
+
+TEST_CASE("Mesh hierarchy shape", "[Mesh]")
+{
+    auto test = BumpySphere(100, 200);
+    MeshBVH tree(test->mesh);
+    REQUIRE(tree.getTriangleCount() == test->mesh.getPrimitiveCount());
+    REQUIRE(tree.getNodeCount() < tree.getTriangleCount());
+    REQUIRE(tree.getDepth() < 40);
+}
+
+TEST_CASE("Mesh picking benchmark", "[.][benchmark]")
+{
+    // About a quarter of a million triangles
+    auto test = BumpySphere(360, 360);
+    const Mesh& mesh = test->mesh;
+    auto rays = RandomRays(10);
+    mesh.pick(rays[0].origin, rays[0].direction, nullptr);
+
+    BENCHMARK("Build the hierarchy")
+    {
+        return MeshBVH(mesh).getNodeCount();
+    };
+
+    BENCHMARK("10 rays, linear search")
+    {
+        int hits = 0;
+        for (const auto& ray : rays)
+            hits += mesh.pickLinear(ray.origin, ray.direction, nullptr) ? 1 : 0;
+        return hits;
+    };
+
+    BENCHMARK("10 rays, hierarchy")
+    {
+        int hits = 0;
+        for (const auto& ray : rays)
+            hits += mesh.pick(ray.origin, ray.direction, nullptr) ? 1 : 0;
+        return hits;
+    };
+}
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <celengine/starname.h>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+namespace
+{
+
+typedef std::map<std::string, AstroCatalog::IndexNumber, CompareIgnoringCasePredicate> NameIndex;
+
+// The linear scan NameDatabase::getCompletion() used to perform
+std::vector<std::string> ScanCompletion(const NameIndex& names,
+                                        const std::string& name)
+{
+    std::vector<std::string> completion;
+    int length = UTF8Length(name);
+    for (const auto& n : names)
+    {
+        if (!UTF8StringCompare(n.first, name, length, true))
+            completion.push_back(n.first);
+    }
+    return completion;
+}
+
+// Catalog-like designations: "Gaia DR2 <n>" for every object and a proper
+// name for a few of them.
+class TestDatabase : public NameDatabase
+{
+ public:
+    explicit TestDatabase(size_t count)
+    {
+        std::mt19937 gen(1234);
+        std::uniform_int_distribution<unsigned int> letter(0, 25);
+        char buf[32];
+        for (size_t i = 0; i < count; i++)
+        {
+            std::snprintf(buf, sizeof(buf), "Gaia DR2 %zu", i * 7919 % 1000003);
+            add(i, buf, false);
+            nameIndex[buf] = i;
+            if (i % 100 == 0)
+            {
+                std::string name(1, 'A' + letter(gen));
+                for (int j = 0; j < 6; j++)
+                    name += 'a' + letter(gen);
+                add(i, name, false);
+                nameIndex[name] = i;
+            }
+        }
+    }
+
+    const NameIndex& names() const { return nameIndex; }
+
+ private:
+    NameIndex nameIndex;
+};
+
+std::vector<std::string> Sorted(std::vector<std::string> v)
+{
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+}
+
+TEST_CASE("Name lookup", "[NameDatabase]")
+{
+    NameDatabase db;
+    db.add(7, "Sirius", false);
+    db.add(3, "Vega", false);
+    db.add(7, "HD 48915", false);
+    db.add(3, "HD 172167", false);
+
+    REQUIRE(db.getNameCount() == 4);
+    REQUIRE(db.getCatalogNumberByName("sirius") == 7);
+    REQUIRE(db.getCatalogNumberByName("hd 172167") == 3);
+    REQUIRE(db.getCatalogNumberByName("Deneb") == UINT32_MAX);
+    REQUIRE(db.getNameByCatalogNumber(7) == "Sirius");
+    REQUIRE(db.getNameByCatalogNumber(5).empty());
+
+    SECTION("Names of an object are iterated in the order added")
+    {
+        auto iter = db.getFirstNameIter(7);
+        REQUIRE(iter != db.getFinalNameIter());
+        REQUIRE(iter->first == 7);
+        REQUIRE(iter->second == "Sirius");
+        ++iter;
+        REQUIRE(iter->second == "HD 48915");
+        ++iter;
+        REQUIRE(iter == db.getFinalNameIter());
+        REQUIRE(db.getFirstNameIter(5) == db.getFinalNameIter());
+    }
+
+    SECTION("A name added again refers to the last object")
+    {
+        db.add(9, "VEGA", false);
+        REQUIRE(db.getNameCount() == 4);
+        REQUIRE(db.getCatalogNumberByName("Vega") == 9);
+    }
+
+    SECTION("Erased names are only found by name")
+    {
+        db.erase(7);
+        db.add(7, "Alpha CMa", false);
+        REQUIRE(db.getFirstNameIter(7)->second != "Sirius");
+        REQUIRE(db.getCatalogNumberByName("Sirius") == 7);
+        auto iter = db.getFirstNameIter(7);
+        ++iter;
+        REQUIRE(iter == db.getFinalNameIter());
+    }
+}
+
+TEST_CASE("Star name file", "[StarNameDatabase]")
+{
+    std::istringstream in("32349:Sirius:HD 48915\n\n91262:Vega\n  7:::Test Star\n");
+    StarNameDatabase* db = StarNameDatabase::readNames(in);
+    REQUIRE(db != nullptr);
+    REQUIRE(db->getNameCount() == 4);
+    REQUIRE(db->getNameByCatalogNumber(32349) == "Sirius");
+    REQUIRE(db->getCatalogNumberByName("HD 48915") == 32349);
+    REQUIRE(db->getCatalogNumberByName("Test Star") == 7);
+    delete db;
+
+    std::istringstream bad("32349:Sirius\nVega\n");
+    REQUIRE(StarNameDatabase::readNames(bad) == nullptr);
+}
+
+TEST_CASE("Name completion", "[NameDatabase]")
+{
+    NameDatabase db;
+    db.add(1, "Altais Major", false);
+    db.add(1, "Rigil Kentaurus", false);
+    db.add(2, "Aldebaran", false);
+    db.add(3, "Altais", false);
+    db.add(4, "\xc3\x85ngstr\xc3\xb6m", false);  // Ångström
+    db.add(5, "ALGOL", false);
+
+    SECTION("Prefixes match regardless of case")
+    {
+        REQUIRE(Sorted(db.getCompletion("al", false)) ==
+                Sorted({ "ALGOL", "Aldebaran", "Altais", "Altais Major" }));
+        REQUIRE(db.getCompletion("altais m", false) == std::vector<std::string>{ "Altais Major" });
+        REQUIRE(db.getCompletion("vega", false).empty());
+    }
+
+    SECTION("Prefixes match regardless of diacritics")
+    {
+        REQUIRE(db.getCompletion("angs", false) == std::vector<std::string>{ "\xc3\x85ngstr\xc3\xb6m" });
+    }
+
+    SECTION("Names added after a completion are found")
+    {
+        db.getCompletion("al", false);
+        db.add(6, "Alcor", false);
+        REQUIRE(db.getCompletion("alc", false) == std::vector<std::string>{ "Alcor" });
+    }
+
+    SECTION("Ranked completion puts an exact match first, then short names")
+    {
+        auto ranked = db.getRankedCompletion("altais", 10, false);
+        REQUIRE(ranked == std::vector<std::string>{ "Altais", "Altais Major" });
+
+        ranked = db.getRankedCompletion("al", 2, false);
+        REQUIRE(ranked == std::vector<std::string>{ "ALGOL", "Altais" });
+    }
+
+    SECTION("Ranked completion puts first names before other designations")
+    {
+        db.add(2, "Altai", false);
+        auto ranked = db.getRankedCompletion("alta", 1, false);
+        REQUIRE(ranked == std::vector<std::string>{ "Altais" });
+    }
+}
+
+TEST_CASE("Name completion agrees with a scan", "[NameDatabase]")
+{
+    TestDatabase db(100000);
+    for (const char* prefix : { "g", "gaia dr2 1", "GAIA DR2 99", "b", "q", "gaia dr3" })
+    {
+        REQUIRE(Sorted(db.getCompletion(prefix, false)) ==
+                Sorted(ScanCompletion(db.names(), prefix)));
+    }
+}
+
+TEST_CASE("Concurrent lookups of unindexed names", "[NameDatabase]")
+{
+    TestDatabase db(20000);
+    std::vector<std::pair<std::string, AstroCatalog::IndexNumber>> names(db.names().begin(),
+                                                                          db.names().end());
+
+    // Each thread starts with a different lookup, so that several of them
+    // may find the indexes out of date.
+    std::vector<std::thread> threads;
+    std::vector<int> failures(4, 0);
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&db, &names, &failures, t]()
+        {
+            if (t % 2 == 0)
+                db.getNameCount();
+            else
+                db.getCompletion("gaia dr2 1", false);
+            for (size_t i = t; i < names.size(); i += 7)
+            {
+                if (db.getCatalogNumberByName(names[i].first) != names[i].second ||
+                    db.getFirstNameIter(names[i].second) == db.getFinalNameIter())
+                    failures[t]++;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (int f : failures)
+        REQUIRE(f == 0);
+}
+
+TEST_CASE("Name database benchmark", "[.][benchmark]")
+{
+    std::ostringstream out;
+    for (unsigned int i = 0; i < 1000000; i++)
+        out << i * 7919 % 1000003 << ":Gaia DR2 " << i * 104729ull << ":TYC " << i / 10000 << "-" << i % 10000 << "-1\n";
+    std::string file = out.str();
+
+    BENCHMARK("Read 2M star names")
+    {
+        std::istringstream in(file);
+        std::unique_ptr<StarNameDatabase> db(StarNameDatabase::readNames(in));
+        return db->getNameCount();
+    };
+}
+
+TEST_CASE("Name completion benchmark", "[.][benchmark]")
+{
+    TestDatabase db(1000000);
+    db.buildCompletionIndex();
+
+    BENCHMARK("Scan of 1M names")
+    {
+        return ScanCompletion(db.names(), "gaia dr2 12345");
+    };
+
+    BENCHMARK("Indexed completion of 1M names")
+    {
+        return db.getCompletion("gaia dr2 12345", false);
+    };
+
+    BENCHMARK("Ranked top 100 completions of 1M names")
+    {
+        return db.getRankedCompletion("gaia dr2 1", 100, false);
+    };
+}
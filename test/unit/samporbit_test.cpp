@@ -0,0 +1,127 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+#include <celephem/samporbit.h>
+#include <celephem/xyzvbinary.h>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+namespace
+{
+
+// An inclined circular orbit sampled at uneven intervals
+std::vector<XYZVBinaryData> MakeSamples(size_t count)
+{
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<double> step(0.01, 0.3);
+    std::vector<XYZVBinaryData> samples;
+    double t = 2451545.0;
+    for (size_t i = 0; i < count; i++)
+    {
+        double a = t * 0.7;
+        double w = 0.7 * 1.0e5 / 86400.0;
+        samples.push_back({ t,
+                            { 1.0e5 * std::cos(a), 0.5e5 * std::sin(a), 0.8e5 * std::sin(a) },
+                            { -1.0e5 * w * std::sin(a), 0.5e5 * w * std::cos(a), 0.8e5 * w * std::cos(a) } });
+        t += step(gen);
+    }
+    return samples;
+}
+
+void WriteText(const fs::path& path, const std::vector<XYZVBinaryData>& samples)
+{
+    std::ofstream out(path.string());
+    out << "# test trajectory\n" << std::setprecision(17);
+    for (const auto& s : samples)
+    {
+        out << s.tdb << ' '
+            << s.position[0] << ' ' << s.position[1] << ' ' << s.position[2] << ' '
+            << s.velocity[0] << ' ' << s.velocity[1] << ' ' << s.velocity[2] << '\n';
+    }
+}
+
+void WriteBinary(const fs::path& path, const std::vector<XYZVBinaryData>& samples)
+{
+    XYZVBinaryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "CELXYZV", 8);
+    header.byteOrder = __BYTE_ORDER__;
+    header.digits = std::numeric_limits<double>::digits;
+    header.count = samples.size();
+
+    std::ofstream out(path.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(samples.data()), samples.size() * sizeof(XYZVBinaryData));
+}
+
+class SampleCounter : public OrbitSampleProc
+{
+ public:
+    void sample(double, const Eigen::Vector3d&, const Eigen::Vector3d&) override { count++; }
+    size_t count{ 0 };
+};
+
+}
+
+
+TEST_CASE("Binary xyzv trajectories", "[SampledOrbit]")
+{
+    fs::path textFile = "samporbit_test.xyzv";
+    fs::path binaryFile = "samporbit_test.xyzvbin";
+    auto samples = MakeSamples(5000);
+    WriteText(textFile, samples);
+    std::remove(binaryFile.string().c_str());
+
+    for (auto interpolation : { TrajectoryInterpolationLinear, TrajectoryInterpolationCubic })
+    {
+        std::unique_ptr<Orbit> text(LoadXYZVTrajectoryDoublePrec(textFile, interpolation));
+        WriteBinary(binaryFile, samples);
+        std::unique_ptr<Orbit> mapped(LoadXYZVTrajectoryDoublePrec(textFile, interpolation));
+        std::remove(binaryFile.string().c_str());
+        REQUIRE(text != nullptr);
+        REQUIRE(mapped != nullptr);
+
+        double begin, end;
+        mapped->getValidRange(begin, end);
+        REQUIRE(begin == samples.front().tdb);
+        REQUIRE(end == samples.back().tdb);
+        REQUIRE(mapped->getBoundingRadius() == Approx(text->getBoundingRadius()));
+
+        // Random jumps in time, including times before and after the
+        // trajectory and exactly at samples
+        std::mt19937 gen(5678);
+        std::uniform_real_distribution<double> dist(begin - 10.0, end + 10.0);
+        std::uniform_int_distribution<size_t> index(0, samples.size() - 1);
+        for (int i = 0; i < 20000; i++)
+        {
+            bool atSample = i % 4 == 0;
+            double t = atSample ? samples[index(gen)].tdb : dist(gen);
+            INFO("t = " << t);
+            // The interpolation may round differently from the old code;
+            // allow a relative 1e-11, well below a millimeter here.
+            Eigen::Vector3d p = text->positionAtTime(t);
+            REQUIRE((mapped->positionAtTime(t) - p).norm() <= 1.0e-11 * p.norm());
+            // At a sample the velocity depends on which of the two
+            // segments the old code had cached.
+            if (!atSample)
+            {
+                Eigen::Vector3d v = text->velocityAtTime(t);
+                REQUIRE((mapped->velocityAtTime(t) - v).norm() <= 1.0e-11 * v.norm());
+            }
+        }
+
+        SampleCounter textSamples, mappedSamples;
+        text->sample(begin, end, textSamples);
+        mapped->sample(begin, end, mappedSamples);
+        REQUIRE(mappedSamples.count == textSamples.count);
+    }
+
+    std::remove(textFile.string().c_str());
+}
@@ -0,0 +1,119 @@
+#include <random>
+#include <vector>
+#include <celttf/skylinepacker.h>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+namespace
+{
+
+struct Rect
+{
+    int x, y, w, h;
+};
+
+bool Overlap(const Rect& a, const Rect& b)
+{
+    return a.x < b.x + b.w && b.x < a.x + a.w &&
+           a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+// Pack rectangles of glyph-like sizes until the packer runs out of room
+std::vector<Rect> PackGlyphs(SkylinePacker& packer, unsigned int seed, int maxHeight)
+{
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> width(3, maxHeight);
+    std::uniform_int_distribution<int> height(maxHeight / 2, maxHeight);
+
+    std::vector<Rect> rects;
+    for (int failures = 0; failures < 20; )
+    {
+        Rect r{ 0, 0, width(gen), height(gen) };
+        if (packer.insert(r.w, r.h, r.x, r.y))
+            rects.push_back(r);
+        else
+            failures++;
+    }
+    return rects;
+}
+
+}
+
+TEST_CASE("Skyline packing", "[SkylinePacker]")
+{
+    SECTION("Rectangles lie inside the area and don't overlap")
+    {
+        SkylinePacker packer(256, 256);
+        std::vector<Rect> rects = PackGlyphs(packer, 1234, 20);
+        REQUIRE(rects.size() > 200);
+
+        long area = 0;
+        for (size_t i = 0; i < rects.size(); i++)
+        {
+            const Rect& r = rects[i];
+            REQUIRE(r.x >= 0);
+            REQUIRE(r.y >= 0);
+            REQUIRE(r.x + r.w <= 256);
+            REQUIRE(r.y + r.h <= 256);
+            for (size_t j = 0; j < i; j++)
+                REQUIRE(!Overlap(r, rects[j]));
+            area += (long) r.w * r.h;
+        }
+        REQUIRE(packer.getUsedArea() == area);
+    }
+
+    SECTION("Glyphs of a font fill most of the area")
+    {
+        SkylinePacker packer(512, 512);
+        PackGlyphs(packer, 5678, 17);
+        REQUIRE(packer.getUsedArea() > 512 * 512 * 8 / 10);
+    }
+
+    SECTION("Equal rectangles are packed in rows from the bottom")
+    {
+        SkylinePacker packer(100, 100);
+        int x, y;
+        for (int i = 0; i < 25; i++)
+        {
+            REQUIRE(packer.insert(20, 20, x, y));
+            REQUIRE(x == i % 5 * 20);
+            REQUIRE(y == i / 5 * 20);
+        }
+        REQUIRE(!packer.insert(1, 1, x, y));
+        REQUIRE(packer.getUsedArea() == 100 * 100);
+    }
+
+    SECTION("Gaps under the skyline aren't reused, but gaps beside it are")
+    {
+        SkylinePacker packer(100, 100);
+        int x, y;
+        REQUIRE(packer.insert(60, 10, x, y));
+        REQUIRE(packer.insert(30, 50, x, y));
+        REQUIRE((x == 60 && y == 0));
+        REQUIRE(packer.insert(50, 30, x, y));
+        REQUIRE((x == 0 && y == 10));
+        REQUIRE(packer.insert(10, 90, x, y));
+        REQUIRE((x == 90 && y == 0));
+    }
+
+    SECTION("Rectangles too large for the area are refused")
+    {
+        SkylinePacker packer(64, 32);
+        int x, y;
+        REQUIRE(!packer.insert(65, 1, x, y));
+        REQUIRE(!packer.insert(1, 33, x, y));
+        REQUIRE(!packer.insert(0, 1, x, y));
+        REQUIRE(packer.insert(64, 32, x, y));
+    }
+}
+
+TEST_CASE("Skyline packing benchmark", "[.][benchmark]")
+{
+    BENCHMARK("Fill a 2048 x 2048 atlas with 17 pixel glyphs")
+    {
+        SkylinePacker packer(2048, 2048);
+        return PackGlyphs(packer, 1234, 17).size();
+    };
+}
@@ -0,0 +1,159 @@
+#include <cmath>
+#include <random>
+#include <vector>
+#include <celengine/astro.h>
+#include <celengine/starcull.h>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+namespace
+{
+
+// Synthetic catalog: stars spread uniformly through a cube centered on
+// the observer, with absolute magnitudes between -5 and 15.
+struct Catalog
+{
+    std::vector<float> x, y, z, absMag;
+
+    Catalog(size_t count, float halfWidth)
+    {
+        std::mt19937 gen(1234);
+        std::uniform_real_distribution<float> pos(-halfWidth, halfWidth);
+        std::uniform_real_distribution<float> mag(-5.0f, 15.0f);
+        for (size_t i = 0; i < count; i++)
+        {
+            x.push_back(pos(gen));
+            y.push_back(pos(gen));
+            z.push_back(pos(gen));
+            absMag.push_back(mag(gen));
+        }
+    }
+
+    size_t size() const { return x.size(); }
+};
+
+constexpr float LIMITING_MAG = 8.0f;
+
+StarCullParams MakeParams(float brightest)
+{
+    StarCullParams params;
+    params.obsPosition = Eigen::Vector3f(1.0f, -2.0f, 3.0f);
+    params.dimmest = 1000.0f;
+    params.maxDistanceSquared = (float) (LY_PER_PARSEC * LY_PER_PARSEC) *
+                                std::pow(10.0f, (LIMITING_MAG - brightest + 5.0f) * 0.4f);
+    return params;
+}
+
+// The per-star computation StarOctree::processVisibleObjects() performs
+size_t CountVisibleScalar(const Catalog& c, const StarCullParams& params)
+{
+    size_t nVisible = 0;
+    for (size_t i = 0; i < c.size(); i++)
+    {
+        if (c.absMag[i] >= params.dimmest)
+            continue;
+        float distance = (params.obsPosition - Eigen::Vector3f(c.x[i], c.y[i], c.z[i])).norm();
+        if (astro::absToAppMag(c.absMag[i], distance) < LIMITING_MAG)
+            nVisible++;
+    }
+    return nVisible;
+}
+
+size_t CountVisibleKernel(const Catalog& c, const StarCullParams& params,
+                          std::vector<uint32_t>& survivors, std::vector<float>& d2)
+{
+    size_t nSurvivors = CullStars(c.x.data(), c.y.data(), c.z.data(), c.absMag.data(),
+                                  c.size(), params, survivors.data(), d2.data());
+    size_t nVisible = 0;
+    for (size_t i = 0; i < nSurvivors; i++)
+    {
+        if (AppMagFromDistanceSquared(c.absMag[survivors[i]], d2[i]) < LIMITING_MAG)
+            nVisible++;
+    }
+    return nVisible;
+}
+
+}
+
+
+TEST_CASE("FastLog10", "[StarCull]")
+{
+    for (float x : { 1.0e-30f, 1.0e-3f, 0.5f, 1.0f, 1.41421f, 1.5f, 2.0f, 10.0f, 12345.6f, 3.0e30f })
+        REQUIRE(FastLog10(x) == Approx(std::log10(x)).margin(1.0e-5));
+}
+
+
+TEST_CASE("CullStars", "[StarCull]")
+{
+    Catalog catalog(100003, 500.0f);
+    StarCullParams params = MakeParams(-5.0f);
+    params.dimmest = 10.0f;
+
+    std::vector<uint32_t> survivors(catalog.size()), refSurvivors(catalog.size());
+    std::vector<float> d2(catalog.size()), refD2(catalog.size());
+
+    size_t n = CullStars(catalog.x.data(), catalog.y.data(), catalog.z.data(),
+                         catalog.absMag.data(), catalog.size(), params,
+                         survivors.data(), d2.data());
+    size_t refN = CullStarsScalar(catalog.x.data(), catalog.y.data(), catalog.z.data(),
+                                  catalog.absMag.data(), catalog.size(), params,
+                                  refSurvivors.data(), refD2.data());
+
+    INFO("Instruction set: " << CullStarsInstructionSet());
+    REQUIRE(n == refN);
+    for (size_t i = 0; i < n; i++)
+    {
+        REQUIRE(survivors[i] == refSurvivors[i]);
+        REQUIRE(d2[i] == Approx(refD2[i]));
+        REQUIRE(catalog.absMag[survivors[i]] < params.dimmest);
+    }
+
+    SECTION("Same visible stars as the per-star path")
+    {
+        Catalog small(20000, 200.0f);
+        std::vector<uint32_t> s(small.size());
+        std::vector<float> d(small.size());
+        REQUIRE(CountVisibleKernel(small, MakeParams(-5.0f), s, d) ==
+                CountVisibleScalar(small, MakeParams(-5.0f)));
+    }
+}
+
+
+// Run explicitly with: starcull "[benchmark]"
+TEST_CASE("CullStars benchmark", "[.][benchmark]")
+{
+    // Roughly a quarter of the stars pass the node magnitude test
+    Catalog catalog(2000000, 2000.0f);
+    StarCullParams params = MakeParams(-5.0f);
+    params.dimmest = 0.0f;
+    std::vector<uint32_t> survivors(catalog.size());
+    std::vector<float> d2(catalog.size());
+
+    INFO("Instruction set: " << CullStarsInstructionSet());
+
+    BENCHMARK("Per-star norm and log10, 2M stars")
+    {
+        return CountVisibleScalar(catalog, params);
+    };
+
+    BENCHMARK("Scalar cull kernel, 2M stars")
+    {
+        return CullStarsScalar(catalog.x.data(), catalog.y.data(), catalog.z.data(),
+                               catalog.absMag.data(), catalog.size(), params,
+                               survivors.data(), d2.data());
+    };
+
+    BENCHMARK("Vectorized cull kernel, 2M stars")
+    {
+        return CullStars(catalog.x.data(), catalog.y.data(), catalog.z.data(),
+                         catalog.absMag.data(), catalog.size(), params,
+                         survivors.data(), d2.data());
+    };
+
+    BENCHMARK("Vectorized cull kernel and fast log, 2M stars")
+    {
+        return CountVisibleKernel(catalog, params, survivors, d2);
+    };
+}
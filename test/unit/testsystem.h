@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <celengine/body.h>
+#include <celengine/frametree.h>
+#include <celengine/solarsys.h>
+#include <celengine/star.h>
+#include <celengine/timeline.h>
+#include <celengine/universe.h>
+#include <celephem/orbit.h>
+#include <celephem/rotation.h>
+
+// A solar system around a G2V star, for tests of code working on bodies.
+// Bodies are added with a timeline of one phase; the system deletes them
+// and their orbits and rotation models with itself.
+class TestSystem
+{
+ public:
+    TestSystem()
+    {
+        universe.setSolarSystemCatalog(new SolarSystemCatalog());
+        sun.setIndex(0);
+        sun.setDetails(StarDetails::GetNormalStarDetails(StellarClass::Spectral_G, 2, StellarClass::Lum_V));
+        sun.setAbsoluteMagnitude(4.83f);
+        system = universe.createSolarSystem(&sun);
+    }
+
+    ~TestSystem()
+    {
+        // Satellites before their primaries, whose frame trees hold their
+        // timeline phases, and planets before the solar system.
+        for (auto iter = bodies.rbegin(); iter != bodies.rend(); ++iter)
+            delete *iter;
+
+        SolarSystemCatalog* catalog = universe.getSolarSystemCatalog();
+        for (const auto& entry : *catalog)
+            delete entry.second;
+        delete catalog;
+        universe.setSolarSystemCatalog(nullptr);
+    }
+
+    TestSystem(const TestSystem&) = delete;
+    TestSystem& operator=(const TestSystem&) = delete;
+
+    // Add a body with the orbit and rotation model given, which the system
+    // takes ownership of.
+    Body* addBody(PlanetarySystem* parent,
+                  const ReferenceFrame::SharedConstPtr& orbitFrame,
+                  const ReferenceFrame::SharedConstPtr& bodyFrame,
+                  Orbit* orbit,
+                  RotationModel* rotation)
+    {
+        orbits.emplace_back(orbit);
+        rotations.emplace_back(rotation);
+
+        auto* body = new Body(parent, "Body");
+        bodies.push_back(body);
+        auto phase = TimelinePhase::CreateTimelinePhase(universe, body,
+                                                        -1.0e10, 1.0e10,
+                                                        orbitFrame, *orbit,
+                                                        bodyFrame, *rotation);
+        auto* timeline = new Timeline();
+        timeline->appendPhase(phase);
+        body->setTimeline(timeline);
+        return body;
+    }
+
+    // The satellites of a body, created when it has none yet
+    static PlanetarySystem* getSatellites(Body* primary)
+    {
+        if (primary->getSatellites() == nullptr)
+            primary->setSatellites(new PlanetarySystem(primary));
+        return primary->getSatellites();
+    }
+
+    Universe universe;
+    Star sun;
+    SolarSystem* system;
+
+ private:
+    std::vector<std::unique_ptr<Orbit>> orbits;
+    std::vector<std::unique_ptr<RotationModel>> rotations;
+    std::vector<Body*> bodies;
+};
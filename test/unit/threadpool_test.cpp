@@ -0,0 +1,48 @@
+#include <atomic>
+#include <vector>
+#include <celutil/threadpool.h>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+TEST_CASE("ThreadPool", "[ThreadPool]")
+{
+    ThreadPool pool(3);
+    REQUIRE(pool.size() == 3);
+
+    SECTION("parallelFor visits every index once")
+    {
+        std::vector<std::atomic<int>> visits(10000);
+        pool.parallelFor(visits.size(), [&](size_t i) { visits[i]++; });
+
+        for (const auto& v : visits)
+            REQUIRE(v.load() == 1);
+    }
+
+    SECTION("parallelFor may be nested")
+    {
+        std::atomic<size_t> sum{ 0 };
+        pool.parallelFor(16, [&](size_t i)
+        {
+            pool.parallelFor(100, [&](size_t j) { sum += i * 100 + j; });
+        });
+        REQUIRE(sum.load() == 1600 * 1599 / 2);
+    }
+
+    SECTION("async returns the result")
+    {
+        std::vector<std::future<int>> results;
+        for (int i = 0; i < 100; i++)
+            results.push_back(pool.async([i]() { return i * i; }));
+
+        for (int i = 0; i < 100; i++)
+            REQUIRE(results[i].get() == i * i);
+    }
+
+    SECTION("parallelFor with no work returns")
+    {
+        bool called = false;
+        pool.parallelFor(0, [&](size_t) { called = true; });
+        REQUIRE_FALSE(called);
+    }
+}
@@ -0,0 +1,165 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <celephem/vsop87.h>
+#include <celephem/vsop87batch.h>
+
+#define CATCH_CONFIG_MAIN
+#include <catch.hpp>
+
+namespace
+{
+
+const char* const Planets[] =
+{
+    "vsop87-mercury", "vsop87-venus", "vsop87-earth", "vsop87-mars",
+    "vsop87-jupiter", "vsop87-saturn", "vsop87-uranus", "vsop87-neptune",
+};
+
+constexpr double J2000 = 2451545.0;
+
+struct Sample
+{
+    double t;
+    Eigen::Vector3d position;
+    Eigen::Vector3d velocity;
+};
+
+class SampleCollector : public OrbitSampleProc
+{
+ public:
+    void sample(double t, const Eigen::Vector3d& p, const Eigen::Vector3d& v) override
+    {
+        samples.push_back({ t, p, v });
+    }
+
+    std::vector<Sample> samples;
+};
+
+class SampleCounter : public OrbitSampleProc
+{
+ public:
+    void sample(double, const Eigen::Vector3d& p, const Eigen::Vector3d&) override
+    {
+        count++;
+        sum += p.x();
+    }
+
+    size_t count{ 0 };
+    double sum{ 0.0 };
+};
+
+}
+
+
+TEST_CASE("Vectorized cosine", "[VSOP87]")
+{
+    INFO("Instruction set: " << VSOPBatchInstructionSet());
+
+    std::mt19937 gen(1234);
+    std::vector<double> x;
+    for (double range : { 1.0, 10.0, 1.0e3, 1.6e6 })
+    {
+        std::uniform_real_distribution<double> dist(-range, range);
+        for (int i = 0; i < 10001; i++)
+            x.push_back(dist(gen));
+    }
+    for (double special : { 0.0, -0.0, M_PI / 4, M_PI / 2, M_PI, 3 * M_PI / 2, 2 * M_PI })
+        x.push_back(special);
+
+    std::vector<double> c(x.size());
+    CosBatch(x.data(), x.size(), c.data());
+    for (size_t i = 0; i < x.size(); i++)
+    {
+        INFO("x = " << x[i]);
+        REQUIRE(std::abs(c[i] - std::cos(x[i])) < 1.0e-15);
+    }
+}
+
+
+TEST_CASE("VSOP87 batch sampling matches computePosition", "[VSOP87]")
+{
+    INFO("Instruction set: " << VSOPBatchInstructionSet());
+
+    for (const char* name : Planets)
+    {
+        INFO("Orbit: " << name);
+        std::unique_ptr<Orbit> orbit(CreateVSOP87Orbit(name));
+        REQUIRE(orbit != nullptr);
+
+        // Cover a period around J2000 and one near the ends of the range
+        // where |t| is largest.
+        for (double start : { J2000 - 100.0, J2000 - 365250.0 * 5.5 })
+        {
+            SampleCollector collector;
+            double period = orbit->getPeriod();
+            orbit->sample(start, start + period, collector);
+            // 150 steps, plus possibly a tiny one left by rounding
+            REQUIRE(collector.samples.size() >= 151);
+            REQUIRE(collector.samples.size() <= 152);
+            REQUIRE(collector.samples.front().t == start);
+            REQUIRE(collector.samples.back().t == start + period);
+
+            for (const auto& s : collector.samples)
+            {
+                // Positions agree to a relative 5e-15, a few centimeters
+                // at most for Neptune. The velocities are differences
+                // over one minute, which scales the position error by
+                // 1440; they agree to 10 m/day.
+                Eigen::Vector3d p = orbit->positionAtTime(s.t);
+                REQUIRE((s.position - p).norm() < 5.0e-15 * p.norm());
+                Eigen::Vector3d v = orbit->velocityAtTime(s.t);
+                REQUIRE((s.velocity - v).norm() < 1.0e-2);
+            }
+        }
+    }
+}
+
+
+// Run explicitly with: vsop87 "[benchmark]"
+TEST_CASE("VSOP87 sampling benchmark", "[.][benchmark]")
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::cout << "Instruction set: " << VSOPBatchInstructionSet() << '\n';
+    for (const char* name : Planets)
+    {
+        std::unique_ptr<Orbit> orbit(CreateVSOP87Orbit(name));
+        double period = orbit->getPeriod();
+        constexpr int nPeriods = 20;
+
+        // One position and velocity evaluation per sample
+        Clock::time_point start = Clock::now();
+        size_t nScalar = 0;
+        double sum = 0.0;
+        for (int i = 0; i < nPeriods; i++)
+        {
+            double t0 = J2000 + i * period;
+            for (int k = 0; k <= 150; k++)
+            {
+                double t = t0 + period * k / 150.0;
+                sum += orbit->positionAtTime(t).x() + orbit->velocityAtTime(t).x();
+                nScalar++;
+            }
+        }
+        double scalarTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        SampleCounter counter;
+        for (int i = 0; i < nPeriods; i++)
+        {
+            double t0 = J2000 + i * period;
+            orbit->sample(t0, t0 + period, counter);
+        }
+        double batchTime = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::cout << name
+                  << ": scalar " << (size_t) (nScalar / scalarTime) << " samples/s"
+                  << ", batch " << (size_t) (counter.count / batchTime) << " samples/s"
+                  << " (checksum " << sum + counter.sum << ")\n";
+    }
+}
@@ -0,0 +1,145 @@
+#include <random>
+#include <vector>
+#include <celestia/yuvconvert.h>
+
+#define CATCH_CONFIG_MAIN
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+
+namespace
+{
+
+// A 4:2:0 frame with a border around the converted region, filled as a
+// capture fills the padding of its frames.
+struct Frame
+{
+    int width;
+    int height;
+    std::vector<unsigned char> y, u, v;
+
+    Frame(int w, int h) :
+        width(w + 4),
+        height(h + 4),
+        y(width * height, 0x10),
+        u(width * height / 4, 0x80),
+        v(width * height / 4, 0x80)
+    {
+    }
+
+    YUV420Planes planes()
+    {
+        return { y.data() + 2 * width + 2,
+                 u.data() + width / 2 + 1,
+                 v.data() + width / 2 + 1,
+                 width,
+                 width / 2 };
+    }
+};
+
+std::vector<unsigned char> RandomRGBA(int width, int height)
+{
+    std::mt19937 gen(1234);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<unsigned char> rgba(width * height * 4);
+    for (auto& c : rgba)
+        c = (unsigned char) byte(gen);
+    return rgba;
+}
+
+}
+
+TEST_CASE("RGBA to YUV 4:2:0", "[yuvconvert]")
+{
+    SECTION("Black and white")
+    {
+        std::vector<unsigned char> rgba = { 0, 0, 0, 255,  255, 255, 255, 255,
+                                            255, 255, 255, 255,  0, 0, 0, 255 };
+        Frame frame(2, 2);
+        ConvertRGBAToYUV420(rgba.data(), 2, 2, 0, 2, frame.planes());
+        YUV420Planes planes = frame.planes();
+        // The source has its bottom row first
+        REQUIRE(planes.y[0] == 235);
+        REQUIRE(planes.y[1] == 16);
+        REQUIRE(planes.y[planes.yStride] == 16);
+        REQUIRE(planes.y[planes.yStride + 1] == 235);
+        REQUIRE(planes.u[0] == 128);
+        REQUIRE(planes.v[0] == 128);
+    }
+
+    SECTION("Pure red")
+    {
+        std::vector<unsigned char> rgba(4 * 4 * 4, 0);
+        for (size_t i = 0; i < rgba.size(); i += 4)
+            rgba[i] = 255;
+        Frame frame(4, 4);
+        ConvertRGBAToYUV420(rgba.data(), 4, 4, 0, 4, frame.planes());
+        YUV420Planes planes = frame.planes();
+        REQUIRE(planes.y[0] == (255 * 2104 + 135168) >> 13);
+        REQUIRE(planes.u[0] == (255 * -1214 + 1052672) >> 13);
+        REQUIRE(planes.v[0] == 240);
+    }
+
+    SECTION("Vectorized and scalar conversions are identical")
+    {
+        INFO("Instruction set: " << ConvertRGBAToYUV420InstructionSet());
+        for (int width : { 1, 2, 7, 8, 9, 16, 31, 64 })
+        {
+            for (int height : { 1, 2, 3, 8, 11 })
+            {
+                auto rgba = RandomRGBA(width, height);
+                Frame scalar(width, height);
+                Frame vectorized(width, height);
+                ConvertRGBAToYUV420Scalar(rgba.data(), width, height, 0, height, scalar.planes());
+                ConvertRGBAToYUV420(rgba.data(), width, height, 0, height, vectorized.planes());
+                REQUIRE(scalar.y == vectorized.y);
+                REQUIRE(scalar.u == vectorized.u);
+                REQUIRE(scalar.v == vectorized.v);
+            }
+        }
+    }
+
+    SECTION("Conversion in bands of rows matches a whole frame")
+    {
+        auto rgba = RandomRGBA(33, 17);
+        Frame whole(33, 17);
+        Frame bands(33, 17);
+        ConvertRGBAToYUV420(rgba.data(), 33, 17, 0, 17, whole.planes());
+        ConvertRGBAToYUV420(rgba.data(), 33, 17, 0, 6, bands.planes());
+        ConvertRGBAToYUV420(rgba.data(), 33, 17, 6, 12, bands.planes());
+        ConvertRGBAToYUV420(rgba.data(), 33, 17, 12, 17, bands.planes());
+        REQUIRE(whole.y == bands.y);
+        REQUIRE(whole.u == bands.u);
+        REQUIRE(whole.v == bands.v);
+    }
+
+    SECTION("Odd edges average with black and leave the padding alone")
+    {
+        std::vector<unsigned char> rgba(3 * 3 * 4, 255);
+        Frame frame(3, 3);
+        ConvertRGBAToYUV420(rgba.data(), 3, 3, 0, 3, frame.planes());
+        YUV420Planes planes = frame.planes();
+        REQUIRE(planes.y[2 * planes.yStride + 2] == 235);
+        REQUIRE(planes.y[2 * planes.yStride + 3] == 0x10);
+        REQUIRE(planes.y[3 * planes.yStride] == 0x10);
+        REQUIRE(planes.u[planes.uvStride + 1] == 128);
+        REQUIRE(planes.u[planes.uvStride + 2] == 0x80);
+    }
+}
+
+TEST_CASE("RGBA to YUV 4:2:0 benchmark", "[.][benchmark]")
+{
+    auto rgba = RandomRGBA(1920, 1080);
+    Frame frame(1920, 1080);
+
+    BENCHMARK("Scalar conversion, 1080p")
+    {
+        ConvertRGBAToYUV420Scalar(rgba.data(), 1920, 1080, 0, 1080, frame.planes());
+        return frame.y[0];
+    };
+
+    BENCHMARK("Vectorized conversion, 1080p")
+    {
+        ConvertRGBAToYUV420(rgba.data(), 1920, 1080, 0, 1080, frame.planes());
+        return frame.y[0];
+    };
+}